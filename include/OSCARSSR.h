@@ -18,13 +18,18 @@
 #include "TOSCARSSR.h"
 
 #include <string>
+#include <vector>
+#include <functional>
 
 #include "OSCARSSR_Cuda.h"
 #include "TFieldContainer.h"
 #include "TParticleBeamContainer.h"
 #include "TSurfacePoints.h"
+#include "TSurfacePoints_Rectangle.h"
 #include "TSpectrumContainer.h"
 #include "T3DScalarContainer.h"
+#include "T3DScalarTree.h"
+#include "TTriangleBVH.h"
 #include "TRandomA.h"
 
 
@@ -40,12 +45,13 @@ class OSCARSSR
     static std::string GetVersionString ();
 
     // Functions related to the magnetic field
-    void AddMagneticField (std::string const, std::string const, TVector3D const& R = TVector3D(0, 0, 0), TVector3D const& D = TVector3D(0, 0, 0), std::vector<double> const& S = std::vector<double>());
-    void AddMagneticFieldInterpolated (std::vector<std::pair<double, std::string> > const&, std::string const, double const, TVector3D const& R = TVector3D(0, 0, 0), TVector3D const& D = TVector3D(0, 0, 0), std::vector<double> const& S = std::vector<double>());
+    void AddMagneticField (std::string const, std::string const, TVector3D const& R = TVector3D(0, 0, 0), TVector3D const& D = TVector3D(0, 0, 0), std::vector<double> const& S = std::vector<double>(), std::string const& Interpolation = "linear", bool const Shared = false, TVector3D const& ExtractMin = TVector3D(0, 0, 0), TVector3D const& ExtractMax = TVector3D(0, 0, 0), std::string const& Storage = "double", TVector3D const& MirrorX = TVector3D(0, 0, 0), TVector3D const& MirrorY = TVector3D(0, 0, 0), TVector3D const& MirrorZ = TVector3D(0, 0, 0));
+    void AddMagneticFieldInterpolated (std::vector<std::pair<double, std::string> > const&, std::string const, double const, TVector3D const& R = TVector3D(0, 0, 0), TVector3D const& D = TVector3D(0, 0, 0), std::vector<double> const& S = std::vector<double>(), std::string const& Interpolation = "linear", bool const Lazy = false);
+    void SetMagneticFieldParameter (double const);
     void AddMagneticField (TField*);
     void ClearMagneticFields ();
 
-    void AddElectricField (std::string const, std::string const, TVector3D const& R = TVector3D(0, 0, 0), TVector3D const& D = TVector3D(0, 0, 0), std::vector<double> const& S = std::vector<double>());
+    void AddElectricField (std::string const, std::string const, TVector3D const& R = TVector3D(0, 0, 0), TVector3D const& D = TVector3D(0, 0, 0), std::vector<double> const& S = std::vector<double>(), std::string const& Interpolation = "linear", bool const Shared = false, TVector3D const& ExtractMin = TVector3D(0, 0, 0), TVector3D const& ExtractMax = TVector3D(0, 0, 0), std::string const& Storage = "double", TVector3D const& MirrorX = TVector3D(0, 0, 0), TVector3D const& MirrorY = TVector3D(0, 0, 0), TVector3D const& MirrorZ = TVector3D(0, 0, 0));
     void AddElectricField (TField*);
     void ClearElectricFields ();
 
@@ -57,18 +63,21 @@ class OSCARSSR
     double    GetBz (double const, double const, double const) const;
     TVector3D GetB  (double const, double const, double const) const;
     TVector3D GetB  (TVector3D const&) const;
+    void      GetBBatch (std::vector<TVector3D> const&, std::vector<TVector3D>&) const;
 
     double    GetEx (double const, double const, double const) const;
     double    GetEy (double const, double const, double const) const;
     double    GetEz (double const, double const, double const) const;
     TVector3D GetE  (double const, double const, double const) const;
     TVector3D GetE  (TVector3D const&) const;
+    void      GetEBatch (std::vector<TVector3D> const&, std::vector<TVector3D>&) const;
 
 
     // Functions related to the particle beam(s)
     void AddParticleBeam (std::string const&, std::string const&, TVector3D const&, TVector3D const&, double const, double const, double const, double const, double const Charge = 0, double const Mass = 0);
     TParticleBeam& GetParticleBeam (std::string const&);
     size_t GetNParticleBeams () const;
+    void GetBeamCorridor (double const, TVector3D&, TVector3D&);
     TParticleA GetNewParticle ();
     TParticleA const&  GetCurrentParticle () const;
     void SetNewParticle ();
@@ -104,7 +113,8 @@ class OSCARSSR
     void CalculateSpectrum (TVector3D const&, TSpectrumContainer&, double const Weight = 1);
     void CalculateSpectrum (TVector3D const&, TSpectrumContainer&, int const, int const, int const);
     void CalculateSpectrumThreads (TParticleA&, TVector3D const&, TSpectrumContainer&, int const, double const Weight = 1, std::string const& OutFileName = "");
-    void CalculateSpectrumPoint (TParticleA&, TVector3D const&, TSpectrumContainer&, int const i, double const Weight = 1);
+    // Value at one point of the spectrum, flux or power density, not added to any container
+    double CalculateSpectrumPoint (TParticleA&, TVector3D const&, TSpectrumContainer const&, int const i, double const Weight = 1);
     void CalculateSpectrum (TParticleA&, TVector3D const&, TSpectrumContainer&, double const Weight = 1);
     void CalculateSpectrum (TParticleA&, TVector3D const&, double const, double const, size_t const, std::string const& OutFileName = "");
     void CalculateSpectrum (TVector3D const&, double const, double const, size_t const);
@@ -124,11 +134,15 @@ class OSCARSSR
     // Power Density calculation
     void CalculatePowerDensity (TParticleA&, TSurfacePoints const&, int const Dimension = 3, bool const Directional = true, double const Weight = 1, std::string const& OutFileName = "");
     void CalculatePowerDensity (TParticleA&, TSurfacePoints const&, T3DScalarContainer&, int const Dimension = 3, bool const Directional = true, double const Weight = 1, std::string const& OutFileName = "");
-    void CalculatePowerDensity (TSurfacePoints const&, T3DScalarContainer&, int const Dimension = 3, bool const Directional = true, int const NParticles = 0, std::string const& OutFileName = "", int const NThreads = 0, int const GPU = 0);
+    void CalculatePowerDensity (TSurfacePoints const&, T3DScalarContainer&, int const Dimension = 3, bool const Directional = true, int const NParticles = 0, std::string const& OutFileName = "", int const NThreads = 0, int const GPU = 0, double const FarField = 0, TTriangleBVH const* Occluders = 0x0);
+    void CalculatePowerDensityAdaptive (TSurfacePoints const&, T3DScalarTree&, double const Tolerance, int const MaxLevel, bool const Directional = true, int const NParticles = 0, int const NThreads = 0, int const GPU = 0, TTriangleBVH const* Occluders = 0x0);
+    void CalculatePowerDensityMirror (TSurfacePoints_Rectangle const&, T3DScalarContainer&, int const Dimension = 3, bool const Directional = true, int const NParticles = 0, std::string const& OutFileName = "", int const NThreads = 0, int const GPU = 0);
     void CalculatePowerDensityGPU (TParticleA&, TSurfacePoints const&, T3DScalarContainer&, int const Dimension = 3, bool const Directional = true, double const Weight = 1, std::string const& OutFileName = "");
     void CalculatePowerDensityGPU (TSurfacePoints const&, T3DScalarContainer&, int const Dimension = 3, bool const Directional = true, double const Weight = 1, std::string const& OutFileName = "");
     void CalculatePowerDensityThreads (TParticleA&, TSurfacePoints const&, T3DScalarContainer&, int const, int const Dimension = 3, bool const Directional = true, double const Weight = 1, std::string const& OutFileName = "");
-    void CalculatePowerDensityPoint (TParticleA&, TSurfacePoints const&, T3DScalarContainer&, size_t const, int const Dimension = 3, bool const Directional = true, double const Weight = 1);
+    void CalculatePowerDensityFarField (TParticleA&, TSurfacePoints const&, T3DScalarContainer&, double const Precision, bool const Directional = true, double const Weight = 1);
+    void CalculatePowerDensityOccluded (TParticleA&, TSurfacePoints const&, T3DScalarContainer&, TTriangleBVH const&, bool const Directional = true, double const Weight = 1, int const NThreads = 1);
+    double CalculatePowerDensityPoint (TParticleA&, TSurfacePoints const&, size_t const, bool const Directional = true, double const Weight = 1);
     double CalculateTotalPower ();
     double CalculateTotalPower (TParticleA&);
 
@@ -136,12 +150,19 @@ class OSCARSSR
     // Flux Calculations
     //void CalculateFlux (TParticleA&, TSurfacePoints const&, double const, std::string const& OutFileName = "");
     void CalculateFlux2   (TParticleA&, TSurfacePoints const&, double const, T3DScalarContainer&, int const Dimension = 3, double const Weight = 1);
-    void CalculateFluxPoint (TParticleA&, TSurfacePoints const&, double const, T3DScalarContainer&, size_t const i, int const Dimension = 3, double const Weight = 1);
+    double CalculateFluxPoint (TParticleA&, TSurfacePoints const&, double const, size_t const i, double const Weight = 1);
     void CalculateFlux    (TParticleA&, TSurfacePoints const&, double const, T3DScalarContainer&, int const Dimension = 3, double const Weight = 1, std::string const& OutFileName = "");
     void CalculateFlux    (TParticleA&, TSurfacePoints const&, double const, int const Dimension = 3, double const Weight = 1, std::string const& OutFileName = "");
     void CalculateFlux1   (TParticleA&, TSurfacePoints const&, double const, T3DScalarContainer&, std::string const& OutFileName = "");
     void CalculateFlux    (TSurfacePoints const&, double const, T3DScalarContainer&, int const Dimension = 3, double const Weight = 1, std::string const& OutFileName = "");
     void CalculateFlux    (TSurfacePoints const&, double const, T3DScalarContainer&, int const NParticles = 0, int const NThreads = 0, int const GPU = 0, int const Dimension = 3, std::string const& OutFileName = "");
+    void CalculateFluxAdaptive (TSurfacePoints const&, double const, T3DScalarTree&, double const Tolerance, int const MaxLevel, int const NParticles = 0, int const NThreads = 0, int const GPU = 0);
+    void CalculateFluxMirror (TSurfacePoints_Rectangle const&, double const, T3DScalarContainer&, int const NParticles = 0, int const NThreads = 0, int const GPU = 0, int const Dimension = 3, std::string const& OutFileName = "");
+    void CalculateFluxNUFFT (TSurfacePoints_Rectangle const&, double const, T3DScalarContainer&, int const NParticles = 0, int const NThreads = 0, int const GPU = 0, int const Dimension = 3, std::string const& OutFileName = "");
+    bool CalculateFluxNUFFT (TParticleA&, TSurfacePoints_Rectangle const&, double const, T3DScalarContainer&, int const NThreads = 1, double const Weight = 1);
+
+    // Mirror symmetry of a rectangle for the current trajectory: 1 for X1, 2 for X2, 3 for both
+    int GetMirrorSymmetry (TSurfacePoints_Rectangle const&);
 
     void CalculateFluxThreads (TParticleA&, TSurfacePoints const&, double const, T3DScalarContainer&, int const NThreads = 0, int const Dimension = 3, double const Weight = 1, std::string const& OutFileName = "");
     void CalculateFluxGPU (TParticleA&, TSurfacePoints const&, double const, T3DScalarContainer& FluxContainer, int const Dimension = 3, double const Weight = 1, std::string const& OutFileName = "");
@@ -165,6 +186,11 @@ class OSCARSSR
     void Derivatives (double t, double x[], double dxdt[], TParticleA const&);
     void RK4 (double y[], double dydx[], int n, double x, double h, double yout[], TParticleA const&);
 
+    void CalculateMirror (TSurfacePoints_Rectangle const&, int const, T3DScalarTree::TEvaluate const&, T3DScalarContainer&, int const, std::string const&);
+
+    // Values[i] = Evaluate(i) for N points on NThreads threads
+    void EvaluateOnThreads (size_t const N, int const NThreads, std::function<double (size_t const)> const& Evaluate, std::vector<double>& Values) const;
+
 
     double fCTStart;
     double fCTStop;
@@ -15,19 +15,57 @@
 
 #include "OSCARSSR.h"
 
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// Calculations run without the GIL.  Those on the same object take turns with Calculation,
+// which every other method holds while it runs as well.  NCalculations counts the ones
+// running or waiting and NPending the calculate_*_async calls not done yet, so other
+// methods can wait for them.  Thread holds Calculation.
+struct TOSCARSSRPythonLock {
+  std::mutex              Calculation;
+  std::mutex              Count;
+  std::condition_variable Idle;
+  int                     NCalculations;
+  int                     NPending;
+  std::thread::id         Thread;
+};
+
 // The python OSCARSSR object
 typedef struct {
   // Define the OSCARSSRObject struct which contains the class I want
   PyObject_HEAD
   OSCARSSR* obj;
+
+  // Return results as nested python lists instead of sr.array
+  int OutputLists;
+
+  // Lock for calculations
+  TOSCARSSRPythonLock* Lock;
 } OSCARSSRObject;
 
+// The python sr.array object: a read-only C-contiguous array of doubles viewing data owned
+// by Owner, with the buffer protocol.  Indexing gives sub-arrays (or floats for 1D).
+typedef struct {
+  PyObject_HEAD
+  std::shared_ptr<void const>* Owner;
+  double const* Data;
+  int        NDim;
+  Py_ssize_t Shape[3];
+  Py_ssize_t Strides[3];
+} OSCARSSRArrayObject;
+
 
 
 static void OSCARSSR_dealloc(OSCARSSRObject* self);
 static PyObject* OSCARSSR_new (PyTypeObject* type, PyObject* args, PyObject* kwds);
+static PyObject* OSCARSSR_Async (OSCARSSRObject* self, char const* Name, PyObject* args, PyObject* keywds);
 static TVector3D OSCARSSR_ListAsTVector3D (PyObject* List);
 static PyObject* OSCARSSR_TVector3DAsList (TVector3D const& V);
+static PyObject* OSCARSSR_NewArray (std::shared_ptr<void const> const& Owner, double const* Data, int const NDim, Py_ssize_t const* Shape);
+static PyObject* OSCARSSR_SetOutputLists (OSCARSSRObject* self, PyObject* arg);
 static PyObject* OSCARSSR_Pi (OSCARSSRObject* self, PyObject* arg);
 static PyObject* OSCARSSR_GetCTStart (OSCARSSRObject* self);
 static PyObject* OSCARSSR_GetCTStop (OSCARSSRObject* self);
@@ -35,7 +73,7 @@ static PyObject* OSCARSSR_SetCTStartStop (OSCARSSRObject* self, PyObject* args);
 static PyObject* OSCARSSR_GetNPointsTrajectory (OSCARSSRObject* self);
 static PyObject* OSCARSSR_SetNPointsTrajectory (OSCARSSRObject* self, PyObject* arg);
 static PyObject* OSCARSSR_AddMagneticField (OSCARSSRObject* self, PyObject* args, PyObject* keywds);
-static PyObject* OSCARSSR_AddMagneticFieldFunction (OSCARSSRObject* self, PyObject* args);
+static PyObject* OSCARSSR_AddMagneticFieldFunction (OSCARSSRObject* self, PyObject* args, PyObject* keywds);
 static PyObject* OSCARSSR_AddMagneticFieldGaussian (OSCARSSRObject* self, PyObject* args, PyObject* keywds);
 static PyObject* OSCARSSR_ClearMagneticFields (OSCARSSRObject* self);
 static PyObject* OSCARSSR_GetBField (OSCARSSRObject* self, PyObject* args);
@@ -49,6 +87,8 @@ static PyObject* OSCARSSR_CalculateSpectrum (OSCARSSRObject* self, PyObject* arg
 static PyObject* OSCARSSR_CalculateTotalPower (OSCARSSRObject* self);
 static PyObject* OSCARSSR_CalculatePowerDensityRectangle (OSCARSSRObject* self, PyObject* args, PyObject *keywds);
 static PyObject* OSCARSSR_CalculateFluxRectangle (OSCARSSRObject* self, PyObject* args, PyObject *keywds);
+static PyObject* OSCARSSR_CalculatePowerDensitySurface (OSCARSSRObject* self, PyObject* args, PyObject *keywds);
+static PyObject* OSCARSSR_CalculateFluxSurface (OSCARSSRObject* self, PyObject* args, PyObject *keywds);
 
 
 
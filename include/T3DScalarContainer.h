@@ -9,6 +9,7 @@
 ////////////////////////////////////////////////////////////////////
 
 #include "TVector3D.h"
+#include "TSurfacePoints_Rectangle.h"
 
 #include <fstream>
 #include <vector>
@@ -53,14 +54,27 @@ class T3DScalar
 
 
 
+// Points and values.  A container can instead be a grid on a rectangle: only values (and
+// their compensation) are kept, 16 bytes a point, and the coordinates of point i are made
+// from the rectangle when asked for.  Points must then be added in the order of the
+// rectangle, which all calculations on a rectangle do.
+
 class T3DScalarContainer
 {
   public:
     T3DScalarContainer ();
+    T3DScalarContainer (TSurfacePoints_Rectangle const&, int const Dimension);
     ~T3DScalarContainer ();
 
+    // Clear and keep only values from now on, coordinates come from the rectangle in
+    // 2 (X1, X2, 0) or 3 (X, Y, Z) dimensions
+    void SetGrid (TSurfacePoints_Rectangle const&, int const Dimension);
+    bool IsGrid () const;
+    TSurfacePoints_Rectangle const& GetGrid () const;
+
     void AddPoint (TVector3D const&, double const);
     void AddToPoint (size_t const, double const);
+    void AddToPoints (std::vector<double> const&);
 
     void Clear ();
     void AverageFromFilesText (std::vector<std::string> const&, int const Dimension);
@@ -68,7 +82,9 @@ class T3DScalarContainer
 
     size_t GetNPoints () const;
 
-    T3DScalar const& GetPoint (size_t const) const;
+    T3DScalar const GetPoint (size_t const) const;
+    double const* GetData () const;
+    double const* GetValues () const;
 
     void WriteToFileText (std::string const&, int const);
     void WriteToFileBinary (std::string const&, int const);
@@ -76,6 +92,11 @@ class T3DScalarContainer
   private:
     std::vector<T3DScalar> fValues;
     std::vector<double> fCompensation;
+
+    bool fIsGrid;
+    int  fGridDimension;
+    TSurfacePoints_Rectangle fGrid;
+    std::vector<double> fGridValues;
 };
 
 
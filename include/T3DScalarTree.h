@@ -0,0 +1,98 @@
+#ifndef GUARD_T3DScalarTree_h
+#define GUARD_T3DScalarTree_h
+////////////////////////////////////////////////////////////////////
+//
+// Scalar (flux, power density) on a surface refined where it
+// needs it.  Starts from the cells of a rectangle's grid or the
+// triangles of a mesh.  Each cell is tested at its edge midpoints
+// (and center for rectangles), and split in four when the value
+// there differs from the interpolation between its corners by more
+// than a tolerance times the largest value seen.  Cells of a
+// rectangle form a quadtree in (X1, X2) which can be resampled to
+// a regular grid.
+//
+////////////////////////////////////////////////////////////////////
+
+#include "TVector3D.h"
+#include "TVector2D.h"
+#include "TSurfacePoints.h"
+#include "T3DScalarContainer.h"
+
+#include <vector>
+#include <functional>
+
+class TSurfacePoints_Rectangle;
+class TSurfacePoints_Mesh;
+
+class T3DScalarTree
+{
+  public:
+    // Fills the values for all points of a surface
+    typedef std::function<void (TSurfacePoints const&, std::vector<double>&)> TEvaluate;
+
+    // A point evaluated.  U is (X1, X2) for a rectangle
+    struct TNode {
+      TVector3D X;
+      TVector3D N;
+      TVector2D U;
+      double    V;
+    };
+
+    // Triangle, or rectangle with corners (lo, lo), (hi, lo), (hi, hi), (lo, hi) in (X1, X2).
+    // The four children are consecutive from Child, -1 for a leaf.  Children of a rectangle
+    // are in the order (lo, lo), (hi, lo), (lo, hi), (hi, hi).
+    struct TCell {
+      int NCorners;
+      int Corner[4];
+      int Level;
+      int Child;
+    };
+
+    T3DScalarTree ();
+    ~T3DScalarTree ();
+
+    // Surface must be a TSurfacePoints_Rectangle or TSurfacePoints_Mesh
+    void Refine (TSurfacePoints const&, TEvaluate const&, double const Tolerance, int const MaxLevel);
+    void Clear ();
+
+    size_t GetNNodes () const;
+    TNode const& GetNode (size_t const) const;
+    size_t GetNCells () const;
+    TCell const& GetCell (size_t const) const;
+    size_t GetNLeaves () const;
+    double GetCellArea (size_t const) const;
+    bool IsRectangle () const;
+
+    // Every point evaluated, in 3D or (X1, X2, 0)
+    void GetNodes (T3DScalarContainer&, int const Dimension = 3) const;
+
+    // Leaf centers with the average of their corners, and their areas [m^2]
+    void GetLeaves (T3DScalarContainer&, std::vector<double>* Areas = 0x0) const;
+
+    // Sum over leaves of area times value, with areas in [m^2]
+    double GetIntegral () const;
+
+    // Rectangles only: interpolated in the leaf containing (X1, X2), and on a regular grid
+    double GetValue (double const X1, double const X2, TVector3D* Position = 0x0) const;
+    void Resample (int const NX1, int const NX2, T3DScalarContainer&, int const Dimension = 2) const;
+
+  private:
+    void RefineRectangle (TSurfacePoints_Rectangle const&, TEvaluate const&, double const, int const);
+    void RefineMesh (TSurfacePoints_Mesh const&, TEvaluate const&, double const, int const);
+    void Evaluate (TEvaluate const&, size_t const);
+    double GetMaxValue () const;
+
+    std::vector<TNode> fNodes;
+    std::vector<TCell> fCells;
+
+    // Root cells of a rectangle are the first (fNX1 - 1) * (fNX2 - 1) cells
+    bool   fIsRectangle;
+    int    fNX1;
+    int    fNX2;
+    double fX1Start;
+    double fX2Start;
+    double fX1Step;
+    double fX2Step;
+};
+
+#endif
@@ -10,6 +10,8 @@
 
 #include "TVector3D.h"
 
+#include <cstddef>
+
 class TField
 {
   // This class is designed to be a base class for a field object.
@@ -21,6 +23,14 @@ class TField
     virtual TVector3D GetF  (double const, double const, double const) const = 0;
     virtual TVector3D GetF  (TVector3D const&) const = 0;
 
+    // Evaluate the field at N points at once.  The default loops over GetF, but
+    // derived classes should override this to hoist per-call work out of the loop
+    virtual void GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+
+    // The same with each coordinate in its own array (structure of arrays), points
+    // (X[i], Y[i], Z[i]) and fields (FX[i], FY[i], FZ[i]).  Goes through the above in blocks.
+    void GetFBatch (double const* X, double const* Y, double const* Z, double* FX, double* FY, double* FZ, size_t const N) const;
+
     virtual ~TField () {};
 
 
@@ -0,0 +1,110 @@
+#ifndef GUARD_TField3D_Fourier_h
+#define GUARD_TField3D_Fourier_h
+////////////////////////////////////////////////////////////////////
+//
+// A periodic field map (undulator) stored as a Fourier series
+// along z.  The map is read and fit once: every transverse grid
+// point gets the coefficients of a few harmonics of the period,
+// fit over a whole number of periods in the middle of the map.
+// What the series misses at the non-periodic ends is kept as a
+// correction on the original grid points there, and blended to
+// zero inside the fit so the field is continuous at the seams.
+//
+////////////////////////////////////////////////////////////////////
+
+#include "TField.h"
+#include "TField3D_Grid.h"
+#include "TMatrix3D.h"
+
+#include <string>
+#include <vector>
+
+class TField3D_Fourier : public TField
+{
+  public:
+    TField3D_Fourier (std::string const& InFileName,
+                      std::string const& FileFormat,
+                      double const Period,
+                      int const NHarmonics = 8,
+                      double const EndLength = -1,
+                      TVector3D const& Rotations = TVector3D(0, 0, 0),
+                      TVector3D const& Translation = TVector3D(0, 0, 0),
+                      std::vector<double> const& Scaling = std::vector<double>());
+    ~TField3D_Fourier ();
+
+    double    GetFx (double const, double const, double const) const;
+    double    GetFy (double const, double const, double const) const;
+    double    GetFz (double const, double const, double const) const;
+    TVector3D GetF  (double const, double const, double const) const;
+    TVector3D GetF  (TVector3D const&) const;
+    void      GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+    using TField::GetFBatch;
+
+    // Accuracy against the map at its own grid points, and memory used
+    double GetMaxError () const;
+    double GetRMSError () const;
+    double GetMaxField () const;
+    size_t GetSize () const;
+    size_t GetMapSize () const;
+
+    static int const kMaxHarmonics = 64;
+
+  private:
+    void Fit (TField3D_Grid const&, double const, int const, double const);
+    TVector3D Evaluate (double const, double const, double const) const;
+    TVector3D GetEndCorrection (std::vector<TVector3D> const&, int const, double const, size_t const, size_t const, double const, double const, double const) const;
+
+    // Transverse grid of the map
+    int    fNX;
+    int    fNY;
+    double fXStart;
+    double fYStart;
+    double fXStep;
+    double fYStep;
+    double fXStop;
+    double fYStop;
+
+    // Range along z, and the middle of the map where the phase is 0
+    double fZStart;
+    double fZStop;
+    double fZStep;
+    double fZCenter;
+
+    // Wave number of the period and the number of functions in the series: the constant,
+    // then the cosine and sine of each harmonic
+    double fK;
+    int    fNHarmonics;
+    int    fNBasis;
+
+    // Coefficients at each transverse point, fNBasis for each
+    std::vector<TVector3D> fCoefficients;
+
+    // Correction to the series on the grid points at each end.  The low end covers
+    // fZStart to fZLowEnd and the high end fZHighEnd to fZStop.  The correction at the
+    // seams is blended to zero over fZBlend inside the fit.
+    std::vector<TVector3D> fLowEnd;
+    std::vector<TVector3D> fHighEnd;
+    int    fNZLowEnd;
+    int    fNZHighEnd;
+    double fZLowEnd;
+    double fZHighEnd;
+    double fZBlend;
+
+    // Accuracy report
+    double fMaxError;
+    double fRMSError;
+    double fMaxField;
+    size_t fMapSize;
+
+    // Rotations and translation, same as TField3D_Grid
+    TMatrix3D fRotationMatrix;
+    bool      fHasRotation;
+    TVector3D fTranslation;
+};
+
+
+
+
+
+
+#endif
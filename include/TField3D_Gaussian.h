@@ -23,9 +23,14 @@ class TField3D_Gaussian : public TField
     double    GetFz (double const, double const, double const) const;
     TVector3D GetF  (double const, double const, double const) const;
     TVector3D GetF  (TVector3D const&) const;
+    void      GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+    using TField::GetFBatch;
 
     bool IsWithinRange (double const, double const, double const) const;
 
+  // The container compiles this field into its own closed representation
+  friend class TFieldContainer;
+
   private:
     TVector3D fField;
     TVector3D fCenter;
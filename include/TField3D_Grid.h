@@ -9,17 +9,38 @@
 ////////////////////////////////////////////////////////////////////
 
 #include "TField.h"
+#include "TMatrix3D.h"
+#include "TMappedFile.h"
 
 #include <string>
 #include <vector>
 #include <array>
+#include <memory>
+#include <ostream>
+#include <cstdint>
 
 class TField3D_Grid : public TField
 {
 
   public:
+    // Interpolation between grid points.  Cubic uses a natural cubic B-spline whose
+    // coefficients are computed once when the file is read.
+    enum TField3D_Grid_Interpolation {
+      kInterpolation_Linear,
+      kInterpolation_Cubic
+    };
+
+    // How the field data is stored.  Lookups and interpolation are always done in double.
+    // Fixed16 stores each component as a 16 bit integer times a scale per component.
+    enum TField3D_Grid_Storage {
+      kStorage_Double,
+      kStorage_Float32,
+      kStorage_Fixed16
+    };
+
     TField3D_Grid ();
-    TField3D_Grid (std::string const&, std::string const& FileFormat = "OSCARS", TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), std::vector<double> const& Scaling = std::vector<double>(), char const CommentChar = '#');
+    TField3D_Grid (std::string const&, std::string const& FileFormat = "OSCARS", TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), std::vector<double> const& Scaling = std::vector<double>(), char const CommentChar = '#', TField3D_Grid_Interpolation const Interpolation = kInterpolation_Linear, bool const Shared = false, TVector3D const& ExtractMin = TVector3D(0, 0, 0), TVector3D const& ExtractMax = TVector3D(0, 0, 0));
+    TField3D_Grid (TField const&, TVector3D const& Start, TVector3D const& Step, int const NX, int const NY, int const NZ, TField3D_Grid_Interpolation const Interpolation = kInterpolation_Linear);
     TField3D_Grid (std::vector<std::pair<double, std::string> > Mapping, std::string const& FileFormat, double const Parameter, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), std::vector<double> const& Scaling = std::vector<double>(), char const CommentChar = '#');
     ~TField3D_Grid ();
 
@@ -28,9 +49,26 @@ class TField3D_Grid : public TField
     double GetFz (double const, double const, double const) const;
     TVector3D GetF (double const, double const, double const) const;
     TVector3D GetF (TVector3D const&) const;
+    void GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+    using TField::GetFBatch;
 
     size_t GetIndex (size_t const, size_t const, size_t const) const;
 
+    // Only the part of a file inside this box (lab frame) is kept when reading.  The grid is
+    // cut to the cells covering the box plus enough for the interpolation.  Min == Max
+    // means read everything.
+    void SetExtractionBox (TVector3D const&, TVector3D const&);
+    bool HasExtractionBox () const;
+
+    // Convert the data read to a more compact storage.  A non-zero parity for an axis keeps
+    // only the half of the map on the positive side of that axis (grid frame), and the
+    // other half is reconstructed on lookup as F(-x) = Parity * F(x) component by component.
+    // The map must be symmetric about 0 in that direction.
+    void SetStorage (TField3D_Grid_Storage const, TVector3D const& MirrorX = TVector3D(0, 0, 0), TVector3D const& MirrorY = TVector3D(0, 0, 0), TVector3D const& MirrorZ = TVector3D(0, 0, 0));
+    TField3D_Grid_Storage GetStorage () const;
+    size_t GetStorageSize () const;
+    double GetStorageError () const;
+
     double GetHeaderValue (std::string const&) const;
     double GetHeaderValueSRW (std::string const&, const char CommentChar = '#') const;
 
@@ -38,14 +76,57 @@ class TField3D_Grid : public TField
     void ReadFile_OSCARS1D  (std::string const&, std::string const&, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), std::vector<double> const& Scaling = std::vector<double>(), char const CommentChar = '#');
     void ReadFile_SRW       (std::string const&, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), char const CommentChar = '#');
     void ReadFile_SPECTRA   (std::string const&, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), char const CommentChar = '#');
+    void ReadFile_Binary    (std::string const&, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), std::vector<double> const& Scaling = std::vector<double>());
+
+    void WriteFile_Binary (std::string const&, bool const Float32 = false, std::string const& Comment = "") const;
+
+    // Header of the OSCARSBIN binary grid format.  The payload starts at PayloadOffset and
+    // holds NX*NY*NZ (Fx, Fy, Fz) triplets of float64 or float32, in the same point order
+    // as the OSCARS text format.  Everything is in the byte order of the writing machine,
+    // which is recorded in ByteOrder.  A comment longer than Comment is cut there and
+    // written in full right after the header, CommentSize bytes (0 if it fits).
+    struct TBinaryHeader {
+      char     Magic[8];
+      uint32_t Version;
+      uint32_t ByteOrder;
+      uint32_t ValueSize;
+      uint32_t CommentSize;
+      uint64_t PayloadOffset;
+      int64_t  N[3];
+      double   Start[3];
+      double   Step[3];
+      char     Comment[256];
+    };
+
+    static void WriteBinaryHeader (std::ostream&, int const, int const, int const, TVector3D const&, TVector3D const&, bool const, std::string const&);
+    static void WriteBinaryPoints (std::ostream&, TVector3D const*, size_t const, bool const);
 
     void InterpolateFromFiles (std::vector<std::pair<double, std::string> > const&, double const, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), std::vector<double> const& Scaling = std::vector<double>(), char const CommentChar = '#');
 
     TVector3D InterpolateFields (std::vector<double> const&, std::vector<TVector3D> const&, double const);
 
+    // For families of maps at different parameter values (see TField3D_GridFamily)
+    bool HasSameGrid (TField3D_Grid const&) const;
+    void SetCombination (TField3D_Grid const&, double const, TField3D_Grid const&, double const);
+
+    static TField3D_Grid_Interpolation GetInterpolation (std::string const&);
+    static TField3D_Grid_Storage GetStorage (std::string const&);
+
+    // Directory for maps shared between processes, /dev/shm by default
+    static void SetSharedDirectory (std::string const&);
+    static std::string GetSharedDirectory ();
+
+    // Remove the shared maps from the shared directory, returns how many.  They stay until
+    // then since other processes may still want them.  Grids already using them keep working.
+    static size_t ClearShared ();
+
     static bool CompareField1D (std::array<double, 4> const&, std::array<double, 4> const&);
+    static bool SamePosition1D (std::array<double, 4> const&, std::array<double, 4> const&);
     static bool CompareMappingElements (std::pair<double, std::string> const&, std::pair<double, std::string> const&);
 
+    // Fits series to the grid data directly
+    friend class TField3D_Fourier;
+
     enum TField3D_Grid_DIMX {
       kDIMX_X,
       kDIMX_Y,
@@ -80,13 +161,79 @@ class TField3D_Grid : public TField
 
     TField3D_Grid_DIMX fDIMX;
 
+    // Extraction box in the lab frame
+    TVector3D fExtractMin;
+    TVector3D fExtractMax;
+    bool GetExtractionRange (TVector3D const&, TVector3D const&, int*) const;
+    void SetExtractedGeometry (int const*);
+
     // Rotations and Translations.  Field is stored rotated, point must be rotated into grid
     // coordinate system before asking for field, but remember field is already rotated.
     TVector3D fRotated;
     TVector3D fTranslation;
 
-    // Field data
+    // Field data.  Readers fill fData, which SelectKernel() then moves into fDataOwner.
+    // Lookups go through fDataPointer, which points into fDataOwner: a vector in memory or
+    // the payload of a memory mapped binary file.  It is never changed once set, so copies
+    // of a grid share it.
     std::vector<TVector3D> fData;
+    double const* fDataPointer;
+    std::shared_ptr<void const> fDataOwner;
+
+    // Precomputed rotation of a point into the grid frame, and reciprocal steps
+    TMatrix3D fRotationMatrix;
+    bool      fHasRotation;
+    double    fXStepInverse;
+    double    fYStepInverse;
+    double    fZStepInverse;
+
+    // Interpolation mode.  For cubic the field data is replaced by the B-spline
+    // coefficients, padded by one point on each end of every grid axis
+    TField3D_Grid_Interpolation fInterpolation;
+    std::vector<TVector3D> fCoefficients;
+    TVector3D const* fCoefficientPointer;
+    void ComputeCubicCoefficients ();
+
+    // Storage of the data the kernels read: fDataPointer or fCoefficientPointer for double,
+    // otherwise a compact copy.  Fixed16 values are multiplied by fStorageScale.
+    TField3D_Grid_Storage fStorage;
+    void const* fStoragePointer;
+    TVector3D   fStorageScale;
+    double      fStorageError;
+    template <typename T> double SetStorageData (TVector3D const*, int const*, int const*, int const*);
+
+    // Mirror symmetry.  The parity is for the field components in the grid frame, and
+    // fFieldAxes are the grid axes in the frame the field is stored in.
+    bool      fHasMirror;
+    bool      fMirror[3];
+    TVector3D fMirrorParity[3];
+    TVector3D fFieldAxes[3];
+    TVector3D MirrorField (TVector3D const&, TVector3D const&) const;
+
+    // Interpolation kernel for this grid's dimensions and storage, selected once the data is read
+    void SelectKernel ();
+    template <typename T> void SelectKernelStorage ();
+    template <TField3D_Grid_DIMX D, typename T> TVector3D GetFKernel (double const, double const, double const) const;
+    template <TField3D_Grid_DIMX D, typename T> TVector3D GetFKernelCubic (double const, double const, double const) const;
+    TVector3D (TField3D_Grid::*fKernel) (double const, double const, double const) const;
+
+    // Text files are memory mapped, cut into line-aligned chunks and parsed on several threads
+    static char const* GetLine (char const*, char const*, std::string&);
+    static std::vector<char const*> GetLineChunks (char const*, char const*);
+    static bool ParseValues (char const*&, char const*, double*, int const);
+    static void CountLines (char const*, char const*, size_t*);
+    void ParseGridData (char const*, char const*, TVector3D const&, TVector3D const&, TVector3D const&);
+    void ParseGridDataChunk (char const*, char const*, size_t const, int const*, TVector3D const&, TVector3D const&, char*);
+    // Maps already read by this process, and maps shared with other processes through
+    // OSCARSBIN files in the shared directory
+    void ReadAnyFormat (std::string const&, std::string const&, TVector3D const&, TVector3D const&, std::vector<double> const&, char const);
+    std::string GetCacheKey (std::string const&, std::string const&, TVector3D const&, TVector3D const&, std::vector<double> const&, char const) const;
+    bool CopyFromCache (std::string const&);
+    void AddToCache (std::string const&) const;
+    bool ReadShared (std::string const&, std::string const&, TVector3D const&, TVector3D const&);
+    void WriteShared (std::string const&, std::string const&) const;
+
+    static void ParseData1DChunk (char const*, char const*, std::vector<int> const&, int const, std::vector<double> const&, char const, std::vector<std::array<double, 4> >*, char*);
 
 };
 
@@ -0,0 +1,74 @@
+#ifndef GUARD_TField3D_GridFamily_h
+#define GUARD_TField3D_GridFamily_h
+////////////////////////////////////////////////////////////////////
+//
+// A family of field maps on the same grid, each one measured or
+// calculated at a different value of some parameter (gap, phase..).
+// All maps are read once.  SetParameter() moves the family to a new
+// parameter value by linear interpolation between the two
+// neighbouring maps, so a scan never goes back to disk.
+//
+////////////////////////////////////////////////////////////////////
+
+#include "TField.h"
+#include "TField3D_Grid.h"
+
+#include <string>
+#include <vector>
+
+class TField3D_GridFamily : public TField
+{
+  public:
+    TField3D_GridFamily (std::vector<std::pair<double, std::string> > const& Mapping,
+                         std::string const& FileFormat,
+                         double const Parameter,
+                         TVector3D const& Rotations = TVector3D(0, 0, 0),
+                         TVector3D const& Translation = TVector3D(0, 0, 0),
+                         std::vector<double> const& Scaling = std::vector<double>(),
+                         char const CommentChar = '#',
+                         TField3D_Grid::TField3D_Grid_Interpolation const Interpolation = TField3D_Grid::kInterpolation_Linear,
+                         bool const Lazy = false);
+    ~TField3D_GridFamily ();
+
+    double    GetFx (double const, double const, double const) const;
+    double    GetFy (double const, double const, double const) const;
+    double    GetFz (double const, double const, double const) const;
+    TVector3D GetF  (double const, double const, double const) const;
+    TVector3D GetF  (TVector3D const&) const;
+    void      GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+    using TField::GetFBatch;
+
+    void   SetParameter (double const);
+    double GetParameter () const;
+
+    size_t GetNMaps () const;
+    bool   IsLazy () const;
+
+  private:
+    // Not copyable, the maps have exactly one owner
+    TField3D_GridFamily (TField3D_GridFamily const&);
+    TField3D_GridFamily& operator = (TField3D_GridFamily const&);
+
+    // Maps sorted by parameter value
+    std::vector<double>         fParameters;
+    std::vector<TField3D_Grid*> fGrids;
+
+    // Current parameter and the weights of the two maps around it
+    double fParameter;
+    size_t fBefore;
+    size_t fAfter;
+    double fWeightBefore;
+    double fWeightAfter;
+
+    // Lazy evaluates both maps on every lookup.  Otherwise SetParameter() builds the
+    // interpolated map once and lookups cost the same as a single grid.
+    bool          fLazy;
+    TField3D_Grid fCurrent;
+};
+
+
+
+
+
+
+#endif
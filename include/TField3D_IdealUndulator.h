@@ -26,11 +26,16 @@ class TField3D_IdealUndulator : public TField
     double    GetFz (double const, double const, double const) const;
     TVector3D GetF  (double const, double const, double const) const;
     TVector3D GetF  (TVector3D const&) const;
+    void      GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+    using TField::GetFBatch;
 
     void Init (TVector3D const&, TVector3D const&, int const, TVector3D const& Center = TVector3D(0, 0, 0), double const Phase = 0, double const Taper = 0);
 
 
 
+  // The container compiles this field into its own closed representation
+  friend class TFieldContainer;
+
   private:
     TVector3D fField;
     TVector3D fPeriod;
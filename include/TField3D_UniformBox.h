@@ -25,8 +25,13 @@ class TField3D_UniformBox : public TField
     double    GetFz (double const, double const, double const) const;
     TVector3D GetF  (double const, double const, double const) const;
     TVector3D GetF  (TVector3D const&) const;
+    void      GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+    using TField::GetFBatch;
 
 
+  // The container compiles this field into its own closed representation
+  friend class TFieldContainer;
+
   private:
     TVector3D fField;
     TVector3D fWidth;
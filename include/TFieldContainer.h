@@ -15,10 +15,11 @@
 #include <vector>
 
 #include "TField.h"
+#include "TMatrix3D.h"
 #include "TVector2D.h"
 #include "TVector3D.h"
 
-class TFieldContainer
+class TFieldContainer : public TField
 {
   public:
     TFieldContainer ();
@@ -33,7 +34,15 @@ class TFieldContainer
     TVector3D GetF  (double const, double const, double const) const;
     TVector3D GetF  (TVector3D const&) const;
 
+    void GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+    void GetFBatch (std::vector<TVector3D> const&, std::vector<TVector3D>&) const;
+    using TField::GetFBatch;
+
     size_t GetNFields () const;
+    TField* GetField (size_t const) const;
+
+    void Compile ();
+    bool IsCompiled () const;
 
     void      Clear ();
 
@@ -41,6 +50,33 @@ class TFieldContainer
 
   private:
     std::vector<TField*> fFields;
+
+    // Closed representation of the known field types built by Compile().  Known types
+    // are evaluated inline with their constants precomputed, anything else goes
+    // through the virtual GetF.
+    enum TFieldContainer_Type {
+      kType_Gaussian,
+      kType_UniformBox,
+      kType_IdealUndulator,
+      kType_Grid,
+      kType_Virtual
+    };
+
+    struct TCompiledField {
+      TFieldContainer_Type Type;
+      TField const*        Field;
+      TMatrix3D            Rotation;
+      bool                 HasRotation;
+      TVector3D            F;
+      TVector3D            Center;
+      TVector3D            Axis;
+      double               P[10];
+    };
+
+    TVector3D GetFCompiled (TVector3D const&) const;
+
+    std::vector<TCompiledField> fCompiled;
+    bool fIsCompiled;
 };
 
 
@@ -14,7 +14,7 @@
 class TFieldPythonFunction : public TField
 {
   public:
-    TFieldPythonFunction (PyObject*);
+    TFieldPythonFunction (PyObject*, bool const Vectorized = false);
     ~TFieldPythonFunction ();
 
     double    GetFx (double const, double const, double const) const;
@@ -22,10 +22,40 @@ class TFieldPythonFunction : public TField
     double    GetFz (double const, double const, double const) const;
     TVector3D GetF  (double const, double const, double const) const;
     TVector3D GetF  (TVector3D const&) const;
+    void      GetFBatch (TVector3D const*, TVector3D*, size_t const) const;
+    using TField::GetFBatch;
+
+    bool IsVectorized () const;
 
   private:
     PyObject* fPythonFunction;
 
+    // A vectorized function is called once for many points.  The python module only uses
+    // it to tabulate onto a grid, as one point at a time is slower than a plain function.
+    // It gets an (N, 3) memoryview of doubles, which numpy.asarray() takes without a copy
+    // (or .tolist() without numpy), and returns N fields as anything with the buffer
+    // protocol (a numpy array) or a sequence of N sequences of 3.
+    bool fVectorized;
+
+    // Holds the GIL while python is called.  Calculations run without it, and maybe on
+    // several threads at once.
+    class TLockGIL
+    {
+      public:
+        TLockGIL ()
+        {
+          fState = PyGILState_Ensure();
+        }
+
+        ~TLockGIL ()
+        {
+          PyGILState_Release(fState);
+        }
+
+      private:
+        PyGILState_STATE fState;
+    };
+
 };
 
 
@@ -0,0 +1,36 @@
+#ifndef GUARD_TMappedFile_h
+#define GUARD_TMappedFile_h
+////////////////////////////////////////////////////////////////////
+//
+// A read-only memory map of a whole file.  The mapping lives as
+// long as this object does.
+//
+////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <cstddef>
+
+class TMappedFile
+{
+  public:
+    TMappedFile (std::string const&);
+    ~TMappedFile ();
+
+    char const* GetData () const;
+    size_t      GetSize () const;
+
+    std::string const& GetFileName () const;
+
+  private:
+    // Not copyable, the mapping has exactly one owner
+    TMappedFile (TMappedFile const&);
+    TMappedFile& operator = (TMappedFile const&);
+
+    std::string fFileName;
+    void*       fData;
+    size_t      fSize;
+};
+
+
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef GUARD_TMatrix3D_h
+#define GUARD_TMatrix3D_h
+////////////////////////////////////////////////////////////////////
+//
+// A basic 3x3 matrix, mostly used to hold a precomputed rotation
+// so that hot loops do not recompute the trig for every point.
+//
+////////////////////////////////////////////////////////////////////
+
+#include "TVector3D.h"
+
+
+class TMatrix3D
+{
+  public:
+    TMatrix3D ();
+    TMatrix3D (TVector3D const&);
+    ~TMatrix3D ();
+
+    void SetIdentity ();
+    void SetRotationXYZ (TVector3D const&);
+
+    bool IsIdentity () const;
+
+    TMatrix3D Transpose () const;
+
+    inline TVector3D operator * (TVector3D const&) const;
+    inline void      Multiply (double const, double const, double const, double&, double&, double&) const;
+
+    double operator () (int const, int const) const;
+
+  private:
+    double fM[3][3];
+};
+
+
+
+
+
+
+
+
+inline TVector3D TMatrix3D::operator * (TVector3D const& V) const
+{
+  // Return the matrix times the vector
+  double X;
+  double Y;
+  double Z;
+  this->Multiply(V.GetX(), V.GetY(), V.GetZ(), X, Y, Z);
+  return TVector3D(X, Y, Z);
+}
+
+
+
+
+inline void TMatrix3D::Multiply (double const X, double const Y, double const Z, double& RX, double& RY, double& RZ) const
+{
+  // Matrix times the vector (X, Y, Z) written to (RX, RY, RZ)
+  RX = fM[0][0] * X + fM[0][1] * Y + fM[0][2] * Z;
+  RY = fM[1][0] * X + fM[1][1] * Y + fM[1][2] * Z;
+  RZ = fM[2][0] * X + fM[2][1] * Y + fM[2][2] * Z;
+  return;
+}
+
+
+
+
+#endif
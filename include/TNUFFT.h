@@ -0,0 +1,71 @@
+#ifndef GUARD_TNUFFT_h
+#define GUARD_TNUFFT_h
+////////////////////////////////////////////////////////////////////
+//
+// Non-uniform FFT in two dimensions (type 1): sums of sources at
+// any positions X1, X2 evaluated on a regular grid of integer
+// frequencies,
+//
+//   f(m1, m2) = Sum c exp(-i (m1 X1 + m2 X2))
+//
+// for -M/2 <= m < M - M/2.  Sources are spread onto an oversampled
+// grid with a Gaussian, transformed with an FFT, and the Gaussian is
+// divided out (Greengard and Lee, SIAM Review 46, 443 (2004)).  The
+// sum is periodic in X1 and X2, so any X is allowed.  Several sets
+// of coefficients at the same sources are transformed together.
+//
+////////////////////////////////////////////////////////////////////
+
+#include <complex>
+#include <vector>
+
+class TNUFFT
+{
+  public:
+    TNUFFT (int const M1, int const M2, int const NSets = 1);
+    ~TNUFFT ();
+
+    // Remove all sources
+    void Clear ();
+
+    // Add a source with one coefficient for each set
+    void Add (double const X1, double const X2, std::complex<double> const* C);
+
+    // Calculate f for the sources added
+    void Transform ();
+
+    // f(m1, m2) of set iSet with i1 = m1 + M1/2 and i2 = m2 + M2/2
+    std::complex<double> const& GetValue (int const iSet, int const i1, int const i2) const;
+
+    // Rough number of complex multiply and adds to add NSources and transform
+    double GetNOperations (size_t const NSources) const;
+
+    int GetM1 () const;
+    int GetM2 () const;
+    int GetNSets () const;
+
+    // Number of grid points on each side of a source in each dimension
+    static int const kSpread = 10;
+
+  private:
+    static void FFT (std::complex<double>*, std::vector<std::complex<double> > const&);
+
+    int fM1;
+    int fM2;
+    int fNSets;
+
+    // Size of the oversampled grid, a power of 2 at least twice M
+    int fMr1;
+    int fMr2;
+
+    // Gaussian widths
+    double fTau1;
+    double fTau2;
+
+    std::vector<std::complex<double> > fGrid;
+    std::vector<std::complex<double> > fValues;
+    std::vector<std::complex<double> > fTwiddle1;
+    std::vector<std::complex<double> > fTwiddle2;
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef GUARD_TRadiationKernel_h
+#define GUARD_TRadiationKernel_h
+////////////////////////////////////////////////////////////////////
+//
+// Sums over the trajectory for one observation point shared by the
+// power density, flux and spectrum calculations.  Options are
+// template parameters (policies) so each combination is compiled
+// without branches in the trajectory loop, and the choice is made
+// once per call.
+//
+//   PowerDensitySum<Directional, TVisibility> - power density
+//     before constants, Directional skips points behind the surface
+//     and TVisibility decides if a trajectory point is seen
+//   FieldSum<TField> - electric field in frequency space before
+//     constants, TField is the form of the integrand
+//
+////////////////////////////////////////////////////////////////////
+
+#include "TOSCARSSR.h"
+#include "TParticleTrajectoryPoints.h"
+#include "TTriangleBVH.h"
+#include "TVector3D.h"
+#include "TVector3DC.h"
+
+#include <complex>
+#include <cmath>
+
+class TRadiationKernel
+{
+  public:
+    // Every trajectory point is seen
+    struct TVisibleAll {
+      static bool const kTest = false;
+      bool operator () (TVector3D const&, TVector3D const&) { return true; }
+    };
+
+    // Trajectory points are seen if the line to the observer is not blocked
+    class TVisibleOccluders {
+      public:
+        static bool const kTest = true;
+        TVisibleOccluders (TTriangleBVH const& Occluders) : fOccluders(Occluders), fLast(0) {}
+        bool operator () (TVector3D const& X, TVector3D const& Obs) { return !fOccluders.IsBlocked(X, Obs, fLast); }
+
+      private:
+        TTriangleBVH const& fOccluders;
+        size_t fLast;
+    };
+
+    // (B - N (1 + i c / (omega D))) / D, after integrating the acceleration term by parts
+    struct TFieldBeta {
+      static TVector3DC Term (TParticleTrajectoryPoints const& T, size_t const iT, TVector3D const& N, double const D, std::complex<double> const& ICoverOmega)
+      {
+        return (TVector3DC(T.GetB(iT)) - (N * (std::complex<double>(1, 0) + (ICoverOmega / (D))))) / D;
+      }
+    };
+
+    // Velocity and acceleration fields, near plus far field, without the factor i omega
+    struct TFieldAcceleration {
+      static TVector3DC Term (TParticleTrajectoryPoints const& T, size_t const iT, TVector3D const& N, double const D, std::complex<double> const&)
+      {
+        TVector3D const& B = T.GetB(iT);
+        double const OneMinusNDotB2 = pow(1 - N.Dot(B), 2);
+        return TVector3DC(((1 - B.Mag2()) * (N - B)) / (D * D * OneMinusNDotB2) + (N.Cross((N - B).Cross(T.GetAoverC(iT)))) / (D * OneMinusNDotB2));
+      }
+    };
+
+
+
+    template <bool Directional, class TVisibility>
+    static double PowerDensitySum (TParticleTrajectoryPoints const& T, TVector3D const& Obs, TVector3D const& Normal, TVisibility& Visible)
+    {
+      // Sum over the trajectory of the power density at Obs with normal Normal, to be
+      // multiplied by |Q I| / (16 pi^2 epsilon0 c) DeltaT.  Visibility is only asked
+      // where the trajectory point adds something.
+
+      size_t const NTPoints = T.GetNPoints();
+
+      double Sum = 0;
+      for (size_t iT = 0; iT != NTPoints; ++iT) {
+
+        // Get current position, Beta, and Acceleration(over c)
+        TVector3D const& X = T.GetX(iT);
+        TVector3D const& B = T.GetB(iT);
+        TVector3D const& AoverC = T.GetAoverC(iT);
+
+        // Define the three normal vectors.  N1 is in the direction of propogation,
+        // N2 and N3 are in a plane perpendicular to N1
+        TVector3D const N1 = (Obs - X).UnitVector();
+        TVector3D const N2 = N1.Orthogonal().UnitVector();
+        TVector3D const N3 = N1.Cross(N2).UnitVector();
+
+        // For computing non-normally incidence
+        double const N1DotNormal = N1.Dot(Normal);
+        if (Directional && N1DotNormal <= 0) {
+          continue;
+        }
+
+        TVector3D const Numerator = N1.Cross( ( (N1 - B).Cross((AoverC)) ) );
+        double const Denominator = pow(1 - (B).Dot(N1), 5);
+
+        // Contributions from both N2 and N3
+        double const Sum2 = pow(Numerator.Dot(N2), 2) / Denominator / (Obs - X).Mag2() * N1DotNormal;
+        double const Sum3 = pow(Numerator.Dot(N3), 2) / Denominator / (Obs - X).Mag2() * N1DotNormal;
+
+        if (TVisibility::kTest && (Sum2 != 0 || Sum3 != 0) && !Visible(X, Obs)) {
+          continue;
+        }
+
+        Sum += Sum2;
+        Sum += Sum3;
+      }
+
+      return Sum;
+    }
+
+
+
+    template <class TField>
+    static TVector3DC FieldSum (TParticleTrajectoryPoints const& T, TVector3D const& Obs, double const Omega)
+    {
+      // Sum over the trajectory of TField times exp(i omega (t + D / c)) for the electric
+      // field at Obs in frequency space
+
+      size_t const NTPoints = T.GetNPoints();
+      double const DeltaT = T.GetDeltaT();
+
+      // Constant for field calculation
+      std::complex<double> const ICoverOmega(0, TOSCARSSR::C() / Omega);
+
+      // Electric field summation in frequency space
+      TVector3DC SumE(0, 0, 0);
+
+      for (size_t iT = 0; iT != NTPoints; ++iT) {
+
+        // Vector pointing from particle to observer, its direction and length
+        TVector3D const R = Obs - T.GetX(iT);
+        TVector3D const N = R.UnitVector();
+        double const D = R.Mag();
+
+        // Exponent for fourier transformed field
+        std::complex<double> const Exponent(0, Omega * (DeltaT * iT + D / TOSCARSSR::C()));
+
+        // Sum in fourier transformed field (integral)
+        SumE += TField::Term(T, iT, N, D, ICoverOmega) * std::exp(Exponent);
+      }
+
+      return SumE;
+    }
+};
+
+#endif
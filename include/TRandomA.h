@@ -9,6 +9,7 @@
 ////////////////////////////////////////////////////////////////////
 
 #include <random>
+#include <mutex>
 
 
 
@@ -31,6 +32,9 @@ class TRandomA
     std::normal_distribution<double> fNormalDist;
     std::uniform_real_distribution<double> fUniformDist;
 
+    // The global generator is shared by calculations running on several threads
+    std::mutex fMutex;
+
 
 };
 
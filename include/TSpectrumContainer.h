@@ -26,10 +26,12 @@ class TSpectrumContainer
     void   SetPoint  (size_t const, double const, double const);
     void   AddPoint  (double const, double const Flux = 0);
     void   AddToFlux (size_t const, double const);
+    void   AddToFlux (std::vector<double> const&);
     double GetFlux   (size_t const) const;
     double GetEnergy (size_t const) const;
     double GetAngularFrequency (size_t const) const;
     size_t GetNPoints () const;
+    double const* GetData () const;
 
     void WriteToFileText (std::string const, std::string const Header = "") const;
     void WriteToFileBinary (std::string const, std::string const Header = "") const;
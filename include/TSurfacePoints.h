@@ -17,16 +17,54 @@
 #include "TSurfacePoint.h"
 
 #include <vector>
+#include <memory>
+#include <atomic>
 
 class TSurfacePoints
 {
   public:
+    TSurfacePoints ();
+
+    // Copies do not share the buffers, each fills its own when asked
+    TSurfacePoints (TSurfacePoints const&);
+    TSurfacePoints& operator= (TSurfacePoints const&);
+
     virtual TSurfacePoint const GetPoint (size_t const) const = 0;
     virtual size_t GetNPoints () const = 0;
 
     virtual double GetX1 (size_t const) const = 0;
     virtual double GetX2 (size_t const) const = 0;
 
+    // Area of surface a point stands for in [m^2], 0 if the surface does not know
+    virtual double GetArea (size_t const) const;
+
+    // All points as contiguous arrays (structure of arrays) for the calculations.  Filled
+    // from the functions above the first time they are asked for and kept until the points
+    // change.  Safe to ask for from several threads at once.
+    struct TBuffers {
+      size_t NPoints;
+      std::vector<double> X;
+      std::vector<double> Y;
+      std::vector<double> Z;
+      std::vector<double> NX;
+      std::vector<double> NY;
+      std::vector<double> NZ;
+      std::vector<double> X1;
+      std::vector<double> X2;
+      std::vector<double> Area;
+    };
+
+    TBuffers const& GetBuffers () const;
+
+  protected:
+    // For derived classes, whenever their points change.  Costs only a flag test while
+    // there are no buffers, so it may be called for every point added.
+    void ClearBuffers ();
+
+  private:
+    mutable std::shared_ptr<TBuffers const> fBuffers;
+    mutable std::atomic<bool>               fHasBuffers;
+
 };
 
 #endif
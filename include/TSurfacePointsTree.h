@@ -0,0 +1,61 @@
+#ifndef GUARD_TSurfacePointsTree_h
+#define GUARD_TSurfacePointsTree_h
+////////////////////////////////////////////////////////////////////
+//
+// Binary tree of patches of the points of a surface, split at the
+// median of the longest side of their bounding box.  Each patch
+// knows its bounding sphere, the cone its normals are in, and has
+// Chebyshev points in its box through which any smooth function
+// can be interpolated to the points of the patch.  Used for the
+// far field part of the power density.
+//
+////////////////////////////////////////////////////////////////////
+
+#include "TSurfacePoints.h"
+#include "TVector3D.h"
+
+#include <vector>
+
+class TSurfacePointsTree
+{
+  public:
+    // Points First to Last (not included) in the order of the tree.  Children are Child and
+    // Child + 1, -1 for a leaf.  Normals are within Cone [rad] of Axis, Cone is pi if unknown.
+    struct TNode {
+      size_t    First;
+      size_t    Last;
+      int       Child;
+      TVector3D Center;
+      double    Radius;
+      TVector3D Lo;
+      TVector3D Hi;
+      TVector3D Axis;
+      double    Cone;
+    };
+
+    TSurfacePointsTree (TSurfacePoints const&, size_t const LeafSize = 32, int const Order = 4);
+    ~TSurfacePointsTree ();
+
+    size_t GetNNodes () const;
+    TNode const& GetNode (size_t const) const;
+
+    // Index in the surface of the ith point in the order of the tree
+    size_t GetIndex (size_t const) const;
+
+    // Chebyshev points of a patch.  A side of the box with no width has a single point.
+    size_t GetNInterpolationPoints (size_t const) const;
+    void GetInterpolationPoints (size_t const, std::vector<TVector3D>&) const;
+
+    // Value at X interpolated from the values at the Chebyshev points of a patch
+    TVector3D Interpolate (size_t const, std::vector<TVector3D> const&, TVector3D const& X) const;
+
+  private:
+    void Build (TSurfacePoints::TBuffers const&, size_t const, size_t const);
+    int GetNPoints (size_t const, int const) const;
+
+    std::vector<TNode>  fNodes;
+    std::vector<size_t> fIndex;
+    int fOrder;
+};
+
+#endif
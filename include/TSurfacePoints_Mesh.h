@@ -0,0 +1,64 @@
+#ifndef GUARD_TSurfacePoints_Mesh_h
+#define GUARD_TSurfacePoints_Mesh_h
+////////////////////////////////////////////////////////////////////
+//
+// Surface of triangles, for example read from an STL (text or
+// binary) or Wavefront OBJ file.  Each triangle is one point at
+// its centroid with the triangle's area.  The normal comes from
+// the order of the vertices, counter-clockwise seen from the side
+// it points to, as both formats use.  OBJ polygons are split into
+// fans of triangles.  Triangles without area are dropped.
+//
+////////////////////////////////////////////////////////////////////
+
+
+#include "TSurfacePoints.h"
+
+#include <vector>
+#include <string>
+
+class TMappedFile;
+
+class TSurfacePoints_Mesh : public TSurfacePoints
+{
+  public:
+    TSurfacePoints_Mesh ();
+    TSurfacePoints_Mesh (std::string const& InFileName, std::string const& Format = "", double const Scale = 1, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), int const Normal = 1);
+    ~TSurfacePoints_Mesh ();
+
+    // Format is stl or obj, from the file extension if empty.  Vertices are multiplied by
+    // Scale (eg 0.001 for a file in mm), then rotated and translated.  Normal -1 reverses
+    // the normals.
+    void ReadFile (std::string const& InFileName, std::string const& Format = "", double const Scale = 1, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), int const Normal = 1);
+
+    void AddTriangle (TVector3D const&, TVector3D const&, TVector3D const&);
+    void AddPolygon (std::vector<TVector3D> const&);
+
+    // Vertices of triangle i in the order given
+    void GetTriangle (size_t const, TVector3D&, TVector3D&, TVector3D&) const;
+
+    TSurfacePoint const GetPoint (size_t const) const;
+    size_t GetNPoints () const;
+
+    // Don't have meaning for this object
+    double GetX1 (size_t const) const;
+    double GetX2 (size_t const) const;
+
+    double GetArea (size_t const) const;
+    double GetTotalArea () const;
+
+  private:
+    std::vector<TSurfacePoint> fPoints;
+    std::vector<double>        fArea;
+    std::vector<TVector3D>     fVertices;
+
+    int fNormal;
+
+    void ReadFile_STL (TMappedFile const&, double const, TVector3D const&, TVector3D const&);
+    void ReadFile_OBJ (TMappedFile const&, double const, TVector3D const&, TVector3D const&);
+
+    static bool GetWord (char const*&, char const*, std::string&);
+    static bool GetNumbers (char const*&, char const*, double*, int const);
+};
+
+#endif
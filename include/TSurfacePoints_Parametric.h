@@ -0,0 +1,64 @@
+#ifndef GUARD_TSurfacePoints_Parametric_h
+#define GUARD_TSurfacePoints_Parametric_h
+////////////////////////////////////////////////////////////////////
+//
+// Surface given by a position as a function of two parameters
+// (u, v), sampled at NU x NV points from start to stop inclusive
+// with u changing slowest, as in python/parametric_surfaces.py.
+// Each point keeps the area it stands for, |dP/du x dP/dv| du dv,
+// halved on the edges of the (u, v) range so that a sum over the
+// points is the trapezoid rule.  Cylinders, spheres and tori are
+// built in with the same parameters and normals as the python
+// shapes.
+//
+////////////////////////////////////////////////////////////////////
+
+
+#include "TSurfacePoints.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+
+class TSurfacePoints_Parametric : public TSurfacePoints
+{
+  public:
+    // Position (or normal) at (u, v)
+    typedef std::function<TVector3D (double const, double const)> TFunction;
+
+    TSurfacePoints_Parametric ();
+    TSurfacePoints_Parametric (TFunction const& Position, TFunction const& NormalFunction, double const UStart, double const UStop, int const NU, double const VStart, double const VStop, int const NV, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), int const Normal = 1);
+    TSurfacePoints_Parametric (std::string const& Shape, std::vector<double> const& Parameters, int const NU, int const NV, std::vector<double> const& URange = std::vector<double>(), std::vector<double> const& VRange = std::vector<double>(), TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), int const Normal = 1);
+    ~TSurfacePoints_Parametric ();
+
+    // Without a normal function the normal is dP/du x dP/dv.  Normal -1 reverses it
+    void Init (TFunction const& Position, TFunction const& NormalFunction, double const UStart, double const UStop, int const NU, double const VStart, double const VStop, int const NV, TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), int const Normal = 1);
+
+    // Shapes: cylinder [R, L], sphere [R], torus [R, r].  An empty range is the whole shape
+    void Init (std::string const& Shape, std::vector<double> const& Parameters, int const NU, int const NV, std::vector<double> const& URange = std::vector<double>(), std::vector<double> const& VRange = std::vector<double>(), TVector3D const& Rotations = TVector3D(0, 0, 0), TVector3D const& Translation = TVector3D(0, 0, 0), int const Normal = 1);
+
+    TSurfacePoint const GetPoint (size_t const) const;
+    size_t GetNPoints () const;
+
+    // The u and v of a point
+    double GetX1 (size_t const) const;
+    double GetX2 (size_t const) const;
+
+    double GetArea (size_t const) const;
+    double GetTotalArea () const;
+
+  private:
+    int    fNU;
+    int    fNV;
+    double fUStart;
+    double fVStart;
+    double fUStep;
+    double fVStep;
+
+    std::vector<TSurfacePoint> fPoints;
+    std::vector<double>        fArea;
+
+    static double GetStep (double const, double const, int const);
+};
+
+#endif
@@ -11,6 +11,7 @@
 ////////////////////////////////////////////////////////////////////
 
 #include "TSurfacePoints.h"
+#include "TVector2D.h"
 
 #include <string>
 #include <stdexcept>
@@ -27,12 +28,20 @@ class TSurfacePoints_Rectangle : public TSurfacePoints
     void Init (std::string const&, int const, int const, double const, double const, TVector3D const&, TVector3D const&, int const);
     TSurfacePoint const GetPoint (size_t const) const;
     TVector3D GetXYZ (size_t const) const;
+
+    // At a fractional point index along X1 and X2, for refining
+    TVector3D GetXYZ (double const, double const) const;
+    TVector2D GetX1X2 (double const, double const) const;
+    int GetNX1 () const;
+    int GetNX2 () const;
+
     size_t GetNPoints () const;
 
     double GetX1 (size_t const) const;
     double GetX2 (size_t const) const;
 
     double GetElementArea () const;
+    double GetArea (size_t const) const;
 
   private:
     int fNX1;
@@ -0,0 +1,55 @@
+#ifndef GUARD_TSurfacePoints_View_h
+#define GUARD_TSurfacePoints_View_h
+////////////////////////////////////////////////////////////////////
+//
+// Surface of arbitrary points viewing memory owned by someone
+// else, for example a numpy array.  Point i is at Points plus
+// i * PointStrides[0] bytes, and its components PointStrides[1]
+// bytes apart, the same for normals.  Nothing is copied, so the
+// memory must stay as is while the surface is used.
+//
+////////////////////////////////////////////////////////////////////
+
+
+#include "TSurfacePoints.h"
+
+#include <cstddef>
+
+class TSurfacePoints_View : public TSurfacePoints
+{
+  public:
+    TSurfacePoints_View (size_t const N,
+                         char const* Points,
+                         std::ptrdiff_t const* PointStrides,
+                         char const* Normals,
+                         std::ptrdiff_t const* NormalStrides,
+                         TVector3D const& Rotations = TVector3D(0, 0, 0),
+                         TVector3D const& Translation = TVector3D(0, 0, 0),
+                         bool const InvertNormals = false);
+    ~TSurfacePoints_View ();
+
+    TSurfacePoint const GetPoint (size_t const) const;
+    size_t GetNPoints () const;
+
+    // Don't have meaning for this object
+    double GetX1 (size_t const) const;
+    double GetX2 (size_t const) const;
+
+  private:
+    size_t fNPoints;
+
+    char const*    fPoints;
+    std::ptrdiff_t fPointStrides[2];
+    char const*    fNormals;
+    std::ptrdiff_t fNormalStrides[2];
+
+    // Applied to each point as it is read, in the same way as to list input
+    TVector3D fRotations;
+    bool      fHasRotation;
+    TVector3D fTranslation;
+    double    fNormalSign;
+
+    TVector3D GetVector (char const*, std::ptrdiff_t const*, size_t const) const;
+};
+
+#endif
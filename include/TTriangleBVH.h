@@ -0,0 +1,64 @@
+#ifndef GUARD_TTriangleBVH_h
+#define GUARD_TTriangleBVH_h
+////////////////////////////////////////////////////////////////////
+//
+// Bounding volume hierarchy of triangles for testing whether a
+// straight line between two points is blocked, for example by a
+// mask in front of an absorber.  Boxes are split at the median of
+// the centroids along their longest side.  Triangles block from
+// either side.
+//
+////////////////////////////////////////////////////////////////////
+
+#include "TSurfacePoints_Mesh.h"
+#include "TVector3D.h"
+
+#include <vector>
+
+class TTriangleBVH
+{
+  public:
+    TTriangleBVH ();
+    ~TTriangleBVH ();
+
+    void AddTriangle (TVector3D const&, TVector3D const&, TVector3D const&);
+    void AddMesh (TSurfacePoints_Mesh const&);
+
+    // Build the tree, needed after adding triangles and before IsBlocked
+    void Build (size_t const LeafSize = 4);
+
+    // True if a triangle crosses the line from From to To.  Crossings at To itself (within
+    // a relative 1e-9 of the length) do not count, so a point on a triangle of the mesh
+    // is not blocked by it.  Last is the triangle that blocked the previous line and is
+    // tried first, it is updated when another one blocks.  Start it at 0.
+    bool IsBlocked (TVector3D const& From, TVector3D const& To, size_t& Last) const;
+
+    size_t GetNTriangles () const;
+
+  private:
+    // Triangles First to Last (not included) in the order of the tree.  Children are
+    // Child and Child + 1, -1 for a leaf.
+    struct TNode {
+      size_t    First;
+      size_t    Last;
+      int       Child;
+      TVector3D Lo;
+      TVector3D Hi;
+    };
+
+    // Vertex A and the edges B - A and C - A
+    struct TTriangle {
+      TVector3D A;
+      TVector3D E1;
+      TVector3D E2;
+    };
+
+    void Build (size_t const, size_t const);
+    bool Intersects (TTriangle const&, TVector3D const& From, TVector3D const& D) const;
+
+    std::vector<TTriangle> fTriangles;
+    std::vector<TNode>     fNodes;
+    bool fBuilt;
+};
+
+#endif
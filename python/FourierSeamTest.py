@@ -0,0 +1,72 @@
+#!/usr/bin/env python
+#
+# Check that a Fourier series field is continuous where the fit meets the corrected ends
+# of the map (the seams).  The jump across each seam is compared to the change of the
+# field over the same step in the middle of the map.
+#
+# How to run this code:
+#   python python/FourierSeamTest.py
+
+import math
+import os
+import sys
+import tempfile
+
+import oscars.sr
+
+
+# Tapered undulator map: the peak field changes along the map, so the map is not periodic
+# and the fit has a residual at the seams.  One period rolls off at each end.
+period = 0.05
+k = 2 * math.pi / period
+nx, ny, nz = 5, 3, 1301
+x0, y0, z0 = -0.004, -0.001, -0.65
+dx, dy, dz = 0.002, 0.001, 0.001
+length = (nz - 1) * dz
+
+def field (x, y, z):
+  envelope = min(1.0, max(0.0, (-z0 - abs(z)) / period)) * (1 + 0.8 * z)
+  by = math.cosh(k * y) * (math.sin(k * z) + 0.1 * math.sin(3 * k * z)) * envelope
+  bz = -math.sinh(k * y) * math.cos(k * z) * envelope
+  return (0.02 * x * by, by, bz)
+
+tmp = tempfile.mkdtemp()
+map_file = os.path.join(tmp, 'undulator.dat')
+with open(map_file, 'w') as f:
+  f.write('# Tapered undulator\n%r\n%r\n%d\n%r\n%r\n%d\n%r\n%r\n%d\n' % (x0, dx, nx, y0, dy, ny, z0, dz, nz))
+  for i in range(nx):
+    for j in range(ny):
+      for n in range(nz):
+        f.write('%.17g %.17g %.17g\n' % field(x0 + i * dx, y0 + j * dy, z0 + n * dz))
+
+ends = 0.2
+osr = oscars.sr.sr()
+osr.add_bfield_fourier(ifile=map_file, iformat='OSCARS', period=period, nharmonics=3, ends=ends)
+
+# Seams: first and last map point of a whole number of periods in the middle of the map
+center = z0 + length / 2
+nperiods = math.floor((length - 2 * ends) / period)
+seams = [z0 + math.ceil((center - nperiods * period / 2 - z0) / dz - 1e-9) * dz,
+         z0 + math.floor((center + nperiods * period / 2 - z0) / dz + 1e-9) * dz]
+
+# Largest change of any component over a step h
+h = 1e-7
+def jump (x, y, z):
+  a = osr.get_bfield([x, y, z - h])
+  b = osr.get_bfield([x, y, z + h])
+  return max(abs(a[i] - b[i]) for i in range(3))
+
+failed = False
+for x, y in [[0, 0], [0.003, 0.0005], [-0.0031, -0.0007]]:
+  # Change over 2h where the field is smooth, with a margin for rounding
+  reference = max(jump(x, y, center + period * i / 17.) for i in range(17)) * 10 + 1e-12
+  for seam in seams:
+    difference = jump(x, y, seam)
+    ok = difference <= reference
+    failed = failed or not ok
+    print('x %+.4f  y %+.4f  seam z %+.4f  jump %.2e  smooth %.2e  %s' % (x, y, seam, difference, reference, 'ok' if ok else 'FAILED'))
+
+os.remove(map_file)
+os.rmdir(tmp)
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,71 @@
+#!/usr/bin/env python
+#
+# Check that the power density of nparticles is the average over the particles for
+# every way it is calculated: serial, threads, far field and occluders.  The beam has
+# no spread, so every particle gives the power density of the ideal one.
+#
+# How to run this code:
+#   python python/PowerDensityWeightTest.py
+
+import os
+import sys
+import tempfile
+
+import oscars.sr
+
+
+osr = oscars.sr.sr()
+osr.set_output_lists(True)
+
+osr.add_bfield_undulator(bfield=[0, 1, 0], period=[0, 0, 0.049], nperiods=11)
+osr.set_particle_beam(type='electron', name='beam_0', x0=[0, 0, -1], d0=[0, 0, 1], energy_GeV=3, current=0.5)
+osr.set_ctstartstop(0, 2)
+
+
+# Absorber as a mesh, and a mask off to the side that blocks nothing
+def quads (f, x0, x1, y0, y1, z, nx, ny):
+  for i in range(nx):
+    for j in range(ny):
+      xa = x0 + (x1 - x0) * i / nx
+      xb = x0 + (x1 - x0) * (i + 1) / nx
+      ya = y0 + (y1 - y0) * j / ny
+      yb = y0 + (y1 - y0) * (j + 1) / ny
+      f.write('v %g %g %g\nv %g %g %g\nv %g %g %g\nv %g %g %g\nf -4 -3 -2 -1\n' % (xa, ya, z, xa, yb, z, xb, yb, z, xb, ya, z))
+
+tmp = tempfile.mkdtemp()
+absorber = os.path.join(tmp, 'absorber.obj')
+mask = os.path.join(tmp, 'mask.obj')
+with open(absorber, 'w') as f:
+  quads(f, -0.01, 0.01, -0.005, 0.005, 30, 8, 4)
+with open(mask, 'w') as f:
+  quads(f, 0.5, 0.51, 0.5, 0.51, 20, 1, 1)
+
+
+rectangle = dict(plane='XY', width=[0.02, 0.01], npoints=[9, 5], translation=[0, 0, 30], normal=1)
+surface = dict(shape='mesh', ifile=absorber, normal=-1)
+
+# Name, function, keywords and relative precision
+paths = [
+  ['serial',    osr.calculate_power_density_rectangle, dict(rectangle, nthreads=1),                1e-12],
+  ['threads',   osr.calculate_power_density_rectangle, dict(rectangle, nthreads=2),                1e-12],
+  ['far field', osr.calculate_power_density_rectangle, dict(rectangle, nthreads=1, farfield=1e-4), 1e-3],
+  ['mesh',      osr.calculate_power_density_surface,   dict(surface, nthreads=1),                  1e-12],
+  ['occluders', osr.calculate_power_density_surface,   dict(surface, nthreads=1, occluders=[mask]), 1e-12],
+]
+
+failed = False
+for name, calculate, keywords, precision in paths:
+  ideal = calculate(**keywords)
+  reference = max(p[1] for p in ideal)
+  for nparticles in [1, 4]:
+    average = calculate(nparticles=nparticles, **keywords)
+    difference = max(abs(a[1] - b[1]) for a, b in zip(ideal, average)) / reference
+    ok = difference <= precision
+    failed = failed or not ok
+    print('%-10s nparticles %d  max %.6e  relative difference %.2e  %s' % (name, nparticles, max(p[1] for p in average), difference, 'ok' if ok else 'FAILED'))
+
+os.remove(absorber)
+os.remove(mask)
+os.rmdir(tmp)
+
+sys.exit(1 if failed else 0)
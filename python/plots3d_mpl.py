@@ -18,6 +18,8 @@ def power_density_3d(srs, surface,
 
 
     power_density = srs.calculate_power_density(points=points, normal=normal, rotations=rotations, translation=translation, nparticles=nparticles, gpu=gpu, nthreads=nthreads)
+    if hasattr(power_density, 'tolist'):
+        power_density = [[item[0:3], item[3]] for item in power_density.tolist()]
     P = [item[1] for item in power_density]
 
     X2 = []
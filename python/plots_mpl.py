@@ -4,8 +4,20 @@ import matplotlib.pyplot as plt
 from math import sqrt
 
 
+def point_values(V):
+    """Power density or flux as [[[x, y, z], value], ...] from either output format:
+    lists, or an sr.array (or numpy array) of [x, y, z, value] rows"""
+
+    if hasattr(V, 'tolist'):
+        V = V.tolist()
+
+    return [item if len(item) == 2 else [item[0:3], item[3]] for item in V]
+
+
 def write_power_density_csv (P, fileName) :
 
+    P = point_values(P)
+
     x = []
     y = []
     z = []
@@ -42,6 +54,8 @@ def write_power_density_csv (P, fileName) :
 def add_power_densities(A, B):
     """Add two power density lists assuming same mesh order"""
     
+    A = point_values(A)
+    B = point_values(B)
     new_list = []
     
     for i in range(len(A)):
@@ -160,6 +174,7 @@ def plot_trajectory_velocity(trajectory, show=True, ofile='', ret=False):
 def plot_power_density(V, title='Power Density [$W / mm^2$]', xlabel='X1 Axis [$m$]', ylabel='X2 Axis [$m$]', show=True, ofile='', figsize=None, ret=False):
     """Plot a 2D histogram with equal spacing"""
         
+    V = point_values(V)
     X = [item[0][0] for item in V]
     Y = [item[0][1] for item in V]
     P = [item[1]    for item in V]
@@ -197,6 +212,7 @@ def plot_power_density(V, title='Power Density [$W / mm^2$]', xlabel='X1 Axis [$
 def plot_flux(V, title='Flux [$\gamma / mm^2 / 0.1\%bw / s]$', xlabel='X1 Axis [$m$]', ylabel='X2 Axis [$m$]', show=True, ofile='', figsize=None, ylim=None, xlim=None, colorbar=True, ret=False):
     """Plot a 2D histogram with equal spacing"""
         
+    V = point_values(V)
     X = [item[0][0] for item in V]
     Y = [item[0][1] for item in V]
     P = [item[1]    for item in V]
@@ -476,6 +492,7 @@ def total_power(pd):
     
     This will not work for a non-uniform grid.  Different NX and NY are ok."""
     
+    pd = point_values(pd)
     X = [item[0][0] for item in pd]
     Y = [item[0][1] for item in pd]
     P = [item[1]    for item in pd]
@@ -494,6 +511,10 @@ def total_power(pd):
 def plot_electric_field_vs_time(efield, show=True, ofile='', ret=False):
     """Plot the electric field as a function of time"""
 
+    # An array has [t, Ex, Ey, Ez] rows
+    if hasattr(efield, 'tolist'):
+        efield = [[item[0], item[1:4]] for item in efield.tolist()]
+
     T  = [item[0]    for item in efield]
     Ex = [item[1][0] for item in efield]
     Ey = [item[1][1] for item in efield]
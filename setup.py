@@ -10,12 +10,19 @@ moduleOSCARSSR = Extension('oscars.sr',
                       sources = ['src/OSCARSSR.cc',
                                  'src/OSCARSSR_Python.cc',
                                  'src/T3DScalarContainer.cc',
+                                 'src/T3DScalarTree.cc',
+                                 'src/TField.cc',
                                  'src/TField3D_Grid.cc',
+                                 'src/TField3D_GridFamily.cc',
+                                 'src/TField3D_Fourier.cc',
                                  'src/TField3D_Gaussian.cc',
                                  'src/TFieldContainer.cc',
                                  'src/TField3D_IdealUndulator.cc',
                                  'src/TField3D_UniformBox.cc',
                                  'src/TFieldPythonFunction.cc',
+                                 'src/TMappedFile.cc',
+                                 'src/TMatrix3D.cc',
+                                 'src/TNUFFT.cc',
                                  'src/TParticleA.cc',
                                  'src/TParticleBeam.cc',
                                  'src/TParticleBeamContainer.cc',
@@ -24,8 +31,14 @@ moduleOSCARSSR = Extension('oscars.sr',
                                  'src/TSpectrumContainer.cc',
                                  'src/TSurfaceOfPoints.cc',
                                  'src/TSurfacePoint.cc',
+                                 'src/TSurfacePoints.cc',
+                                 'src/TSurfacePointsTree.cc',
                                  'src/TSurfacePoints_3D.cc',
+                                 'src/TSurfacePoints_View.cc',
                                  'src/TSurfacePoints_Rectangle.cc',
+                                 'src/TSurfacePoints_Parametric.cc',
+                                 'src/TSurfacePoints_Mesh.cc',
+                                 'src/TTriangleBVH.cc',
                                  'src/TVector2D.cc',
                                  'src/TVector3D.cc',
                                  'src/TVector3DC.cc',
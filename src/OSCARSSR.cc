@@ -14,11 +14,17 @@
 #include <sstream>
 #include <thread>
 #include <algorithm>
+#include <atomic>
 
 #include "TVector3DC.h"
 #include "TField3D_Grid.h"
+#include "TField3D_GridFamily.h"
 #include "TSpectrumContainer.h"
 #include "TSurfacePoints_Rectangle.h"
+#include "TSurfacePoints_3D.h"
+#include "TSurfacePointsTree.h"
+#include "TNUFFT.h"
+#include "TRadiationKernel.h"
 
 
 
@@ -65,7 +71,7 @@ std::string OSCARSSR::GetVersionString ()
 
 
 
-void OSCARSSR::AddMagneticField (std::string const FileName, std::string const Format, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling)
+void OSCARSSR::AddMagneticField (std::string const FileName, std::string const Format, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling, std::string const& Interpolation, bool const Shared, TVector3D const& ExtractMin, TVector3D const& ExtractMax, std::string const& Storage, TVector3D const& MirrorX, TVector3D const& MirrorY, TVector3D const& MirrorZ)
 {
   // Add a magnetic field from a file to the field container
 
@@ -73,16 +79,29 @@ void OSCARSSR::AddMagneticField (std::string const FileName, std::string const F
   std::string FormatUpperCase = Format;
   std::transform(FormatUpperCase.begin(), FormatUpperCase.end(), FormatUpperCase.begin(), ::toupper);
 
-  if (FormatUpperCase == "OSCARS" || FormatUpperCase == "SRW" || FormatUpperCase == "SPECTRA") {
-    this->fBFieldContainer.AddField( new TField3D_Grid(FileName, Format, Rotations, Translation, Scaling) );
+  // Interpolation between grid points and how the data is stored
+  TField3D_Grid::TField3D_Grid_Interpolation const Interp = TField3D_Grid::GetInterpolation(Interpolation);
+  TField3D_Grid::TField3D_Grid_Storage const Store = TField3D_Grid::GetStorage(Storage);
+
+  TField3D_Grid* Grid = 0x0;
+  if (FormatUpperCase == "OSCARS" || FormatUpperCase == "SRW" || FormatUpperCase == "SPECTRA" || FormatUpperCase == "OSCARSBIN") {
+    Grid = new TField3D_Grid(FileName, Format, Rotations, Translation, Scaling, '#', Interp, Shared, ExtractMin, ExtractMax);
   } else if (FormatUpperCase.size() > 8 && std::string(FormatUpperCase.begin(), FormatUpperCase.begin() + 8) == std::string("OSCARS1D")) {
 
-    this->fBFieldContainer.AddField( new TField3D_Grid(FileName, Format, Rotations, Translation, Scaling) );
+    Grid = new TField3D_Grid(FileName, Format, Rotations, Translation, Scaling, '#', Interp, Shared, ExtractMin, ExtractMax);
 
   } else {
     throw std::invalid_argument("Incorrect format in format string");
   }
 
+  try {
+    Grid->SetStorage(Store, MirrorX, MirrorY, MirrorZ);
+  } catch (...) {
+    delete Grid;
+    throw;
+  }
+  this->fBFieldContainer.AddField(Grid);
+
   // Set the derivs function accordingly
   this->SetDerivativesFunction();
 
@@ -91,18 +110,22 @@ void OSCARSSR::AddMagneticField (std::string const FileName, std::string const F
 
 
 
-void OSCARSSR::AddMagneticFieldInterpolated (std::vector<std::pair<double, std::string> > const& Mapping, std::string const Format, double const Parameter, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling)
+void OSCARSSR::AddMagneticFieldInterpolated (std::vector<std::pair<double, std::string> > const& Mapping, std::string const Format, double const Parameter, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling, std::string const& Interpolation, bool const Lazy)
 {
-  // Add a magnetic field from a file to the field container
+  // Add a family of magnetic field maps interpolated at Parameter.  All maps are kept
+  // in memory so the parameter can be changed later with SetMagneticFieldParameter()
 
   // Format string all upper-case (just in case you like to type L.C.).
   std::string FormatUpperCase = Format;
   std::transform(FormatUpperCase.begin(), FormatUpperCase.end(), FormatUpperCase.begin(), ::toupper);
 
-  if (FormatUpperCase == "OSCARS" || FormatUpperCase == "SRW" || FormatUpperCase == "SPECTRA") {
-    this->fBFieldContainer.AddField( new TField3D_Grid(Mapping, Format, Parameter, Rotations, Translation, Scaling) );
-  } else if (FormatUpperCase.size() > 8 && std::string(FormatUpperCase.begin(), FormatUpperCase.begin() + 8) == std::string("OSCARSSR")) {
-    this->fBFieldContainer.AddField( new TField3D_Grid(Mapping, Format, Parameter, Rotations, Translation, Scaling) );
+  // Interpolation between grid points
+  TField3D_Grid::TField3D_Grid_Interpolation const Interp = TField3D_Grid::GetInterpolation(Interpolation);
+
+  if (FormatUpperCase == "OSCARS" || FormatUpperCase == "SRW" || FormatUpperCase == "SPECTRA" || FormatUpperCase == "OSCARSBIN") {
+    this->fBFieldContainer.AddField( new TField3D_GridFamily(Mapping, Format, Parameter, Rotations, Translation, Scaling, '#', Interp, Lazy) );
+  } else if (FormatUpperCase.size() > 8 && std::string(FormatUpperCase.begin(), FormatUpperCase.begin() + 8) == std::string("OSCARS1D")) {
+    this->fBFieldContainer.AddField( new TField3D_GridFamily(Mapping, Format, Parameter, Rotations, Translation, Scaling, '#', Interp, Lazy) );
   } else {
     throw std::invalid_argument("Incorrect format in format string");
   }
@@ -116,6 +139,29 @@ void OSCARSSR::AddMagneticFieldInterpolated (std::vector<std::pair<double, std::
 
 
 
+void OSCARSSR::SetMagneticFieldParameter (double const Parameter)
+{
+  // Move every interpolated magnetic field family to a new parameter value (gap, phase, ..)
+
+  int NFamilies = 0;
+  for (size_t i = 0; i != fBFieldContainer.GetNFields(); ++i) {
+    TField3D_GridFamily* Family = dynamic_cast<TField3D_GridFamily*>(fBFieldContainer.GetField(i));
+    if (Family != 0x0) {
+      Family->SetParameter(Parameter);
+      ++NFamilies;
+    }
+  }
+
+  if (NFamilies == 0) {
+    throw std::invalid_argument("no interpolated magnetic fields to set parameter for");
+  }
+
+  return;
+}
+
+
+
+
 void OSCARSSR::AddMagneticField (TField* Field)
 {
   // Add a magnetic field from a file to the field container
@@ -194,15 +240,34 @@ TVector3D OSCARSSR::GetB (TVector3D const& X) const
 
 
 
+void OSCARSSR::GetBBatch (std::vector<TVector3D> const& X, std::vector<TVector3D>& B) const
+{
+  // Fill B with the summed field from container at every point in X
+  this->fBFieldContainer.GetFBatch(X, B);
+  return;
+}
+
+
+
+
+
 
 
 
 
 
-void OSCARSSR::AddElectricField (std::string const FileName, std::string const Format, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling)
+void OSCARSSR::AddElectricField (std::string const FileName, std::string const Format, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling, std::string const& Interpolation, bool const Shared, TVector3D const& ExtractMin, TVector3D const& ExtractMax, std::string const& Storage, TVector3D const& MirrorX, TVector3D const& MirrorY, TVector3D const& MirrorZ)
 {
   // Add a electric field from a file to the field container
-  this->fEFieldContainer.AddField( new TField3D_Grid(FileName, Format, Rotations, Translation) );
+  TField3D_Grid::TField3D_Grid_Storage const Store = TField3D_Grid::GetStorage(Storage);
+  TField3D_Grid* Grid = new TField3D_Grid(FileName, Format, Rotations, Translation, Scaling, '#', TField3D_Grid::GetInterpolation(Interpolation), Shared, ExtractMin, ExtractMax);
+  try {
+    Grid->SetStorage(Store, MirrorX, MirrorY, MirrorZ);
+  } catch (...) {
+    delete Grid;
+    throw;
+  }
+  this->fEFieldContainer.AddField(Grid);
 
   // Set the derivs function accordingly
   this->SetDerivativesFunction();
@@ -302,6 +367,17 @@ TVector3D OSCARSSR::GetE (TVector3D const& X) const
 
 
 
+void OSCARSSR::GetEBatch (std::vector<TVector3D> const& X, std::vector<TVector3D>& E) const
+{
+  // Fill E with the summed field from container at every point in X
+  this->fEFieldContainer.GetFBatch(X, E);
+  return;
+}
+
+
+
+
+
 
 
 
@@ -360,6 +436,52 @@ size_t OSCARSSR::GetNParticleBeams () const
 
 
 
+void OSCARSSR::GetBeamCorridor (double const Margin, TVector3D& Min, TVector3D& Max)
+{
+  // Box around the straight beam axis of every beam, with Margin added on all sides.  If
+  // ctstart and ctstop are set the axis runs between them, otherwise it has no end and the
+  // box is unbounded along every axis the beam direction has a component in.
+
+  if (fParticleBeamContainer.GetNParticleBeams() == 0) {
+    throw std::out_of_range("no particle beam defined for the corridor");
+  }
+
+  double const Unbounded = 1e100;
+  bool const HasCT = fCTStart != fCTStop;
+
+  for (size_t ib = 0; ib != fParticleBeamContainer.GetNParticleBeams(); ++ib) {
+    TParticleBeam& Beam = fParticleBeamContainer.GetParticleBeam(ib);
+    TVector3D const U = Beam.GetU0().UnitVector();
+
+    TVector3D BeamMin;
+    TVector3D BeamMax;
+    for (int d = 0; d != 3; ++d) {
+      if (HasCT) {
+        double const A = Beam.GetX0()[d] + U[d] * (fCTStart - Beam.GetT0());
+        double const B = Beam.GetX0()[d] + U[d] * (fCTStop  - Beam.GetT0());
+        BeamMin[d] = std::min(A, B) - Margin;
+        BeamMax[d] = std::max(A, B) + Margin;
+      } else if (std::fabs(U[d]) > 1e-12) {
+        BeamMin[d] = -Unbounded;
+        BeamMax[d] =  Unbounded;
+      } else {
+        BeamMin[d] = Beam.GetX0()[d] - Margin;
+        BeamMax[d] = Beam.GetX0()[d] + Margin;
+      }
+    }
+
+    for (int d = 0; d != 3; ++d) {
+      Min[d] = ib == 0 ? BeamMin[d] : std::min(Min[d], BeamMin[d]);
+      Max[d] = ib == 0 ? BeamMax[d] : std::max(Max[d], BeamMax[d]);
+    }
+  }
+
+  return;
+}
+
+
+
+
 TParticleA OSCARSSR::GetNewParticle ()
 {
   // Get a new particle.  Randomly sampled according to input beam parameters and beam weights
@@ -621,6 +743,9 @@ void OSCARSSR::CalculateTrajectory (TParticleA& P)
   // Set delta T for the trajectory
   ParticleTrajectory.SetDeltaT(DeltaT);
 
+  // Acceleration at the first point, which is added before the first step
+  (this->*fDerivativesFunction)(P.GetT0(), x, dxdt, P);
+
   // Loop over points in the forward direction
   for (int i = 0; i != NPointsForward; ++i) {
 
@@ -689,7 +814,12 @@ TParticleTrajectoryPoints const& OSCARSSR::GetTrajectory ()
 
 void OSCARSSR::SetDerivativesFunction ()
 {
-  // Set the derivatives function for RK4 depending on what fields exist
+  // Set the derivatives function for RK4 depending on what fields exist.  This is
+  // called whenever the fields change, so it is also where the field containers
+  // are compiled for the trajectory calculation
+
+  fBFieldContainer.Compile();
+  fEFieldContainer.Compile();
 
   if (fBFieldContainer.GetNFields() == 0 && fEFieldContainer.GetNFields() > 0) {
     fDerivativesFunction = &OSCARSSR::DerivativesE;
@@ -986,11 +1116,11 @@ void OSCARSSR::CalculateSpectrum (TVector3D const& ObservationPoint, TSpectrumCo
 
 
 
-void OSCARSSR::CalculateSpectrumPoint (TParticleA& Particle, TVector3D const& ObservationPoint, TSpectrumContainer& Spectrum, int const i, double const Weight)
+double OSCARSSR::CalculateSpectrumPoint (TParticleA& Particle, TVector3D const& ObservationPoint, TSpectrumContainer const& Spectrum, int const i, double const Weight)
 {
   // Calculates the single particle spectrum at a given observation point
   // in units of [photons / second / 0.001% BW / mm^2]
-  // Save this in the spectrum container.
+  // for point i of the spectrum container, which is not changed.
   //
   // Particle - the Particle.. with a Trajectory structure hopefully
   // ObservationPoint - Observation Point
@@ -1024,56 +1154,21 @@ void OSCARSSR::CalculateSpectrumPoint (TParticleA& Particle, TVector3D const& Ob
   // Constant for flux calculation at the end
   double const C2 = TOSCARSSR::FourPi() * Particle.GetCurrent() / (TOSCARSSR::H() * fabs(Particle.GetQ()) * TOSCARSSR::Mu0() * TOSCARSSR::C()) * 1e-6 * 0.001;
 
-  // Imaginary "i" and complxe 1+0i
-  std::complex<double> const I(0, 1);
-  std::complex<double> const One(1, 0);
 
   // Angular frequency
   double const Omega = Spectrum.GetAngularFrequency(i);
 
-  // Constant for field calculation
-  std::complex<double> ICoverOmega = I * TOSCARSSR::C() / Omega;
-
   // Constant for calculation
   std::complex<double> const C1(0, C0 * Omega);
 
   // Electric field summation in frequency space
-  TVector3DC SumE(0, 0, 0);
-
-  // Loop over all points in trajectory
-  for (int iT = 0; iT != NTPoints; ++iT) {
-
-    // Particle position
-    TVector3D const& X = T.GetX(iT);
-
-    // Particle "Beta" (velocity over speed of light)
-    TVector3D const& B = T.GetB(iT);
-
-    // Vector pointing from particle to observer
-    TVector3D const R = ObservationPoint - X;
-
-    // Unit vector pointing from particl to observer
-    TVector3D const N = R.UnitVector();
-
-    // Distance from particle to observer
-    double const D = R.Mag();
-
-    // Exponent for fourier transformed field
-    std::complex<double> Exponent(0, Omega * (DeltaT * iT + D / TOSCARSSR::C()));
-
-    // Sum in fourier transformed field (integral)
-    SumE += (TVector3DC(B) - (N * ( One + (ICoverOmega / (D))))) / D * std::exp(Exponent);
-  }
+  TVector3DC SumE = TRadiationKernel::FieldSum<TRadiationKernel::TFieldBeta>(T, ObservationPoint, Omega);
 
   // Multiply field by Constant C1 and time step
   SumE *= C1 * DeltaT;
 
-  // Set the flux for this frequency / energy point
-  Spectrum.AddToFlux(i, C2 *  SumE.Dot( SumE.CC() ).real() * Weight);
-
-
-
-  return;
+  // The flux for this frequency / energy point
+  return C2 *  SumE.Dot( SumE.CC() ).real() * Weight;
 }
 
 
@@ -1100,36 +1195,14 @@ void OSCARSSR::CalculateSpectrumThreads (TParticleA& Particle, TVector3D const&
   this->CalculateTrajectory(Particle);
 
   // Check if NThreads is overriding the default nthreads
-  size_t const NThreadsToUse = (size_t) NThreads > 0 ? NThreads : fNThreadsGlobal;
-
-  // Calculate the trajectory from scratch
-  this->CalculateTrajectory(Particle);
-
-  // Vector container for threads
-  std::vector<std::thread> Threads;
-
-  // Number of points in spectrum
-  size_t const NPoints = Spectrum.GetNPoints();
-
-  // How many threads to start in the first for loop
-  size_t const NFirst = NPoints > NThreadsToUse ? NThreadsToUse : NPoints;
-
-  // Start threads and keep in vector
-  for (size_t io = 0; io != NFirst; ++io) {
-    Threads.push_back(std::thread(&OSCARSSR::CalculateSpectrumPoint, this, std::ref(Particle), std::ref(Obs), std::ref(Spectrum), io, Weight));
-  }
-
-  // Look for threads that end in order, once joined replace with a new thread if we're not yet at the end
-  for (size_t io = NFirst; io != NPoints + NFirst; ++io) {
-    size_t const it = io % NFirst;
-    Threads[it].join();
-    if (io < NPoints) {
-      Threads[it] = std::thread(&OSCARSSR::CalculateSpectrumPoint, this, std::ref(Particle), std::ref(Obs), std::ref(Spectrum), (int) io, Weight);
-    }
-  }
+  int const NThreadsToUse = NThreads > 0 ? NThreads : fNThreadsGlobal;
 
-  // Clear all threads
-  Threads.clear();
+  // Flux at each point, then added to the spectrum in order
+  std::vector<double> Flux;
+  this->EvaluateOnThreads(Spectrum.GetNPoints(), NThreadsToUse, [&] (size_t const i) {
+    return this->CalculateSpectrumPoint(Particle, Obs, Spectrum, (int) i, Weight);
+  }, Flux);
+  Spectrum.AddToFlux(Flux);
 
   return;
 }
@@ -1193,9 +1266,6 @@ void OSCARSSR::CalculateSpectrum (TParticleA& Particle, TVector3D const& Observa
   // Constant for flux calculation at the end
   double const C2 = TOSCARSSR::FourPi() * Particle.GetCurrent() / (TOSCARSSR::H() * fabs(Particle.GetQ()) * TOSCARSSR::Mu0() * TOSCARSSR::C()) * 1e-6 * 0.001;
 
-  // Imaginary "i" and complxe 1+0i
-  std::complex<double> const I(0, 1);
-  std::complex<double> const One(1, 0);
 
 
   // Loop over all points in the spectrum container
@@ -1204,39 +1274,11 @@ void OSCARSSR::CalculateSpectrum (TParticleA& Particle, TVector3D const& Observa
     // Angular frequency
     double const Omega = Spectrum.GetAngularFrequency(i);
 
-    // Constant for field calculation
-    std::complex<double> ICoverOmega = I * TOSCARSSR::C() / Omega;
-
     // Constant for calculation
     std::complex<double> const C1(0, C0 * Omega);
 
     // Electric field summation in frequency space
-    TVector3DC SumE(0, 0, 0);
-
-    // Loop over all points in trajectory
-    for (int iT = 0; iT != NTPoints; ++iT) {
-
-      // Particle position
-      TVector3D const& X = T.GetX(iT);
-
-      // Particle "Beta" (velocity over speed of light)
-      TVector3D const& B = T.GetB(iT);
-
-      // Vector pointing from particle to observer
-      TVector3D const R = ObservationPoint - X;
-
-      // Unit vector pointing from particl to observer
-      TVector3D const N = R.UnitVector();
-
-      // Distance from particle to observer
-      double const D = R.Mag();
-
-      // Exponent for fourier transformed field
-      std::complex<double> Exponent(0, Omega * (DeltaT * iT + D / TOSCARSSR::C()));
-
-      // Sum in fourier transformed field (integral)
-      SumE += (TVector3DC(B) - (N * ( One + (ICoverOmega / (D))))) / D * std::exp(Exponent);
-    }
+    TVector3DC SumE = TRadiationKernel::FieldSum<TRadiationKernel::TFieldBeta>(T, ObservationPoint, Omega);
 
     // Multiply field by Constant C1 and time step
     SumE *= C1 * DeltaT;
@@ -1482,6 +1524,9 @@ void OSCARSSR::CalculatePowerDensity (TParticleA& Particle, TSurfacePoints const
   // Particle - Particle, contains trajectory (or if not, calculate it)
   // Surface - Observation Point
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
 
   // Check that particle has been set yet.  If fType is "" it has not been set yet
   if (Particle.GetType() == "") {
@@ -1497,15 +1542,15 @@ void OSCARSSR::CalculatePowerDensity (TParticleA& Particle, TSurfacePoints const
   // Grab the Trajectory
   TParticleTrajectoryPoints& T = Particle.GetTrajectory();
 
-  // Number of points in Trajectory
-  size_t const NTPoints = T.GetNPoints();
-
   // Timestep from trajectory
   double const DeltaT = T.GetDeltaT();
 
-  // Variables for parts of the numerator and denominator of power density equation
-  TVector3D Numerator;
-  double Denominator;
+  if (Dimension != 2 && Dimension != 3) {
+    throw std::out_of_range("incorrect dimensions");
+  }
+
+  // Every trajectory point is seen
+  TRadiationKernel::TVisibleAll Visible;
 
   // If writing to a file, open it and set to scientific output
   std::ofstream of;
@@ -1519,45 +1564,15 @@ void OSCARSSR::CalculatePowerDensity (TParticleA& Particle, TSurfacePoints const
   //std::cout << "Directional: " << Directional << std::endl;
 
   // Loop over all points in the given surface
-  for (size_t io = 0; io < Surface.GetNPoints(); ++io) {
+  for (size_t io = 0; io < S.NPoints; ++io) {
 
     // Get the observation point (on the surface, and its "normal"
-    TVector3D Obs = Surface.GetPoint(io).GetPoint();
-    TVector3D Normal = Surface.GetPoint(io).GetNormal();
-
-
-    // For summing power contributions
-    double Sum = 0;
-
-    // Loop over all points in the trajectory
-    for (int iT = 0; iT != NTPoints ; ++iT) {
+    TVector3D Obs(S.X[io], S.Y[io], S.Z[io]);
+    TVector3D Normal(S.NX[io], S.NY[io], S.NZ[io]);
 
-      // Get current position, Beta, and Acceleration(over c)
-      TVector3D const& X = T.GetX(iT);
-      TVector3D const& B = T.GetB(iT);
-      TVector3D const& AoverC = T.GetAoverC(iT);
 
-      // Define the three normal vectors.  N1 is in the direction of propogation,
-      // N2 and N3 are in a plane perpendicular to N1
-      TVector3D const N1 = (Obs - X).UnitVector();
-      TVector3D const N2 = N1.Orthogonal().UnitVector();
-      TVector3D const N3 = N1.Cross(N2).UnitVector();
-
-      // For computing non-normally incidence
-      double const N1DotNormal = N1.Dot(Normal);
-      // UPDATE: URGENT: Check this
-      if (Directional && N1DotNormal <= 0) {
-        continue;
-      }
-
-      // Compute Numerator and denominator
-      Numerator = N1.Cross( ( (N1 - B).Cross((AoverC)) ) );
-      Denominator = pow(1 - (B).Dot(N1), 5);
-
-      // Add contributions from both N2 and N3
-      Sum += pow(Numerator.Dot(N2), 2) / Denominator / (Obs - X).Mag2() * N1DotNormal;
-      Sum += pow(Numerator.Dot(N3), 2) / Denominator / (Obs - X).Mag2() * N1DotNormal;
-    }
+    // Sum of power contributions over the trajectory
+    double Sum = Directional ? TRadiationKernel::PowerDensitySum<true>(T, Obs, Normal, Visible) : TRadiationKernel::PowerDensitySum<false>(T, Obs, Normal, Visible);
 
     // Undulators, Wigglers and their applications, p42
     Sum *= fabs(Particle.GetQ() * Particle.GetCurrent()) / (16 * TOSCARSSR::Pi2() * TOSCARSSR::Epsilon0() * TOSCARSSR::C()) * DeltaT;
@@ -1572,20 +1587,12 @@ void OSCARSSR::CalculatePowerDensity (TParticleA& Particle, TSurfacePoints const
       }
     }
 
-    if (Dimension == 2) {
-      if (WriteToFile) {
-        of << Surface.GetX1(io) << " " << Surface.GetX2(io) << " " << Sum << "\n";
-      } else {
-        PowerDensityContainer.AddToPoint(io, Sum);
-      }
-    } else if (Dimension == 3) {
-      if (WriteToFile) {
-        of << Obs.GetX() << " " << Obs.GetY() << " " << Obs.GetZ() << " " << Sum << "\n";
-      } else {
-        PowerDensityContainer.AddToPoint(io, Sum);
-      }
+    if (!WriteToFile) {
+      PowerDensityContainer.AddToPoint(io, Sum * Weight);
+    } else if (Dimension == 2) {
+      of << S.X1[io] << " " << S.X2[io] << " " << Sum * Weight << "\n";
     } else {
-      throw std::out_of_range("incorrect dimensions");
+      of << Obs.GetX() << " " << Obs.GetY() << " " << Obs.GetZ() << " " << Sum * Weight << "\n";
     }
 
   }
@@ -1600,13 +1607,21 @@ void OSCARSSR::CalculatePowerDensity (TParticleA& Particle, TSurfacePoints const
 
 
 
-void OSCARSSR::CalculatePowerDensity (TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, int const Dimension, bool const Directional, int const NParticles, std::string const& OutFileName, int const NThreads, int const GPU)
+void OSCARSSR::CalculatePowerDensity (TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, int const Dimension, bool const Directional, int const NParticles, std::string const& OutFileName, int const NThreads, int const GPU, double const FarField, TTriangleBVH const* Occluders)
 {
   // Calculates the power density
   // in units of [W / mm^2]
   //
+  // FarField  - If > 0 the far field is approximated to this precision on the CPU, see
+  //             CalculatePowerDensityFarField
+  // Occluders - If given, radiation blocked by these triangles on its way to a point does
+  //             not count, on the CPU.  See CalculatePowerDensityOccluded
+  //
   // UPDATE: inputs
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
   // How many threads to use.
   int const NThreadsToUse = NThreads < 1 ? fNThreadsGlobal : NThreads;
   if (NThreadsToUse <= 0) {
@@ -1614,6 +1629,9 @@ void OSCARSSR::CalculatePowerDensity (TSurfacePoints const& Surface, T3DScalarCo
     throw;
   }
 
+  if (Occluders != 0x0 && FarField > 0) {
+    throw std::invalid_argument("occlusion and the far field approximation cannot be used together");
+  }
 
 
   // Check that particle has been set yet.  If fType is "" it has not been set yet
@@ -1626,12 +1644,12 @@ void OSCARSSR::CalculatePowerDensity (TSurfacePoints const& Surface, T3DScalarCo
   }
 
   if (Dimension == 3) {
-    for (int i = 0; i != Surface.GetNPoints(); ++i) {
-      PowerDensityContainer.AddPoint(Surface.GetPoint(i).GetPoint(), 0);
+    for (int i = 0; i != S.NPoints; ++i) {
+      PowerDensityContainer.AddPoint(TVector3D(S.X[i], S.Y[i], S.Z[i]), 0);
     }
   } else if (Dimension == 2) {
-    for (int i = 0; i != Surface.GetNPoints(); ++i) {
-      PowerDensityContainer.AddPoint( TVector3D(Surface.GetX1(i), Surface.GetX2(i), 0), 0);
+    for (int i = 0; i != S.NPoints; ++i) {
+      PowerDensityContainer.AddPoint( TVector3D(S.X1[i], S.X2[i], 0), 0);
     }
   } else {
     std::cerr << "Wrong dimension" << std::endl;
@@ -1644,7 +1662,11 @@ void OSCARSSR::CalculatePowerDensity (TSurfacePoints const& Surface, T3DScalarCo
   // GPU will outrank NThreads...
   if (NParticles == 0) {
     if (GPU == 0) {
-      if (NThreadsToUse == 1) {
+      if (Occluders != 0x0) {
+        this->CalculatePowerDensityOccluded(fParticle, Surface, PowerDensityContainer, *Occluders, Directional, 1, NThreadsToUse);
+      } else if (FarField > 0) {
+        this->CalculatePowerDensityFarField(fParticle, Surface, PowerDensityContainer, FarField, Directional, 1);
+      } else if (NThreadsToUse == 1) {
         this->CalculatePowerDensity(fParticle, Surface, PowerDensityContainer, Dimension, Directional, 1, BlankOutFileName);
       } else {
         this->CalculatePowerDensityThreads(fParticle, Surface, PowerDensityContainer, NThreadsToUse, Dimension, Directional, 1, BlankOutFileName);
@@ -1657,7 +1679,11 @@ void OSCARSSR::CalculatePowerDensity (TSurfacePoints const& Surface, T3DScalarCo
     for (int i = 0; i != NParticles; ++i) {
       this->SetNewParticle();
       if (GPU == 0) {
-        if (NThreadsToUse == 1) {
+        if (Occluders != 0x0) {
+          this->CalculatePowerDensityOccluded(fParticle, Surface, PowerDensityContainer, *Occluders, Directional, Weight, NThreadsToUse);
+        } else if (FarField > 0) {
+          this->CalculatePowerDensityFarField(fParticle, Surface, PowerDensityContainer, FarField, Directional, Weight);
+        } else if (NThreadsToUse == 1) {
           this->CalculatePowerDensity(fParticle, Surface, PowerDensityContainer, Dimension, Directional, Weight, BlankOutFileName);
         } else {
           this->CalculatePowerDensityThreads(fParticle, Surface, PowerDensityContainer,  NThreadsToUse, Dimension, Directional, Weight, BlankOutFileName);
@@ -1679,103 +1705,109 @@ void OSCARSSR::CalculatePowerDensity (TSurfacePoints const& Surface, T3DScalarCo
 
 
 
+void OSCARSSR::CalculatePowerDensityAdaptive (TSurfacePoints const& Surface, T3DScalarTree& Tree, double const Tolerance, int const MaxLevel, bool const Directional, int const NParticles, int const NThreads, int const GPU, TTriangleBVH const* Occluders)
+{
+  // Power density [W / mm^2] on a rectangle or mesh, evaluated where the tree needs it.
+  // Each level of refinement is one call of the usual calculation for all new points.
+  // With Occluders the edges of shadows are refined as well.
 
+  Tree.Refine(Surface, [&] (TSurfacePoints const& Points, std::vector<double>& Values) {
+    T3DScalarContainer Container;
+    this->CalculatePowerDensity(Points, Container, 3, Directional, NParticles, "", NThreads, GPU, 0, Occluders);
 
+    Values.resize(Points.GetNPoints());
+    for (size_t i = 0; i != Values.size(); ++i) {
+      Values[i] = Container.GetPoint(i).GetV();
+    }
+  }, Tolerance, MaxLevel);
 
+  return;
+}
 
 
-void OSCARSSR::CalculatePowerDensityPoint (TParticleA& Particle, TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, size_t const io, int const Dimension, bool const Directional, double const Weight)
-{
-  // Calculates the single particle spectrum at a given observation point
-  // in units of [photons / second / 0.001% BW / mm^2]
-  //
-  // Particle - Particle, contains trajectory (or if not, calculate it)
-  // Surface - Observation Point
 
 
-  // Check that particle has been set yet.  If fType is "" it has not been set yet
-  if (Particle.GetType() == "") {
-    throw std::out_of_range("no particle defined");
+void OSCARSSR::CalculatePowerDensityMirror (TSurfacePoints_Rectangle const& Surface, T3DScalarContainer& PowerDensityContainer, int const Dimension, bool const Directional, int const NParticles, std::string const& OutFileName, int const NThreads, int const GPU)
+{
+  // Power density [W / mm^2] on a rectangle, calculated only on the part of it not given
+  // by a mirror symmetry (see GetMirrorSymmetry).  Random particles of a beam break the
+  // symmetry, so with NParticles every point is calculated.
+
+  int const Symmetry = NParticles == 0 ? this->GetMirrorSymmetry(Surface) : 0;
+  if (Symmetry == 0) {
+    this->CalculatePowerDensity(Surface, PowerDensityContainer, Dimension, Directional, NParticles, OutFileName, NThreads, GPU);
+    return;
   }
 
+  this->CalculateMirror(Surface, Symmetry, [&] (TSurfacePoints const& Points, std::vector<double>& Values) {
+    T3DScalarContainer Container;
+    this->CalculatePowerDensity(Points, Container, 3, Directional, 0, "", NThreads, GPU);
+
+    Values.resize(Points.GetNPoints());
+    for (size_t i = 0; i != Values.size(); ++i) {
+      Values[i] = Container.GetPoint(i).GetV();
+    }
+  }, PowerDensityContainer, Dimension, OutFileName);
+
+  return;
+}
 
-  // Grab the Trajectory
-  TParticleTrajectoryPoints& T = Particle.GetTrajectory();
 
-  // Number of points in Trajectory
-  size_t const NTPoints = T.GetNPoints();
 
-  // Timestep from trajectory
-  double const DeltaT = T.GetDeltaT();
 
-  // Variables for parts of the numerator and denominator of power density equation
-  TVector3D Numerator;
-  double Denominator;
 
-  //std::cout << "Directional: " << Directional << std::endl;
 
 
-  TVector3D const Obs = Surface.GetPoint(io).GetPoint();
-  TVector3D const Normal = Surface.GetPoint(io).GetNormal();
 
 
-    // For summing power contributions
-    double Sum = 0;
+double OSCARSSR::CalculatePowerDensityPoint (TParticleA& Particle, TSurfacePoints const& Surface, size_t const io, bool const Directional, double const Weight)
+{
+  // Calculates the single particle power density at point io of the surface
+  // in units of [W / mm^2]
+  //
+  // Particle - Particle, contains trajectory
+  // Surface - Observation Point
 
-    // Loop over all points in the trajectory
-    for (int iT = 0; iT != NTPoints ; ++iT) {
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
 
-      // Get current position, Beta, and Acceleration(over c)
-      TVector3D const& X = T.GetX(iT);
-      TVector3D const& B = T.GetB(iT);
-      TVector3D const& AoverC = T.GetAoverC(iT);
 
-      // Define the three normal vectors.  N1 is in the direction of propogation,
-      // N2 and N3 are in a plane perpendicular to N1
-      TVector3D const N1 = (Obs - X).UnitVector();
-      TVector3D const N2 = N1.Orthogonal().UnitVector();
-      TVector3D const N3 = N1.Cross(N2).UnitVector();
+  // Check that particle has been set yet.  If fType is "" it has not been set yet
+  if (Particle.GetType() == "") {
+    throw std::out_of_range("no particle defined");
+  }
 
-      // For computing non-normally incidence
-      double const N1DotNormal = N1.Dot(Normal);
-      // UPDATE: URGENT: Check this
-      if (Directional && N1DotNormal <= 0) {
-        continue;
-      }
 
-      // Compute Numerator and denominator
-      Numerator = N1.Cross( ( (N1 - B).Cross((AoverC)) ) );
-      Denominator = pow(1 - (B).Dot(N1), 5);
+  // Grab the Trajectory
+  TParticleTrajectoryPoints& T = Particle.GetTrajectory();
 
-      // Add contributions from both N2 and N3
-      Sum += pow(Numerator.Dot(N2), 2) / Denominator / (Obs - X).Mag2() * N1DotNormal;
-      Sum += pow(Numerator.Dot(N3), 2) / Denominator / (Obs - X).Mag2() * N1DotNormal;
+  // Timestep from trajectory
+  double const DeltaT = T.GetDeltaT();
 
-  }
-    // Undulators, Wigglers and their applications, p42
-    Sum *= fabs(Particle.GetQ() * Particle.GetCurrent()) / (16 * TOSCARSSR::Pi2() * TOSCARSSR::Epsilon0() * TOSCARSSR::C()) * DeltaT;
 
-    Sum /= 1e6; // m^2 to mm^2
+  TVector3D const Obs(S.X[io], S.Y[io], S.Z[io]);
+  TVector3D const Normal(S.NX[io], S.NY[io], S.NZ[io]);
 
-    // If you don't care about the direction of the normal vector
-    // UPDATE: Check
-    if (!Directional) {
-      if (Sum < 0) {
-        Sum *= -1;
-      }
-    }
+  // Every trajectory point is seen
+  TRadiationKernel::TVisibleAll Visible;
 
-    if (Dimension == 2) {
-      PowerDensityContainer.AddToPoint(io, Sum);
-    } else if (Dimension == 3) {
-      PowerDensityContainer.AddToPoint(io, Sum);
-    } else {
-      throw std::out_of_range("incorrect dimensions");
-    }
+  // Sum of power contributions over the trajectory
+  double Sum = Directional ? TRadiationKernel::PowerDensitySum<true>(T, Obs, Normal, Visible) : TRadiationKernel::PowerDensitySum<false>(T, Obs, Normal, Visible);
 
+  // Undulators, Wigglers and their applications, p42
+  Sum *= fabs(Particle.GetQ() * Particle.GetCurrent()) / (16 * TOSCARSSR::Pi2() * TOSCARSSR::Epsilon0() * TOSCARSSR::C()) * DeltaT;
 
+  Sum /= 1e6; // m^2 to mm^2
 
-  return;
+  // If you don't care about the direction of the normal vector
+  // UPDATE: Check
+  if (!Directional) {
+    if (Sum < 0) {
+      Sum *= -1;
+    }
+  }
+
+  return Sum * Weight;
 }
 
 
@@ -1787,11 +1819,14 @@ void OSCARSSR::CalculatePowerDensityPoint (TParticleA& Particle, TSurfacePoints
 
 void OSCARSSR::CalculatePowerDensityThreads (TParticleA& Particle, TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, int const NThreads, int const Dimension, bool const Directional, double const Weight, std::string const& OutFileName)
 {
-  // Calculates the single particle spectrum at a given observation point
-  // in units of [photons / second / 0.001% BW / mm^2]
+  // Calculates the single particle power density on NThreads threads
+  // in units of [W / mm^2], added to the points already in the container
   //
   // Surface - Observation Point
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
   // Check that particle has been set yet.  If fType is "" it has not been set yet
   if (Particle.GetType() == "") {
     try {
@@ -1801,17 +1836,8 @@ void OSCARSSR::CalculatePowerDensityThreads (TParticleA& Particle, TSurfacePoint
     }
   }
 
-  if (Dimension == 3) {
-    for (int i = 0; i != Surface.GetNPoints(); ++i) {
-      PowerDensityContainer.AddPoint(Surface.GetPoint(i).GetPoint(), 0);
-    }
-  } else if (Dimension == 2) {
-    for (int i = 0; i != Surface.GetNPoints(); ++i) {
-      PowerDensityContainer.AddPoint( TVector3D(Surface.GetX1(i), Surface.GetX2(i), 0), 0);
-    }
-  } else {
-    std::cerr << "wrong dimension" << std::endl;
-    throw;
+  if (Dimension != 2 && Dimension != 3) {
+    throw std::out_of_range("incorrect dimensions");
   }
 
   // Check if NThreads is overriding the default nthreads
@@ -1820,30 +1846,12 @@ void OSCARSSR::CalculatePowerDensityThreads (TParticleA& Particle, TSurfacePoint
   // Calculate the trajectory from scratch
   this->CalculateTrajectory(Particle);
 
-  std::vector<std::thread> Threads;
-
-  // Number of points in spectrum
-  size_t const NPoints = Surface.GetNPoints();
-
-  // How many threads to start in the first for loop
-  size_t const NFirst = (size_t) NPoints > NThreadsToUse ? NThreadsToUse : NPoints;
-
-  // Start threads and keep in vector
-  for (size_t io = 0; io != NFirst; ++io) {
-    Threads.push_back(std::thread(&OSCARSSR::CalculatePowerDensityPoint, this, std::ref(Particle), std::ref(Surface), std::ref(PowerDensityContainer), (int) io, Dimension, Directional, Weight));
-  }
-
-  // Look for threads that end in order, once joined replace with a new thread if we're not yet at the end
-  for (size_t io = NFirst; io != NPoints + NFirst; ++io) {
-    size_t const it = io % NFirst;
-    Threads[it].join();
-    if (io < NPoints) {
-      Threads[it] = std::thread(&OSCARSSR::CalculatePowerDensityPoint, this, std::ref(Particle), std::ref(Surface), std::ref(PowerDensityContainer), (int) io, Dimension, Directional, Weight);
-    }
-  }
-
-  // Clear all threads
-  Threads.clear();
+  // Power density at each point, then added to the container in order
+  std::vector<double> PowerDensity;
+  this->EvaluateOnThreads(S.NPoints, NThreadsToUse, [&] (size_t const io) {
+    return this->CalculatePowerDensityPoint(Particle, Surface, io, Directional, Weight);
+  }, PowerDensity);
+  PowerDensityContainer.AddToPoints(PowerDensity);
 
   return;
 }
@@ -1851,63 +1859,317 @@ void OSCARSSR::CalculatePowerDensityThreads (TParticleA& Particle, TSurfacePoint
 
 
 
+void OSCARSSR::CalculatePowerDensityFarField (TParticleA& Particle, TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, double const Precision, bool const Directional, double const Weight)
+{
+  // Power density [W / mm^2] of one particle with the far field approximated.  Patches of
+  // the surface (TSurfacePointsTree) and segments of the trajectory are paired from the
+  // top down.  Where a patch is small compared to its distance from a segment over gamma,
+  // the scale on which the radiation changes, the segment is summed exactly at the
+  // Chebyshev points of the patch and interpolated to its points.  Other pairs are split,
+  // down to leaves summed directly.  The power density is Normal . Sum(g N1), so the
+  // vector Sum(g N1) is what is interpolated.  For the directional power density a pair
+  // is only approximated when all of it faces the same way, from the cone of normals.
+  //
+  // Precision - Patch radius times gamma over distance below which a pair is far.
+  //             Smaller is more accurate, 1 gives about 1e-3 or better, 2 about 1e-2
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
 
-
-
-
-
-void OSCARSSR::CalculatePowerDensityGPU (TParticleA& Particle, TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, int const Dimension, bool const Directional, double const Weight, std::string const& OutFileName)
-{
-  // If you compile for Cuda use the GPU in this function, else throw
+  if (Precision <= 0) {
+    throw std::invalid_argument("far field precision must be > 0");
+  }
 
   // Check that particle has been set yet.  If fType is "" it has not been set yet
   if (Particle.GetType() == "") {
     throw std::out_of_range("no particle defined");
   }
 
-  for (int i = 0; i != Surface.GetNPoints(); ++i) {
-    PowerDensityContainer.AddPoint(Surface.GetPoint(i).GetPoint(), 0);
-  }
-
   // Calculate the trajectory from scratch
   this->CalculateTrajectory(Particle);
+  TParticleTrajectoryPoints& T = Particle.GetTrajectory();
+  size_t const NTPoints = T.GetNPoints();
+  double const DeltaT = T.GetDeltaT();
+  double const Gamma = Particle.GetGamma();
+
+  if (S.NPoints == 0 || NTPoints == 0) {
+    return;
+  }
+
+  // Segments of the trajectory, children are consecutive
+  struct TSegment {
+    size_t    First;
+    size_t    Last;
+    int       Child;
+    TVector3D Center;
+    double    Radius;
+  };
+  std::vector<TSegment> Segments(1);
+  Segments[0].First = 0;
+  Segments[0].Last = NTPoints;
+  for (size_t is = 0; is != Segments.size(); ++is) {
+    TVector3D Lo = T.GetX(Segments[is].First);
+    TVector3D Hi = Lo;
+    for (size_t it = Segments[is].First; it != Segments[is].Last; ++it) {
+      TVector3D const& X = T.GetX(it);
+      Lo.SetXYZ(std::min(Lo.GetX(), X.GetX()), std::min(Lo.GetY(), X.GetY()), std::min(Lo.GetZ(), X.GetZ()));
+      Hi.SetXYZ(std::max(Hi.GetX(), X.GetX()), std::max(Hi.GetY(), X.GetY()), std::max(Hi.GetZ(), X.GetZ()));
+    }
+    Segments[is].Center = Lo;
+    Segments[is].Center += Hi;
+    Segments[is].Center /= 2.;
+    Segments[is].Radius = 0;
+    for (size_t it = Segments[is].First; it != Segments[is].Last; ++it) {
+      Segments[is].Radius = std::max(Segments[is].Radius, (T.GetX(it) - Segments[is].Center).Mag());
+    }
 
-  #ifdef CUDA
-  // Check that the GPU exists
-  if (this->CheckGPU() < 1) {
-    throw std::invalid_argument("You are requesting the GPU, but none were found");
+    Segments[is].Child = -1;
+    if (Segments[is].Last - Segments[is].First > 32) {
+      size_t const Middle = (Segments[is].First + Segments[is].Last) / 2;
+      Segments[is].Child = (int) Segments.size();
+      TSegment Segment;
+      Segment.First = Segments[is].First;
+      Segment.Last = Middle;
+      Segments.push_back(Segment);
+      Segment.First = Middle;
+      Segment.Last = Segments[is].Last;
+      Segments.push_back(Segment);
+    }
   }
 
-  return OSCARSSR_Cuda_CalculatePowerDensityGPU (Particle, Surface, PowerDensityContainer, Dimension, Directional, Weight, OutFileName);
-  #else
-  throw std::invalid_argument("GPU functionality not compiled into this binary distribution");
-  #endif
+  TSurfacePointsTree const Tree(Surface, 32, 8);
 
-  return;
-}
+  // g N1 of one trajectory point at Obs, the power density being Normal . g N1
+  auto Kernel = [&T] (TVector3D const& Obs, size_t const it) {
+    TVector3D const& X = T.GetX(it);
+    TVector3D const& B = T.GetB(it);
+    TVector3D const& AoverC = T.GetAoverC(it);
 
+    TVector3D const R = Obs - X;
+    double const R2 = R.Mag2();
+    TVector3D const N1 = R / sqrt(R2);
 
+    TVector3D const Numerator = N1.Cross( ( (N1 - B).Cross((AoverC)) ) );
+    double const Denominator = pow(1 - (B).Dot(N1), 5);
 
+    return (Numerator.Mag2() / Denominator / R2) * N1;
+  };
 
+  // Sums in the order of the tree, and Sum(g N1) at the Chebyshev points of each patch
+  std::vector<double> Sum(S.NPoints, 0);
+  std::vector<std::vector<TVector3D> > Far(Tree.GetNNodes());
+  std::vector<TVector3D> Points;
 
-void OSCARSSR::CalculatePowerDensityGPU (TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, int const Dimension, bool const Directional, double const Weight, std::string const& OutFileName)
-{
-  // Calculates the single particle spectrum at a given observation point
-  // in units of [photons / second / 0.001% BW / mm^2]
-  //
-  // Surface - Observation Point
+  std::vector<std::pair<int, int> > Pairs(1, std::make_pair(0, 0));
+  while (!Pairs.empty()) {
+    int const ip = Pairs.back().first;
+    int const is = Pairs.back().second;
+    Pairs.pop_back();
 
-  // Check that particle has been set yet.  If fType is "" it has not been set yet
-  if (fParticle.GetType() == "") {
-    try {
-      this->SetNewParticle();
-    } catch (std::exception e) {
-      throw std::out_of_range("no beam defined");
-    }
-  }
+    TSurfacePointsTree::TNode const& P = Tree.GetNode(ip);
+    TSegment const& G = Segments[is];
 
-  this->CalculatePowerDensityGPU(fParticle, Surface, PowerDensityContainer, Dimension, Directional, Weight, OutFileName);
+    TVector3D const D = P.Center - G.Center;
+    double const Distance = D.Mag();
+    double const Gap = Distance - P.Radius - G.Radius;
+
+    // Only worth it for patches with more points than they have Chebyshev points
+    bool IsFar = Gap > 0 && P.Radius * Gamma < Precision * Gap && P.Last - P.First > Tree.GetNInterpolationPoints(ip);
+
+    // Every N1 of the pair is within Alpha of D, every normal within Cone of Axis
+    if (IsFar && Directional) {
+      double const Alpha = asin(std::min(1., (P.Radius + G.Radius) / Distance));
+      double const Angle = P.Cone < TOSCARSSR::Pi() ? acos(std::max(-1., std::min(1., D.Dot(P.Axis) / Distance))) : 0;
+      if (P.Cone < TOSCARSSR::Pi() && Angle - Alpha - P.Cone > TOSCARSSR::PiOver2()) {
+        continue;
+      }
+      IsFar = P.Cone < TOSCARSSR::Pi() && Angle + Alpha + P.Cone < TOSCARSSR::PiOver2();
+    }
+
+    if (IsFar) {
+      Tree.GetInterpolationPoints(ip, Points);
+      Far[ip].resize(Points.size(), TVector3D(0, 0, 0));
+      for (size_t k = 0; k != Points.size(); ++k) {
+        for (size_t it = G.First; it != G.Last; ++it) {
+          Far[ip][k] += Kernel(Points[k], it);
+        }
+      }
+    } else if (P.Child == -1 && G.Child == -1) {
+      for (size_t k = P.First; k != P.Last; ++k) {
+        size_t const io = Tree.GetIndex(k);
+        TVector3D const Obs(S.X[io], S.Y[io], S.Z[io]);
+        TVector3D const Normal(S.NX[io], S.NY[io], S.NZ[io]);
+        for (size_t it = G.First; it != G.Last; ++it) {
+          double const V = Kernel(Obs, it).Dot(Normal);
+          if (Directional && V <= 0) {
+            continue;
+          }
+          Sum[k] += V;
+        }
+      }
+    } else if (P.Child != -1 && (G.Child == -1 || P.Radius * Gamma >= G.Radius)) {
+      Pairs.push_back(std::make_pair(P.Child, is));
+      Pairs.push_back(std::make_pair(P.Child + 1, is));
+    } else {
+      Pairs.push_back(std::make_pair(ip, G.Child));
+      Pairs.push_back(std::make_pair(ip, G.Child + 1));
+    }
+  }
+
+  // Far field of every patch to its points
+  for (size_t ip = 0; ip != Tree.GetNNodes(); ++ip) {
+    if (Far[ip].empty()) {
+      continue;
+    }
+    TSurfacePointsTree::TNode const& P = Tree.GetNode(ip);
+    for (size_t k = P.First; k != P.Last; ++k) {
+      size_t const io = Tree.GetIndex(k);
+      TVector3D const Obs(S.X[io], S.Y[io], S.Z[io]);
+      TVector3D const Normal(S.NX[io], S.NY[io], S.NZ[io]);
+      Sum[k] += Tree.Interpolate(ip, Far[ip], Obs).Dot(Normal);
+    }
+  }
+
+  // Undulators, Wigglers and their applications, p42
+  double const Factor = fabs(Particle.GetQ() * Particle.GetCurrent()) / (16 * TOSCARSSR::Pi2() * TOSCARSSR::Epsilon0() * TOSCARSSR::C()) * DeltaT / 1e6;
+  for (size_t k = 0; k != S.NPoints; ++k) {
+    double V = Sum[k] * Factor;
+    if (!Directional && V < 0) {
+      V *= -1;
+    }
+    PowerDensityContainer.AddToPoint(Tree.GetIndex(k), V * Weight);
+  }
+
+  return;
+}
+
+
+
+
+
+
+
+
+
+
+void OSCARSSR::CalculatePowerDensityOccluded (TParticleA& Particle, TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, TTriangleBVH const& Occluders, bool const Directional, double const Weight, int const NThreads)
+{
+  // Power density [W / mm^2] of one particle where radiation from a point of the trajectory
+  // only counts if the straight line from it to the surface point is not blocked by one
+  // of the triangles in Occluders, for example a mask upstream of an absorber or the
+  // absorber itself.  The line is only tested where the radiation adds something.
+  //
+  // Occluders - Triangles that block, built
+  // NThreads  - Number of threads for the surface points
+
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
+  if (NThreads < 1) {
+    throw std::invalid_argument("number of threads must be at least 1");
+  }
+
+  // Check that particle has been set yet.  If fType is "" it has not been set yet
+  if (Particle.GetType() == "") {
+    throw std::out_of_range("no particle defined");
+  }
+
+  // Calculate the trajectory from scratch
+  this->CalculateTrajectory(Particle);
+  TParticleTrajectoryPoints const& T = Particle.GetTrajectory();
+  double const DeltaT = T.GetDeltaT();
+
+  // Undulators, Wigglers and their applications, p42
+  double const Factor = fabs(Particle.GetQ() * Particle.GetCurrent()) / (16 * TOSCARSSR::Pi2() * TOSCARSSR::Epsilon0() * TOSCARSSR::C()) * DeltaT / 1e6;
+
+  // Power density at each point, then added to the container in order
+  std::vector<double> PowerDensity;
+  this->EvaluateOnThreads(S.NPoints, NThreads, [&] (size_t const io) {
+    TVector3D const Obs(S.X[io], S.Y[io], S.Z[io]);
+    TVector3D const Normal(S.NX[io], S.NY[io], S.NZ[io]);
+
+    // Lines to this point are tested starting from the last triangle that blocked one
+    TRadiationKernel::TVisibleOccluders Visible(Occluders);
+
+    double Sum = Directional ? TRadiationKernel::PowerDensitySum<true>(T, Obs, Normal, Visible) : TRadiationKernel::PowerDensitySum<false>(T, Obs, Normal, Visible);
+
+    Sum *= Factor;
+
+    // If you don't care about the direction of the normal vector
+    if (!Directional && Sum < 0) {
+      Sum *= -1;
+    }
+
+    return Sum * Weight;
+  }, PowerDensity);
+  PowerDensityContainer.AddToPoints(PowerDensity);
+
+  return;
+}
+
+
+
+
+
+
+
+
+
+
+void OSCARSSR::CalculatePowerDensityGPU (TParticleA& Particle, TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, int const Dimension, bool const Directional, double const Weight, std::string const& OutFileName)
+{
+  // If you compile for Cuda use the GPU in this function, else throw
+
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
+  // Check that particle has been set yet.  If fType is "" it has not been set yet
+  if (Particle.GetType() == "") {
+    throw std::out_of_range("no particle defined");
+  }
+
+  for (int i = 0; i != S.NPoints; ++i) {
+    PowerDensityContainer.AddPoint(TVector3D(S.X[i], S.Y[i], S.Z[i]), 0);
+  }
+
+  // Calculate the trajectory from scratch
+  this->CalculateTrajectory(Particle);
+
+  #ifdef CUDA
+  // Check that the GPU exists
+  if (this->CheckGPU() < 1) {
+    throw std::invalid_argument("You are requesting the GPU, but none were found");
+  }
+
+  return OSCARSSR_Cuda_CalculatePowerDensityGPU (Particle, Surface, PowerDensityContainer, Dimension, Directional, Weight, OutFileName);
+  #else
+  throw std::invalid_argument("GPU functionality not compiled into this binary distribution");
+  #endif
+
+  return;
+}
+
+
+
+
+
+void OSCARSSR::CalculatePowerDensityGPU (TSurfacePoints const& Surface, T3DScalarContainer& PowerDensityContainer, int const Dimension, bool const Directional, double const Weight, std::string const& OutFileName)
+{
+  // Calculates the single particle spectrum at a given observation point
+  // in units of [photons / second / 0.001% BW / mm^2]
+  //
+  // Surface - Observation Point
+
+  // Check that particle has been set yet.  If fType is "" it has not been set yet
+  if (fParticle.GetType() == "") {
+    try {
+      this->SetNewParticle();
+    } catch (std::exception e) {
+      throw std::out_of_range("no beam defined");
+    }
+  }
+
+  this->CalculatePowerDensityGPU(fParticle, Surface, PowerDensityContainer, Dimension, Directional, Weight, OutFileName);
 
   return;
 }
@@ -1996,6 +2258,9 @@ void OSCARSSR::CalculateFlux2 (TParticleA& Particle, TSurfacePoints const& Surfa
   // ObservationPoint - Observation Point
   // Spectrum - Spectrum container
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
   // Check that particle has been set yet.  If fType is "" it has not been set yet
   if (Particle.GetType() == "") {
     throw std::out_of_range("no particle defined");
@@ -2019,7 +2284,7 @@ void OSCARSSR::CalculateFlux2 (TParticleA& Particle, TSurfacePoints const& Surfa
   }
 
   // Number of points in the spectrum container
-  size_t const NSPoints = Surface.GetNPoints();
+  size_t const NSPoints = S.NPoints;
 
   // Constant C0 for calculation
   double const C0 = Particle.GetQ() / (TOSCARSSR::FourPi() * TOSCARSSR::C() * TOSCARSSR::Epsilon0() * TOSCARSSR::Sqrt2Pi());
@@ -2027,17 +2292,11 @@ void OSCARSSR::CalculateFlux2 (TParticleA& Particle, TSurfacePoints const& Surfa
   // Constant for flux calculation at the end
   double const C2 = TOSCARSSR::FourPi() * Particle.GetCurrent() / (TOSCARSSR::H() * fabs(Particle.GetQ()) * TOSCARSSR::Mu0() * TOSCARSSR::C()) * 1e-6 * 0.001;
 
-  // Imaginary "i" and complxe 1+0i
-  std::complex<double> const I(0, 1);
-  std::complex<double> const One(1, 0);
 
 
   // Angular frequency
   double const Omega = TOSCARSSR::EvToAngularFrequency(Energy_eV);;
 
-  // Constant for field calculation
-  std::complex<double> ICoverOmega = I * TOSCARSSR::C() / Omega;
-
   // Constant for calculation
   std::complex<double> const C1(0, C0 * Omega);
 
@@ -2045,35 +2304,10 @@ void OSCARSSR::CalculateFlux2 (TParticleA& Particle, TSurfacePoints const& Surfa
   for (size_t i = 0; i != NSPoints; ++i) {
 
     // Obs point
-    TVector3D ObservationPoint = Surface.GetPoint(i).GetPoint();
+    TVector3D ObservationPoint(S.X[i], S.Y[i], S.Z[i]);
 
     // Electric field summation in frequency space
-    TVector3DC SumE(0, 0, 0);
-
-    // Loop over all points in trajectory
-    for (int iT = 0; iT != NTPoints; ++iT) {
-
-      // Particle position
-      TVector3D const& X = T.GetX(iT);
-
-      // Particle "Beta" (velocity over speed of light)
-      TVector3D const& B = T.GetB(iT);
-
-      // Vector pointing from particle to observer
-      TVector3D const R = ObservationPoint - X;
-
-      // Unit vector pointing from particl to observer
-      TVector3D const N = R.UnitVector();
-
-      // Distance from particle to observer
-      double const D = R.Mag();
-
-      // Exponent for fourier transformed field
-      std::complex<double> Exponent(0, Omega * (DeltaT * iT + D / TOSCARSSR::C()));
-
-      // Sum in fourier transformed field (integral)
-      SumE += (TVector3DC(B) - (N * ( One + (ICoverOmega / (D))))) / D * std::exp(Exponent);
-    }
+    TVector3DC SumE = TRadiationKernel::FieldSum<TRadiationKernel::TFieldBeta>(T, ObservationPoint, Omega);
 
 
     // Multiply field by Constant C1 and time step
@@ -2101,16 +2335,18 @@ void OSCARSSR::CalculateFlux2 (TParticleA& Particle, TSurfacePoints const& Surfa
 
 
 
-void OSCARSSR::CalculateFluxPoint (TParticleA& Particle, TSurfacePoints const& Surface, double const Energy_eV, T3DScalarContainer& FluxContainer, size_t const i, int const Dimension, double const Weight)
+double OSCARSSR::CalculateFluxPoint (TParticleA& Particle, TSurfacePoints const& Surface, double const Energy_eV, size_t const i, double const Weight)
 {
-  // Calculates the single particle spectrum at a given observation point
+  // Calculates the single particle flux at point i of the surface
   // in units of [photons / second / 0.001% BW / mm^2]
-  // Save this in the spectrum container.
   //
   // Particle - the Particle.. with a Trajectory structure hopefully
   // ObservationPoint - Observation Point
   // Spectrum - Spectrum container
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
   // Check that particle has been set yet.  If fType is "" it has not been set yet
   if (Particle.GetType() == "") {
     throw std::out_of_range("no particle defined");
@@ -2136,50 +2372,19 @@ void OSCARSSR::CalculateFluxPoint (TParticleA& Particle, TSurfacePoints const& S
   // Constant for flux calculation at the end
   double const C2 = TOSCARSSR::FourPi() * Particle.GetCurrent() / (TOSCARSSR::H() * fabs(Particle.GetQ()) * TOSCARSSR::Mu0() * TOSCARSSR::C()) * 1e-6 * 0.001;
 
-  // Imaginary "i" and complxe 1+0i
-  std::complex<double> const I(0, 1);
-  std::complex<double> const One(1, 0);
 
 
   // Angular frequency
   double const Omega = TOSCARSSR::EvToAngularFrequency(Energy_eV);;
 
-  // Constant for field calculation
-  std::complex<double> ICoverOmega = I * TOSCARSSR::C() / Omega;
-
   // Constant for calculation
   std::complex<double> const C1(0, C0 * Omega);
 
   // Obs point
-  TVector3D ObservationPoint = Surface.GetPoint(i).GetPoint();
+  TVector3D ObservationPoint(S.X[i], S.Y[i], S.Z[i]);
 
   // Electric field summation in frequency space
-  TVector3DC SumE(0, 0, 0);
-
-  // Loop over all points in trajectory
-  for (int iT = 0; iT != NTPoints; ++iT) {
-
-    // Particle position
-    TVector3D const& X = T.GetX(iT);
-
-    // Particle "Beta" (velocity over speed of light)
-    TVector3D const& B = T.GetB(iT);
-
-    // Vector pointing from particle to observer
-    TVector3D const R = ObservationPoint - X;
-
-    // Unit vector pointing from particl to observer
-    TVector3D const N = R.UnitVector();
-
-    // Distance from particle to observer
-    double const D = R.Mag();
-
-    // Exponent for fourier transformed field
-    std::complex<double> Exponent(0, Omega * (DeltaT * iT + D / TOSCARSSR::C()));
-
-    // Sum in fourier transformed field (integral)
-    SumE += (TVector3DC(B) - (N * ( One + (ICoverOmega / (D))))) / D * std::exp(Exponent);
-  }
+  TVector3DC SumE = TRadiationKernel::FieldSum<TRadiationKernel::TFieldBeta>(T, ObservationPoint, Omega);
 
 
   // Multiply field by Constant C1 and time step
@@ -2198,9 +2403,7 @@ void OSCARSSR::CalculateFluxPoint (TParticleA& Particle, TSurfacePoints const& S
   double const ThisFlux = C2 *  SumE.Dot( SumE.CC() ).real() * Weight;
   //double const ThisFlux = LinearFraction;
 
-  FluxContainer.AddToPoint(i, ThisFlux);
-
-  return;
+  return ThisFlux;
 }
 
 
@@ -2216,6 +2419,9 @@ void OSCARSSR::CalculateFlux1 (TParticleA& Particle, TSurfacePoints const& Surfa
   // Current - beam current
   // Energy - beam energy in eV
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
   // Check that particle has been set yet.  If fType is "" it has not been set yet
   if (Particle.GetType() == "") {
     throw std::out_of_range("no particle defined");
@@ -2234,9 +2440,6 @@ void OSCARSSR::CalculateFlux1 (TParticleA& Particle, TSurfacePoints const& Surfa
   // Grab the Trajectory
   TParticleTrajectoryPoints& T = Particle.GetTrajectory();
 
-  // Number of points in trajectory
-  size_t const NTPoints = T.GetNPoints();
-
   // Time step size
   double const DeltaT = T.GetDeltaT();
 
@@ -2247,11 +2450,8 @@ void OSCARSSR::CalculateFlux1 (TParticleA& Particle, TSurfacePoints const& Surfa
   // Constant for flux calculation at the end
   double const C2 = TOSCARSSR::FourPi() * Particle.GetCurrent() / (TOSCARSSR::H() * fabs(Particle.GetQ()) * TOSCARSSR::Mu0() * TOSCARSSR::C()) * 1e-6 * 0.001;
 
-  // Complex number i
-  std::complex<double> const I(0, 1);
-
-  // UPDATE: use common function
-  double const Omega = Energy_eV * TOSCARSSR::TwoPi() / 4.1357e-15;
+  // Angular frequency
+  double const Omega = TOSCARSSR::EvToAngularFrequency(Energy_eV);
 
   // Constant C1 (complex)
   //std::complex<double> const C1(0, C0 * Omega);
@@ -2267,43 +2467,16 @@ void OSCARSSR::CalculateFlux1 (TParticleA& Particle, TSurfacePoints const& Surfa
   }
 
   // Loop over all surface points
-  for (size_t ip = 0; ip != Surface.GetNPoints(); ++ip) {
+  for (size_t ip = 0; ip != S.NPoints; ++ip) {
 
     // Observation point
-    TVector3D Obs = Surface.GetPoint(ip).GetPoint();
-
-    // Sum E-field
-    TVector3DC SumE(0, 0, 0);
-
-    // Loop over trajectory points
-    for (int iT = 0; iT != NTPoints; ++iT) {
-
-      // Get position, Beta, and Acceleration (over c)
-      TVector3D const& X = T.GetX(iT);
-      TVector3D const& B = T.GetB(iT);
-      TVector3D const& AoverC = T.GetAoverC(iT);
+    TVector3D Obs(S.X[ip], S.Y[ip], S.Z[ip]);
 
-      // Define R and unit vector in direction of R, and D (distance to observer)
-      TVector3D const R = Obs - X;
-      TVector3D const N = R.UnitVector();
-      double const D = R.Mag();
-
-      // Exponent in transformed field
-      std::complex<double> Exponent(0, -Omega * (DeltaT * iT + D / TOSCARSSR::C()));
-
-      // UPDATE: with better field avoiding A
-      // TVector3DC const ThisEw = ( N.Cross( (N - B).Cross(AoverC) ) ) / ( D * pow(1 - N.Dot(B), 2) ) * std::exp(Exponent) * DeltaT; // FF only
-
-      TVector3DC const ThisEw = ( ( (1 - (B).Mag2()) * (N - B) ) / ( D * D * (pow(1 - N.Dot(B), 2)) )
-          + ( N.Cross( (N - B).Cross(AoverC) ) ) / ( D * pow(1 - N.Dot(B), 2) ) ) * std::exp(Exponent) * DeltaT; // NF + FF
-
-      // Add this contribution
-      SumE += ThisEw;
-
-    }
+    // Sum E-field, near plus far field from the velocity and acceleration
+    TVector3DC SumE = TRadiationKernel::FieldSum<TRadiationKernel::TFieldAcceleration>(T, Obs, Omega);
 
     // Multiply by constant factor
-    SumE *= C0;
+    SumE *= C0 * DeltaT;
 
 
     double const ThisFlux = C2 * SumE.Dot( SumE.CC() ).real();
@@ -2318,7 +2491,7 @@ void OSCARSSR::CalculateFlux1 (TParticleA& Particle, TSurfacePoints const& Surfa
 
     if (Dimension == 2) {
       if (WriteToFile) {
-        of << Surface.GetX1(ip) << " " << Surface.GetX2(ip) << " " << ThisFlux << "\n";
+        of << S.X1[ip] << " " << S.X2[ip] << " " << ThisFlux << "\n";
       } else {
         FluxContainer.AddToPoint(ip, ThisFlux);
       }
@@ -2349,13 +2522,16 @@ void OSCARSSR::CalculateFlux (TParticleA& Particle, TSurfacePoints const& Surfac
 {
   // Final stop for entry to calculation
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
   if (Dimension == 3) {
-    for (int i = 0; i != Surface.GetNPoints(); ++i) {
-      FluxContainer.AddPoint(Surface.GetPoint(i).GetPoint(), 0);
+    for (int i = 0; i != S.NPoints; ++i) {
+      FluxContainer.AddPoint(TVector3D(S.X[i], S.Y[i], S.Z[i]), 0);
     }
   } else if (Dimension == 2) {
-    for (int i = 0; i != Surface.GetNPoints(); ++i) {
-      FluxContainer.AddPoint( TVector3D(Surface.GetX1(i), Surface.GetX2(i), 0), 0);
+    for (int i = 0; i != S.NPoints; ++i) {
+      FluxContainer.AddPoint( TVector3D(S.X1[i], S.X2[i], 0), 0);
     }
   } else {
     std::cerr << "wRong dimension" << std::endl;
@@ -2419,6 +2595,9 @@ void OSCARSSR::CalculateFlux (TSurfacePoints const& Surface, double const Energy
 {
   // UPDATE: inputs
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
   // How many threads to use.
   int const NThreadsToUse = NThreads < 1 ? fNThreadsGlobal : NThreads;
   if (NThreadsToUse <= 0) {
@@ -2436,12 +2615,12 @@ void OSCARSSR::CalculateFlux (TSurfacePoints const& Surface, double const Energy
   }
 
   if (Dimension == 3) {
-    for (int i = 0; i != Surface.GetNPoints(); ++i) {
-      FluxContainer.AddPoint(Surface.GetPoint(i).GetPoint(), 0);
+    for (int i = 0; i != S.NPoints; ++i) {
+      FluxContainer.AddPoint(TVector3D(S.X[i], S.Y[i], S.Z[i]), 0);
     }
   } else if (Dimension == 2) {
-    for (int i = 0; i != Surface.GetNPoints(); ++i) {
-      FluxContainer.AddPoint( TVector3D(Surface.GetX1(i), Surface.GetX2(i), 0), 0);
+    for (int i = 0; i != S.NPoints; ++i) {
+      FluxContainer.AddPoint( TVector3D(S.X1[i], S.X2[i], 0), 0);
     }
   } else {
     std::cerr << "wROng dimension" << std::endl;
@@ -2455,7 +2634,7 @@ void OSCARSSR::CalculateFlux (TSurfacePoints const& Surface, double const Energy
   if (NParticles == 0) {
     if (GPU == 0) {
       if (NThreadsToUse == 1) {
-        this->CalculateFlux(fParticle, Surface, Energy_eV, FluxContainer, Dimension, 1, BlankOutFileName);
+        this->CalculateFlux2(fParticle, Surface, Energy_eV, FluxContainer, Dimension, 1);
       } else {
         this->CalculateFluxThreads(fParticle, Surface, Energy_eV, FluxContainer, NThreadsToUse, Dimension, 1, BlankOutFileName);
       }
@@ -2468,7 +2647,7 @@ void OSCARSSR::CalculateFlux (TSurfacePoints const& Surface, double const Energy
       this->SetNewParticle();
       if (GPU == 0) {
         if (NThreadsToUse == 1) {
-          this->CalculateFlux(fParticle, Surface, Energy_eV, FluxContainer, Dimension, Weight, BlankOutFileName);
+          this->CalculateFlux2(fParticle, Surface, Energy_eV, FluxContainer, Dimension, Weight);
         } else {
           this->CalculateFluxThreads(fParticle, Surface, Energy_eV, FluxContainer, NThreadsToUse, Dimension, Weight, BlankOutFileName);
         }
@@ -2491,17 +2670,382 @@ void OSCARSSR::CalculateFlux (TSurfacePoints const& Surface, double const Energy
 
 
 
+void OSCARSSR::CalculateFluxAdaptive (TSurfacePoints const& Surface, double const Energy_eV, T3DScalarTree& Tree, double const Tolerance, int const MaxLevel, int const NParticles, int const NThreads, int const GPU)
+{
+  // Flux [photons / second / 0.001% BW / mm^2] on a rectangle or mesh, evaluated where the
+  // tree needs it.  Each level of refinement is one call of the usual calculation.
 
+  Tree.Refine(Surface, [&] (TSurfacePoints const& Points, std::vector<double>& Values) {
+    T3DScalarContainer Container;
+    this->CalculateFlux(Points, Energy_eV, Container, NParticles, NThreads, GPU, 3);
 
-void OSCARSSR::CalculateFluxThreads (TParticleA& Particle, TSurfacePoints const& Surface, double const Energy_eV, T3DScalarContainer& FluxContainer, int const NThreads, int const Dimension, double const Weight, std::string const& OutFileName)
+    Values.resize(Points.GetNPoints());
+    for (size_t i = 0; i != Values.size(); ++i) {
+      Values[i] = Container.GetPoint(i).GetV();
+    }
+  }, Tolerance, MaxLevel);
+
+  return;
+}
+
+
+
+
+void OSCARSSR::CalculateFluxMirror (TSurfacePoints_Rectangle const& Surface, double const Energy_eV, T3DScalarContainer& FluxContainer, int const NParticles, int const NThreads, int const GPU, int const Dimension, std::string const& OutFileName)
 {
-  // Calculates the single particle spectrum at a given observation point
-  // in units of [photons / second / 0.001% BW / mm^2]
+  // Flux [photons / second / 0.001% BW / mm^2] on a rectangle, calculated only on the
+  // part of it not given by a mirror symmetry.  As for CalculatePowerDensityMirror.
+
+  int const Symmetry = NParticles == 0 ? this->GetMirrorSymmetry(Surface) : 0;
+  if (Symmetry == 0) {
+    this->CalculateFlux(Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dimension, OutFileName);
+    return;
+  }
+
+  this->CalculateMirror(Surface, Symmetry, [&] (TSurfacePoints const& Points, std::vector<double>& Values) {
+    T3DScalarContainer Container;
+    this->CalculateFlux(Points, Energy_eV, Container, 0, NThreads, GPU, 3);
+
+    Values.resize(Points.GetNPoints());
+    for (size_t i = 0; i != Values.size(); ++i) {
+      Values[i] = Container.GetPoint(i).GetV();
+    }
+  }, FluxContainer, Dimension, OutFileName);
+
+  return;
+}
+
+
+
+
+void OSCARSSR::CalculateFluxNUFFT (TSurfacePoints_Rectangle const& Surface, double const Energy_eV, T3DScalarContainer& FluxContainer, int const NParticles, int const NThreads, int const GPU, int const Dimension, std::string const& OutFileName)
+{
+  // Flux [photons / second / 0.001% BW / mm^2] on a rectangle in the paraxial approximation
+  // with non-uniform FFTs, see the single particle version.  A particle for which the
+  // approximation does not hold, or would not be faster, is calculated as usual.  The GPU
+  // has its own calculation.
+
+  if (GPU != 0) {
+    this->CalculateFlux(Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dimension, OutFileName);
+    return;
+  }
+
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
+  // How many threads to use.
+  int const NThreadsToUse = NThreads < 1 ? fNThreadsGlobal : NThreads;
+  if (NThreadsToUse <= 0) {
+    throw std::invalid_argument("NThreads or NThreadsGlobal must be >= 1");
+  }
+
+  // Check that particle has been set yet.  If fType is "" it has not been set yet
+  if (fParticle.GetType() == "") {
+    try {
+      this->SetNewParticle();
+    } catch (std::exception e) {
+      throw std::out_of_range("no beam defined");
+    }
+  }
+
+  if (Dimension == 3) {
+    for (size_t i = 0; i != S.NPoints; ++i) {
+      FluxContainer.AddPoint(TVector3D(S.X[i], S.Y[i], S.Z[i]), 0);
+    }
+  } else if (Dimension == 2) {
+    for (size_t i = 0; i != S.NPoints; ++i) {
+      FluxContainer.AddPoint(TVector3D(S.X1[i], S.X2[i], 0), 0);
+    }
+  } else {
+    throw std::invalid_argument("dimension must be 2 or 3");
+  }
+
+  int const NCalculations = NParticles == 0 ? 1 : NParticles;
+  double const Weight = 1.0 / (double) NCalculations;
+  for (int i = 0; i != NCalculations; ++i) {
+    if (NParticles != 0) {
+      this->SetNewParticle();
+    }
+
+    if (this->CalculateFluxNUFFT(fParticle, Surface, Energy_eV, FluxContainer, NThreadsToUse, Weight)) {
+      continue;
+    }
+
+    if (NThreadsToUse == 1) {
+      this->CalculateFlux2(fParticle, Surface, Energy_eV, FluxContainer, Dimension, Weight);
+    } else {
+      this->CalculateFluxThreads(fParticle, Surface, Energy_eV, FluxContainer, NThreadsToUse, Dimension, Weight);
+    }
+  }
+
+  if (OutFileName != "") {
+    FluxContainer.WriteToFileText(OutFileName, Dimension);
+  }
+
+  return;
+}
+
+
+
+
+bool OSCARSSR::CalculateFluxNUFFT (TParticleA& Particle, TSurfacePoints_Rectangle const& Surface, double const Energy_eV, T3DScalarContainer& FluxContainer, int const NThreads, double const Weight)
+{
+  // Flux [photons / second / 0.001% BW / mm^2] of one particle on a rectangle in the
+  // paraxial approximation, added to the points of FluxContainer.  With L the distance
+  // from a point of the trajectory to the plane, (p, q) where it is over the plane and
+  // (a, b) the observer, both from the center of the rectangle,
   //
-  // Surface - Observation Point
+  //   D = L + (p^2 + q^2) / 2L - (a p + b q) / L + (a^2 + b^2) / 2L
+  //
+  // The first two terms belong to the trajectory, the third makes the sum over the
+  // trajectory a Fourier transform evaluated on the regular grid of (a, b), done with a
+  // non-uniform FFT (TNUFFT).  1 / L changes along the trajectory, so the last term is
+  // taken at the center of segments of it and the rest expanded in powers of
+  // (1 / L - 1 / L_segment), one transform for each.  In the far field it is one segment
+  // and one power, so N log N rather than N^2.  Nothing is added and false is returned if
+  // the approximation does not hold to about 1e-4 (angles to the plane, the next term of D,
+  // the near field term) or if summing every point on NThreads threads would be faster.
 
   // Check that particle has been set yet.  If fType is "" it has not been set yet
   if (Particle.GetType() == "") {
+    throw std::out_of_range("no particle defined");
+  }
+
+  int const NX1 = Surface.GetNX1();
+  int const NX2 = Surface.GetNX2();
+  if (NX1 < 2 || NX2 < 2) {
+    return false;
+  }
+
+  // Calculate trajectory
+  this->CalculateTrajectory(Particle);
+
+  // Grab the Trajectory
+  TParticleTrajectoryPoints& T = Particle.GetTrajectory();
+
+  // Time step.  Expecting it to be constant throughout calculation
+  double const DeltaT = T.GetDeltaT();
+
+  // Number of points in the trajectory
+  size_t const NTPoints = T.GetNPoints();
+
+  if (NTPoints < 1) {
+    throw std::length_error("no points in trajectory.  Is particle or beam defined?");
+  }
+
+  // Frame of the rectangle, which must have right angles
+  TVector3D const Center = Surface.GetXYZ((NX1 - 1) / 2., (NX2 - 1) / 2.);
+  TVector3D const Arm1 = Surface.GetXYZ(1., 0.) - Surface.GetXYZ(0., 0.);
+  TVector3D const Arm2 = Surface.GetXYZ(0., 1.) - Surface.GetXYZ(0., 0.);
+  TVector3D const U1 = Arm1.UnitVector();
+  TVector3D const U2 = Arm2.UnitVector();
+  double const Step1 = Arm1.Mag();
+  double const Step2 = Arm2.Mag();
+  if (fabs(U1.Dot(U2)) > 1e-9) {
+    return false;
+  }
+
+  // Normal toward the plane from the trajectory
+  TVector3D Normal = U1.Cross(U2);
+  if ((Center - T.GetX(0)).Dot(Normal) < 0) {
+    Normal *= -1;
+  }
+
+  // Angular frequency and wave number
+  double const Omega = TOSCARSSR::EvToAngularFrequency(Energy_eV);
+  double const K = Omega / TOSCARSSR::C();
+
+  // Half widths of the rectangle and the largest (a^2 + b^2)
+  double const Half1 = Step1 * (NX1 - 1) / 2.;
+  double const Half2 = Step2 * (NX2 - 1) / 2.;
+  double const Rho2Max = Half1 * Half1 + Half2 * Half2;
+
+  // What the approximation must hold to
+  double const Epsilon = 1e-4;
+
+  // L, p, q for each point of the trajectory, and the checks.  The next term of D is
+  // -((a - p)^2 + (b - q)^2)^2 / 8L^3.  Only how much it changes along the trajectory
+  // matters, which is largest at the corners.
+  std::vector<double> L(NTPoints);
+  std::vector<double> P(NTPoints);
+  std::vector<double> Q(NTPoints);
+  double Corner[4][2] = { {1e99, -1e99}, {1e99, -1e99}, {1e99, -1e99}, {1e99, -1e99} };
+  for (size_t iT = 0; iT != NTPoints; ++iT) {
+    TVector3D const D = T.GetX(iT) - Center;
+    L[iT] = -D.Dot(Normal);
+    P[iT] = D.Dot(U1);
+    Q[iT] = D.Dot(U2);
+
+    if (L[iT] <= 0) {
+      return false;
+    }
+
+    double const Rho2 = pow(Half1 + fabs(P[iT]), 2) + pow(Half2 + fabs(Q[iT]), 2);
+    if (Rho2 / (L[iT] * L[iT]) > Epsilon || 1. / (K * L[iT]) > Epsilon) {
+      return false;
+    }
+
+    for (int ic = 0; ic != 4; ++ic) {
+      double const A = (ic & 1) ? Half1 : -Half1;
+      double const B = (ic & 2) ? Half2 : -Half2;
+      double const Term = pow(pow(A - P[iT], 2) + pow(B - Q[iT], 2), 2) / pow(L[iT], 3);
+      Corner[ic][0] = std::min(Corner[ic][0], Term);
+      Corner[ic][1] = std::max(Corner[ic][1], Term);
+    }
+  }
+  for (int ic = 0; ic != 4; ++ic) {
+    if (K * (Corner[ic][1] - Corner[ic][0]) / 16. > Epsilon) {
+      return false;
+    }
+  }
+
+  // Segments of the trajectory in which K (a^2 + b^2) (1/L - 1/L_segment) / 2 is at most
+  // MaxPhase, and the number of powers of it for 1e-10
+  double const MaxPhase = 2;
+  std::vector<double> Delta(NTPoints);
+  std::vector<size_t> First;
+  std::vector<double> Middle;
+  std::vector<int>    NPowers;
+  double Min = 0;
+  double Max = 0;
+  for (size_t iT = 0; iT <= NTPoints; ++iT) {
+    if (iT != NTPoints) {
+      Delta[iT] = 1. / L[iT] - 1. / L[0];
+    }
+
+    if (iT == NTPoints || iT == 0 || K * Rho2Max / 4. * (std::max(Max, Delta[iT]) - std::min(Min, Delta[iT])) > MaxPhase) {
+      if (iT != 0) {
+        double const Phase = K * Rho2Max / 4. * (Max - Min);
+        int N = 1;
+        for (double Term = Phase; Term > 1e-10 && N < 50; ++N) {
+          Term *= Phase / (N + 1);
+        }
+        Middle.push_back((Max + Min) / 2.);
+        NPowers.push_back(N);
+      }
+      if (iT != NTPoints) {
+        First.push_back(iT);
+        Min = Max = Delta[iT];
+      }
+      continue;
+    }
+
+    Min = std::min(Min, Delta[iT]);
+    Max = std::max(Max, Delta[iT]);
+  }
+  First.push_back(NTPoints);
+
+  // Compare with summing every point.  One term of that sum costs about as much as 100
+  // complex multiply and adds.
+  TNUFFT NUFFT(NX1, NX2, 4);
+  double Cost = 0;
+  for (size_t j = 0; j != NPowers.size(); ++j) {
+    Cost += NPowers[j] * (NUFFT.GetNOperations(First[j + 1] - First[j]) + 8. * NX1 * NX2);
+  }
+  if (Cost > 100. * NX1 * NX2 * NTPoints / NThreads) {
+    return false;
+  }
+
+  // Constant C0 for calculation
+  double const C0 = Particle.GetQ() / (TOSCARSSR::FourPi() * TOSCARSSR::C() * TOSCARSSR::Epsilon0() * TOSCARSSR::Sqrt2Pi());
+
+  // Constant for flux calculation at the end
+  double const C2 = TOSCARSSR::FourPi() * Particle.GetCurrent() / (TOSCARSSR::H() * fabs(Particle.GetQ()) * TOSCARSSR::Mu0() * TOSCARSSR::C()) * 1e-6 * 0.001;
+
+  // Constant for calculation
+  std::complex<double> const C1(0, C0 * Omega);
+
+  // The grid of the transform is centered on frequency 0, (a, b) on the center of the
+  // rectangle, which differ by half a step for an even number of points
+  double const Offset1 = (NX1 / 2 - (NX1 - 1) / 2.) * Step1;
+  double const Offset2 = (NX2 / 2 - (NX2 - 1) / 2.) * Step2;
+
+  // Everything of the trajectory but the powers: phase, amplitude (B - N) / D for
+  // N = Normal + ((a - p) U1 + (b - q) U2) / L without a and b, and what multiplies them.
+  // L - L[0] is taken from the trajectory directly, K L itself is too large to keep the
+  // phase to much better than 1e-4 in double precision.
+  std::vector<std::complex<double> > Base(NTPoints);
+  std::vector<TVector3D> Amplitude(NTPoints);
+  for (size_t iT = 0; iT != NTPoints; ++iT) {
+    double const X1 = K * P[iT] / L[iT];
+    double const X2 = K * Q[iT] / L[iT];
+    double const Phase = Omega * DeltaT * iT - K * (T.GetX(iT) - T.GetX(0)).Dot(Normal) + K * (P[iT] * P[iT] + Q[iT] * Q[iT]) / (2. * L[iT]) - Offset1 * X1 - Offset2 * X2;
+    Base[iT] = std::polar(1., Phase);
+    Amplitude[iT] = (T.GetB(iT) - Normal + (P[iT] * U1 + Q[iT] * U2) / L[iT]) / L[iT];
+  }
+
+  // Sums for the three components and for what multiplies a U1 + b U2
+  std::vector<std::complex<double> > Sum((size_t) 4 * NX1 * NX2, 0);
+  std::vector<std::complex<double> > Power((size_t) NX1 * NX2);
+
+  std::complex<double> C[4];
+  for (size_t j = 0; j != NPowers.size(); ++j) {
+    for (size_t i = 0; i != Power.size(); ++i) {
+      double const A = (i / NX2 - (NX1 - 1) / 2.) * Step1;
+      double const B = (i % NX2 - (NX2 - 1) / 2.) * Step2;
+      Power[i] = std::polar(1., K * (A * A + B * B) * Middle[j] / 2.);
+    }
+
+    for (int n = 0; n != NPowers[j]; ++n) {
+      NUFFT.Clear();
+      for (size_t iT = First[j]; iT != First[j + 1]; ++iT) {
+        double Factor = 1;
+        for (int k = 1; k <= n; ++k) {
+          Factor *= (Delta[iT] - Middle[j]) / k;
+        }
+        std::complex<double> const BF = Base[iT] * Factor;
+        C[0] = BF * Amplitude[iT].GetX();
+        C[1] = BF * Amplitude[iT].GetY();
+        C[2] = BF * Amplitude[iT].GetZ();
+        C[3] = BF / (L[iT] * L[iT]);
+        NUFFT.Add(Step1 * K * P[iT] / L[iT], Step2 * K * Q[iT] / L[iT], C);
+      }
+      NUFFT.Transform();
+
+      for (int i1 = 0; i1 != NX1; ++i1) {
+        double const A = (i1 - (NX1 - 1) / 2.) * Step1;
+        for (int i2 = 0; i2 != NX2; ++i2) {
+          double const B = (i2 - (NX2 - 1) / 2.) * Step2;
+          size_t const i = (size_t) i1 * NX2 + i2;
+          for (int k = 0; k != 4; ++k) {
+            Sum[4 * i + k] += Power[i] * NUFFT.GetValue(k, i1, i2);
+          }
+          Power[i] *= std::complex<double>(0, K * (A * A + B * B) / 2.);
+        }
+      }
+    }
+  }
+
+  for (int i1 = 0; i1 != NX1; ++i1) {
+    double const A = (i1 - (NX1 - 1) / 2.) * Step1;
+    for (int i2 = 0; i2 != NX2; ++i2) {
+      double const B = (i2 - (NX2 - 1) / 2.) * Step2;
+      size_t const i = (size_t) i1 * NX2 + i2;
+
+      // Electric field in frequency space
+      TVector3DC SumE(Sum[4 * i], Sum[4 * i + 1], Sum[4 * i + 2]);
+      SumE -= Sum[4 * i + 3] * TVector3DC(A * U1 + B * U2);
+      SumE *= C1 * DeltaT;
+
+      FluxContainer.AddToPoint(i, C2 * SumE.Dot(SumE.CC()).real() * Weight);
+    }
+  }
+
+  return true;
+}
+
+
+
+
+int OSCARSSR::GetMirrorSymmetry (TSurfacePoints_Rectangle const& Surface)
+{
+  // A trajectory in a plane x, y, or z = constant radiates the same at points mirrored in
+  // that plane.  The rectangle is symmetric in X1 if X1 is perpendicular to such a plane,
+  // and X2 and the center of the rectangle are in it, and likewise for X2.  Returns 1 for
+  // X1, 2 for X2, 3 for both and 0 for none.
+
+  // Check that particle has been set yet.  If fType is "" it has not been set yet
+  if (fParticle.GetType() == "") {
     try {
       this->SetNewParticle();
     } catch (std::exception e) {
@@ -2510,50 +3054,179 @@ void OSCARSSR::CalculateFluxThreads (TParticleA& Particle, TSurfacePoints const&
   }
 
   if (Surface.GetNPoints() == 0) {
-    if (Dimension == 3) {
-      for (int i = 0; i != Surface.GetNPoints(); ++i) {
-        FluxContainer.AddPoint(Surface.GetPoint(i).GetPoint(), 0);
-      }
-    } else if (Dimension == 2) {
-      for (int i = 0; i != Surface.GetNPoints(); ++i) {
-        FluxContainer.AddPoint( TVector3D(Surface.GetX1(i), Surface.GetX2(i), 0), 0);
+    return 0;
+  }
+
+  this->CalculateTrajectory(fParticle);
+  TParticleTrajectoryPoints const& T = fParticle.GetTrajectory();
+  if (T.GetNPoints() == 0) {
+    return 0;
+  }
+
+  // Distances and directions below this are taken as 0 [m]
+  double const Epsilon = 1e-9;
+
+  TVector3D const Center = Surface.GetXYZ((Surface.GetNX1() - 1) / 2., (Surface.GetNX2() - 1) / 2.);
+  TVector3D const U1 = (Surface.GetXYZ(1., 0.) - Surface.GetXYZ(0., 0.)).UnitVector();
+  TVector3D const U2 = (Surface.GetXYZ(0., 1.) - Surface.GetXYZ(0., 0.)).UnitVector();
+
+  int Symmetry = 0;
+  for (int iAxis = 0; iAxis != 3; ++iAxis) {
+    double const Plane = T.GetX(0)[iAxis];
+
+    bool InPlane = true;
+    for (size_t i = 0; i != T.GetNPoints() && InPlane; ++i) {
+      InPlane = fabs(T.GetX(i)[iAxis] - Plane) < Epsilon;
+    }
+    if (!InPlane || fabs(Center[iAxis] - Plane) > Epsilon) {
+      continue;
+    }
+
+    if (fabs(fabs(U1[iAxis]) - 1) < Epsilon && fabs(U2[iAxis]) < Epsilon) {
+      Symmetry |= 1;
+    }
+    if (fabs(fabs(U2[iAxis]) - 1) < Epsilon && fabs(U1[iAxis]) < Epsilon) {
+      Symmetry |= 2;
+    }
+  }
+
+  return Symmetry;
+}
+
+
+
+
+void OSCARSSR::CalculateMirror (TSurfacePoints_Rectangle const& Surface, int const Symmetry, T3DScalarTree::TEvaluate const& Evaluate, T3DScalarContainer& Container, int const Dimension, std::string const& OutFileName)
+{
+  // Evaluate the points of the rectangle with i1 <= NX1 - 1 - i1 if symmetric in X1 (and
+  // likewise for X2) and fill the rest by reflection.  The normal of the rectangle is in
+  // the mirror plane so mirrored points see the same normal.
+
+  if (Dimension != 2 && Dimension != 3) {
+    throw std::invalid_argument("dimension must be 2 or 3");
+  }
+
+  int const NX1 = Surface.GetNX1();
+  int const NX2 = Surface.GetNX2();
+  int const N1 = (Symmetry & 1) ? (NX1 + 1) / 2 : NX1;
+  int const N2 = (Symmetry & 2) ? (NX2 + 1) / 2 : NX2;
+
+  TSurfacePoints_3D Fundamental;
+  for (int i1 = 0; i1 != N1; ++i1) {
+    for (int i2 = 0; i2 != N2; ++i2) {
+      Fundamental.AddPoint(Surface.GetPoint(i1 * NX2 + i2));
+    }
+  }
+
+  std::vector<double> Values;
+  Evaluate(Fundamental, Values);
+
+  for (int i1 = 0; i1 != NX1; ++i1) {
+    int const j1 = (Symmetry & 1) ? std::min(i1, NX1 - 1 - i1) : i1;
+    for (int i2 = 0; i2 != NX2; ++i2) {
+      int const j2 = (Symmetry & 2) ? std::min(i2, NX2 - 1 - i2) : i2;
+      size_t const i = (size_t) i1 * NX2 + i2;
+      double const V = Values[(size_t) j1 * N2 + j2];
+
+      if (Dimension == 3) {
+        Container.AddPoint(Surface.GetXYZ(i), V);
+      } else {
+        Container.AddPoint(TVector3D(Surface.GetX1(i), Surface.GetX2(i), 0), V);
       }
-    } else {
-      std::cerr << "wrOng dimension" << std::endl;
-      throw;
     }
   }
 
-  // Check if NThreads is overriding the default nthreads
-  int const NThreadsToUse = NThreads > 0 ? NThreads : fNThreadsGlobal;
+  if (OutFileName != "") {
+    Container.WriteToFileText(OutFileName, Dimension);
+  }
+
+  return;
+}
+
 
-  // Calculate the trajectory from scratch
-  this->CalculateTrajectory(Particle);
 
-  std::vector<std::thread> Threads;
 
-  // Number of points in spectrum
-  size_t const NPoints = Surface.GetNPoints();
 
-  // How many threads to start in the first for loop
-  size_t const NFirst = (size_t) NPoints > NThreadsToUse ? NThreadsToUse : NPoints;
+void OSCARSSR::EvaluateOnThreads (size_t const N, int const NThreads, std::function<double (size_t const)> const& Evaluate, std::vector<double>& Values) const
+{
+  // Values[i] = Evaluate(i) for i from 0 to N.  Threads take chunks of consecutive points
+  // as they become free, so a slow part of a surface is shared, and each writes only its
+  // own chunk.  Every value is calculated on its own, so they do not depend on the number
+  // of threads or the order the chunks are done in.  The caller adds them to its container
+  // in order from one thread.
+
+  if (NThreads < 1) {
+    throw std::invalid_argument("number of threads must be at least 1");
+  }
 
-  // Start threads and keep in vector
-  for (size_t io = 0; io != NFirst; ++io) {
-    Threads.push_back(std::thread(&OSCARSSR::CalculateFluxPoint, this, std::ref(Particle), std::ref(Surface), Energy_eV, std::ref(FluxContainer), (int) io, Dimension, Weight));
+  Values.assign(N, 0);
+  if (N == 0) {
+    return;
   }
 
-  // Look for threads that end in order, once joined replace with a new thread if we're not yet at the end
-  for (size_t io = NFirst; io != NPoints + NFirst; ++io) {
-    size_t const it = io % NFirst;
-    Threads[it].join();
-    if (io < NPoints) {
-      Threads[it] = std::thread(&OSCARSSR::CalculateFluxPoint, this, std::ref(Particle), std::ref(Surface), Energy_eV, std::ref(FluxContainer), (int) io, Dimension, Weight);
+  // A few chunks per thread, long enough that threads rarely write to the same cache line
+  size_t const NThreadsToUse = std::min((size_t) NThreads, N);
+  size_t const ChunkSize = std::max((size_t) 8, N / (8 * NThreadsToUse));
+
+  std::atomic<size_t> Next(0);
+  auto Run = [&] () {
+    for (size_t First = Next.fetch_add(ChunkSize); First < N; First = Next.fetch_add(ChunkSize)) {
+      size_t const Last = std::min(First + ChunkSize, N);
+      for (size_t i = First; i != Last; ++i) {
+        Values[i] = Evaluate(i);
+      }
     }
+  };
+
+  std::vector<std::thread> Threads;
+  for (size_t i = 1; i < NThreadsToUse; ++i) {
+    Threads.push_back(std::thread(Run));
   }
+  Run();
+  for (size_t i = 0; i != Threads.size(); ++i) {
+    Threads[i].join();
+  }
+
+  return;
+}
+
+
 
-  // Clear all threads
-  Threads.clear();
+
+
+
+void OSCARSSR::CalculateFluxThreads (TParticleA& Particle, TSurfacePoints const& Surface, double const Energy_eV, T3DScalarContainer& FluxContainer, int const NThreads, int const Dimension, double const Weight, std::string const& OutFileName)
+{
+  // Calculates the single particle flux on NThreads threads
+  // in units of [photons / second / 0.001% BW / mm^2], added to the points already in
+  // the container
+  //
+  // Surface - Observation Point
+
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
+  // Check that particle has been set yet.  If fType is "" it has not been set yet
+  if (Particle.GetType() == "") {
+    try {
+      this->SetNewParticle();
+    } catch (std::exception e) {
+      throw std::out_of_range("no beam defined");
+    }
+  }
+
+  // Check if NThreads is overriding the default nthreads
+  int const NThreadsToUse = NThreads > 0 ? NThreads : fNThreadsGlobal;
+
+  // Calculate the trajectory from scratch
+  this->CalculateTrajectory(Particle);
+
+  // Flux at each point, then added to the container in order
+  std::vector<double> Flux;
+  this->EvaluateOnThreads(S.NPoints, NThreadsToUse, [&] (size_t const i) {
+    return this->CalculateFluxPoint(Particle, Surface, Energy_eV, i, Weight);
+  }, Flux);
+  FluxContainer.AddToPoints(Flux);
 
   return;
 }
@@ -2566,9 +3239,12 @@ void OSCARSSR::CalculateFluxGPU (TParticleA& Particle, TSurfacePoints const& Sur
 {
   // If you compile for Cuda use the GPU in this function, else throw
 
+  // Surface points as contiguous arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
   // Add points to flux container
-  for (size_t i = 0; i != Surface.GetNPoints(); ++i) {
-    FluxContainer.AddPoint(Surface.GetPoint(i).GetPoint(), 0);
+  for (size_t i = 0; i != S.NPoints; ++i) {
+    FluxContainer.AddPoint(TVector3D(S.X[i], S.Y[i], S.Z[i]), 0);
   }
 
   // Check that particle has been set yet.  If fType is "" it has not been set yet
@@ -720,12 +720,13 @@ extern "C" void OSCARSSR_Cuda_CalculateFluxGPU (TParticleA& Particle, TSurfacePo
   double *bz    = new double[NTPoints];
 
 
-  int const NSPoints = (int) Surface.GetNPoints();
+  // Observer, read straight from the surface arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+  int const NSPoints = (int) S.NPoints;
 
-  // Observer
-  double *sx     = new double[NSPoints];
-  double *sy     = new double[NSPoints];
-  double *sz     = new double[NSPoints];
+  double const *sx = S.X.data();
+  double const *sy = S.Y.data();
+  double const *sz = S.Z.data();
 
   // Constants
   double const C = TOSCARSSR::C();
@@ -746,13 +747,6 @@ extern "C" void OSCARSSR_Cuda_CalculateFluxGPU (TParticleA& Particle, TSurfacePo
     bz[i] = T.GetB(i).GetZ();
   }
 
-  // Set the surface points
-  for (size_t i = 0; i < NSPoints; ++i) {
-    sx[i] = Surface.GetPoint(i).GetX();
-    sy[i] = Surface.GetPoint(i).GetY();
-    sz[i] = Surface.GetPoint(i).GetZ();
-  }
-
 
 
 
@@ -878,10 +872,6 @@ extern "C" void OSCARSSR_Cuda_CalculateFluxGPU (TParticleA& Particle, TSurfacePo
   delete [] by;
   delete [] bz;
 
-  delete [] sx;
-  delete [] sy;
-  delete [] sz;
-
 
   delete [] flux;
 
@@ -1367,15 +1357,17 @@ extern "C" void OSCARSSR_Cuda_CalculatePowerDensityGPU (TParticleA& Particle, TS
   double *aocy  = new double[NTPoints];
   double *aocz  = new double[NTPoints];
 
-  int const NSPoints = (int) Surface.GetNPoints();
+  // Observer, read straight from the surface arrays
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+  int const NSPoints = (int) S.NPoints;
 
-  double *sx     = new double[NSPoints];
-  double *sy     = new double[NSPoints];
-  double *sz     = new double[NSPoints];
+  double const *sx = S.X.data();
+  double const *sy = S.Y.data();
+  double const *sz = S.Z.data();
 
-  double *snx    = new double[NSPoints];
-  double *sny    = new double[NSPoints];
-  double *snz    = new double[NSPoints];
+  double const *snx = S.NX.data();
+  double const *sny = S.NY.data();
+  double const *snz = S.NZ.data();
 
   double *power_density = new double[NSPoints];
 
@@ -1396,18 +1388,6 @@ extern "C" void OSCARSSR_Cuda_CalculatePowerDensityGPU (TParticleA& Particle, TS
 
 
 
-  for (size_t i = 0; i < NSPoints; ++i) {
-    sx[i] = Surface.GetPoint(i).GetX();
-    sy[i] = Surface.GetPoint(i).GetY();
-    sz[i] = Surface.GetPoint(i).GetZ();
-
-    snx[i] = Surface.GetPoint(i).GetNormalX();
-    sny[i] = Surface.GetPoint(i).GetNormalY();
-    snz[i] = Surface.GetPoint(i).GetNormalZ();
-  }
-
-
-
   double *d_x, *d_y, *d_z;
   double *d_bx, *d_by, *d_bz;
   double *d_aocx, *d_aocy, *d_aocz;
@@ -1533,13 +1513,6 @@ extern "C" void OSCARSSR_Cuda_CalculatePowerDensityGPU (TParticleA& Particle, TS
   delete [] aocy;
   delete [] aocz;
 
-  delete [] sx;
-  delete [] sy;
-  delete [] sz;
-
-  delete [] snx;
-  delete [] sny;
-  delete [] snz;
 
   delete [] power_density;
 
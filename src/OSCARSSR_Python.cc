@@ -18,14 +18,22 @@
 
 #include "TSurfacePoints_Rectangle.h"
 #include "TSurfacePoints_3D.h"
+#include "TSurfacePoints_View.h"
+#include "TSurfacePoints_Parametric.h"
+#include "TSurfacePoints_Mesh.h"
 #include "T3DScalarContainer.h"
+#include "T3DScalarTree.h"
 #include "TFieldPythonFunction.h"
 #include "TField3D_Gaussian.h"
 #include "TField3D_UniformBox.h"
 #include "TField3D_IdealUndulator.h"
+#include "TField3D_Grid.h"
+#include "TField3D_Fourier.h"
 #include "TRandomA.h"
 
 #include <iostream>
+#include <fstream>
+#include <stdexcept>
 #include <vector>
 #include <algorithm>
 #include <cstring>
@@ -43,6 +51,7 @@ static void OSCARSSR_dealloc(OSCARSSRObject* self)
   // Python needs to know how to deallocate things in the struct
 
   delete self->obj;
+  delete self->Lock;
   //self->ob_type->tp_free((PyObject*) self);
   Py_TYPE(self)->tp_free((PyObject*) self);
 }
@@ -59,6 +68,8 @@ static PyObject* OSCARSSR_new (PyTypeObject* type, PyObject* args, PyObject* kwd
 
     // Create the new object for self
     self->obj = new OSCARSSR();
+    self->OutputLists = 1;
+    self->Lock = new TOSCARSSRPythonLock();
   }
 
   // Return myself
@@ -77,6 +88,135 @@ static int sr_init(OSCARSSRObject* self, PyObject* args, PyObject* kwds)
 
 
 
+class TOSCARSSRCalculation
+{
+  // Runs a calculation on an object without the GIL, for as long as this exists.  Nothing
+  // python may be touched meanwhile.  Python field functions take the GIL themselves.
+
+  public:
+    TOSCARSSRCalculation (OSCARSSRObject* self)
+    {
+      fLock = self->Lock;
+      {
+        std::lock_guard<std::mutex> Guard(fLock->Count);
+        ++fLock->NCalculations;
+      }
+
+      fThreadState = PyEval_SaveThread();
+      fLock->Calculation.lock();
+
+      std::lock_guard<std::mutex> Guard(fLock->Count);
+      fLock->Thread = std::this_thread::get_id();
+    }
+
+    ~TOSCARSSRCalculation ()
+    {
+      this->RestoreThread();
+
+      {
+        std::lock_guard<std::mutex> Guard(fLock->Count);
+        fLock->Thread = std::thread::id();
+        if (--fLock->NCalculations == 0) {
+          fLock->Idle.notify_all();
+        }
+      }
+      fLock->Calculation.unlock();
+    }
+
+    // Take the GIL back early, keeping the object to read results from it
+    void RestoreThread ()
+    {
+      if (fThreadState != 0x0) {
+        PyEval_RestoreThread(fThreadState);
+        fThreadState = 0x0;
+      }
+    }
+
+  private:
+    TOSCARSSRPythonLock* fLock;
+    PyThreadState*       fThreadState;
+};
+
+
+
+
+class TOSCARSSRModification
+{
+  // Every method but the calculations holds this for as long as it runs.  It waits for the
+  // calculations on the object, running or pending from calculate_*_async, then keeps new
+  // ones from starting, so nothing is changed or read under them.  A python field function
+  // called by a calculation, or a method called from one of these methods, runs on the
+  // thread already holding the object and does not wait.
+
+  public:
+    TOSCARSSRModification (OSCARSSRObject* self)
+    {
+      fLock = self->Lock;
+      fHolding = false;
+
+      {
+        std::lock_guard<std::mutex> Guard(fLock->Count);
+        if (fLock->Thread == std::this_thread::get_id()) {
+          return;
+        }
+      }
+
+      PyThreadState* ThreadState = PyEval_SaveThread();
+      {
+        std::unique_lock<std::mutex> Guard(fLock->Count);
+        TOSCARSSRPythonLock* Lock = fLock;
+        fLock->Idle.wait(Guard, [Lock] { return Lock->NCalculations == 0 && Lock->NPending == 0; });
+      }
+      fLock->Calculation.lock();
+      {
+        std::lock_guard<std::mutex> Guard(fLock->Count);
+        fLock->Thread = std::this_thread::get_id();
+      }
+      PyEval_RestoreThread(ThreadState);
+
+      fHolding = true;
+    }
+
+    ~TOSCARSSRModification ()
+    {
+      if (!fHolding) {
+        return;
+      }
+
+      {
+        std::lock_guard<std::mutex> Guard(fLock->Count);
+        fLock->Thread = std::thread::id();
+      }
+      fLock->Calculation.unlock();
+    }
+
+  private:
+    TOSCARSSRPythonLock* fLock;
+    bool                 fHolding;
+};
+
+
+
+
+
+
+
+static PyObject* OSCARSSR_CalculationError (std::exception const& e)
+{
+  // Set the python error for an exception from a calculation or field evaluation that is
+  // not one of the argument errors, for example from a python field function.  An error
+  // python has set already (the function raised) is kept.  Always returns NULL.
+
+  if (!PyErr_Occurred()) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+  }
+
+  return NULL;
+}
+
+
+
+
 
 
 static TVector2D OSCARSSR_ListAsTVector2D (PyObject* List)
@@ -101,42 +241,716 @@ static TVector2D OSCARSSR_ListAsTVector2D (PyObject* List)
 
 
 
-static TVector3D OSCARSSR_ListAsTVector3D (PyObject* List)
-{
-  TVector3D V;
-  if (PyList_Size(List) == 3) {
-    Py_INCREF(List);
-    V.SetXYZ(PyFloat_AsDouble(PyList_GetItem(List, 0)),
-             PyFloat_AsDouble(PyList_GetItem(List, 1)),
-             PyFloat_AsDouble(PyList_GetItem(List, 2)));
-    Py_DECREF(List);
-  } else {
-    throw std::length_error("number of elements not 3");
+static TVector3D OSCARSSR_ListAsTVector3D (PyObject* List)
+{
+  TVector3D V;
+  if (PyList_Size(List) == 3) {
+    Py_INCREF(List);
+    V.SetXYZ(PyFloat_AsDouble(PyList_GetItem(List, 0)),
+             PyFloat_AsDouble(PyList_GetItem(List, 1)),
+             PyFloat_AsDouble(PyList_GetItem(List, 2)));
+    Py_DECREF(List);
+  } else {
+    throw std::length_error("number of elements not 3");
+  }
+
+  // Return the python list
+  return V;
+}
+
+
+
+
+
+
+
+static bool OSCARSSR_GetExtractionBox (OSCARSSRObject* self, PyObject* List_XLim, PyObject* List_YLim, PyObject* List_ZLim, double const Corridor, TVector3D& Min, TVector3D& Max)
+{
+  // Part of a field file to keep when reading.  Starts from the beam corridor if one is
+  // asked for, otherwise from everything, and any of xlim, ylim, zlim given replace the
+  // limits in that direction.  Min == Max is returned when nothing is asked for.
+  // Returns false with the python error set if the input is bad.
+
+  Min.SetXYZ(0, 0, 0);
+  Max.SetXYZ(0, 0, 0);
+
+  PyObject* const Lists[3] = {List_XLim, List_YLim, List_ZLim};
+  char const* const Names[3] = {"Incorrect format in 'xlim'", "Incorrect format in 'ylim'", "Incorrect format in 'zlim'"};
+
+  if (Corridor <= 0 && PyList_Size(List_XLim) == 0 && PyList_Size(List_YLim) == 0 && PyList_Size(List_ZLim) == 0) {
+    return true;
+  }
+
+  if (Corridor > 0) {
+    try {
+      self->obj->GetBeamCorridor(Corridor, Min, Max);
+    } catch (...) {
+      PyErr_SetString(PyExc_ValueError, "'corridor' needs a particle beam to be defined first");
+      return false;
+    }
+  } else {
+    double const Unbounded = 1e100;
+    Min.SetXYZ(-Unbounded, -Unbounded, -Unbounded);
+    Max.SetXYZ( Unbounded,  Unbounded,  Unbounded);
+  }
+
+  for (int d = 0; d != 3; ++d) {
+    if (PyList_Size(Lists[d]) != 0) {
+      try {
+        TVector2D const Lim = OSCARSSR_ListAsTVector2D(Lists[d]);
+        Min[d] = std::min(Lim[0], Lim[1]);
+        Max[d] = std::max(Lim[0], Lim[1]);
+      } catch (std::length_error e) {
+        PyErr_SetString(PyExc_ValueError, Names[d]);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+
+
+
+
+
+static bool OSCARSSR_GetMirrors (PyObject* List_XMirror, PyObject* List_YMirror, PyObject* List_ZMirror, TVector3D* Mirror)
+{
+  // Parity of each field component under a mirror through x=0, y=0, z=0 of the map.
+  // An empty list means no mirror.  Returns false with the python error set if the
+  // input is bad.
+
+  PyObject* const Lists[3] = {List_XMirror, List_YMirror, List_ZMirror};
+  char const* const Names[3] = {"Incorrect format in 'xmirror'", "Incorrect format in 'ymirror'", "Incorrect format in 'zmirror'"};
+
+  for (int d = 0; d != 3; ++d) {
+    Mirror[d].SetXYZ(0, 0, 0);
+    if (PyList_Size(Lists[d]) != 0) {
+      try {
+        Mirror[d] = OSCARSSR_ListAsTVector3D(Lists[d]);
+      } catch (std::length_error e) {
+        PyErr_SetString(PyExc_ValueError, Names[d]);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+
+
+
+
+
+class TOSCARSSRBuffer
+{
+  // A python buffer, held for as long as this exists.  Released with the GIL held.
+
+  public:
+    TOSCARSSRBuffer ()
+    {
+      fBuffer.obj = NULL;
+    }
+
+    ~TOSCARSSRBuffer ()
+    {
+      if (fBuffer.obj != NULL) {
+        PyBuffer_Release(&fBuffer);
+      }
+    }
+
+    // An [N][3] array of doubles with any strides, or the python error is set
+    bool GetVectors (PyObject* Object, char const* Name)
+    {
+      if (PyObject_GetBuffer(Object, &fBuffer, PyBUF_STRIDES | PyBUF_FORMAT) != 0) {
+        fBuffer.obj = NULL;
+        PyErr_Clear();
+      } else {
+        char const* Format = fBuffer.format == NULL ? "B" : fBuffer.format;
+        bool const IsDouble = fBuffer.itemsize == sizeof(double) && (std::strcmp(Format, "d") == 0 || std::strcmp(Format, "@d") == 0 || std::strcmp(Format, "=d") == 0);
+        if (IsDouble && fBuffer.ndim == 2 && fBuffer.shape[1] == 3) {
+          return true;
+        }
+      }
+
+      PyErr_SetString(PyExc_ValueError, (std::string("'") + Name + "' must be an [N][3] array of float64, or a list").c_str());
+      return false;
+    }
+
+    Py_buffer fBuffer;
+};
+
+
+
+
+static TSurfacePoints_View* OSCARSSR_NewSurfaceView (PyObject* Points, PyObject* Normals, TOSCARSSRBuffer& PointsBuffer, TOSCARSSRBuffer& NormalsBuffer, TVector3D const& Rotations, TVector3D const& Translation, bool const InvertNormals)
+{
+  // Surface viewing [N][3] arrays (numpy or anything with the buffer protocol) of points and
+  // normals without a copy.  The buffers must be held while the surface is used.
+  // Returns 0x0 with the python error set if anything is wrong.
+
+  if (Normals == 0x0) {
+    PyErr_SetString(PyExc_ValueError, "'normals' are needed with an array of 'points'");
+    return 0x0;
+  }
+
+  if (!PointsBuffer.GetVectors(Points, "points") || !NormalsBuffer.GetVectors(Normals, "normals")) {
+    return 0x0;
+  }
+
+  if (PointsBuffer.fBuffer.shape[0] != NormalsBuffer.fBuffer.shape[0]) {
+    PyErr_SetString(PyExc_ValueError, "'points' and 'normals' must have the same length");
+    return 0x0;
+  }
+
+  std::ptrdiff_t const PointStrides[2]  = { PointsBuffer.fBuffer.strides[0],  PointsBuffer.fBuffer.strides[1]  };
+  std::ptrdiff_t const NormalStrides[2] = { NormalsBuffer.fBuffer.strides[0], NormalsBuffer.fBuffer.strides[1] };
+
+  return new TSurfacePoints_View((size_t) PointsBuffer.fBuffer.shape[0],
+                                 (char const*) PointsBuffer.fBuffer.buf,
+                                 PointStrides,
+                                 (char const*) NormalsBuffer.fBuffer.buf,
+                                 NormalStrides,
+                                 Rotations,
+                                 Translation,
+                                 InvertNormals);
+}
+
+
+
+
+
+
+static TVector3D OSCARSSR_CallAsTVector3D (PyObject* Function, char const* Name, double const U, double const V)
+{
+  // Call a python function f(u, v) returning [x, y, z].  Throws std::runtime_error with the
+  // python error set if anything goes wrong.
+
+  PyObject* Result = PyObject_CallFunction(Function, (char*) "dd", U, V);
+  if (Result == NULL) {
+    throw std::runtime_error("error in python function");
+  }
+
+  PyObject* Sequence = PySequence_Fast(Result, "");
+  Py_DECREF(Result);
+  if (Sequence == NULL || PySequence_Fast_GET_SIZE(Sequence) != 3) {
+    Py_XDECREF(Sequence);
+    PyErr_SetString(PyExc_ValueError, (std::string("'") + Name + "' must return [x, y, z]").c_str());
+    throw std::runtime_error("error in python function");
+  }
+
+  TVector3D const X(PyFloat_AsDouble(PySequence_Fast_GET_ITEM(Sequence, 0)),
+                    PyFloat_AsDouble(PySequence_Fast_GET_ITEM(Sequence, 1)),
+                    PyFloat_AsDouble(PySequence_Fast_GET_ITEM(Sequence, 2)));
+  Py_DECREF(Sequence);
+  if (PyErr_Occurred()) {
+    throw std::runtime_error("error in python function");
+  }
+
+  return X;
+}
+
+
+
+
+static bool OSCARSSR_ListAsVector (PyObject* List, char const* Name, size_t const MaxSize, std::vector<double>& Values)
+{
+  // A list of up to MaxSize numbers.  Returns false with the python error set if not.
+
+  Values.clear();
+  if (!PyList_Check(List) || (size_t) PyList_Size(List) > MaxSize) {
+    PyErr_SetString(PyExc_ValueError, (std::string("Incorrect format in '") + Name + "'").c_str());
+    return false;
+  }
+
+  for (Py_ssize_t i = 0; i != PyList_Size(List); ++i) {
+    Values.push_back(PyFloat_AsDouble(PyList_GetItem(List, i)));
+  }
+  if (PyErr_Occurred()) {
+    PyErr_Clear();
+    PyErr_SetString(PyExc_ValueError, (std::string("Incorrect format in '") + Name + "'").c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+
+
+static TSurfacePoints* OSCARSSR_NewSurface (char const* Shape, PyObject* List_Parameters, PyObject* List_NPoints, PyObject* List_URange, PyObject* List_VRange, PyObject* Position, PyObject* NormalFunction, char const* InFileName, char const* Format, double const Scale, TVector3D const& Rotations, TVector3D const& Translation, int const NormalDirection)
+{
+  // Surface for the *_surface calculations:
+  //   cylinder, sphere, torus - built in shapes with 'parameters', 'npoints' = [nu, nv] and
+  //                             optionally 'urange', 'vrange'
+  //   parametric              - 'position' f(u, v) -> [x, y, z], optionally 'normalfunction'
+  //                             f(u, v) -> [nx, ny, nz], with 'npoints', 'urange', 'vrange'
+  //   mesh                    - triangles from 'ifile' (stl or obj), 'format' and 'scale'
+  // Returns 0x0 with the python error set if anything is wrong.  Python functions are only
+  // called here, with the GIL held.
+
+  std::string const S = Shape;
+  if (S != "cylinder" && S != "sphere" && S != "torus" && S != "parametric" && S != "mesh") {
+    PyErr_SetString(PyExc_ValueError, "'shape' must be cylinder, sphere, torus, parametric or mesh");
+    return 0x0;
+  }
+
+  if (S == "mesh") {
+    if (std::strlen(InFileName) == 0) {
+      PyErr_SetString(PyExc_ValueError, "'ifile' is needed for a mesh");
+      return 0x0;
+    }
+    try {
+      return new TSurfacePoints_Mesh(InFileName, Format, Scale, Rotations, Translation, NormalDirection);
+    } catch (std::ifstream::failure e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+    } catch (std::invalid_argument e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+    } catch (std::out_of_range e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+    }
+    return 0x0;
+  }
+
+  std::vector<double> Parameters;
+  std::vector<double> NPoints;
+  std::vector<double> URange;
+  std::vector<double> VRange;
+  if (!OSCARSSR_ListAsVector(List_Parameters, "parameters", 2, Parameters) ||
+      !OSCARSSR_ListAsVector(List_NPoints,    "npoints",    2, NPoints)    ||
+      !OSCARSSR_ListAsVector(List_URange,     "urange",     2, URange)     ||
+      !OSCARSSR_ListAsVector(List_VRange,     "vrange",     2, VRange)) {
+    return 0x0;
+  }
+  if (NPoints.size() != 2) {
+    PyErr_SetString(PyExc_ValueError, "'npoints' must be [int, int]");
+    return 0x0;
+  }
+
+  try {
+    if (S == "parametric") {
+      if (Position == 0x0 || !PyCallable_Check(Position) || (NormalFunction != 0x0 && !PyCallable_Check(NormalFunction))) {
+        PyErr_SetString(PyExc_ValueError, "'position' (and 'normalfunction' if given) must be functions of (u, v)");
+        return 0x0;
+      }
+      if (URange.size() != 2 || VRange.size() != 2) {
+        PyErr_SetString(PyExc_ValueError, "'urange' and 'vrange' must be [start, stop]");
+        return 0x0;
+      }
+
+      TSurfacePoints_Parametric::TFunction const P = [Position] (double const U, double const V) {
+        return OSCARSSR_CallAsTVector3D(Position, "position", U, V);
+      };
+      TSurfacePoints_Parametric::TFunction N;
+      if (NormalFunction != 0x0) {
+        N = [NormalFunction] (double const U, double const V) {
+          return OSCARSSR_CallAsTVector3D(NormalFunction, "normalfunction", U, V);
+        };
+      }
+      return new TSurfacePoints_Parametric(P, N, URange[0], URange[1], (int) NPoints[0], VRange[0], VRange[1], (int) NPoints[1], Rotations, Translation, NormalDirection);
+    }
+
+    return new TSurfacePoints_Parametric(S, Parameters, (int) NPoints[0], (int) NPoints[1], URange, VRange, Rotations, Translation, NormalDirection);
+  } catch (std::invalid_argument e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+  } catch (std::runtime_error e) {
+    // The python error is already set
+  }
+
+  return 0x0;
+}
+
+
+
+
+static PyObject* OSCARSSR_SurfaceResult (PyObject* Result, TSurfacePoints const& Surface, T3DScalarContainer const& Container, int const Total)
+{
+  // The result alone, or with Total the tuple (result, integral over the surface).  Values
+  // are per mm^2 and areas in m^2.  Steals the reference to Result.
+
+  if (!Total || Result == NULL) {
+    return Result;
+  }
+
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+  double Sum = 0;
+  for (size_t i = 0; i != S.NPoints && i != Container.GetNPoints(); ++i) {
+    Sum += Container.GetPoint(i).GetV() * S.Area[i];
+  }
+
+  return Py_BuildValue("(Nd)", Result, Sum * 1e6);
+}
+
+
+
+
+static void OSCARSSR_GetTreeResult (T3DScalarTree const& Tree, PyObject* List_Resample, T3DScalarContainer& Container, int const Dim, char const* OutFileName)
+{
+  // Points of an adaptive calculation on a rectangle: all points evaluated, or interpolated
+  // on the regular grid given by resample [NX1, NX2]
+
+  if (PyList_Size(List_Resample) == 0) {
+    Tree.GetNodes(Container, Dim);
+  } else if (PyList_Size(List_Resample) == 2) {
+    Tree.Resample((int) PyLong_AsLong(PyList_GetItem(List_Resample, 0)), (int) PyLong_AsLong(PyList_GetItem(List_Resample, 1)), Container, Dim);
+  } else {
+    throw std::invalid_argument("'resample' must be [int, int]");
+  }
+
+  if (std::strlen(OutFileName) != 0) {
+    Container.WriteToFileText(OutFileName, Dim);
+  }
+
+  return;
+}
+
+
+
+
+static PyObject* OSCARSSR_TreeResult (PyObject* Result, T3DScalarTree const& Tree, int const Total)
+{
+  // As OSCARSSR_SurfaceResult for the leaves of an adaptive calculation.  Steals the
+  // reference to Result.
+
+  if (!Total || Result == NULL) {
+    return Result;
+  }
+
+  return Py_BuildValue("(Nd)", Result, Tree.GetIntegral() * 1e6);
+}
+
+
+
+
+
+
+static PyObject* OSCARSSR_TVector3DAsList (TVector3D const& V)
+{
+  // Turn a TVector3D into a list (like a vector)
+
+  // Create a python list
+  PyObject *PList = PyList_New(0);
+
+  PyList_Append(PList, Py_BuildValue("f", V.GetX()));
+  PyList_Append(PList, Py_BuildValue("f", V.GetY()));
+  PyList_Append(PList, Py_BuildValue("f", V.GetZ()));
+
+  // Return the python list
+  return PList;
+}
+
+
+
+
+
+
+static void OSCARSSR_Array_dealloc (OSCARSSRArrayObject* self)
+{
+  // Release the data this array views
+
+  delete self->Owner;
+  PyObject_Del(self);
+}
+
+
+
+
+static PyObject* OSCARSSR_ArrayAsList (double const* Data, int const NDim, Py_ssize_t const* Shape, Py_ssize_t const* Strides)
+{
+  // Nested python lists with the numbers of an array
+
+  PyObject* PList = PyList_New(Shape[0]);
+  for (Py_ssize_t i = 0; i != Shape[0]; ++i) {
+    double const* Row = Data + i * (Strides[0] / (Py_ssize_t) sizeof(double));
+    PyList_SET_ITEM(PList, i, NDim == 1 ? PyFloat_FromDouble(*Row) : OSCARSSR_ArrayAsList(Row, NDim - 1, Shape + 1, Strides + 1));
+  }
+
+  return PList;
+}
+
+
+
+
+static PyObject* OSCARSSR_Array_ToList (OSCARSSRArrayObject* self)
+{
+  // Return the array as nested python lists
+  return OSCARSSR_ArrayAsList(self->Data, self->NDim, self->Shape, self->Strides);
+}
+
+
+
+
+static PyObject* OSCARSSR_Array_GetShape (OSCARSSRArrayObject* self, void* closure)
+{
+  // Shape of the array as a tuple
+
+  PyObject* Shape = PyTuple_New(self->NDim);
+  for (int i = 0; i != self->NDim; ++i) {
+    PyTuple_SET_ITEM(Shape, i, PyLong_FromSsize_t(self->Shape[i]));
+  }
+
+  return Shape;
+}
+
+
+
+
+static PyObject* OSCARSSR_Array_Repr (OSCARSSRArrayObject* self)
+{
+  // Same as the list it would be
+
+  PyObject* PList = OSCARSSR_Array_ToList(self);
+  PyObject* Repr  = PyObject_Repr(PList);
+  Py_DECREF(PList);
+
+  return Repr;
+}
+
+
+
+
+static Py_ssize_t OSCARSSR_Array_Length (OSCARSSRArrayObject* self)
+{
+  // Length along the first dimension
+  return self->Shape[0];
+}
+
+
+
+
+static PyObject* OSCARSSR_Array_Item (OSCARSSRArrayObject* self, Py_ssize_t i)
+{
+  // A float for 1D, otherwise a view of the sub-array i
+
+  if (i < 0 || i >= self->Shape[0]) {
+    PyErr_SetString(PyExc_IndexError, "array index out of range");
+    return NULL;
+  }
+
+  double const* Row = self->Data + i * (self->Strides[0] / (Py_ssize_t) sizeof(double));
+  if (self->NDim == 1) {
+    return PyFloat_FromDouble(*Row);
+  }
+
+  return OSCARSSR_NewArray(*self->Owner, Row, self->NDim - 1, self->Shape + 1);
+}
+
+
+
+
+static PyObject* OSCARSSR_Array_Subscript (OSCARSSRArrayObject* self, PyObject* Key)
+{
+  // An index as for sq_item, negative from the end, or a slice along the first dimension.
+  // A slice with step 1 views the same data, any other step is a copy.
+
+  if (PyIndex_Check(Key)) {
+    Py_ssize_t i = PyNumber_AsSsize_t(Key, PyExc_IndexError);
+    if (i == -1 && PyErr_Occurred()) {
+      return NULL;
+    }
+    return OSCARSSR_Array_Item(self, i < 0 ? i + self->Shape[0] : i);
+  }
+
+  if (!PySlice_Check(Key)) {
+    PyErr_SetString(PyExc_TypeError, "sr.array indices must be integers or slices");
+    return NULL;
+  }
+
+  Py_ssize_t Start;
+  Py_ssize_t Stop;
+  Py_ssize_t Step;
+  Py_ssize_t Length;
+#if PY_MAJOR_VERSION >= 3
+  if (PySlice_GetIndicesEx(Key, self->Shape[0], &Start, &Stop, &Step, &Length) < 0) {
+#else
+  if (PySlice_GetIndicesEx((PySliceObject*) Key, self->Shape[0], &Start, &Stop, &Step, &Length) < 0) {
+#endif
+    return NULL;
+  }
+
+  Py_ssize_t Shape[3];
+  for (int i = 0; i != self->NDim; ++i) {
+    Shape[i] = self->Shape[i];
+  }
+  Shape[0] = Length;
+
+  Py_ssize_t const RowSize = self->Strides[0] / (Py_ssize_t) sizeof(double);
+  if (Step == 1 || Length <= 1) {
+    return OSCARSSR_NewArray(*self->Owner, self->Data + (Length > 0 ? Start : 0) * RowSize, self->NDim, Shape);
+  }
+
+  std::shared_ptr<std::vector<double> > Data(new std::vector<double>(Length * RowSize));
+  for (Py_ssize_t i = 0; i != Length; ++i) {
+    double const* Row = self->Data + (Start + i * Step) * RowSize;
+    std::copy(Row, Row + RowSize, Data->data() + i * RowSize);
+  }
+
+  return OSCARSSR_NewArray(Data, Data->data(), self->NDim, Shape);
+}
+
+
+
+
+static int OSCARSSR_Array_GetBuffer (OSCARSSRArrayObject* self, Py_buffer* View, int Flags)
+{
+  // Buffer protocol.  The data is read-only and always C-contiguous.
+
+  if ((Flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "sr.array is read-only");
+    View->obj = NULL;
+    return -1;
+  }
+
+  Py_ssize_t N = 1;
+  for (int i = 0; i != self->NDim; ++i) {
+    N *= self->Shape[i];
+  }
+
+  View->buf        = (void*) self->Data;
+  View->obj        = (PyObject*) self;
+  View->len        = N * (Py_ssize_t) sizeof(double);
+  View->readonly   = 1;
+  View->itemsize   = sizeof(double);
+  View->format     = (Flags & PyBUF_FORMAT) == PyBUF_FORMAT ? (char*) "d" : NULL;
+  View->ndim       = self->NDim;
+  View->shape      = (Flags & PyBUF_ND) == PyBUF_ND ? self->Shape : NULL;
+  View->strides    = (Flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->Strides : NULL;
+  View->suboffsets = NULL;
+  View->internal   = NULL;
+  Py_INCREF(self);
+
+  return 0;
+}
+
+
+
+
+static PyMethodDef OSCARSSR_Array_methods[] = {
+  {"tolist", (PyCFunction) OSCARSSR_Array_ToList, METH_NOARGS, "return the array as nested python lists"},
+  {NULL}  /* Sentinel */
+};
+
+static PyGetSetDef OSCARSSR_Array_getset[] = {
+  {(char*) "shape", (getter) OSCARSSR_Array_GetShape, NULL, (char*) "shape of the array", NULL},
+  {NULL}  /* Sentinel */
+};
+
+static PySequenceMethods OSCARSSR_Array_as_sequence = {
+  (lenfunc) OSCARSSR_Array_Length,       /* sq_length */
+  0,                                     /* sq_concat */
+  0,                                     /* sq_repeat */
+  (ssizeargfunc) OSCARSSR_Array_Item,    /* sq_item */
+};
+
+static PyMappingMethods OSCARSSR_Array_as_mapping = {
+  (lenfunc) OSCARSSR_Array_Length,        /* mp_length */
+  (binaryfunc) OSCARSSR_Array_Subscript,  /* mp_subscript */
+  0,                                      /* mp_ass_subscript */
+};
+
+#if PY_MAJOR_VERSION >= 3
+static PyBufferProcs OSCARSSR_Array_as_buffer = {
+  (getbufferproc) OSCARSSR_Array_GetBuffer, /* bf_getbuffer */
+  0,                                        /* bf_releasebuffer */
+};
+#else
+static PyBufferProcs OSCARSSR_Array_as_buffer = {
+  0,                                        /* bf_getreadbuffer */
+  0,                                        /* bf_getwritebuffer */
+  0,                                        /* bf_getsegcount */
+  0,                                        /* bf_getcharbuffer */
+  (getbufferproc) OSCARSSR_Array_GetBuffer, /* bf_getbuffer */
+  0,                                        /* bf_releasebuffer */
+};
+#endif
+
+static PyTypeObject OSCARSSRArrayType = {
+#if PY_MAJOR_VERSION >= 3
+  PyVarObject_HEAD_INIT(NULL, 0)
+#else
+  PyObject_HEAD_INIT(NULL)
+  0,                                        /* ob_size */
+#endif
+  "sr.array",                               /* tp_name */
+  sizeof(OSCARSSRArrayObject),              /* tp_basicsize */
+  0,                                        /* tp_itemsize */
+  (destructor) OSCARSSR_Array_dealloc,      /* tp_dealloc */
+  0,                                        /* tp_print */
+  0,                                        /* tp_getattr */
+  0,                                        /* tp_setattr */
+  0,                                        /* tp_reserved */
+  (reprfunc) OSCARSSR_Array_Repr,           /* tp_repr */
+  0,                                        /* tp_as_number */
+  &OSCARSSR_Array_as_sequence,              /* tp_as_sequence */
+  &OSCARSSR_Array_as_mapping,               /* tp_as_mapping */
+  0,                                        /* tp_hash */
+  0,                                        /* tp_call */
+  0,                                        /* tp_str */
+  0,                                        /* tp_getattro */
+  0,                                        /* tp_setattro */
+  &OSCARSSR_Array_as_buffer,                /* tp_as_buffer */
+#if PY_MAJOR_VERSION >= 3
+  Py_TPFLAGS_DEFAULT,                       /* tp_flags */
+#else
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /* tp_flags */
+#endif
+  "read-only array of doubles from oscars sr, numpy.asarray() views it without a copy", /* tp_doc */
+  0,                                        /* tp_traverse */
+  0,                                        /* tp_clear */
+  0,                                        /* tp_richcompare */
+  0,                                        /* tp_weaklistoffset */
+  0,                                        /* tp_iter */
+  0,                                        /* tp_iternext */
+  OSCARSSR_Array_methods,                   /* tp_methods */
+  0,                                        /* tp_members */
+  OSCARSSR_Array_getset,                    /* tp_getset */
+};
+
+
+
+
+static PyObject* OSCARSSR_NewArray (std::shared_ptr<void const> const& Owner, double const* Data, int const NDim, Py_ssize_t const* Shape)
+{
+  // New sr.array of NDim (at most 3) dimensions viewing Data, which Owner keeps alive
+
+  OSCARSSRArrayObject* self = PyObject_New(OSCARSSRArrayObject, &OSCARSSRArrayType);
+  if (self == NULL) {
+    return NULL;
+  }
+
+  self->Owner = new std::shared_ptr<void const>(Owner);
+  self->Data  = Data;
+  self->NDim  = NDim;
+  for (int i = NDim - 1; i >= 0; --i) {
+    self->Shape[i]   = Shape[i];
+    self->Strides[i] = i == NDim - 1 ? (Py_ssize_t) sizeof(double) : self->Strides[i + 1] * Shape[i + 1];
   }
 
-  // Return the python list
-  return V;
+  return (PyObject*) self;
 }
 
 
 
 
-
-
-
-static PyObject* OSCARSSR_TVector3DAsList (TVector3D const& V)
+static PyObject* OSCARSSR_SetOutputLists (OSCARSSRObject* self, PyObject* arg)
 {
-  // Turn a TVector3D into a list (like a vector)
+  // Return results as nested python lists (True, the default) or as sr.array (False)
 
-  // Create a python list
-  PyObject *PList = PyList_New(0);
+  TOSCARSSRModification Modification(self);
 
-  PyList_Append(PList, Py_BuildValue("f", V.GetX()));
-  PyList_Append(PList, Py_BuildValue("f", V.GetY()));
-  PyList_Append(PList, Py_BuildValue("f", V.GetZ()));
+  int const OutputLists = PyObject_IsTrue(arg);
+  if (OutputLists < 0) {
+    return NULL;
+  }
+  self->OutputLists = OutputLists;
 
-  // Return the python list
-  return PList;
+  // Must return python object None in a special way
+  Py_INCREF(Py_None);
+  return Py_None;
 }
 
 
@@ -183,6 +997,8 @@ static PyObject* OSCARSSR_RandomNormal (OSCARSSRObject* self, PyObject* arg)
 
 static PyObject* OSCARSSR_SetSeed (OSCARSSRObject* self, PyObject* arg)
 {
+  TOSCARSSRModification Modification(self);
+
   // Grab the value from input
   double Seed = PyFloat_AsDouble(arg);
 
@@ -199,6 +1015,8 @@ static PyObject* OSCARSSR_SetSeed (OSCARSSRObject* self, PyObject* arg)
 
 static PyObject* OSCARSSR_SetGPUGlobal (OSCARSSRObject* self, PyObject* arg)
 {
+  TOSCARSSRModification Modification(self);
+
   // Grab the value from input
   int const GPU = (int) PyLong_AsLong(arg);
 
@@ -215,6 +1033,7 @@ static PyObject* OSCARSSR_SetGPUGlobal (OSCARSSRObject* self, PyObject* arg)
 
 static PyObject* OSCARSSR_CheckGPU (OSCARSSRObject* self, PyObject* arg)
 {
+  TOSCARSSRModification Modification(self);
 
   int const NGPUStatus = self->obj->CheckGPU();
 
@@ -238,6 +1057,8 @@ static PyObject* OSCARSSR_CheckGPU (OSCARSSRObject* self, PyObject* arg)
 
 static PyObject* OSCARSSR_SetNThreadsGlobal (OSCARSSRObject* self, PyObject* arg)
 {
+  TOSCARSSRModification Modification(self);
+
   // Grab the value from input
   int const NThreads = (int) PyLong_AsLong(arg);
 
@@ -263,6 +1084,8 @@ static PyObject* OSCARSSR_SetNThreadsGlobal (OSCARSSRObject* self, PyObject* arg
 
 static PyObject* OSCARSSR_GetCTStart (OSCARSSRObject* self)
 {
+  TOSCARSSRModification Modification(self);
+
   // Get the start time in [m] for calculation
   return Py_BuildValue("d", self->obj->GetCTStart());
 }
@@ -272,6 +1095,8 @@ static PyObject* OSCARSSR_GetCTStart (OSCARSSRObject* self)
 
 static PyObject* OSCARSSR_GetCTStop (OSCARSSRObject* self)
 {
+  TOSCARSSRModification Modification(self);
+
   // Get the CTStop variable from OSCARSSR
   return Py_BuildValue("d", self->obj->GetCTStop());
 }
@@ -283,6 +1108,8 @@ static PyObject* OSCARSSR_SetCTStartStop (OSCARSSRObject* self, PyObject* args)
 {
   // Set the start and stop times for OSCARSSR in [m]
 
+  TOSCARSSRModification Modification(self);
+
   // Grab the values
   double Start, Stop;
   if (!PyArg_ParseTuple(args, "dd", &Start, &Stop)) {
@@ -305,6 +1132,8 @@ static PyObject* OSCARSSR_SetCTStartStop (OSCARSSRObject* self, PyObject* args)
 
 static PyObject* OSCARSSR_GetNPointsTrajectory (OSCARSSRObject* self)
 {
+  TOSCARSSRModification Modification(self);
+
   // Get the numper of points for trajectory calculaton
   return PyLong_FromSize_t(self->obj->GetNPointsTrajectory());
 }
@@ -316,6 +1145,8 @@ static PyObject* OSCARSSR_SetNPointsTrajectory (OSCARSSRObject* self, PyObject*
 {
   // Set the number of points for trajectory calculation
 
+  TOSCARSSRModification Modification(self);
+
   // Grab the value from input
   size_t N = PyLong_AsSsize_t(arg);
 
@@ -339,6 +1170,8 @@ static PyObject* OSCARSSR_AddMagneticField (OSCARSSRObject* self, PyObject* args
   // Add a magnetic field from a file.
   // UPDATE: add binary file reading
 
+  TOSCARSSRModification Modification(self);
+
 
   // Grab the values
   char const* FileName = "";
@@ -346,20 +1179,53 @@ static PyObject* OSCARSSR_AddMagneticField (OSCARSSRObject* self, PyObject* args
   PyObject*   List_Rotations   = PyList_New(0);
   PyObject*   List_Translation = PyList_New(0);
   PyObject*   List_Scaling     = PyList_New(0);
+  char const* Interpolation    = "linear";
+  int         Shared           = 0;
+  PyObject*   List_XLim        = PyList_New(0);
+  PyObject*   List_YLim        = PyList_New(0);
+  PyObject*   List_ZLim        = PyList_New(0);
+  double      Corridor         = 0;
+  char const* Storage          = "double";
+  PyObject*   List_XMirror     = PyList_New(0);
+  PyObject*   List_YMirror     = PyList_New(0);
+  PyObject*   List_ZMirror     = PyList_New(0);
 
   TVector3D Rotations(0, 0, 0);
   TVector3D Translation(0, 0, 0);
   std::vector<double> Scaling;
+  TVector3D ExtractMin(0, 0, 0);
+  TVector3D ExtractMax(0, 0, 0);
+  TVector3D Mirror[3] = {TVector3D(0, 0, 0), TVector3D(0, 0, 0), TVector3D(0, 0, 0)};
 
 
   // Input variables and parsing
-  static char *kwlist[] = {"ifile", "iformat", "rotations", "translation", "scale", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "ss|OOO", kwlist,
-                                                           &FileName,
-                                                           &FileFormat,
-                                                           &List_Rotations,
-                                                           &List_Translation,
-                                                           &List_Scaling)) {
+  static char *kwlist[] = {"ifile", "iformat", "rotations", "translation", "scale", "interpolation", "shared", "xlim", "ylim", "zlim", "corridor", "storage", "xmirror", "ymirror", "zmirror", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "ss|OOOsiOOOdsOOO", kwlist,
+                                                            &FileName,
+                                                            &FileFormat,
+                                                            &List_Rotations,
+                                                            &List_Translation,
+                                                            &List_Scaling,
+                                                            &Interpolation,
+                                                            &Shared,
+                                                            &List_XLim,
+                                                            &List_YLim,
+                                                            &List_ZLim,
+                                                            &Corridor,
+                                                            &Storage,
+                                                            &List_XMirror,
+                                                            &List_YMirror,
+                                                            &List_ZMirror)) {
+    return NULL;
+  }
+
+  // Part of the file to keep, if only part is wanted
+  if (!OSCARSSR_GetExtractionBox(self, List_XLim, List_YLim, List_ZLim, Corridor, ExtractMin, ExtractMax)) {
+    return NULL;
+  }
+
+  // Parity of the field components for mirror symmetric maps
+  if (!OSCARSSR_GetMirrors(List_XMirror, List_YMirror, List_ZMirror, Mirror)) {
     return NULL;
   }
 
@@ -398,7 +1264,10 @@ static PyObject* OSCARSSR_AddMagneticField (OSCARSSRObject* self, PyObject* args
 
   // Add the magnetic field to the OSCARSSR object
   try {
-    self->obj->AddMagneticField(FileName, FileFormat, Rotations, Translation, Scaling);
+    self->obj->AddMagneticField(FileName, FileFormat, Rotations, Translation, Scaling, Interpolation, Shared != 0, ExtractMin, ExtractMax, Storage, Mirror[0], Mirror[1], Mirror[2]);
+  } catch (std::invalid_argument e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
   } catch (...) {
     PyErr_SetString(PyExc_ValueError, "Could not import magnetic field.  Check 'ifile' and 'iformat' are correct");
     return NULL;
@@ -421,6 +1290,8 @@ static PyObject* OSCARSSR_AddMagneticFieldInterpolated (OSCARSSRObject* self, Py
   // Add a magnetic field from a file.
   // UPDATE: add binary file reading
 
+  TOSCARSSRModification Modification(self);
+
   // Grab the values
   PyObject*   List_Mapping     = PyList_New(0);
   char const* FileFormat       = "";
@@ -428,6 +1299,8 @@ static PyObject* OSCARSSR_AddMagneticFieldInterpolated (OSCARSSRObject* self, Py
   PyObject*   List_Rotations   = PyList_New(0);
   PyObject*   List_Translation = PyList_New(0);
   PyObject*   List_Scaling     = PyList_New(0);
+  char const* Interpolation    = "linear";
+  int         Lazy             = 0;
 
   TVector3D Rotations(0, 0, 0);
   TVector3D Translation(0, 0, 0);
@@ -437,14 +1310,16 @@ static PyObject* OSCARSSR_AddMagneticFieldInterpolated (OSCARSSRObject* self, Py
   std::vector<std::pair<double, std::string> > Mapping;
 
   // Input variables and parsing
-  static char *kwlist[] = {"mapping", "iformat", "parameter", "rotations", "translation", "scale", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "Osd|OOO", kwlist,
+  static char *kwlist[] = {"mapping", "iformat", "parameter", "rotations", "translation", "scale", "interpolation", "lazy", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "Osd|OOOsi", kwlist,
                                                             &List_Mapping,
                                                             &FileFormat,
                                                             &Parameter,
                                                             &List_Rotations,
                                                             &List_Translation,
-                                                            &List_Scaling)) {
+                                                            &List_Scaling,
+                                                            &Interpolation,
+                                                            &Lazy)) {
     return NULL;
   }
 
@@ -460,7 +1335,16 @@ static PyObject* OSCARSSR_AddMagneticFieldInterpolated (OSCARSSRObject* self, Py
       }
 
       ParameterValue = PyFloat_AsDouble(PyList_GetItem(ThisPair, 0));
-      FileName = PyBytes_AS_STRING(PyList_GetItem(ThisPair, 1));
+#if PY_MAJOR_VERSION >= 3
+      char const* ThisName = PyUnicode_AsUTF8(PyList_GetItem(ThisPair, 1));
+#else
+      char const* ThisName = PyString_AsString(PyList_GetItem(ThisPair, 1));
+#endif
+      if (ThisName == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Incorrect file name in 'mapping'");
+        return NULL;
+      }
+      FileName = ThisName;
 
       Mapping.push_back(std::make_pair(ParameterValue, FileName));
     }
@@ -504,7 +1388,7 @@ static PyObject* OSCARSSR_AddMagneticFieldInterpolated (OSCARSSRObject* self, Py
 
   // Add the magnetic field to the OSCARSSR object
   try {
-    self->obj->AddMagneticFieldInterpolated(Mapping, FileFormat, Parameter, Rotations, Translation, Scaling);
+    self->obj->AddMagneticFieldInterpolated(Mapping, FileFormat, Parameter, Rotations, Translation, Scaling, Interpolation, Lazy != 0);
   } catch (...) {
     PyErr_SetString(PyExc_ValueError, "Could not import magnetic field.  Check filenames and 'iformat' are correct");
     return NULL;
@@ -522,29 +1406,252 @@ static PyObject* OSCARSSR_AddMagneticFieldInterpolated (OSCARSSRObject* self, Py
 
 
 
-static PyObject* OSCARSSR_AddMagneticFieldFunction (OSCARSSRObject* self, PyObject* args)
+static PyObject* OSCARSSR_SetMagneticFieldParameter (OSCARSSRObject* self, PyObject* arg)
 {
-  // Add a python function as a magnetic field object
+  // Move all interpolated magnetic fields to a new parameter value.  The maps
+  // are already in memory so nothing is read from disk
+
+  TOSCARSSRModification Modification(self);
 
-  // Grab the function
-  PyObject* Function;
-  if (! PyArg_ParseTuple(args, "O:set_callback", &Function)) {
+  // Grab the value from input
+  double const Parameter = PyFloat_AsDouble(arg);
+  if (PyErr_Occurred()) {
     return NULL;
   }
 
-  // Increment ref to function for python
-  Py_INCREF(Function);
+  try {
+    self->obj->SetMagneticFieldParameter(Parameter);
+  } catch (std::out_of_range e) {
+    PyErr_SetString(PyExc_ValueError, "'parameter' is outside of the range of the mapping");
+    return NULL;
+  } catch (...) {
+    PyErr_SetString(PyExc_ValueError, "No interpolated magnetic field to set the parameter of.  Use add_bfield_interpolated first");
+    return NULL;
+  }
+
+  // Must return python object None in a special way
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+
+
+
+
+
+
+
+static PyObject* OSCARSSR_AddMagneticFieldFourier (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // Add a magnetic field from a periodic map as a Fourier series along z.  Returns the
+  // accuracy of the series against the map and the memory used.
+
+  TOSCARSSRModification Modification(self);
+
+  // Grab the values
+  char const* FileName         = "";
+  char const* FileFormat       = "";
+  double      Period           = 0;
+  int         NHarmonics       = 8;
+  double      Ends             = -1;
+  PyObject*   List_Rotations   = PyList_New(0);
+  PyObject*   List_Translation = PyList_New(0);
+  PyObject*   List_Scaling     = PyList_New(0);
+
+  TVector3D Rotations(0, 0, 0);
+  TVector3D Translation(0, 0, 0);
+  std::vector<double> Scaling;
+
+  // Input variables and parsing
+  static char *kwlist[] = {"ifile", "iformat", "period", "nharmonics", "ends", "rotations", "translation", "scale", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "ssd|idOOO", kwlist,
+                                                            &FileName,
+                                                            &FileFormat,
+                                                            &Period,
+                                                            &NHarmonics,
+                                                            &Ends,
+                                                            &List_Rotations,
+                                                            &List_Translation,
+                                                            &List_Scaling)) {
+    return NULL;
+  }
+
+  // Check that filename and format exist
+  if (std::strlen(FileName) == 0 || std::strlen(FileFormat) == 0) {
+    PyErr_SetString(PyExc_ValueError, "'ifile' or 'iformat' is blank");
+    return NULL;
+  }
+
+  // Check for Rotations in the input
+  if (PyList_Size(List_Rotations) != 0) {
+    try {
+      Rotations = OSCARSSR_ListAsTVector3D(List_Rotations);
+    } catch (std::length_error e) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect format in 'rotations'");
+      return NULL;
+    }
+  }
+
+  // Check for Translation in the input
+  if (PyList_Size(List_Translation) != 0) {
+    try {
+      Translation = OSCARSSR_ListAsTVector3D(List_Translation);
+    } catch (std::length_error e) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect format in 'translation'");
+      return NULL;
+    }
+  }
+
+  // Get any scaling factors
+  for (size_t i = 0; i < PyList_Size(List_Scaling); ++i) {
+    Scaling.push_back(PyFloat_AsDouble(PyList_GetItem(List_Scaling, i)));
+  }
+
+  // Read and fit the map
+  TField3D_Fourier* Field = 0x0;
+  try {
+    Field = new TField3D_Fourier(FileName, FileFormat, Period, NHarmonics, Ends, Rotations, Translation, Scaling);
+  } catch (std::invalid_argument e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  } catch (...) {
+    PyErr_SetString(PyExc_ValueError, "Could not import magnetic field.  Check 'ifile' and 'iformat' are correct");
+    return NULL;
+  }
+
+  // Accuracy report
+  PyObject* Report = Py_BuildValue("{s:d,s:d,s:d,s:n,s:n}",
+                                   "max_error", Field->GetMaxError(),
+                                   "rms_error", Field->GetRMSError(),
+                                   "max_field", Field->GetMaxField(),
+                                   "nbytes",    (Py_ssize_t) Field->GetSize(),
+                                   "nbytes_map", (Py_ssize_t) Field->GetMapSize());
+
+  // Add the field to the OSCARSSR object, which owns it from here
+  self->obj->AddMagneticField((TField*) Field);
+
+  return Report;
+}
+
+
+
+
+
+
+
+
+static TField* OSCARSSR_NewFieldFunction (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // Field from a python function.  A vectorized function takes an (N, 3) array of points and
+  // returns N fields.  If npoints are given in any direction the function is tabulated
+  // onto a grid over xlim, ylim, zlim and/or the beam corridor, calling it only a few times,
+  // and the field is looked up in the grid from then on without any python.  A vectorized
+  // function must be tabulated: the trajectory asks for one point at a time, which would
+  // cost more than a plain function.
+  // Returns 0x0 with the python error set if anything is wrong.
+
+  PyObject*   Function      = 0x0;
+  int         Vectorized    = 0;
+  PyObject*   List_XLim     = PyList_New(0);
+  int         NX            = 0;
+  PyObject*   List_YLim     = PyList_New(0);
+  int         NY            = 0;
+  PyObject*   List_ZLim     = PyList_New(0);
+  int         NZ            = 0;
+  double      Corridor      = 0;
+  char const* Interpolation = "linear";
+
+  static char *kwlist[] = {"function", "vectorized", "xlim", "nx", "ylim", "ny", "zlim", "nz", "corridor", "interpolation", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|iOiOiOids", kwlist,
+                                                              &Function,
+                                                              &Vectorized,
+                                                              &List_XLim,
+                                                              &NX,
+                                                              &List_YLim,
+                                                              &NY,
+                                                              &List_ZLim,
+                                                              &NZ,
+                                                              &Corridor,
+                                                              &Interpolation)) {
+    return 0x0;
+  }
+
+  // Just the function
+  if (NX <= 1 && NY <= 1 && NZ <= 1) {
+    if (Vectorized) {
+      PyErr_SetString(PyExc_ValueError, "'vectorized' needs a grid to tabulate onto: 'nx', 'ny' and/or 'nz' with 'xlim', 'ylim', 'zlim' or 'corridor'");
+      return 0x0;
+    }
+    try {
+      return new TFieldPythonFunction(Function, Vectorized != 0);
+    } catch (std::invalid_argument e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return 0x0;
+    }
+  }
+
+  // Region to tabulate
+  TVector3D Min(0, 0, 0);
+  TVector3D Max(0, 0, 0);
+  if (!OSCARSSR_GetExtractionBox(self, List_XLim, List_YLim, List_ZLim, Corridor, Min, Max)) {
+    return 0x0;
+  }
+
+  int const N[3] = {std::max(NX, 1), std::max(NY, 1), std::max(NZ, 1)};
+  char const* const Names[3] = {"'xlim' or 'corridor' is needed to tabulate in x", "'ylim' or 'corridor' is needed to tabulate in y", "'zlim' or a corridor with ctstart and ctstop is needed to tabulate in z"};
+  TVector3D Start(0, 0, 0);
+  TVector3D Step(0, 0, 0);
+  for (int d = 0; d != 3; ++d) {
+    bool const Bounded = Min != Max && std::fabs(Min[d]) < 1e99 && std::fabs(Max[d]) < 1e99;
+    if (N[d] > 1 && !Bounded) {
+      PyErr_SetString(PyExc_ValueError, Names[d]);
+      return 0x0;
+    }
+
+    // One point is at the middle of the limits if there are any
+    if (N[d] > 1) {
+      Start[d] = Min[d];
+      Step[d]  = (Max[d] - Min[d]) / (N[d] - 1);
+    } else if (Bounded) {
+      Start[d] = (Min[d] + Max[d]) / 2.;
+    }
+  }
 
-  // Add the function as a field to the OSCARSSR object
   try {
-    self->obj->AddMagneticField( (TField*) new TFieldPythonFunction(Function));
+    TFieldPythonFunction const Python(Function, Vectorized != 0);
+    return new TField3D_Grid(Python, Start, Step, N[0], N[1], N[2], TField3D_Grid::GetInterpolation(Interpolation));
   } catch (std::invalid_argument e) {
     PyErr_SetString(PyExc_ValueError, e.what());
+  } catch (...) {
+    // Keep the error of a python function that raised
+    if (!PyErr_Occurred()) {
+      PyErr_SetString(PyExc_ValueError, "Could not tabulate the python function");
+    }
+  }
+
+  return 0x0;
+}
+
+
+
+
+
+
+
+
+static PyObject* OSCARSSR_AddMagneticFieldFunction (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // Add a python function as a magnetic field object, or tabulate it onto a grid
+
+  TOSCARSSRModification Modification(self);
+
+  TField* Field = OSCARSSR_NewFieldFunction(self, args, keywds);
+  if (Field == 0x0) {
     return NULL;
   }
 
-  // Decrement reference to function for python
-  Py_DECREF(Function);
+  // Add the function as a field to the OSCARSSR object
+  self->obj->AddMagneticField(Field);
 
   // Must return python object None in a special way
   Py_INCREF(Py_None);
@@ -562,6 +1669,8 @@ static PyObject* OSCARSSR_AddMagneticFieldGaussian (OSCARSSRObject* self, PyObje
 {
   // Add a magnetic field that is a gaussian
 
+  TOSCARSSRModification Modification(self);
+
   // Lists and variables
   PyObject* List_BField       = PyList_New(0);
   PyObject* List_Translation  = PyList_New(0);
@@ -641,6 +1750,8 @@ static PyObject* OSCARSSR_AddMagneticFieldUniform (OSCARSSRObject* self, PyObjec
 {
   // Add a uniform field with a given width in a given direction, or for all space
 
+  TOSCARSSRModification Modification(self);
+
   // Lists and vectors
   PyObject* List_BField      = PyList_New(0);
   PyObject* List_Translation = PyList_New(0);
@@ -716,6 +1827,8 @@ static PyObject* OSCARSSR_AddMagneticFieldUniform (OSCARSSRObject* self, PyObjec
 
 static PyObject* OSCARSSR_ClearMagneticFields (OSCARSSRObject* self)
 {
+  TOSCARSSRModification Modification(self);
+
   // Clear all magnetic fields in the OSCARSSR object
   self->obj->ClearMagneticFields();
 
@@ -737,6 +1850,8 @@ static PyObject* OSCARSSR_AddMagneticFieldIdealUndulator (OSCARSSRObject* self,
 {
   // Add a magnetic field for undulator
 
+  TOSCARSSRModification Modification(self);
+
   // Lists and variables
   PyObject* List_Field      = PyList_New(0);
   PyObject* List_Period      = PyList_New(0);
@@ -828,6 +1943,8 @@ static PyObject* OSCARSSR_GetBField (OSCARSSRObject* self, PyObject* args)
 {
   // Get the magnetic field at a point as a 3D list [Bx, By, Bz]
 
+  TOSCARSSRModification Modification(self);
+
   // Python list object
   PyObject * List;
 
@@ -836,6 +1953,39 @@ static PyObject* OSCARSSR_GetBField (OSCARSSRObject* self, PyObject* args)
     return NULL;
   }
 
+  // A list of points is evaluated in one batch and returns a list of [Fx, Fy, Fz]
+  if (PyList_Size(List) > 0 && PyList_Check(PyList_GetItem(List, 0))) {
+
+    // Grab all of the points
+    std::vector<TVector3D> X(PyList_Size(List));
+    try {
+      for (size_t i = 0; i != X.size(); ++i) {
+        X[i] = OSCARSSR_ListAsTVector3D(PyList_GetItem(List, i));
+      }
+    } catch (std::length_error e) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect format in input");
+      return NULL;
+    }
+
+    // Evaluate the field at all points
+    std::vector<TVector3D> F;
+    try {
+      self->obj->GetBBatch(X, F);
+    } catch (std::exception const& e) {
+      return OSCARSSR_CalculationError(e);
+    }
+
+    // Create a python list of lists
+    PyObject *PList = PyList_New(0);
+    for (size_t i = 0; i != F.size(); ++i) {
+      PyObject *PF = OSCARSSR_TVector3DAsList(F[i]);
+      PyList_Append(PList, PF);
+      Py_DECREF(PF);
+    }
+
+    return PList;
+  }
+
   // Has to have the correct number of arguments
   if (PyList_Size(List) != 3) {
     return NULL;
@@ -851,7 +2001,12 @@ static PyObject* OSCARSSR_GetBField (OSCARSSRObject* self, PyObject* args)
   }
 
   // Set the object variable
-  TVector3D const B = self->obj->GetB(X);
+  TVector3D B;
+  try {
+    B = self->obj->GetB(X);
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
+  }
 
   // Create a python list
   PyObject *PList = OSCARSSR_TVector3DAsList(B);
@@ -878,6 +2033,8 @@ static PyObject* OSCARSSR_AddElectricField (OSCARSSRObject* self, PyObject* args
   // Add a magnetic field from a file.
   // UPDATE: add binary file reading
 
+  TOSCARSSRModification Modification(self);
+
 
   // Grab the values
   char const* FileName = "";
@@ -885,20 +2042,53 @@ static PyObject* OSCARSSR_AddElectricField (OSCARSSRObject* self, PyObject* args
   PyObject*   List_Rotations   = PyList_New(0);
   PyObject*   List_Translation = PyList_New(0);
   PyObject*   List_Scaling     = PyList_New(0);
+  char const* Interpolation    = "linear";
+  int         Shared           = 0;
+  PyObject*   List_XLim        = PyList_New(0);
+  PyObject*   List_YLim        = PyList_New(0);
+  PyObject*   List_ZLim        = PyList_New(0);
+  double      Corridor         = 0;
+  char const* Storage          = "double";
+  PyObject*   List_XMirror     = PyList_New(0);
+  PyObject*   List_YMirror     = PyList_New(0);
+  PyObject*   List_ZMirror     = PyList_New(0);
 
   TVector3D Rotations(0, 0, 0);
   TVector3D Translation(0, 0, 0);
   std::vector<double> Scaling;
+  TVector3D ExtractMin(0, 0, 0);
+  TVector3D ExtractMax(0, 0, 0);
+  TVector3D Mirror[3] = {TVector3D(0, 0, 0), TVector3D(0, 0, 0), TVector3D(0, 0, 0)};
 
 
   // Input variables and parsing
-  static char *kwlist[] = {"ifile", "iformat", "rotations", "translation", "scale", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "ss|OOO", kwlist,
-                                                           &FileName,
-                                                           &FileFormat,
-                                                           &List_Rotations,
-                                                           &List_Translation,
-                                                           &List_Scaling)) {
+  static char *kwlist[] = {"ifile", "iformat", "rotations", "translation", "scale", "interpolation", "shared", "xlim", "ylim", "zlim", "corridor", "storage", "xmirror", "ymirror", "zmirror", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "ss|OOOsiOOOdsOOO", kwlist,
+                                                            &FileName,
+                                                            &FileFormat,
+                                                            &List_Rotations,
+                                                            &List_Translation,
+                                                            &List_Scaling,
+                                                            &Interpolation,
+                                                            &Shared,
+                                                            &List_XLim,
+                                                            &List_YLim,
+                                                            &List_ZLim,
+                                                            &Corridor,
+                                                            &Storage,
+                                                            &List_XMirror,
+                                                            &List_YMirror,
+                                                            &List_ZMirror)) {
+    return NULL;
+  }
+
+  // Part of the file to keep, if only part is wanted
+  if (!OSCARSSR_GetExtractionBox(self, List_XLim, List_YLim, List_ZLim, Corridor, ExtractMin, ExtractMax)) {
+    return NULL;
+  }
+
+  // Parity of the field components for mirror symmetric maps
+  if (!OSCARSSR_GetMirrors(List_XMirror, List_YMirror, List_ZMirror, Mirror)) {
     return NULL;
   }
 
@@ -937,7 +2127,10 @@ static PyObject* OSCARSSR_AddElectricField (OSCARSSRObject* self, PyObject* args
 
   // Add the magnetic field to the OSCARSSR object
   try {
-    self->obj->AddElectricField(FileName, FileFormat, Rotations, Translation, Scaling);
+    self->obj->AddElectricField(FileName, FileFormat, Rotations, Translation, Scaling, Interpolation, Shared != 0, ExtractMin, ExtractMax, Storage, Mirror[0], Mirror[1], Mirror[2]);
+  } catch (std::invalid_argument e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
   } catch (...) {
     PyErr_SetString(PyExc_ValueError, "Could not import electric field.  Check 'ifile' and 'iformat' are correct");
     return NULL;
@@ -955,29 +2148,19 @@ static PyObject* OSCARSSR_AddElectricField (OSCARSSRObject* self, PyObject* args
 
 
 
-static PyObject* OSCARSSR_AddElectricFieldFunction (OSCARSSRObject* self, PyObject* args)
+static PyObject* OSCARSSR_AddElectricFieldFunction (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
 {
-  // Add a python function as an electric field object
-
-  // Grab the function
-  PyObject* Function;
-  if (! PyArg_ParseTuple(args, "O:set_callback", &Function)) {
-    return NULL;
-  }
+  // Add a python function as an electric field object, or tabulate it onto a grid
 
-  // Increment ref to function for python
-  Py_INCREF(Function);
+  TOSCARSSRModification Modification(self);
 
-  // Add the function as a field to the OSCARSSR object
-  try {
-    self->obj->AddElectricField( (TField*) new TFieldPythonFunction(Function));
-  } catch (std::invalid_argument e) {
-    PyErr_SetString(PyExc_ValueError, e.what());
+  TField* Field = OSCARSSR_NewFieldFunction(self, args, keywds);
+  if (Field == 0x0) {
     return NULL;
   }
 
-  // Decrement reference to function for python
-  Py_DECREF(Function);
+  // Add the function as a field to the OSCARSSR object
+  self->obj->AddElectricField(Field);
 
   // Must return python object None in a special way
   Py_INCREF(Py_None);
@@ -995,6 +2178,8 @@ static PyObject* OSCARSSR_AddElectricFieldGaussian (OSCARSSRObject* self, PyObje
 {
   // Add an electric field that is a gaussian
 
+  TOSCARSSRModification Modification(self);
+
   // Lists and variables
   PyObject* List_Field       = PyList_New(0);
   PyObject* List_Translation  = PyList_New(0);
@@ -1074,6 +2259,8 @@ static PyObject* OSCARSSR_AddElectricFieldUniform (OSCARSSRObject* self, PyObjec
 {
   // Add a uniform field with a given width in a given direction, or for all space
 
+  TOSCARSSRModification Modification(self);
+
   // Lists and vectors
   PyObject* List_Field       = PyList_New(0);
   PyObject* List_Translation = PyList_New(0);
@@ -1157,6 +2344,8 @@ static PyObject* OSCARSSR_AddElectricFieldIdealUndulator (OSCARSSRObject* self,
 {
   // Add an electric field undulator to OSCARSSR
 
+  TOSCARSSRModification Modification(self);
+
   // Lists and variables
   PyObject* List_Field       = PyList_New(0);
   PyObject* List_Period      = PyList_New(0);
@@ -1241,16 +2430,51 @@ static PyObject* OSCARSSR_AddElectricFieldIdealUndulator (OSCARSSRObject* self,
 
 
 
-static PyObject* OSCARSSR_GetEField (OSCARSSRObject* self, PyObject* args)
-{
-  // Get the magnetic field at a point as a 3D list [Ex, Ey, Ez]
+static PyObject* OSCARSSR_GetEField (OSCARSSRObject* self, PyObject* args)
+{
+  // Get the magnetic field at a point as a 3D list [Ex, Ey, Ez]
+
+  TOSCARSSRModification Modification(self);
+
+  // Python list object
+  PyObject * List;
+
+  // Grab the python list from the input
+  if (! PyArg_ParseTuple( args, "O!", &PyList_Type, &List)) {
+    return NULL;
+  }
+
+  // A list of points is evaluated in one batch and returns a list of [Fx, Fy, Fz]
+  if (PyList_Size(List) > 0 && PyList_Check(PyList_GetItem(List, 0))) {
+
+    // Grab all of the points
+    std::vector<TVector3D> X(PyList_Size(List));
+    try {
+      for (size_t i = 0; i != X.size(); ++i) {
+        X[i] = OSCARSSR_ListAsTVector3D(PyList_GetItem(List, i));
+      }
+    } catch (std::length_error e) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect format in input");
+      return NULL;
+    }
+
+    // Evaluate the field at all points
+    std::vector<TVector3D> F;
+    try {
+      self->obj->GetEBatch(X, F);
+    } catch (std::exception const& e) {
+      return OSCARSSR_CalculationError(e);
+    }
 
-  // Python list object
-  PyObject * List;
+    // Create a python list of lists
+    PyObject *PList = PyList_New(0);
+    for (size_t i = 0; i != F.size(); ++i) {
+      PyObject *PF = OSCARSSR_TVector3DAsList(F[i]);
+      PyList_Append(PList, PF);
+      Py_DECREF(PF);
+    }
 
-  // Grab the python list from the input
-  if (! PyArg_ParseTuple( args, "O!", &PyList_Type, &List)) {
-    return NULL;
+    return PList;
   }
 
   // Has to have the correct number of arguments
@@ -1268,7 +2492,12 @@ static PyObject* OSCARSSR_GetEField (OSCARSSRObject* self, PyObject* args)
   }
 
   // Set the object variable
-  TVector3D const F = self->obj->GetE(X);
+  TVector3D F;
+  try {
+    F = self->obj->GetE(X);
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
+  }
 
   // Create a python list
   PyObject *PList = OSCARSSR_TVector3DAsList(F);
@@ -1281,6 +2510,8 @@ static PyObject* OSCARSSR_GetEField (OSCARSSRObject* self, PyObject* args)
 
 static PyObject* OSCARSSR_ClearElectricFields (OSCARSSRObject* self)
 {
+  TOSCARSSRModification Modification(self);
+
   // Clear all magnetic fields in the OSCARSSR object
   self->obj->ClearElectricFields();
 
@@ -1307,6 +2538,8 @@ static PyObject* OSCARSSR_AddFieldGaussian (OSCARSSRObject* self, PyObject* args
 {
   // Add a magnetic field that is a gaussian
 
+  TOSCARSSRModification Modification(self);
+
   // Lists and variables
   PyObject* List_BField       = PyList_New(0);
   PyObject* List_EField       = PyList_New(0);
@@ -1408,6 +2641,8 @@ static PyObject* OSCARSSR_WriteMagneticField (OSCARSSRObject* self, PyObject* ar
 {
   // Add a magnetic field that is a gaussian
 
+  TOSCARSSRModification Modification(self);
+
   const char* OutFileName = "";
   const char* OutFormat   = "";
   const char* Comment     = "";
@@ -1499,6 +2734,8 @@ static PyObject* OSCARSSR_WriteElectricField (OSCARSSRObject* self, PyObject* ar
 {
   // Add a magnetic field that is a gaussian
 
+  TOSCARSSRModification Modification(self);
+
   const char* OutFileName = "";
   const char* OutFormat   = "";
   const char* Comment     = "";
@@ -1589,6 +2826,66 @@ static PyObject* OSCARSSR_WriteElectricField (OSCARSSRObject* self, PyObject* ar
 
 
 
+static PyObject* OSCARSSR_ClearSharedMaps (OSCARSSRObject* self)
+{
+  // Remove the field maps read with shared=1 from the shared directory, returns how many
+
+  size_t const NRemoved = TField3D_Grid::ClearShared();
+
+  return Py_BuildValue("n", (Py_ssize_t) NRemoved);
+}
+
+
+
+
+static PyObject* OSCARSSR_ConvertFieldFile (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // Convert a field file in any of the input formats to the OSCARSBIN binary format
+
+  const char* InFileName  = "";
+  const char* InFormat    = "";
+  const char* OutFileName = "";
+  const char* Comment     = "";
+  int         Float32     = 0;
+
+  // Input variables and parsing
+  static char *kwlist[] = {"ifile", "iformat", "ofile", "float32", "comment", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "sss|is", kwlist,
+                                                           &InFileName,
+                                                           &InFormat,
+                                                           &OutFileName,
+                                                           &Float32,
+                                                           &Comment)) {
+    return NULL;
+  }
+
+  // Check that filenames and format exist
+  if (std::strlen(InFileName) == 0 || std::strlen(InFormat) == 0 || std::strlen(OutFileName) == 0) {
+    PyErr_SetString(PyExc_ValueError, "'ifile', 'iformat', or 'ofile' is blank");
+    return NULL;
+  }
+
+  // Read the input and write it out again
+  try {
+    TField3D_Grid Grid(InFileName, InFormat);
+    Grid.WriteFile_Binary(OutFileName, Float32 != 0, std::strlen(Comment) == 0 ? InFileName : Comment);
+  } catch (...) {
+    PyErr_SetString(PyExc_ValueError, "could not convert field file.  Check 'ifile' and 'iformat' are correct");
+    return NULL;
+  }
+
+  // Must return python object None in a special way
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+
+
+
+
+
+
+
 
 
 
@@ -1642,6 +2939,8 @@ static PyObject* OSCARSSR_SetParticleBeam (OSCARSSRObject* self, PyObject* args,
 {
   // Clear all particle beams, add this beam, and set a new particle
 
+  TOSCARSSRModification Modification(self);
+
   self->obj->ClearParticleBeams();
 
   PyObject* ret = OSCARSSR_AddParticleBeam(self, args, keywds);
@@ -1662,6 +2961,8 @@ static PyObject* OSCARSSR_AddParticleBeam (OSCARSSRObject* self, PyObject* args,
 {
   // Add a particle beam to the experiment
 
+  TOSCARSSRModification Modification(self);
+
   // Lists and variables some with initial values
   char const* Type                       = "";
   char const* Name                       = "";
@@ -1892,6 +3193,8 @@ static PyObject* OSCARSSR_SetNewParticle (OSCARSSRObject* self, PyObject* args,
 {
   // Set a new particle within the OSCARSSR object
 
+  TOSCARSSRModification Modification(self);
+
   char const* Beam_IN = "";
   char const* Particle_IN = "";
 
@@ -1944,6 +3247,8 @@ static PyObject* OSCARSSR_SetNewParticle (OSCARSSRObject* self, PyObject* args,
 
 static PyObject* OSCARSSR_GetParticleX0 (OSCARSSRObject* self)
 {
+  TOSCARSSRModification Modification(self);
+
   // Get the particle position at particle t0
   return OSCARSSR_TVector3DAsList( self->obj->GetCurrentParticle().GetX0() );
 }
@@ -1953,6 +3258,8 @@ static PyObject* OSCARSSR_GetParticleX0 (OSCARSSRObject* self)
 
 static PyObject* OSCARSSR_GetParticleBeta0 (OSCARSSRObject* self)
 {
+  TOSCARSSRModification Modification(self);
+
   // Get the particle beta at particle t0
   return OSCARSSR_TVector3DAsList( self->obj->GetCurrentParticle().GetB0() );
 }
@@ -1962,6 +3269,8 @@ static PyObject* OSCARSSR_GetParticleBeta0 (OSCARSSRObject* self)
 
 static PyObject* OSCARSSR_GetParticleE0 (OSCARSSRObject* self)
 {
+  TOSCARSSRModification Modification(self);
+
   // Get the particle beta at particle t0
   return Py_BuildValue("f", (self->obj->GetCurrentParticle().GetE0()));
 }
@@ -1973,6 +3282,8 @@ static PyObject* OSCARSSR_ClearParticleBeams (OSCARSSRObject* self)
 {
   // Clear the contents of the particle beam container in OSCARSSR
 
+  TOSCARSSRModification Modification(self);
+
   self->obj->ClearParticleBeams();
 
   // Must return python object None in a special way
@@ -1990,17 +3301,21 @@ static PyObject* OSCARSSR_CalculateTrajectory (OSCARSSRObject* self)
   // Get the CTStop variable from OSCARSSR
 
   try {
+    TOSCARSSRCalculation Calculation(self);
     self->obj->CalculateTrajectory();
+
+    // Return the trajectory
+    Calculation.RestoreThread();
+    return OSCARSSR_GetTrajectory(self);
   } catch (std::length_error e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
   } catch (std::out_of_range e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
   }
-
-  // Return the trajectory
-  return OSCARSSR_GetTrajectory(self);
 }
 
 
@@ -2010,10 +3325,10 @@ static PyObject* OSCARSSR_CalculateTrajectory (OSCARSSRObject* self)
 
 static PyObject* OSCARSSR_GetTrajectory (OSCARSSRObject* self)
 {
-  // Get the Trajectory as 2 3D lists [[x, y, z], [BetaX, BetaY, BetaZ]]
+  // Get the Trajectory as 2 3D lists [[x, y, z], [BetaX, BetaY, BetaZ]], or the same
+  // numbers as an sr.array of shape [N][2][3]
 
-  // Create a python list
-  PyObject *PList = PyList_New(0);
+  TOSCARSSRModification Modification(self);
 
   // Grab trajectory
   TParticleTrajectoryPoints const& T = self->obj->GetTrajectory();
@@ -2021,6 +3336,28 @@ static PyObject* OSCARSSR_GetTrajectory (OSCARSSRObject* self)
   // Number of points in trajectory calculation
   size_t NTPoints = T.GetNPoints();
 
+  if (!self->OutputLists) {
+    // Copy of the points, as the trajectory is recalculated in place
+    std::shared_ptr<std::vector<double> > Data(new std::vector<double>(6 * NTPoints));
+    for (size_t iT = 0; iT != NTPoints; ++iT) {
+      TVector3D const& X = T.GetX(iT);
+      TVector3D const& B = T.GetB(iT);
+      double* P = Data->data() + 6 * iT;
+      P[0] = X.GetX();
+      P[1] = X.GetY();
+      P[2] = X.GetZ();
+      P[3] = B.GetX();
+      P[4] = B.GetY();
+      P[5] = B.GetZ();
+    }
+
+    Py_ssize_t const Shape[3] = { (Py_ssize_t) NTPoints, 2, 3 };
+    return OSCARSSR_NewArray(Data, Data->data(), 3, Shape);
+  }
+
+  // Create a python list
+  PyObject *PList = PyList_New(0);
+
   // Loop over all points in trajectory
   for (int iT = 0; iT != NTPoints; ++iT) {
     // Create a python list for X and Beta
@@ -2110,10 +3447,84 @@ static PyObject* OSCARSSR_GetT3DScalarAsList (OSCARSSRObject* self, T3DScalarCon
 
 
 
+
+static PyObject* OSCARSSR_GetSpectrumResult (OSCARSSRObject* self, std::shared_ptr<TSpectrumContainer const> const& Spectrum)
+{
+  // Spectrum for python output: a list or an sr.array [N][2] of energy, flux viewing
+  // the container, which the array keeps
+
+  if (self->OutputLists) {
+    return OSCARSSR_GetSpectrumAsList(self, *Spectrum);
+  }
+
+  Py_ssize_t const Shape[2] = { (Py_ssize_t) Spectrum->GetNPoints(), 2 };
+  return OSCARSSR_NewArray(Spectrum, Spectrum->GetData(), 2, Shape);
+}
+
+
+
+
+
+
+static PyObject* OSCARSSR_GetT3DScalarResult (OSCARSSRObject* self, std::shared_ptr<T3DScalarContainer const> const& C)
+{
+  // Points and values for python output: a list [[[x, y, z], V], ...] or an sr.array
+  // [N][4] of x, y, z, V viewing the container, which the array keeps
+
+  if (self->OutputLists) {
+    return OSCARSSR_GetT3DScalarAsList(self, *C);
+  }
+
+  Py_ssize_t const Shape[2] = { (Py_ssize_t) C->GetNPoints(), 4 };
+  return OSCARSSR_NewArray(C, C->GetData(), 2, Shape);
+}
+
+
+
+
+
+static PyObject* OSCARSSR_GetT3DScalarGridResult (OSCARSSRObject* self, std::shared_ptr<T3DScalarContainer const> const& C)
+{
+  // Values of a grid for python output as [NX1][NX2] in the order of the rectangle: nested
+  // lists or an sr.array viewing the container, which the array keeps
+
+  Py_ssize_t const Shape[2] = { (Py_ssize_t) C->GetGrid().GetNX1(), (Py_ssize_t) C->GetGrid().GetNX2() };
+  if ((size_t) (Shape[0] * Shape[1]) != C->GetNPoints()) {
+    PyErr_SetString(PyExc_ValueError, "grid is not full");
+    return NULL;
+  }
+
+  if (self->OutputLists) {
+    Py_ssize_t const Strides[2] = { Shape[1] * (Py_ssize_t) sizeof(double), (Py_ssize_t) sizeof(double) };
+    return OSCARSSR_ArrayAsList(C->GetValues(), 2, Shape, Strides);
+  }
+
+  return OSCARSSR_NewArray(C, C->GetValues(), 2, Shape);
+}
+
+
+
+
+
+
 TSpectrumContainer OSCARSSR_GetSpectrumFromList (PyObject* List)
 {
   // Take an input list in spectrum format and convert it to TSpectrumContainer object
 
+  // An sr.array [N][2] is read directly
+  if (PyObject_TypeCheck(List, &OSCARSSRArrayType)) {
+    OSCARSSRArrayObject const* A = (OSCARSSRArrayObject const*) List;
+    if (A->NDim != 2 || A->Shape[1] != 2) {
+      throw std::length_error("spectrum array must be [N][2]");
+    }
+
+    TSpectrumContainer S;
+    for (Py_ssize_t ip = 0; ip != A->Shape[0]; ++ip) {
+      S.AddPoint(A->Data[2 * ip], A->Data[2 * ip + 1]);
+    }
+    return S;
+  }
+
   // Increment reference for list
   Py_INCREF(List);
 
@@ -2152,6 +3563,21 @@ T3DScalarContainer OSCARSSR_GetT3DScalarContainerFromList (PyObject* List)
 {
   // Take an input list and convert it to T3DScalarContainer object
 
+  // An sr.array [N][4] is read directly
+  if (PyObject_TypeCheck(List, &OSCARSSRArrayType)) {
+    OSCARSSRArrayObject const* A = (OSCARSSRArrayObject const*) List;
+    if (A->NDim != 2 || A->Shape[1] != 4) {
+      throw std::length_error("array of points and values must be [N][4]");
+    }
+
+    T3DScalarContainer F;
+    for (Py_ssize_t ip = 0; ip != A->Shape[0]; ++ip) {
+      double const* P = A->Data + 4 * ip;
+      F.AddPoint(TVector3D(P[0], P[1], P[2]), P[3]);
+    }
+    return F;
+  }
+
   // Increment reference for list
   Py_INCREF(List);
 
@@ -2309,8 +3735,9 @@ static PyObject* OSCARSSR_CalculateSpectrum (OSCARSSRObject* self, PyObject* arg
     return NULL;
   }
 
-  // Container for spectrum
-  TSpectrumContainer SpectrumContainer;
+  // Container for spectrum, kept by the array returned
+  std::shared_ptr<TSpectrumContainer> Spectrum(new TSpectrumContainer());
+  TSpectrumContainer& SpectrumContainer = *Spectrum;
 
   if (VPoints_eV.size() == 0) {
     // Check NPoints parameter
@@ -2325,6 +3752,7 @@ static PyObject* OSCARSSR_CalculateSpectrum (OSCARSSRObject* self, PyObject* arg
 
   // Actually calculate the spectrum
   try {
+    TOSCARSSRCalculation Calculation(self);
     self->obj->CalculateSpectrum(Obs, SpectrumContainer, NParticles, NThreads, GPU);
   } catch (std::length_error e) {
     PyErr_SetString(PyExc_ValueError, e.what());
@@ -2335,6 +3763,8 @@ static PyObject* OSCARSSR_CalculateSpectrum (OSCARSSRObject* self, PyObject* arg
   } catch (std::invalid_argument e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
   }
 
 
@@ -2347,7 +3777,7 @@ static PyObject* OSCARSSR_CalculateSpectrum (OSCARSSRObject* self, PyObject* arg
   }
 
   // Return the spectrum
-  return OSCARSSR_GetSpectrumAsList(self, SpectrumContainer);
+  return OSCARSSR_GetSpectrumResult(self, Spectrum);
 }
 
 
@@ -2372,15 +3802,16 @@ static PyObject* OSCARSSR_CalculateTotalPower (OSCARSSRObject* self)
 
   double Power = 0;
 
-  // Check if a beam is at least defined
-  if (self->obj->GetNParticleBeams() < 1) {
-    PyErr_SetString(PyExc_ValueError, "No particle beam defined");
-    return NULL;
-  }
-
   // Return the total power
   // UPDATE: This does not fail when no beam defined
   try {
+    TOSCARSSRCalculation Calculation(self);
+
+    // Check if a beam is at least defined, with the object held
+    if (self->obj->GetNParticleBeams() < 1) {
+      throw std::out_of_range("No particle beam defined");
+    }
+
     Power = self->obj->CalculateTotalPower();
   } catch (std::length_error e) {
     PyErr_SetString(PyExc_ValueError, e.what());
@@ -2388,6 +3819,8 @@ static PyObject* OSCARSSR_CalculateTotalPower (OSCARSSRObject* self)
   } catch (std::out_of_range e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
   }
 
   return Py_BuildValue("f", Power);
@@ -2413,11 +3846,13 @@ static PyObject* OSCARSSR_CalculatePowerDensity (OSCARSSRObject* self, PyObject*
   int         GPU = 0;
   int         NThreads = 0;
   char const* OutFileName = "";
+  PyObject*   Array_Normals    = 0x0;
+  double      FarField = 0;
 
 
-  static char *kwlist[] = {"points", "normal", "rotations", "translation", "nparticles", "gpu", "nthreads", "ofile", NULL};
+  static char *kwlist[] = {"points", "normal", "rotations", "translation", "nparticles", "gpu", "nthreads", "ofile", "normals", "farfield", NULL};
 
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|iOOiiis", kwlist,
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|iOOiiisOd", kwlist,
                                                               &List_Points,
                                                               &NormalDirection,
                                                               &List_Rotations,
@@ -2425,13 +3860,15 @@ static PyObject* OSCARSSR_CalculatePowerDensity (OSCARSSRObject* self, PyObject*
                                                               &NParticles,
                                                               &GPU,
                                                               &NThreads,
-                                                              &OutFileName)) {
+                                                              &OutFileName,
+                                                              &Array_Normals,
+                                                              &FarField)) {
     return NULL;
   }
 
-  // Check if a beam is at least defined
-  if (self->obj->GetNParticleBeams() < 1) {
-    PyErr_SetString(PyExc_ValueError, "No particle beam defined");
+  // Check the far field precision
+  if (FarField < 0) {
+    PyErr_SetString(PyExc_ValueError, "'farfield' must be >= 0");
     return NULL;
   }
 
@@ -2469,9 +3906,20 @@ static PyObject* OSCARSSR_CalculatePowerDensity (OSCARSSRObject* self, PyObject*
     }
   }
 
+  // Points and normals given as [N][3] arrays are viewed without a copy
+  TOSCARSSRBuffer PointsBuffer;
+  TOSCARSSRBuffer NormalsBuffer;
+  std::unique_ptr<TSurfacePoints_View> View;
+  if (!PyList_Check(List_Points)) {
+    View.reset(OSCARSSR_NewSurfaceView(List_Points, Array_Normals, PointsBuffer, NormalsBuffer, Rotations, Translation, NormalDirection == -1));
+    if (!View) {
+      return NULL;
+    }
+  }
+
   // Look for arbitrary shape 3D points
   TSurfacePoints_3D Surface;
-  for (size_t i = 0; i < PyList_Size(List_Points); ++i) {
+  for (size_t i = 0; !View && i < PyList_Size(List_Points); ++i) {
     PyObject* LXN = PyList_GetItem(List_Points, i);
     TVector3D X;
     TVector3D N;
@@ -2532,15 +3980,23 @@ static PyObject* OSCARSSR_CalculatePowerDensity (OSCARSSRObject* self, PyObject*
     
 
 
-  // Container for Point plus scalar
-  T3DScalarContainer PowerDensityContainer;
+  // Container for Point plus scalar, kept by the array returned
+  std::shared_ptr<T3DScalarContainer> Container(new T3DScalarContainer());
+  T3DScalarContainer& PowerDensityContainer = *Container;
 
 
   // Actually calculate the spectrum
   bool const Directional = NormalDirection == 0 ? false : true;
 
   try {
-    self->obj->CalculatePowerDensity(Surface, PowerDensityContainer, Dim, Directional, NParticles, OutFileName, NThreads, GPU);
+    TOSCARSSRCalculation Calculation(self);
+
+    // Check if a beam is at least defined, with the object held
+    if (self->obj->GetNParticleBeams() < 1) {
+      throw std::out_of_range("No particle beam defined");
+    }
+
+    self->obj->CalculatePowerDensity(View ? (TSurfacePoints const&) *View : Surface, PowerDensityContainer, Dim, Directional, NParticles, OutFileName, NThreads, GPU, FarField);
   } catch (std::length_error e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
@@ -2550,30 +4006,13 @@ static PyObject* OSCARSSR_CalculatePowerDensity (OSCARSSRObject* self, PyObject*
   } catch (std::invalid_argument e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
   }
 
 
-  // Build the output list of: [[[x, y, z], PowerDensity], [...]]
-  // Create a python list
-  PyObject *PList = PyList_New(0);
-
-  size_t const NPoints = PowerDensityContainer.GetNPoints();
-
-  for (size_t i = 0; i != NPoints; ++i) {
-    T3DScalar P = PowerDensityContainer.GetPoint(i);
-
-    // Inner list for each point
-    PyObject *PList2 = PyList_New(0);
-
-
-    // Add position and value to list
-    PyList_Append(PList2, OSCARSSR_TVector3DAsList(P.GetX()));
-    PyList_Append(PList2, Py_BuildValue("f", P.GetV()));
-    PyList_Append(PList, PList2);
-
-  }
-
-  return PList;
+  // Output of: [[[x, y, z], PowerDensity], [...]] or an sr.array of rows [x, y, z, PowerDensity]
+  return OSCARSSR_GetT3DScalarResult(self, Container);
 }
 
 
@@ -2604,11 +4043,17 @@ static PyObject* OSCARSSR_CalculatePowerDensityRectangle (OSCARSSRObject* self,
   int         NThreads = 0;
   int         Dim = 2;
   char*       OutFileName = "";
+  double      Tolerance = 0;
+  int         MaxLevel = 4;
+  PyObject*   List_Resample    = PyList_New(0);
+  int         Symmetry = 0;
+  double      FarField = 0;
+  int         Grid = 0;
 
 
-  static char *kwlist[] = {"npoints", "plane", "width", "x0x1x2", "rotations", "translation", "ofile", "normal", "nparticles", "gpu", "nthreads", "dim",  NULL};
+  static char *kwlist[] = {"npoints", "plane", "width", "x0x1x2", "rotations", "translation", "ofile", "normal", "nparticles", "gpu", "nthreads", "dim", "tolerance", "maxlevel", "resample", "symmetry", "farfield", "grid", NULL};
 
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|sOOOOsiiiii", kwlist,
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|sOOOOsiiiiidiOidi", kwlist,
                                                                   &List_NPoints,
                                                                   &SurfacePlane,
                                                                   &List_Width,
@@ -2620,13 +4065,25 @@ static PyObject* OSCARSSR_CalculatePowerDensityRectangle (OSCARSSRObject* self,
                                                                   &NParticles,
                                                                   &GPU,
                                                                   &NThreads,
-                                                                  &Dim)) {
+                                                                  &Dim,
+                                                                  &Tolerance,
+                                                                  &MaxLevel,
+                                                                  &List_Resample,
+                                                                  &Symmetry,
+                                                                  &FarField,
+                                                                  &Grid)) {
     return NULL;
   }
 
-  // Check if a beam is at least defined
-  if (self->obj->GetNParticleBeams() < 1) {
-    PyErr_SetString(PyExc_ValueError, "No particle beam defined");
+  // Values alone are not kept for the points of an adaptive calculation
+  if (Grid && Tolerance > 0) {
+    PyErr_SetString(PyExc_ValueError, "'grid' cannot be used with 'tolerance'");
+    return NULL;
+  }
+
+  // Check the far field precision
+  if (FarField < 0) {
+    PyErr_SetString(PyExc_ValueError, "'farfield' must be >= 0");
     return NULL;
   }
 
@@ -2722,15 +4179,211 @@ static PyObject* OSCARSSR_CalculatePowerDensityRectangle (OSCARSSRObject* self,
       return NULL;
     }
 
-    for (std::vector<TVector3D>::iterator it = X0X1X2.begin(); it != X0X1X2.end(); ++it) {
-      it->RotateSelfXYZ(Rotations);
-      *it += Translation;
-    }
+    for (std::vector<TVector3D>::iterator it = X0X1X2.begin(); it != X0X1X2.end(); ++it) {
+      it->RotateSelfXYZ(Rotations);
+      *it += Translation;
+    }
+
+    // UPDATE: Check for orthogonality
+    Surface.Init((int) NX1, (int) NX2, X0X1X2[0], X0X1X2[1], X0X1X2[2], NormalDirection);
+  }
+
+
+  // Check number of particles
+  if (NParticles < 0) {
+    PyErr_SetString(PyExc_ValueError, "'nparticles' must be >= 1 (sort of)");
+    return NULL;
+  }
+
+
+  // Check GPU parameter
+  if (GPU != 0 && GPU != 1) {
+    PyErr_SetString(PyExc_ValueError, "'gpu' must be 0 or 1");
+    return NULL;
+  }
+
+  // Check NThreads parameter
+  if (NThreads < 0) {
+    PyErr_SetString(PyExc_ValueError, "'nthreads' must be > 0");
+    return NULL;
+  }
+
+  // Check you are not trying to use threads and GPU
+  if (NThreads > 0 && GPU == 1) {
+    PyErr_SetString(PyExc_ValueError, "gpu is 1 and nthreads > 0.  Both are not currently allowed.");
+    return NULL;
+  }
+    
+
+
+
+
+
+  // Container for Point plus scalar, or for values alone on a grid, kept by the array returned
+  std::shared_ptr<T3DScalarContainer> Container(new T3DScalarContainer());
+  T3DScalarContainer& PowerDensityContainer = *Container;
+
+
+  // Actually calculate the spectrum
+  bool const Directional = NormalDirection == 0 ? false : true;
+  try {
+    if (Grid) {
+      PowerDensityContainer.SetGrid(Surface, Dim);
+    }
+    TOSCARSSRCalculation Calculation(self);
+
+    // Check if a beam is at least defined, with the object held
+    if (self->obj->GetNParticleBeams() < 1) {
+      throw std::out_of_range("No particle beam defined");
+    }
+
+    if (Tolerance > 0) {
+      T3DScalarTree Tree;
+      self->obj->CalculatePowerDensityAdaptive(Surface, Tree, Tolerance, MaxLevel, Directional, NParticles, NThreads, GPU);
+      OSCARSSR_GetTreeResult(Tree, List_Resample, PowerDensityContainer, Dim, OutFileName);
+    } else if (Symmetry) {
+      self->obj->CalculatePowerDensityMirror(Surface, PowerDensityContainer, Dim, Directional, NParticles, OutFileName, NThreads, GPU);
+    } else {
+      self->obj->CalculatePowerDensity(Surface, PowerDensityContainer, Dim, Directional, NParticles, OutFileName, NThreads, GPU, FarField);
+    }
+  } catch (std::length_error e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  } catch (std::out_of_range e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  } catch (std::invalid_argument e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
+  }
+
+
+
+  // Output of: [[[x, y, z], PowerDensity], [...]] or an sr.array of rows [x, y, z, PowerDensity],
+  // or for a grid the power density alone as [NX1][NX2]
+  if (Grid) {
+    return OSCARSSR_GetT3DScalarGridResult(self, Container);
+  }
+  return OSCARSSR_GetT3DScalarResult(self, Container);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+static PyObject* OSCARSSR_CalculatePowerDensitySurface (OSCARSSRObject* self, PyObject* args, PyObject *keywds)
+{
+  // Calculate the power density on a built in, parametric or mesh surface.  See
+  // OSCARSSR_NewSurface for the surfaces.  With total the integrated power [W] is
+  // returned as well.  With a tolerance a mesh is refined where the power density
+  // changes and its smallest triangles are returned.  With occlusion a mesh shadows
+  // itself, and the meshes in the files of occluders (stl or obj, in the same frame as
+  // the surface after rotations and translation, with scale) shadow the surface.
+
+  char const* Shape = "";
+  PyObject*   List_Parameters  = PyList_New(0);
+  PyObject*   List_NPoints     = PyList_New(0);
+  PyObject*   List_URange      = PyList_New(0);
+  PyObject*   List_VRange      = PyList_New(0);
+  PyObject*   Position         = 0x0;
+  PyObject*   NormalFunction   = 0x0;
+  char const* InFileName = "";
+  char const* Format = "";
+  double      Scale = 1;
+  PyObject*   List_Rotations   = PyList_New(0);
+  PyObject*   List_Translation = PyList_New(0);
+  int         NormalDirection = 0;
+  int         NParticles = 0;
+  int         GPU = 0;
+  int         NThreads = 0;
+  int         Dim = 3;
+  char const* OutFileName = "";
+  int         Total = 0;
+  double      Tolerance = 0;
+  int         MaxLevel = 4;
+  double      FarField = 0;
+  int         Occlusion = 0;
+  PyObject*   List_Occluders   = PyList_New(0);
+
 
-    // UPDATE: Check for orthogonality
-    Surface.Init((int) NX1, (int) NX2, X0X1X2[0], X0X1X2[1], X0X1X2[2], NormalDirection);
+  static char *kwlist[] = {"shape", "parameters", "npoints", "urange", "vrange", "position", "normalfunction", "ifile", "format", "scale", "rotations", "translation", "normal", "nparticles", "gpu", "nthreads", "dim", "ofile", "total", "tolerance", "maxlevel", "farfield", "occlusion", "occluders", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "s|OOOOOOssdOOiiiiisididiO", kwlist,
+                                                                        &Shape,
+                                                                        &List_Parameters,
+                                                                        &List_NPoints,
+                                                                        &List_URange,
+                                                                        &List_VRange,
+                                                                        &Position,
+                                                                        &NormalFunction,
+                                                                        &InFileName,
+                                                                        &Format,
+                                                                        &Scale,
+                                                                        &List_Rotations,
+                                                                        &List_Translation,
+                                                                        &NormalDirection,
+                                                                        &NParticles,
+                                                                        &GPU,
+                                                                        &NThreads,
+                                                                        &Dim,
+                                                                        &OutFileName,
+                                                                        &Total,
+                                                                        &Tolerance,
+                                                                        &MaxLevel,
+                                                                        &FarField,
+                                                                        &Occlusion,
+                                                                        &List_Occluders)) {
+    return NULL;
+  }
+
+  // Check the far field precision
+  if (FarField < 0) {
+    PyErr_SetString(PyExc_ValueError, "'farfield' must be >= 0");
+    return NULL;
+  }
+
+  // Check the occlusion inputs
+  if (!PyList_Check(List_Occluders)) {
+    PyErr_SetString(PyExc_ValueError, "'occluders' must be a list of file names");
+    return NULL;
+  }
+  bool const Occluded = Occlusion != 0 || PyList_Size(List_Occluders) != 0;
+  if (Occlusion != 0 && std::string(Shape) != "mesh") {
+    PyErr_SetString(PyExc_ValueError, "'occlusion' is only for a mesh");
+    return NULL;
+  }
+  if (Occluded && (GPU != 0 || FarField > 0)) {
+    PyErr_SetString(PyExc_ValueError, "occlusion cannot be used with 'gpu' or 'farfield'");
+    return NULL;
   }
 
+  // Check requested dimension.  A mesh has no (u, v) coordinates for dim 2.
+  if (Dim != 2 && Dim != 3) {
+    PyErr_SetString(PyExc_ValueError, "'dim' must be 2 or 3");
+    return NULL;
+  }
+  if (Dim == 2 && std::string(Shape) == "mesh") {
+    PyErr_SetString(PyExc_ValueError, "'dim' must be 3 for a mesh, which has no (u, v) coordinates");
+    return NULL;
+  }
 
   // Check number of particles
   if (NParticles < 0) {
@@ -2738,7 +4391,6 @@ static PyObject* OSCARSSR_CalculatePowerDensityRectangle (OSCARSSRObject* self,
     return NULL;
   }
 
-
   // Check GPU parameter
   if (GPU != 0 && GPU != 1) {
     PyErr_SetString(PyExc_ValueError, "'gpu' must be 0 or 1");
@@ -2756,20 +4408,93 @@ static PyObject* OSCARSSR_CalculatePowerDensityRectangle (OSCARSSRObject* self,
     PyErr_SetString(PyExc_ValueError, "gpu is 1 and nthreads > 0.  Both are not currently allowed.");
     return NULL;
   }
-    
 
+  // Vectors for rotations and translations.  Default to 0
+  TVector3D Rotations(0, 0, 0);
+  TVector3D Translation(0, 0, 0);
+
+  // Check for Rotations in the input
+  if (PyList_Size(List_Rotations) != 0) {
+    try {
+      Rotations = OSCARSSR_ListAsTVector3D(List_Rotations);
+    } catch (std::length_error e) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect format in 'rotations'");
+      return NULL;
+    }
+  }
 
+  // Check for Translation in the input
+  if (PyList_Size(List_Translation) != 0) {
+    try {
+      Translation = OSCARSSR_ListAsTVector3D(List_Translation);
+    } catch (std::length_error e) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect format in 'translation'");
+      return NULL;
+    }
+  }
 
+  // The surface, built before the calculation lets go of the GIL
+  std::unique_ptr<TSurfacePoints> Surface(OSCARSSR_NewSurface(Shape, List_Parameters, List_NPoints, List_URange, List_VRange, Position, NormalFunction, InFileName, Format, Scale, Rotations, Translation, NormalDirection));
+  if (!Surface) {
+    return NULL;
+  }
 
+  // Triangles that shadow the surface
+  TTriangleBVH Occluders;
+  if (Occlusion != 0) {
+    Occluders.AddMesh(dynamic_cast<TSurfacePoints_Mesh const&>(*Surface));
+  }
+  for (size_t i = 0; i != PyList_Size(List_Occluders); ++i) {
+#if PY_MAJOR_VERSION >= 3
+    char const* ThisName = PyUnicode_Check(PyList_GetItem(List_Occluders, i)) ? PyUnicode_AsUTF8(PyList_GetItem(List_Occluders, i)) : NULL;
+#else
+    char const* ThisName = PyString_Check(PyList_GetItem(List_Occluders, i)) ? PyString_AsString(PyList_GetItem(List_Occluders, i)) : NULL;
+#endif
+    if (ThisName == NULL) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect file name in 'occluders'");
+      return NULL;
+    }
+    try {
+      Occluders.AddMesh(TSurfacePoints_Mesh(ThisName, "", Scale, Rotations, Translation));
+    } catch (std::ifstream::failure e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    } catch (std::invalid_argument e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    } catch (std::out_of_range e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    }
+  }
+  Occluders.Build();
 
-  // Container for Point plus scalar
-  T3DScalarContainer PowerDensityContainer;
 
+  // Container for Point plus scalar, kept by the array returned
+  std::shared_ptr<T3DScalarContainer> Container(new T3DScalarContainer());
+  T3DScalarContainer& PowerDensityContainer = *Container;
 
-  // Actually calculate the spectrum
+  // Actually calculate the power density
   bool const Directional = NormalDirection == 0 ? false : true;
+  // With a tolerance a mesh is refined and the leaves returned
+  T3DScalarTree Tree;
   try {
-    self->obj->CalculatePowerDensity(Surface, PowerDensityContainer, Dim, Directional, NParticles, OutFileName, NThreads, GPU);
+    TOSCARSSRCalculation Calculation(self);
+
+    // Check if a beam is at least defined, with the object held
+    if (self->obj->GetNParticleBeams() < 1) {
+      throw std::out_of_range("No particle beam defined");
+    }
+
+    if (Tolerance > 0) {
+      self->obj->CalculatePowerDensityAdaptive(*Surface, Tree, Tolerance, MaxLevel, Directional, NParticles, NThreads, GPU, Occluded ? &Occluders : 0x0);
+      Tree.GetLeaves(PowerDensityContainer);
+      if (std::strlen(OutFileName) != 0) {
+        PowerDensityContainer.WriteToFileText(OutFileName, 3);
+      }
+    } else {
+      self->obj->CalculatePowerDensity(*Surface, PowerDensityContainer, Dim, Directional, NParticles, OutFileName, NThreads, GPU, FarField, Occluded ? &Occluders : 0x0);
+    }
   } catch (std::length_error e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
@@ -2779,52 +4504,21 @@ static PyObject* OSCARSSR_CalculatePowerDensityRectangle (OSCARSSRObject* self,
   } catch (std::invalid_argument e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
   }
 
-
-
-  // Build the output list of: [[[x, y, z], PowerDensity], [...]]
-  // Create a python list
-  PyObject *PList = PyList_New(0);
-
-  size_t const NPoints = PowerDensityContainer.GetNPoints();
-
-  for (size_t i = 0; i != NPoints; ++i) {
-    T3DScalar P = PowerDensityContainer.GetPoint(i);
-
-    // Inner list for each point
-    PyObject *PList2 = PyList_New(0);
-
-
-    // Add position and value to list
-    PyList_Append(PList2, OSCARSSR_TVector3DAsList(P.GetX()));
-    PyList_Append(PList2, Py_BuildValue("f", P.GetV()));
-    PyList_Append(PList, PList2);
-
+  // Output of: [[[x, y, z], PowerDensity], [...]] or an sr.array of rows [x, y, z, PowerDensity]
+  if (Tolerance > 0) {
+    return OSCARSSR_TreeResult(OSCARSSR_GetT3DScalarResult(self, Container), Tree, Total);
   }
-
-  return PList;
+  return OSCARSSR_SurfaceResult(OSCARSSR_GetT3DScalarResult(self, Container), *Surface, PowerDensityContainer, Total);
 }
 
 
 
 
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
 
 static PyObject* OSCARSSR_CalculateFlux (OSCARSSRObject* self, PyObject* args, PyObject *keywds)
 {
@@ -2840,11 +4534,12 @@ static PyObject* OSCARSSR_CalculateFlux (OSCARSSRObject* self, PyObject* args, P
   int         GPU = 0;
   int         NThreads = 0;
   char const* OutFileName = "";
+  PyObject*   Array_Normals    = 0x0;
 
 
-  static char *kwlist[] = {"energy_eV", "points", "normal", "rotations", "translation", "nparticles", "nthreads", "gpu", "ofile", NULL};
+  static char *kwlist[] = {"energy_eV", "points", "normal", "rotations", "translation", "nparticles", "nthreads", "gpu", "ofile", "normals", NULL};
 
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "dO|iOOiiis", kwlist,
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "dO|iOOiiisO", kwlist,
                                                               &Energy_eV,
                                                               &List_Points,
                                                               &NormalDirection,
@@ -2853,13 +4548,8 @@ static PyObject* OSCARSSR_CalculateFlux (OSCARSSRObject* self, PyObject* args, P
                                                               &NParticles,
                                                               &NThreads,
                                                               &GPU,
-                                                              &OutFileName)) {
-    return NULL;
-  }
-
-  // Check if a beam is at least defined
-  if (self->obj->GetNParticleBeams() < 1) {
-    PyErr_SetString(PyExc_ValueError, "No particle beam defined");
+                                                              &OutFileName,
+                                                              &Array_Normals)) {
     return NULL;
   }
 
@@ -2897,9 +4587,20 @@ static PyObject* OSCARSSR_CalculateFlux (OSCARSSRObject* self, PyObject* args, P
     }
   }
 
+  // Points and normals given as [N][3] arrays are viewed without a copy
+  TOSCARSSRBuffer PointsBuffer;
+  TOSCARSSRBuffer NormalsBuffer;
+  std::unique_ptr<TSurfacePoints_View> View;
+  if (!PyList_Check(List_Points)) {
+    View.reset(OSCARSSR_NewSurfaceView(List_Points, Array_Normals, PointsBuffer, NormalsBuffer, Rotations, Translation, false));
+    if (!View) {
+      return NULL;
+    }
+  }
+
   // Look for arbitrary shape 3D points
   TSurfacePoints_3D Surface;
-  for (size_t i = 0; i < PyList_Size(List_Points); ++i) {
+  for (size_t i = 0; !View && i < PyList_Size(List_Points); ++i) {
     PyObject* LXN = PyList_GetItem(List_Points, i);
     TVector3D X;
     TVector3D N;
@@ -2956,11 +4657,19 @@ static PyObject* OSCARSSR_CalculateFlux (OSCARSSRObject* self, PyObject* args, P
 
 
 
-  // Container for Point plus scalar
-  T3DScalarContainer FluxContainer;
+  // Container for Point plus scalar, kept by the array returned
+  std::shared_ptr<T3DScalarContainer> Container(new T3DScalarContainer());
+  T3DScalarContainer& FluxContainer = *Container;
 
   try {
-    self->obj->CalculateFlux(Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dim, OutFileName);
+    TOSCARSSRCalculation Calculation(self);
+
+    // Check if a beam is at least defined, with the object held
+    if (self->obj->GetNParticleBeams() < 1) {
+      throw std::out_of_range("No particle beam defined");
+    }
+
+    self->obj->CalculateFlux(View ? (TSurfacePoints const&) *View : Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dim, OutFileName);
   } catch (std::length_error e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
@@ -2970,29 +4679,12 @@ static PyObject* OSCARSSR_CalculateFlux (OSCARSSRObject* self, PyObject* args, P
   } catch (std::invalid_argument e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
   }
 
-  // Build the output list of: [[[x, y, z], Flux], [...]]
-  // Create a python list
-  PyObject *PList = PyList_New(0);
-
-  size_t const NPoints = FluxContainer.GetNPoints();
-
-  for (size_t i = 0; i != NPoints; ++i) {
-    T3DScalar P = FluxContainer.GetPoint(i);
-
-    // Inner list for each point
-    PyObject *PList2 = PyList_New(0);
-
-
-    // Add position and value to list
-    PyList_Append(PList2, OSCARSSR_TVector3DAsList(P.GetX()));
-    PyList_Append(PList2, Py_BuildValue("f", P.GetV()));
-    PyList_Append(PList, PList2);
-
-  }
-
-  return PList;
+  // Output of: [[[x, y, z], Flux], [...]] or an sr.array of rows [x, y, z, Flux]
+  return OSCARSSR_GetT3DScalarResult(self, Container);
 }
 
 
@@ -3028,11 +4720,17 @@ static PyObject* OSCARSSR_CalculateFluxRectangle (OSCARSSRObject* self, PyObject
   int         NThreads = 0;
   int         GPU = 0;
   char const* OutFileName = "";
+  double      Tolerance = 0;
+  int         MaxLevel = 4;
+  PyObject*   List_Resample = PyList_New(0);
+  int         Symmetry = 0;
+  int         NUFFT = 0;
+  int         Grid = 0;
 
 
-  static char *kwlist[] = {"energy_eV", "npoints", "plane", "normal", "dim", "width", "rotations", "translation", "x0x1x2", "nparticles", "polarization", "nthreads", "gpu", "ofile", NULL};
+  static char *kwlist[] = {"energy_eV", "npoints", "plane", "normal", "dim", "width", "rotations", "translation", "x0x1x2", "nparticles", "polarization", "nthreads", "gpu", "ofile", "tolerance", "maxlevel", "resample", "symmetry", "nufft", "grid", NULL};
 
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "dO|siiOOOOisiis", kwlist,
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "dO|siiOOOOisiisdiOiii", kwlist,
                                                                    &Energy_eV,
                                                                    &List_NPoints,
                                                                    &SurfacePlane,
@@ -3046,13 +4744,19 @@ static PyObject* OSCARSSR_CalculateFluxRectangle (OSCARSSRObject* self, PyObject
                                                                    &Polarization,
                                                                    &NThreads,
                                                                    &GPU,
-                                                                   &OutFileName)) {
+                                                                   &OutFileName,
+                                                                   &Tolerance,
+                                                                   &MaxLevel,
+                                                                   &List_Resample,
+                                                                   &Symmetry,
+                                                                   &NUFFT,
+                                                                   &Grid)) {
     return NULL;
   }
 
-  // Check if a beam is at least defined
-  if (self->obj->GetNParticleBeams() < 1) {
-    PyErr_SetString(PyExc_ValueError, "No particle beam defined");
+  // Values alone are not kept for the points of an adaptive calculation
+  if (Grid && Tolerance > 0) {
+    PyErr_SetString(PyExc_ValueError, "'grid' cannot be used with 'tolerance'");
     return NULL;
   }
 
@@ -3177,25 +4881,234 @@ static PyObject* OSCARSSR_CalculateFluxRectangle (OSCARSSRObject* self, PyObject
     return NULL;
   }
 
-  // Check you are not trying to use threads and GPU
-  if (NThreads > 0 && GPU == 1) {
-    PyErr_SetString(PyExc_ValueError, "gpu is 1 and nthreads > 0.  Both are not currently allowed.");
+  // Check you are not trying to use threads and GPU
+  if (NThreads > 0 && GPU == 1) {
+    PyErr_SetString(PyExc_ValueError, "gpu is 1 and nthreads > 0.  Both are not currently allowed.");
+    return NULL;
+  }
+    
+
+
+
+  // Container for Point plus scalar, or for values alone on a grid, kept by the array returned
+  std::shared_ptr<T3DScalarContainer> Container(new T3DScalarContainer());
+  T3DScalarContainer& FluxContainer = *Container;
+
+
+  // Actually calculate the spectrum
+  // UPDATE: Needed, directional?
+  //bool const Directional = NormalDirection == 0 ? false : true;
+
+  try {
+    if (Grid) {
+      FluxContainer.SetGrid(Surface, Dim);
+    }
+    TOSCARSSRCalculation Calculation(self);
+
+    // Check if a beam is at least defined, with the object held
+    if (self->obj->GetNParticleBeams() < 1) {
+      throw std::out_of_range("No particle beam defined");
+    }
+
+    if (Tolerance > 0) {
+      T3DScalarTree Tree;
+      self->obj->CalculateFluxAdaptive(Surface, Energy_eV, Tree, Tolerance, MaxLevel, NParticles, NThreads, GPU);
+      OSCARSSR_GetTreeResult(Tree, List_Resample, FluxContainer, Dim, OutFileName);
+    } else if (Symmetry) {
+      self->obj->CalculateFluxMirror(Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dim, OutFileName);
+    } else if (NUFFT) {
+      self->obj->CalculateFluxNUFFT(Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dim, OutFileName);
+    } else {
+      self->obj->CalculateFlux(Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dim, OutFileName);
+    }
+  } catch (std::length_error e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  } catch (std::out_of_range e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  } catch (std::invalid_argument e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
+  }
+
+
+
+  // Output of: [[[x, y, z], Flux], [...]] or an sr.array of rows [x, y, z, Flux],
+  // or for a grid the flux alone as [NX1][NX2]
+  if (Grid) {
+    return OSCARSSR_GetT3DScalarGridResult(self, Container);
+  }
+  return OSCARSSR_GetT3DScalarResult(self, Container);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+static PyObject* OSCARSSR_CalculateFluxSurface (OSCARSSRObject* self, PyObject* args, PyObject *keywds)
+{
+  // Calculate the flux on a built in, parametric or mesh surface.  See OSCARSSR_NewSurface
+  // for the surfaces.  With total the flux integrated over the surface is returned as well.
+  // With a tolerance a mesh is refined where the flux changes and its smallest triangles
+  // are returned.
+
+  double      Energy_eV = 0;
+  char const* Shape = "";
+  PyObject*   List_Parameters  = PyList_New(0);
+  PyObject*   List_NPoints     = PyList_New(0);
+  PyObject*   List_URange      = PyList_New(0);
+  PyObject*   List_VRange      = PyList_New(0);
+  PyObject*   Position         = 0x0;
+  PyObject*   NormalFunction   = 0x0;
+  char const* InFileName = "";
+  char const* Format = "";
+  double      Scale = 1;
+  PyObject*   List_Rotations   = PyList_New(0);
+  PyObject*   List_Translation = PyList_New(0);
+  int         NormalDirection = 0;
+  int         NParticles = 0;
+  int         GPU = 0;
+  int         NThreads = 0;
+  int         Dim = 3;
+  char const* OutFileName = "";
+  int         Total = 0;
+  double      Tolerance = 0;
+  int         MaxLevel = 4;
+
+
+  static char *kwlist[] = {"energy_eV", "shape", "parameters", "npoints", "urange", "vrange", "position", "normalfunction", "ifile", "format", "scale", "rotations", "translation", "normal", "nparticles", "gpu", "nthreads", "dim", "ofile", "total", "tolerance", "maxlevel", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "ds|OOOOOOssdOOiiiiisidi", kwlist,
+                                                                         &Energy_eV,
+                                                                         &Shape,
+                                                                         &List_Parameters,
+                                                                         &List_NPoints,
+                                                                         &List_URange,
+                                                                         &List_VRange,
+                                                                         &Position,
+                                                                         &NormalFunction,
+                                                                         &InFileName,
+                                                                         &Format,
+                                                                         &Scale,
+                                                                         &List_Rotations,
+                                                                         &List_Translation,
+                                                                         &NormalDirection,
+                                                                         &NParticles,
+                                                                         &GPU,
+                                                                         &NThreads,
+                                                                         &Dim,
+                                                                         &OutFileName,
+                                                                         &Total,
+                                                                         &Tolerance,
+                                                                         &MaxLevel)) {
+    return NULL;
+  }
+
+  // Check requested dimension.  A mesh has no (u, v) coordinates for dim 2.
+  if (Dim != 2 && Dim != 3) {
+    PyErr_SetString(PyExc_ValueError, "'dim' must be 2 or 3");
+    return NULL;
+  }
+  if (Dim == 2 && std::string(Shape) == "mesh") {
+    PyErr_SetString(PyExc_ValueError, "'dim' must be 3 for a mesh, which has no (u, v) coordinates");
+    return NULL;
+  }
+
+  // Check number of particles
+  if (NParticles < 0) {
+    PyErr_SetString(PyExc_ValueError, "'nparticles' must be >= 1 (sort of)");
+    return NULL;
+  }
+
+  // Check GPU parameter
+  if (GPU != 0 && GPU != 1) {
+    PyErr_SetString(PyExc_ValueError, "'gpu' must be 0 or 1");
+    return NULL;
+  }
+
+  // Check NThreads parameter
+  if (NThreads < 0) {
+    PyErr_SetString(PyExc_ValueError, "'nthreads' must be > 0");
+    return NULL;
+  }
+
+  // Check you are not trying to use threads and GPU
+  if (NThreads > 0 && GPU == 1) {
+    PyErr_SetString(PyExc_ValueError, "gpu is 1 and nthreads > 0.  Both are not currently allowed.");
+    return NULL;
+  }
+
+  // Vectors for rotations and translations.  Default to 0
+  TVector3D Rotations(0, 0, 0);
+  TVector3D Translation(0, 0, 0);
+
+  // Check for Rotations in the input
+  if (PyList_Size(List_Rotations) != 0) {
+    try {
+      Rotations = OSCARSSR_ListAsTVector3D(List_Rotations);
+    } catch (std::length_error e) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect format in 'rotations'");
+      return NULL;
+    }
+  }
+
+  // Check for Translation in the input
+  if (PyList_Size(List_Translation) != 0) {
+    try {
+      Translation = OSCARSSR_ListAsTVector3D(List_Translation);
+    } catch (std::length_error e) {
+      PyErr_SetString(PyExc_ValueError, "Incorrect format in 'translation'");
+      return NULL;
+    }
+  }
+
+  // The surface, built before the calculation lets go of the GIL
+  std::unique_ptr<TSurfacePoints> Surface(OSCARSSR_NewSurface(Shape, List_Parameters, List_NPoints, List_URange, List_VRange, Position, NormalFunction, InFileName, Format, Scale, Rotations, Translation, NormalDirection));
+  if (!Surface) {
     return NULL;
   }
-    
-
 
 
-  // Container for Point plus scalar
-  T3DScalarContainer FluxContainer;
+  // Container for Point plus scalar, kept by the array returned
+  std::shared_ptr<T3DScalarContainer> Container(new T3DScalarContainer());
+  T3DScalarContainer& FluxContainer = *Container;
 
+  // Actually calculate the flux
+  // With a tolerance a mesh is refined and the leaves returned
+  T3DScalarTree Tree;
+  try {
+    TOSCARSSRCalculation Calculation(self);
 
-  // Actually calculate the spectrum
-  // UPDATE: Needed, directional?
-  //bool const Directional = NormalDirection == 0 ? false : true;
+    // Check if a beam is at least defined, with the object held
+    if (self->obj->GetNParticleBeams() < 1) {
+      throw std::out_of_range("No particle beam defined");
+    }
 
-  try {
-    self->obj->CalculateFlux(Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dim, OutFileName);
+    if (Tolerance > 0) {
+      self->obj->CalculateFluxAdaptive(*Surface, Energy_eV, Tree, Tolerance, MaxLevel, NParticles, NThreads, GPU);
+      Tree.GetLeaves(FluxContainer);
+      if (std::strlen(OutFileName) != 0) {
+        FluxContainer.WriteToFileText(OutFileName, 3);
+      }
+    } else {
+      self->obj->CalculateFlux(*Surface, Energy_eV, FluxContainer, NParticles, NThreads, GPU, Dim, OutFileName);
+    }
   } catch (std::length_error e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
@@ -3205,31 +5118,15 @@ static PyObject* OSCARSSR_CalculateFluxRectangle (OSCARSSRObject* self, PyObject
   } catch (std::invalid_argument e) {
     PyErr_SetString(PyExc_ValueError, e.what());
     return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
   }
 
-
-
-  // Build the output list of: [[[x, y, z], Flux], [...]]
-  // Create a python list
-  PyObject *PList = PyList_New(0);
-
-  size_t const NPoints = FluxContainer.GetNPoints();
-
-  for (size_t i = 0; i != NPoints; ++i) {
-    T3DScalar P = FluxContainer.GetPoint(i);
-
-    // Inner list for each point
-    PyObject *PList2 = PyList_New(0);
-
-
-    // Add position and value to list
-    PyList_Append(PList2, OSCARSSR_TVector3DAsList(P.GetX()));
-    PyList_Append(PList2, Py_BuildValue("f", P.GetV()));
-    PyList_Append(PList, PList2);
-
+  // Output of: [[[x, y, z], Flux], [...]] or an sr.array of rows [x, y, z, Flux]
+  if (Tolerance > 0) {
+    return OSCARSSR_TreeResult(OSCARSSR_GetT3DScalarResult(self, Container), Tree, Total);
   }
-
-  return PList;
+  return OSCARSSR_SurfaceResult(OSCARSSR_GetT3DScalarResult(self, Container), *Surface, FluxContainer, Total);
 }
 
 
@@ -3237,18 +5134,6 @@ static PyObject* OSCARSSR_CalculateFluxRectangle (OSCARSSRObject* self, PyObject
 
 
 
-
-
-
-
-
-
-
-
-
-
-
-
 static PyObject* OSCARSSR_AverageSpectra (OSCARSSRObject* self, PyObject* args, PyObject *keywds)
 {
   // Calculate the flux on a surface given an energy and list of points in 3D
@@ -3294,8 +5179,9 @@ static PyObject* OSCARSSR_AverageSpectra (OSCARSSRObject* self, PyObject* args,
     FileNames.push_back( PyBytes_AS_STRING(PyList_GetItem(List_InFileNamesBinary, i)) );
   }
 
-  // Container for flux average
-  TSpectrumContainer Container;
+  // Container for flux average, kept by the array returned
+  std::shared_ptr<TSpectrumContainer> Spectrum(new TSpectrumContainer());
+  TSpectrumContainer& Container = *Spectrum;
 
   // Either they are text files or binary files
   if (NFilesText > 0) {
@@ -3315,7 +5201,7 @@ static PyObject* OSCARSSR_AverageSpectra (OSCARSSRObject* self, PyObject* args,
   }
 
 
-  return OSCARSSR_GetSpectrumAsList(self, Container);
+  return OSCARSSR_GetSpectrumResult(self, Spectrum);
 }
 
 
@@ -3330,6 +5216,8 @@ static PyObject* OSCARSSR_AddToSpectrum (OSCARSSRObject* self, PyObject* args, P
 {
   // Calculate the flux on a surface given an energy and list of points in 3D
 
+  TOSCARSSRModification Modification(self);
+
   PyObject*   List_Spectrum = PyList_New(0);
   double Weight = 1;
 
@@ -3345,13 +5233,16 @@ static PyObject* OSCARSSR_AddToSpectrum (OSCARSSRObject* self, PyObject* args, P
 
   // Check if there is an input spectrum
 
-  if (PyList_Size(List_Spectrum) < 1) {
+  if (PyObject_Length(List_Spectrum) < 1) {
     PyErr_SetString(PyExc_ValueError, "No points in spectrum.");
     return NULL;
   }
-  TSpectrumContainer S = OSCARSSR_GetSpectrumFromList(List_Spectrum);
-
-  self->obj->AddToSpectrum(S, Weight);
+  try {
+    self->obj->AddToSpectrum(OSCARSSR_GetSpectrumFromList(List_Spectrum), Weight);
+  } catch (std::length_error e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  }
 
   // Must return python object None in a special way
   Py_INCREF(Py_None);
@@ -3365,7 +5256,9 @@ static PyObject* OSCARSSR_GetSpectrum (OSCARSSRObject* self)
 {
   // Calculate the flux on a surface given an energy and list of points in 3D
 
-  return OSCARSSR_GetSpectrumAsList(self, self->obj->GetSpectrum());
+  TOSCARSSRModification Modification(self);
+
+  return OSCARSSR_GetSpectrumResult(self, std::make_shared<TSpectrumContainer>(self->obj->GetSpectrum()));
 }
 
 
@@ -3377,6 +5270,8 @@ static PyObject* OSCARSSR_AddToFlux (OSCARSSRObject* self, PyObject* args, PyObj
 {
   // Calculate the flux on a surface given an energy and list of points in 3D
 
+  TOSCARSSRModification Modification(self);
+
   PyObject*   List_Flux = PyList_New(0);
   double Weight = 1;
 
@@ -3392,13 +5287,16 @@ static PyObject* OSCARSSR_AddToFlux (OSCARSSRObject* self, PyObject* args, PyObj
 
   // Check if there is an input spectrum
 
-  if (PyList_Size(List_Flux) < 1) {
+  if (PyObject_Length(List_Flux) < 1) {
     PyErr_SetString(PyExc_ValueError, "No points in flux.");
     return NULL;
   }
-  T3DScalarContainer F = OSCARSSR_GetT3DScalarContainerFromList(List_Flux);
-
-  self->obj->AddToFlux(F, Weight);
+  try {
+    self->obj->AddToFlux(OSCARSSR_GetT3DScalarContainerFromList(List_Flux), Weight);
+  } catch (std::length_error e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  }
 
   // Must return python object None in a special way
   Py_INCREF(Py_None);
@@ -3411,7 +5309,9 @@ static PyObject* OSCARSSR_GetFlux (OSCARSSRObject* self)
 {
   // Return flux list
 
-  return OSCARSSR_GetT3DScalarAsList(self, self->obj->GetFlux());
+  TOSCARSSRModification Modification(self);
+
+  return OSCARSSR_GetT3DScalarResult(self, std::make_shared<T3DScalarContainer>(self->obj->GetFlux()));
 }
 
 
@@ -3423,6 +5323,8 @@ static PyObject* OSCARSSR_AddToPowerDensity (OSCARSSRObject* self, PyObject* arg
 {
   // Calculate the flux on a surface given an energy and list of points in 3D
 
+  TOSCARSSRModification Modification(self);
+
   PyObject*   List_PowerDensity = PyList_New(0);
   double Weight = 1;
 
@@ -3438,13 +5340,16 @@ static PyObject* OSCARSSR_AddToPowerDensity (OSCARSSRObject* self, PyObject* arg
 
   // Check if there is an input spectrum
 
-  if (PyList_Size(List_PowerDensity) < 1) {
+  if (PyObject_Length(List_PowerDensity) < 1) {
     PyErr_SetString(PyExc_ValueError, "No points in flux.");
     return NULL;
   }
-  T3DScalarContainer F = OSCARSSR_GetT3DScalarContainerFromList(List_PowerDensity);
-
-  self->obj->AddToPowerDensity(F, Weight);
+  try {
+    self->obj->AddToPowerDensity(OSCARSSR_GetT3DScalarContainerFromList(List_PowerDensity), Weight);
+  } catch (std::length_error e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  }
 
   // Must return python object None in a special way
   Py_INCREF(Py_None);
@@ -3457,7 +5362,9 @@ static PyObject* OSCARSSR_GetPowerDensity (OSCARSSRObject* self)
 {
   // Return flux list
 
-  return OSCARSSR_GetT3DScalarAsList(self, self->obj->GetPowerDensity());
+  TOSCARSSRModification Modification(self);
+
+  return OSCARSSR_GetT3DScalarResult(self, std::make_shared<T3DScalarContainer>(self->obj->GetPowerDensity()));
 }
 
 
@@ -3516,8 +5423,9 @@ static PyObject* OSCARSSR_AverageT3DScalars (OSCARSSRObject* self, PyObject* arg
     FileNames.push_back( PyBytes_AS_STRING(PyList_GetItem(List_InFileNamesBinary, i)) );
   }
 
-  // Container for flux average
-  T3DScalarContainer Container;
+  // Container for flux average, kept by the array returned
+  std::shared_ptr<T3DScalarContainer> Average(new T3DScalarContainer());
+  T3DScalarContainer& Container = *Average;
 
   // Either they are text files or binary files
   if (NFilesText > 0) {
@@ -3526,29 +5434,6 @@ static PyObject* OSCARSSR_AverageT3DScalars (OSCARSSRObject* self, PyObject* arg
     Container.AverageFromFilesBinary(FileNames, Dim);
   }
 
-  // Build the output list of: [[[x, y, z], Value], [...]]
-  // Create a python list
-  PyObject *PList = PyList_New(0);
-
-  // Number of points in container
-  size_t const NPoints = Container.GetNPoints();
-
-  for (size_t i = 0; i != NPoints; ++i) {
-
-    // This point in container
-    T3DScalar P = Container.GetPoint(i);
-
-    // Inner list for each point
-    PyObject *PList2 = PyList_New(0);
-
-
-    // Add position and value to list
-    PyList_Append(PList2, OSCARSSR_TVector3DAsList(P.GetX()));
-    PyList_Append(PList2, Py_BuildValue("f", P.GetV()));
-    PyList_Append(PList, PList2);
-
-  }
-
   // Text output
   if (std::string(OutFileNameText) != "") {
     Container.WriteToFileText(OutFileNameText, Dim);
@@ -3559,7 +5444,8 @@ static PyObject* OSCARSSR_AverageT3DScalars (OSCARSSRObject* self, PyObject* arg
     Container.WriteToFileBinary(OutFileNameBinary, Dim);
   }
 
-  return PList;
+  // Output of: [[[x, y, z], Value], [...]] or an sr.array of rows [x, y, z, Value]
+  return OSCARSSR_GetT3DScalarResult(self, Average);
 }
 
 
@@ -3589,12 +5475,6 @@ static PyObject* OSCARSSR_CalculateElectricFieldTimeDomain (OSCARSSRObject* self
     return NULL;
   }
 
-  // Check if a beam is at least defined
-  if (self->obj->GetNParticleBeams() < 1) {
-    PyErr_SetString(PyExc_ValueError, "No particle beam defined");
-    return NULL;
-  }
-
 
   // Observation point
   TVector3D Obs(0, 0, 0);
@@ -3606,19 +5486,49 @@ static PyObject* OSCARSSR_CalculateElectricFieldTimeDomain (OSCARSSRObject* self
   }
 
   T3DScalarContainer XYZT;
-  self->obj->CalculateElectricFieldTimeDomain(Obs, XYZT);
+  try {
+    TOSCARSSRCalculation Calculation(self);
+
+    // Check if a beam is at least defined, with the object held
+    if (self->obj->GetNParticleBeams() < 1) {
+      throw std::out_of_range("No particle beam defined");
+    }
+
+    self->obj->CalculateElectricFieldTimeDomain(Obs, XYZT);
+  } catch (std::out_of_range e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  } catch (std::exception const& e) {
+    return OSCARSSR_CalculationError(e);
+  }
 
   // UPDATE: Format is not great for XYZT output
   if (std::string(OutFileName) != "") {
     XYZT.WriteToFileText(OutFileName, 3);
   }
 
-  // Build the output list of: [[[x, y, z], Flux], [...]]
+  size_t const NPoints = XYZT.GetNPoints();
+
+  // As an sr.array [N][4] of t, Ex, Ey, Ez
+  if (!self->OutputLists) {
+    std::shared_ptr<std::vector<double> > Data(new std::vector<double>(4 * NPoints));
+    for (size_t i = 0; i != NPoints; ++i) {
+      T3DScalar const& P = XYZT.GetPoint(i);
+      double* D = Data->data() + 4 * i;
+      D[0] = P.GetV();
+      D[1] = P.GetX().GetX();
+      D[2] = P.GetX().GetY();
+      D[3] = P.GetX().GetZ();
+    }
+
+    Py_ssize_t const Shape[2] = { (Py_ssize_t) NPoints, 4 };
+    return OSCARSSR_NewArray(Data, Data->data(), 2, Shape);
+  }
+
+  // Build the output list of: [[t, [Ex, Ey, Ez]], [...]]
   // Create a python list
   PyObject *PList = PyList_New(0);
 
-  size_t const NPoints = XYZT.GetNPoints();
-
   for (size_t i = 0; i != NPoints; ++i) {
     T3DScalar P = XYZT.GetPoint(i);
 
@@ -3654,6 +5564,225 @@ static PyObject* OSCARSSR_CalculateElectricFieldTimeDomain (OSCARSSRObject* self
 
 
 
+
+
+
+
+
+
+
+
+
+
+
+
+
+static void OSCARSSR_PendingDone (OSCARSSRObject* self)
+{
+  // A calculate_*_async call is done, wake whoever waits for the object to be idle
+
+  TOSCARSSRPythonLock* Lock = self->Lock;
+  std::lock_guard<std::mutex> Guard(Lock->Count);
+  if (--Lock->NPending == 0 && Lock->NCalculations == 0) {
+    Lock->Idle.notify_all();
+  }
+
+  return;
+}
+
+
+
+
+static PyObject* OSCARSSR_RunPending (PyObject* self, PyObject* args, PyObject* keywds)
+{
+  // Call args[0] with the rest of the arguments on an executor thread, for a
+  // calculate_*_async call on the object self.  Until it returns other methods on self wait.
+
+  PyObject* Method = PyTuple_GetItem(args, 0);
+  PyObject* MethodArgs = Method == NULL ? NULL : PyTuple_GetSlice(args, 1, PyTuple_Size(args));
+
+  PyObject* Result = MethodArgs == NULL ? NULL : PyObject_Call(Method, MethodArgs, keywds);
+  Py_XDECREF(MethodArgs);
+
+  OSCARSSR_PendingDone((OSCARSSRObject*) self);
+
+  return Result;
+}
+
+
+
+
+static PyObject* OSCARSSR_Async (OSCARSSRObject* self, char const* Name, PyObject* args, PyObject* keywds)
+{
+  // Run the method Name with these arguments on a thread pool shared by all objects and
+  // return a concurrent.futures.Future for its result.  Calculations run without the GIL,
+  // so those on different objects run at the same time, and those on the same object one
+  // after the other.
+
+  static PyObject* Executor = 0x0;
+  if (Executor == 0x0) {
+    PyObject* Futures = PyImport_ImportModule("concurrent.futures");
+    if (Futures == NULL) {
+      return NULL;
+    }
+    unsigned int const NThreads = std::max(1u, std::thread::hardware_concurrency());
+    Executor = PyObject_CallMethod(Futures, (char*) "ThreadPoolExecutor", (char*) "I", NThreads);
+    Py_DECREF(Futures);
+    if (Executor == NULL) {
+      return NULL;
+    }
+  }
+
+  // Runs the method and counts it as pending until then, see OSCARSSR_RunPending
+  static PyMethodDef RunPendingDef = {"run_pending", (PyCFunction) OSCARSSR_RunPending, METH_VARARGS | METH_KEYWORDS, "run a method of a pending calculate_*_async"};
+  PyObject* RunPending = PyCFunction_New(&RunPendingDef, (PyObject*) self);
+  if (RunPending == NULL) {
+    return NULL;
+  }
+
+  // Arguments for submit: the function running it, the bound method, then the arguments given
+  PyObject* Method = PyObject_GetAttrString((PyObject*) self, Name);
+  if (Method == NULL) {
+    Py_DECREF(RunPending);
+    return NULL;
+  }
+  Py_ssize_t const NArgs = PyTuple_Size(args);
+  PyObject* SubmitArgs = PyTuple_New(NArgs + 2);
+  PyTuple_SET_ITEM(SubmitArgs, 0, RunPending);
+  PyTuple_SET_ITEM(SubmitArgs, 1, Method);
+  for (Py_ssize_t i = 0; i != NArgs; ++i) {
+    PyObject* Arg = PyTuple_GET_ITEM(args, i);
+    Py_INCREF(Arg);
+    PyTuple_SET_ITEM(SubmitArgs, i + 2, Arg);
+  }
+
+  {
+    std::lock_guard<std::mutex> Guard(self->Lock->Count);
+    ++self->Lock->NPending;
+  }
+
+  PyObject* Submit = PyObject_GetAttrString(Executor, "submit");
+  PyObject* Future = Submit == NULL ? NULL : PyObject_Call(Submit, SubmitArgs, keywds);
+  Py_XDECREF(Submit);
+  Py_DECREF(SubmitArgs);
+
+  // Never submitted, so never run
+  if (Future == NULL) {
+    OSCARSSR_PendingDone(self);
+  }
+
+  return Future;
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculateTrajectoryAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_trajectory on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_trajectory", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculateSpectrumAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_spectrum on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_spectrum", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculateTotalPowerAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_total_power on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_total_power", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculatePowerDensityRectangleAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_power_density_rectangle on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_power_density_rectangle", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculatePowerDensityAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_power_density on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_power_density", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculateFluxAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_flux on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_flux", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculateFluxRectangleAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_flux_rectangle on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_flux_rectangle", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculatePowerDensitySurfaceAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_power_density_surface on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_power_density_surface", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculateFluxSurfaceAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_flux_surface on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_flux_surface", args, keywds);
+}
+
+
+
+
+static PyObject* OSCARSSR_CalculateElectricFieldTimeDomainAsync (OSCARSSRObject* self, PyObject* args, PyObject* keywds)
+{
+  // calculate_efield_vs_time on a thread, returns a concurrent.futures.Future
+  return OSCARSSR_Async(self, "calculate_efield_vs_time", args, keywds);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 
 
 
@@ -3687,27 +5816,31 @@ static PyMethodDef OSCARSSR_methods[] = {
   {"set_npoints_trajectory",            (PyCFunction) OSCARSSR_SetNPointsTrajectory,            METH_O,                       "set the total number of points for the trajectory"},
   {"get_npoints_trajectory",            (PyCFunction) OSCARSSR_GetNPointsTrajectory,            METH_NOARGS,                  "get the total number of points for the trajectory"},
                                                                                           
-  {"add_bfield_file",                   (PyCFunction) OSCARSSR_AddMagneticField,                METH_VARARGS | METH_KEYWORDS, "add a magnetic field from a file"},
+  {"add_bfield_file",                   (PyCFunction) OSCARSSR_AddMagneticField,                METH_VARARGS | METH_KEYWORDS, "add a magnetic field from a file.  With shared=1 the map is left in /dev/shm for other processes until clear_shared_maps()"},
   {"add_bfield_interpolated",           (PyCFunction) OSCARSSR_AddMagneticFieldInterpolated,    METH_VARARGS | METH_KEYWORDS, "add a magnetic field interpolated from file data"},
-  {"add_bfield_function",               (PyCFunction) OSCARSSR_AddMagneticFieldFunction,        METH_VARARGS,                 "add a magnetic field in form of python function"},
+  {"set_bfield_parameter",              (PyCFunction) OSCARSSR_SetMagneticFieldParameter,       METH_O,                       "set the parameter (gap, phase, ..) of all interpolated magnetic fields without reading the files again"},
+  {"add_bfield_fourier",                (PyCFunction) OSCARSSR_AddMagneticFieldFourier,         METH_VARARGS | METH_KEYWORDS, "add a magnetic field from a periodic map as a Fourier series along z, returns the accuracy against the map"},
+  {"add_bfield_function",               (PyCFunction) OSCARSSR_AddMagneticFieldFunction,        METH_VARARGS | METH_KEYWORDS, "add a magnetic field in form of python function, optionally tabulated onto a grid (nx, ny, nz), which a vectorized function must be"},
   {"add_bfield_gaussian",               (PyCFunction) OSCARSSR_AddMagneticFieldGaussian,        METH_VARARGS | METH_KEYWORDS, "add a magnetic field in form of 3D gaussian"},
   {"add_bfield_uniform",                (PyCFunction) OSCARSSR_AddMagneticFieldUniform,         METH_VARARGS | METH_KEYWORDS, "add a uniform magnetic field in 3D"},
   {"add_bfield_undulator",              (PyCFunction) OSCARSSR_AddMagneticFieldIdealUndulator,  METH_VARARGS | METH_KEYWORDS, "add magnetic field from ideal undulator in 3D"},
-  {"get_bfield",                        (PyCFunction) OSCARSSR_GetBField,                       METH_VARARGS,                 "get the magnetic field at a given position in space (and someday time?)"},
+  {"get_bfield",                        (PyCFunction) OSCARSSR_GetBField,                       METH_VARARGS,                 "get the magnetic field at a given position in space (and someday time?), or at each position in a list of positions"},
   {"clear_bfields",                     (PyCFunction) OSCARSSR_ClearMagneticFields,             METH_NOARGS,                  "clear all internal magnetic fields"},
 
-  {"add_efield_file",                   (PyCFunction) OSCARSSR_AddElectricField,                METH_VARARGS | METH_KEYWORDS, "add an electric field from a file"},
-  {"add_efield_function",               (PyCFunction) OSCARSSR_AddElectricFieldFunction,        METH_VARARGS,                 "add an electric field in form of python function"},
+  {"add_efield_file",                   (PyCFunction) OSCARSSR_AddElectricField,                METH_VARARGS | METH_KEYWORDS, "add an electric field from a file.  With shared=1 the map is left in /dev/shm for other processes until clear_shared_maps()"},
+  {"add_efield_function",               (PyCFunction) OSCARSSR_AddElectricFieldFunction,        METH_VARARGS | METH_KEYWORDS, "add an electric field in form of python function, optionally tabulated onto a grid (nx, ny, nz), which a vectorized function must be"},
   {"add_efield_gaussian",               (PyCFunction) OSCARSSR_AddElectricFieldGaussian,        METH_VARARGS | METH_KEYWORDS, "add an electric field in form of 3D gaussian"},
   {"add_efield_uniform",                (PyCFunction) OSCARSSR_AddElectricFieldUniform,         METH_VARARGS | METH_KEYWORDS, "add a uniform electric field in 3D"},
   {"add_efield_undulator",              (PyCFunction) OSCARSSR_AddElectricFieldIdealUndulator,  METH_VARARGS | METH_KEYWORDS, "add magnetic field from ideal undulator in 3D"},
-  {"get_efield",                        (PyCFunction) OSCARSSR_GetEField,                       METH_VARARGS,                 "get the electric field at a given position in space (and someday time?)"},
+  {"get_efield",                        (PyCFunction) OSCARSSR_GetEField,                       METH_VARARGS,                 "get the electric field at a given position in space (and someday time?), or at each position in a list of positions"},
   {"clear_efields",                     (PyCFunction) OSCARSSR_ClearElectricFields,             METH_NOARGS,                  "clear all internal electric fields"},
  
   {"add_field_gaussian",                (PyCFunction) OSCARSSR_AddFieldGaussian,                METH_VARARGS | METH_KEYWORDS, "add a magnetic or electric field in form of 3D gaussian"},
 
   {"write_bfield",                      (PyCFunction) OSCARSSR_WriteMagneticField,              METH_VARARGS | METH_KEYWORDS, "write the magnetic field to a file"},
   {"write_efield",                      (PyCFunction) OSCARSSR_WriteElectricField,              METH_VARARGS | METH_KEYWORDS, "write the magnetic field to a file"},
+  {"convert_field_file",                (PyCFunction) OSCARSSR_ConvertFieldFile,                METH_VARARGS | METH_KEYWORDS, "convert a field file to the OSCARSBIN binary format"},
+  {"clear_shared_maps",                 (PyCFunction) OSCARSSR_ClearSharedMaps,                 METH_NOARGS,                  "remove the field maps read with shared=1 from /dev/shm, which otherwise stay until a reboot.  Objects using them keep working.  Returns the number removed"},
 
                                                                                           
   {"set_particle_beam",                 (PyCFunction) OSCARSSR_SetParticleBeam,                 METH_VARARGS | METH_KEYWORDS, "add a particle beam"},
@@ -3725,10 +5858,12 @@ static PyMethodDef OSCARSSR_methods[] = {
   {"calculate_spectrum",                (PyCFunction) OSCARSSR_CalculateSpectrum,               METH_VARARGS | METH_KEYWORDS, "calculate the spectrum at an observation point"},
 
   {"calculate_total_power",             (PyCFunction) OSCARSSR_CalculateTotalPower,             METH_NOARGS,                  "calculate total power radiated"},
-  {"calculate_power_density_rectangle", (PyCFunction) OSCARSSR_CalculatePowerDensityRectangle,  METH_VARARGS | METH_KEYWORDS, "calculate the power density given a surface"},
-  {"calculate_power_density",           (PyCFunction) OSCARSSR_CalculatePowerDensity,           METH_VARARGS | METH_KEYWORDS, "calculate the power density given a surface"},
+  {"calculate_power_density_rectangle", (PyCFunction) OSCARSSR_CalculatePowerDensityRectangle,  METH_VARARGS | METH_KEYWORDS, "calculate the power density given a surface, averaged over the particles when nparticles > 0"},
+  {"calculate_power_density",           (PyCFunction) OSCARSSR_CalculatePowerDensity,           METH_VARARGS | METH_KEYWORDS, "calculate the power density given a surface, averaged over the particles when nparticles > 0"},
   {"calculate_flux",                    (PyCFunction) OSCARSSR_CalculateFlux,                   METH_VARARGS | METH_KEYWORDS, "calculate the flux given a surface"},
   {"calculate_flux_rectangle",          (PyCFunction) OSCARSSR_CalculateFluxRectangle,          METH_VARARGS | METH_KEYWORDS, "calculate the flux given a surface"},
+  {"calculate_power_density_surface",   (PyCFunction) OSCARSSR_CalculatePowerDensitySurface,    METH_VARARGS | METH_KEYWORDS, "calculate the power density on a cylinder, sphere, torus, parametric or mesh surface, optionally shadowed by meshes, averaged over the particles when nparticles > 0"},
+  {"calculate_flux_surface",            (PyCFunction) OSCARSSR_CalculateFluxSurface,            METH_VARARGS | METH_KEYWORDS, "calculate the flux on a cylinder, sphere, torus, parametric or mesh surface"},
 
   {"average_spectra",                   (PyCFunction) OSCARSSR_AverageSpectra,                  METH_VARARGS | METH_KEYWORDS, "average spectra"},
   {"average_flux",                      (PyCFunction) OSCARSSR_AverageT3DScalars,               METH_VARARGS | METH_KEYWORDS, "average fluxes"},
@@ -3743,6 +5878,19 @@ static PyMethodDef OSCARSSR_methods[] = {
 
   {"calculate_efield_vs_time",          (PyCFunction) OSCARSSR_CalculateElectricFieldTimeDomain,METH_VARARGS | METH_KEYWORDS, "calculate the electric field in the time domain"},
 
+  {"calculate_trajectory_async",              (PyCFunction) OSCARSSR_CalculateTrajectoryAsync,              METH_VARARGS | METH_KEYWORDS, "calculate_trajectory on a thread, returns a concurrent.futures.Future"},
+  {"calculate_spectrum_async",                (PyCFunction) OSCARSSR_CalculateSpectrumAsync,                METH_VARARGS | METH_KEYWORDS, "calculate_spectrum on a thread, returns a concurrent.futures.Future"},
+  {"calculate_total_power_async",             (PyCFunction) OSCARSSR_CalculateTotalPowerAsync,              METH_VARARGS | METH_KEYWORDS, "calculate_total_power on a thread, returns a concurrent.futures.Future"},
+  {"calculate_power_density_rectangle_async", (PyCFunction) OSCARSSR_CalculatePowerDensityRectangleAsync,   METH_VARARGS | METH_KEYWORDS, "calculate_power_density_rectangle on a thread, returns a concurrent.futures.Future"},
+  {"calculate_power_density_async",           (PyCFunction) OSCARSSR_CalculatePowerDensityAsync,            METH_VARARGS | METH_KEYWORDS, "calculate_power_density on a thread, returns a concurrent.futures.Future"},
+  {"calculate_flux_async",                    (PyCFunction) OSCARSSR_CalculateFluxAsync,                    METH_VARARGS | METH_KEYWORDS, "calculate_flux on a thread, returns a concurrent.futures.Future"},
+  {"calculate_flux_rectangle_async",          (PyCFunction) OSCARSSR_CalculateFluxRectangleAsync,           METH_VARARGS | METH_KEYWORDS, "calculate_flux_rectangle on a thread, returns a concurrent.futures.Future"},
+  {"calculate_power_density_surface_async",   (PyCFunction) OSCARSSR_CalculatePowerDensitySurfaceAsync,     METH_VARARGS | METH_KEYWORDS, "calculate_power_density_surface on a thread, returns a concurrent.futures.Future"},
+  {"calculate_flux_surface_async",            (PyCFunction) OSCARSSR_CalculateFluxSurfaceAsync,             METH_VARARGS | METH_KEYWORDS, "calculate_flux_surface on a thread, returns a concurrent.futures.Future"},
+  {"calculate_efield_vs_time_async",          (PyCFunction) OSCARSSR_CalculateElectricFieldTimeDomainAsync, METH_VARARGS | METH_KEYWORDS, "calculate_efield_vs_time on a thread, returns a concurrent.futures.Future"},
+
+  {"set_output_lists",                  (PyCFunction) OSCARSSR_SetOutputLists,                  METH_O,                       "return results as nested python lists (True, default) or as sr.array (False), which numpy.asarray() views without a copy.  An sr.array is flat where the lists nest: points with a value are rows [x, y, z, value] instead of [[x, y, z], value], the trajectory is [N][2][3], a spectrum [N][2] and the time domain electric field [N][4] of t, Ex, Ey, Ez"},
+
   {NULL}  /* Sentinel */
 };
 
@@ -3872,7 +6020,12 @@ PyMODINIT_FUNC PyInit_sr(void)
 PyMODINIT_FUNC initsr(OSCARSSRObject* self, PyObject* args, PyObject* kwds)
 #endif
 {
-  if (PyType_Ready(&OSCARSSRType) < 0) {
+#if PY_VERSION_HEX < 0x03070000
+  // Calculations run without the GIL
+  PyEval_InitThreads();
+#endif
+
+  if (PyType_Ready(&OSCARSSRType) < 0 || PyType_Ready(&OSCARSSRArrayType) < 0) {
 #if PY_MAJOR_VERSION >= 3
     return NULL;
 #else
@@ -3895,6 +6048,8 @@ PyMODINIT_FUNC initsr(OSCARSSRObject* self, PyObject* args, PyObject* kwds)
 
   Py_INCREF(&OSCARSSRType);
   PyModule_AddObject(m, "sr", (PyObject *)&OSCARSSRType);
+  Py_INCREF(&OSCARSSRArrayType);
+  PyModule_AddObject(m, "array", (PyObject *)&OSCARSSRArrayType);
 
   // Print copyright notice
   PyObject* sys = PyImport_ImportModule( "sys");
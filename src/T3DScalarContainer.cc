@@ -5,6 +5,20 @@
 T3DScalarContainer::T3DScalarContainer ()
 {
   // Default constructor
+  fIsGrid = false;
+  fGridDimension = 0;
+}
+
+
+
+
+T3DScalarContainer::T3DScalarContainer (TSurfacePoints_Rectangle const& Grid, int const Dimension)
+{
+  // Constructor for a grid on a rectangle, see SetGrid
+  fIsGrid = false;
+  fGridDimension = 0;
+
+  this->SetGrid(Grid, Dimension);
 }
 
 
@@ -18,8 +32,60 @@ T3DScalarContainer::~T3DScalarContainer ()
 
 
 
+void T3DScalarContainer::SetGrid (TSurfacePoints_Rectangle const& Grid, int const Dimension)
+{
+  // Clear and keep only the values of the points of Grid from now on.  Dimension is that
+  // of the coordinates made by GetPoint and written to files.
+
+  if (Dimension != 2 && Dimension != 3) {
+    throw std::out_of_range("incorrect dimensions");
+  }
+
+  this->Clear();
+
+  fIsGrid = true;
+  fGridDimension = Dimension;
+  fGrid = Grid;
+  fGridValues.reserve(Grid.GetNPoints());
+  fCompensation.reserve(Grid.GetNPoints());
+
+  return;
+}
+
+
+
+
+bool T3DScalarContainer::IsGrid () const
+{
+  // Are only values kept
+  return fIsGrid;
+}
+
+
+
+
+TSurfacePoints_Rectangle const& T3DScalarContainer::GetGrid () const
+{
+  // Rectangle the values are on
+  return fGrid;
+}
+
+
+
+
 void T3DScalarContainer::AddPoint (TVector3D const& X, double const V)
 {
+  // Add a point.  For a grid X is not kept, it is the next point of the rectangle.
+
+  if (fIsGrid) {
+    if (fGridValues.size() >= fGrid.GetNPoints()) {
+      throw std::length_error("T3DScalarContainer::AddPoint more points than the grid has");
+    }
+    fGridValues.push_back(V);
+    fCompensation.push_back(0);
+    return;
+  }
+
   fValues.push_back( T3DScalar(X, V) );
   fCompensation.push_back(0);
   return;
@@ -33,15 +99,39 @@ void T3DScalarContainer::AddToPoint (size_t const i, double const V)
   // Compensated sum for adding to points
 
   // Check that the point is within range
-  if (i >= fValues.size()) {
+  if (i >= this->GetNPoints()) {
     throw std::length_error("T3DScalarContainer::AddtoPoint index out of range");
   }
 
-  double Sum = fValues[i].GetV();
+  double Sum = fIsGrid ? fGridValues[i] : fValues[i].GetV();
   double y = V - fCompensation[i];
   double t = Sum + y;
   fCompensation[i] = (t - Sum) - y;
-  fValues[i].SetV(t);
+  if (fIsGrid) {
+    fGridValues[i] = t;
+  } else {
+    fValues[i].SetV(t);
+  }
+
+  return;
+}
+
+
+
+
+void T3DScalarContainer::AddToPoints (std::vector<double> const& V)
+{
+  // Add V[i] to point i for every point, in order.  Values calculated on several threads
+  // are collected first and added here from one, so the sum does not depend on the number
+  // of threads.
+
+  if (V.size() != this->GetNPoints()) {
+    throw std::length_error("T3DScalarContainer::AddToPoints wrong number of values");
+  }
+
+  for (size_t i = 0; i != V.size(); ++i) {
+    this->AddToPoint(i, V[i]);
+  }
 
   return;
 }
@@ -51,11 +141,16 @@ void T3DScalarContainer::AddToPoint (size_t const i, double const V)
 
 void T3DScalarContainer::Clear ()
 {
-  // Clear all contents from the container
+  // Clear all contents from the container, a grid becomes a container of points again
 
   fValues.clear();
   fCompensation.clear();
 
+  fIsGrid = false;
+  fGridDimension = 0;
+  fGrid = TSurfacePoints_Rectangle();
+  std::vector<double>().swap(fGridValues);
+
   return;
 }
 
@@ -330,12 +425,13 @@ void T3DScalarContainer::WriteToFileText (std::string const& OutFileName, int co
   of << std::scientific;
 
   for (size_t i = 0; i != this->GetNPoints(); ++i) {
-    TVector3D const& Obs = this->GetPoint(i).GetX();
+    T3DScalar const P = this->GetPoint(i);
+    TVector3D const& Obs = P.GetX();
 
     if (Dimension == 2) {
-      of << Obs.GetX() << " " << Obs.GetY() << " " << this->GetPoint(i).GetV() << "\n";
+      of << Obs.GetX() << " " << Obs.GetY() << " " << P.GetV() << "\n";
     } else if (Dimension == 3) {
-      of << Obs.GetX() << " " << Obs.GetY() << " " << Obs.GetZ() << " " << this->GetPoint(i).GetV() << "\n";
+      of << Obs.GetX() << " " << Obs.GetY() << " " << Obs.GetZ() << " " << P.GetV() << "\n";
     } else {
       throw std::out_of_range("incorrect dimensions");
     }
@@ -366,10 +462,11 @@ void T3DScalarContainer::WriteToFileBinary (std::string const& OutFileName, int
 
   if (Dimension == 2) {
     for (size_t i = 0; i != this->GetNPoints(); ++i) {
-      TVector3D const& Obs = this->GetPoint(i).GetX();
+      T3DScalar const P = this->GetPoint(i);
+      TVector3D const& Obs = P.GetX();
       X = Obs.GetX();
       Y = Obs.GetY();
-      V = this->GetPoint(i).GetV();
+      V = P.GetV();
 
       of.write((char*) &X, sizeof(double));
       of.write((char*) &Y, sizeof(double));
@@ -377,11 +474,12 @@ void T3DScalarContainer::WriteToFileBinary (std::string const& OutFileName, int
     }
   } else if (Dimension == 3) {
     for (size_t i = 0; i != this->GetNPoints(); ++i) {
-      TVector3D const& Obs = this->GetPoint(i).GetX();
+      T3DScalar const P = this->GetPoint(i);
+      TVector3D const& Obs = P.GetX();
       X = Obs.GetX();
       Y = Obs.GetY();
       Z = Obs.GetZ();
-      V = this->GetPoint(i).GetV();
+      V = P.GetV();
 
       of.write((char*) &X, sizeof(double));
       of.write((char*) &Y, sizeof(double));
@@ -401,16 +499,25 @@ void T3DScalarContainer::WriteToFileBinary (std::string const& OutFileName, int
 
 size_t T3DScalarContainer::GetNPoints () const
 {
-  return fValues.size();
+  return fIsGrid ? fGridValues.size() : fValues.size();
 }
 
 
 
 
-T3DScalar const& T3DScalarContainer::GetPoint (size_t const i) const
+T3DScalar const T3DScalarContainer::GetPoint (size_t const i) const
 {
-  if (i >= fValues.size()) {
-    throw;
+  // Point i, for a grid its coordinates are made from the rectangle
+
+  if (i >= this->GetNPoints()) {
+    throw std::out_of_range("T3DScalarContainer::GetPoint index out of range");
+  }
+
+  if (fIsGrid) {
+    if (fGridDimension == 3) {
+      return T3DScalar(fGrid.GetXYZ(i), fGridValues[i]);
+    }
+    return T3DScalar(TVector3D(fGrid.GetX1(i), fGrid.GetX2(i), 0), fGridValues[i]);
   }
 
   return fValues[i];
@@ -420,5 +527,36 @@ T3DScalar const& T3DScalarContainer::GetPoint (size_t const i) const
 
 
 
+double const* T3DScalarContainer::GetData () const
+{
+  // All points as contiguous doubles: x, y, z, value for each point
+
+  static_assert(sizeof(T3DScalar) == 4 * sizeof(double), "T3DScalar must be four packed doubles");
+
+  if (fIsGrid) {
+    throw std::invalid_argument("a grid keeps only values, see GetValues");
+  }
+
+  return fValues.empty() ? 0x0 : (double const*) fValues.data();
+}
+
+
+
+
+double const* T3DScalarContainer::GetValues () const
+{
+  // Values of a grid as contiguous doubles in the order of the rectangle
+
+  if (!fIsGrid) {
+    throw std::invalid_argument("only a grid keeps values alone, see GetData");
+  }
+
+  return fGridValues.empty() ? 0x0 : fGridValues.data();
+}
+
+
+
+
+
 
 
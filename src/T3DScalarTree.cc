@@ -0,0 +1,588 @@
+#include "T3DScalarTree.h"
+
+#include "TSurfacePoints_Rectangle.h"
+#include "TSurfacePoints_Mesh.h"
+#include "TSurfacePoints_3D.h"
+
+#include <map>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <stdexcept>
+#include <cmath>
+
+T3DScalarTree::T3DScalarTree ()
+{
+  // Default constructor, empty
+  this->Clear();
+}
+
+
+
+
+T3DScalarTree::~T3DScalarTree ()
+{
+  // Destructor
+}
+
+
+
+
+void T3DScalarTree::Refine (TSurfacePoints const& Surface, TEvaluate const& Function, double const Tolerance, int const MaxLevel)
+{
+  // Evaluate the surface, splitting cells until the interpolation error is below
+  // Tolerance times the largest value, or a cell has been split MaxLevel times
+  //
+  // Surface   - TSurfacePoints_Rectangle or TSurfacePoints_Mesh
+  // Function  - Fills the values for a batch of points
+  // Tolerance - Relative to the largest |value| evaluated
+  // MaxLevel  - Number of times a starting cell may be split, 0 to 20
+
+  if (Tolerance < 0) {
+    throw std::invalid_argument("tolerance must not be negative");
+  }
+  if (MaxLevel < 0 || MaxLevel > 20) {
+    throw std::invalid_argument("maxlevel must be from 0 to 20");
+  }
+
+  this->Clear();
+
+  TSurfacePoints_Rectangle const* Rectangle = dynamic_cast<TSurfacePoints_Rectangle const*>(&Surface);
+  TSurfacePoints_Mesh      const* Mesh      = dynamic_cast<TSurfacePoints_Mesh const*>(&Surface);
+
+  if (Rectangle != 0x0) {
+    this->RefineRectangle(*Rectangle, Function, Tolerance, MaxLevel);
+  } else if (Mesh != 0x0) {
+    this->RefineMesh(*Mesh, Function, Tolerance, MaxLevel);
+  } else {
+    throw std::invalid_argument("adaptive refinement needs a rectangle or a mesh surface");
+  }
+
+  return;
+}
+
+
+
+
+void T3DScalarTree::Clear ()
+{
+  // Remove all nodes and cells
+  fNodes.clear();
+  fCells.clear();
+
+  fIsRectangle = false;
+  fNX1 = 0;
+  fNX2 = 0;
+  fX1Start = 0;
+  fX2Start = 0;
+  fX1Step = 0;
+  fX2Step = 0;
+
+  return;
+}
+
+
+
+
+void T3DScalarTree::RefineRectangle (TSurfacePoints_Rectangle const& Rectangle, TEvaluate const& Function, double const Tolerance, int const MaxLevel)
+{
+  // Nodes are on a lattice with 2^MaxLevel steps between points of the rectangle, so a
+  // point shared by neighbouring cells is only evaluated once
+
+  if (Rectangle.GetNX1() < 2 || Rectangle.GetNX2() < 2) {
+    throw std::invalid_argument("adaptive refinement needs at least 2 points in X1 and in X2");
+  }
+
+  fIsRectangle = true;
+  fNX1 = Rectangle.GetNX1();
+  fNX2 = Rectangle.GetNX2();
+  fX1Start = Rectangle.GetX1X2(0, 0).GetX();
+  fX2Start = Rectangle.GetX1X2(0, 0).GetY();
+  fX1Step  = Rectangle.GetX1X2(1, 1).GetX() - fX1Start;
+  fX2Step  = Rectangle.GetX1X2(1, 1).GetY() - fX2Start;
+
+  long const Scale = 1L << MaxLevel;
+  TVector3D const Normal = Rectangle.GetPoint(0).GetNormal();
+
+  std::map<std::pair<long, long>, int> Lattice;
+  auto Node = [&] (long const K1, long const K2) {
+    std::pair<std::map<std::pair<long, long>, int>::iterator, bool> const It = Lattice.insert(std::make_pair(std::make_pair(K1, K2), (int) fNodes.size()));
+    if (It.second) {
+      TNode N;
+      N.X = Rectangle.GetXYZ((double) K1 / Scale, (double) K2 / Scale);
+      N.N = Normal;
+      N.U = Rectangle.GetX1X2((double) K1 / Scale, (double) K2 / Scale);
+      N.V = 0;
+      fNodes.push_back(N);
+    }
+    return It.first->second;
+  };
+
+  // Lattice position of the (lo, lo) corner and the size of each cell
+  std::vector<std::array<long, 3> > Place;
+  auto AddCell = [&] (long const K1, long const K2, long const Size, int const Level) {
+    TCell C;
+    C.NCorners = 4;
+    C.Corner[0] = Node(K1, K2);
+    C.Corner[1] = Node(K1 + Size, K2);
+    C.Corner[2] = Node(K1 + Size, K2 + Size);
+    C.Corner[3] = Node(K1, K2 + Size);
+    C.Level = Level;
+    C.Child = -1;
+    fCells.push_back(C);
+    Place.push_back(std::array<long, 3>{{K1, K2, Size}});
+  };
+
+  // Starting cells in the same order as the points of the rectangle
+  std::vector<int> Active;
+  for (int i1 = 0; i1 != fNX1 - 1; ++i1) {
+    for (int i2 = 0; i2 != fNX2 - 1; ++i2) {
+      Active.push_back((int) fCells.size());
+      AddCell(i1 * Scale, i2 * Scale, Scale, 0);
+    }
+  }
+  this->Evaluate(Function, 0);
+
+  for (int Level = 0; Level < MaxLevel && !Active.empty(); ++Level) {
+
+    // Edge midpoints and center of every cell still being refined, evaluated together
+    size_t const First = fNodes.size();
+    std::vector<std::array<int, 5> > Tests(Active.size());
+    for (size_t ia = 0; ia != Active.size(); ++ia) {
+      long const K1 = Place[Active[ia]][0];
+      long const K2 = Place[Active[ia]][1];
+      long const H  = Place[Active[ia]][2] / 2;
+      Tests[ia][0] = Node(K1 + H, K2);
+      Tests[ia][1] = Node(K1 + 2 * H, K2 + H);
+      Tests[ia][2] = Node(K1 + H, K2 + 2 * H);
+      Tests[ia][3] = Node(K1, K2 + H);
+      Tests[ia][4] = Node(K1 + H, K2 + H);
+    }
+    this->Evaluate(Function, First);
+
+    double const Limit = Tolerance * this->GetMaxValue();
+
+    std::vector<int> Next;
+    for (size_t ia = 0; ia != Active.size(); ++ia) {
+      int const ic = Active[ia];
+      double V[4];
+      for (int i = 0; i != 4; ++i) {
+        V[i] = fNodes[fCells[ic].Corner[i]].V;
+      }
+
+      double Error = fabs(fNodes[Tests[ia][4]].V - (V[0] + V[1] + V[2] + V[3]) / 4.);
+      for (int i = 0; i != 4; ++i) {
+        Error = std::max(Error, fabs(fNodes[Tests[ia][i]].V - (V[i] + V[(i + 1) % 4]) / 2.));
+      }
+      if (Error <= Limit) {
+        continue;
+      }
+
+      long const K1 = Place[ic][0];
+      long const K2 = Place[ic][1];
+      long const H  = Place[ic][2] / 2;
+      fCells[ic].Child = (int) fCells.size();
+      for (int i = 0; i != 4; ++i) {
+        Next.push_back((int) fCells.size());
+        AddCell(K1 + (i % 2) * H, K2 + (i / 2) * H, H, Level + 1);
+      }
+    }
+
+    Active.swap(Next);
+  }
+
+  return;
+}
+
+
+
+
+void T3DScalarTree::RefineMesh (TSurfacePoints_Mesh const& Mesh, TEvaluate const& Function, double const Tolerance, int const MaxLevel)
+{
+  // Triangles are sampled at their vertices and split at their edge midpoints.  A vertex
+  // is shared by triangles with the same normal, as the value can depend on it.
+
+  std::map<std::array<double, 6>, int> Lattice;
+  auto Node = [&] (TVector3D const& X, TVector3D const& Normal) {
+    std::array<double, 6> const Key = {{X.GetX(), X.GetY(), X.GetZ(), Normal.GetX(), Normal.GetY(), Normal.GetZ()}};
+    std::pair<std::map<std::array<double, 6>, int>::iterator, bool> const It = Lattice.insert(std::make_pair(Key, (int) fNodes.size()));
+    if (It.second) {
+      TNode N;
+      N.X = X;
+      N.N = Normal;
+      N.U = TVector2D(0, 0);
+      N.V = 0;
+      fNodes.push_back(N);
+    }
+    return It.first->second;
+  };
+
+  auto AddCell = [&] (int const A, int const B, int const C, int const Level) {
+    TCell Cell;
+    Cell.NCorners = 3;
+    Cell.Corner[0] = A;
+    Cell.Corner[1] = B;
+    Cell.Corner[2] = C;
+    Cell.Corner[3] = -1;
+    Cell.Level = Level;
+    Cell.Child = -1;
+    fCells.push_back(Cell);
+  };
+
+  std::vector<int> Active;
+  for (size_t i = 0; i != Mesh.GetNPoints(); ++i) {
+    TVector3D A;
+    TVector3D B;
+    TVector3D C;
+    Mesh.GetTriangle(i, A, B, C);
+    TVector3D const Normal = Mesh.GetPoint(i).GetNormal();
+
+    Active.push_back((int) fCells.size());
+    AddCell(Node(A, Normal), Node(B, Normal), Node(C, Normal), 0);
+  }
+  this->Evaluate(Function, 0);
+
+  for (int Level = 0; Level < MaxLevel && !Active.empty(); ++Level) {
+
+    // Edge midpoints of every triangle still being refined, evaluated together
+    size_t const First = fNodes.size();
+    std::vector<std::array<int, 3> > Tests(Active.size());
+    for (size_t ia = 0; ia != Active.size(); ++ia) {
+      TCell const& Cell = fCells[Active[ia]];
+      for (int i = 0; i != 3; ++i) {
+        TNode const P = fNodes[Cell.Corner[i]];
+        TNode const Q = fNodes[Cell.Corner[(i + 1) % 3]];
+        Tests[ia][i] = Node((P.X + Q.X) / 2., P.N);
+      }
+    }
+    this->Evaluate(Function, First);
+
+    double const Limit = Tolerance * this->GetMaxValue();
+
+    std::vector<int> Next;
+    for (size_t ia = 0; ia != Active.size(); ++ia) {
+      int const ic = Active[ia];
+      int const A = fCells[ic].Corner[0];
+      int const B = fCells[ic].Corner[1];
+      int const C = fCells[ic].Corner[2];
+      int const AB = Tests[ia][0];
+      int const BC = Tests[ia][1];
+      int const CA = Tests[ia][2];
+
+      double const Error = std::max(fabs(fNodes[AB].V - (fNodes[A].V + fNodes[B].V) / 2.),
+                           std::max(fabs(fNodes[BC].V - (fNodes[B].V + fNodes[C].V) / 2.),
+                                    fabs(fNodes[CA].V - (fNodes[C].V + fNodes[A].V) / 2.)));
+      if (Error <= Limit) {
+        continue;
+      }
+
+      fCells[ic].Child = (int) fCells.size();
+      for (int i = 0; i != 4; ++i) {
+        Next.push_back((int) fCells.size() + i);
+      }
+      AddCell(A, AB, CA, Level + 1);
+      AddCell(AB, B, BC, Level + 1);
+      AddCell(CA, BC, C, Level + 1);
+      AddCell(AB, BC, CA, Level + 1);
+    }
+
+    Active.swap(Next);
+  }
+
+  return;
+}
+
+
+
+
+void T3DScalarTree::Evaluate (TEvaluate const& Function, size_t const First)
+{
+  // Evaluate all nodes from First on as one batch
+
+  if (First >= fNodes.size()) {
+    return;
+  }
+
+  TSurfacePoints_3D Points;
+  for (size_t i = First; i != fNodes.size(); ++i) {
+    Points.AddPoint(fNodes[i].X, fNodes[i].N);
+  }
+
+  std::vector<double> Values;
+  Function(Points, Values);
+  if (Values.size() < Points.GetNPoints()) {
+    throw std::length_error("evaluation returned fewer values than points");
+  }
+
+  for (size_t i = First; i != fNodes.size(); ++i) {
+    fNodes[i].V = Values[i - First];
+  }
+
+  return;
+}
+
+
+
+
+double T3DScalarTree::GetMaxValue () const
+{
+  // Largest |value| of all nodes
+  double Max = 0;
+  for (std::vector<TNode>::const_iterator it = fNodes.begin(); it != fNodes.end(); ++it) {
+    Max = std::max(Max, fabs(it->V));
+  }
+
+  return Max;
+}
+
+
+
+
+size_t T3DScalarTree::GetNNodes () const
+{
+  // Number of points evaluated
+  return fNodes.size();
+}
+
+
+
+
+T3DScalarTree::TNode const& T3DScalarTree::GetNode (size_t const i) const
+{
+  // The ith point evaluated
+  if (i >= fNodes.size()) {
+    throw std::out_of_range("node index out of range");
+  }
+
+  return fNodes[i];
+}
+
+
+
+
+size_t T3DScalarTree::GetNCells () const
+{
+  // Number of cells including those which were split
+  return fCells.size();
+}
+
+
+
+
+T3DScalarTree::TCell const& T3DScalarTree::GetCell (size_t const i) const
+{
+  // The ith cell
+  if (i >= fCells.size()) {
+    throw std::out_of_range("cell index out of range");
+  }
+
+  return fCells[i];
+}
+
+
+
+
+size_t T3DScalarTree::GetNLeaves () const
+{
+  // Number of cells which were not split
+  size_t N = 0;
+  for (std::vector<TCell>::const_iterator it = fCells.begin(); it != fCells.end(); ++it) {
+    if (it->Child == -1) {
+      ++N;
+    }
+  }
+
+  return N;
+}
+
+
+
+
+double T3DScalarTree::GetCellArea (size_t const i) const
+{
+  // Area of the ith cell [m^2].  A flat quadrilateral is half the cross product of its diagonals
+
+  TCell const& C = this->GetCell(i);
+  TVector3D const& A = fNodes[C.Corner[0]].X;
+  TVector3D const& B = fNodes[C.Corner[1]].X;
+  TVector3D const& D = fNodes[C.Corner[2]].X;
+
+  if (C.NCorners == 3) {
+    return (B - A).Cross(D - A).Mag() / 2.;
+  }
+
+  return (D - A).Cross(fNodes[C.Corner[3]].X - B).Mag() / 2.;
+}
+
+
+
+
+bool T3DScalarTree::IsRectangle () const
+{
+  // True if refined from a rectangle
+  return fIsRectangle;
+}
+
+
+
+
+void T3DScalarTree::GetNodes (T3DScalarContainer& Container, int const Dimension) const
+{
+  // Add every node to the container, at (X1, X2, 0) for Dimension 2 of a rectangle
+
+  if (Dimension != 2 && Dimension != 3) {
+    throw std::invalid_argument("dimension must be 2 or 3");
+  }
+
+  for (std::vector<TNode>::const_iterator it = fNodes.begin(); it != fNodes.end(); ++it) {
+    if (Dimension == 2 && fIsRectangle) {
+      Container.AddPoint(TVector3D(it->U.GetX(), it->U.GetY(), 0), it->V);
+    } else {
+      Container.AddPoint(it->X, it->V);
+    }
+  }
+
+  return;
+}
+
+
+
+
+void T3DScalarTree::GetLeaves (T3DScalarContainer& Container, std::vector<double>* Areas) const
+{
+  // Add the center of every leaf with the average of its corners, and optionally its area
+
+  for (size_t i = 0; i != fCells.size(); ++i) {
+    TCell const& C = fCells[i];
+    if (C.Child != -1) {
+      continue;
+    }
+
+    TVector3D X(0, 0, 0);
+    double V = 0;
+    for (int j = 0; j != C.NCorners; ++j) {
+      X += fNodes[C.Corner[j]].X;
+      V += fNodes[C.Corner[j]].V;
+    }
+    Container.AddPoint(X / (double) C.NCorners, V / (double) C.NCorners);
+
+    if (Areas != 0x0) {
+      Areas->push_back(this->GetCellArea(i));
+    }
+  }
+
+  return;
+}
+
+
+
+
+double T3DScalarTree::GetIntegral () const
+{
+  // Sum over leaves of the area times the average of the corners
+
+  double Sum = 0;
+  for (size_t i = 0; i != fCells.size(); ++i) {
+    TCell const& C = fCells[i];
+    if (C.Child != -1) {
+      continue;
+    }
+
+    double V = 0;
+    for (int j = 0; j != C.NCorners; ++j) {
+      V += fNodes[C.Corner[j]].V;
+    }
+    Sum += this->GetCellArea(i) * V / (double) C.NCorners;
+  }
+
+  return Sum;
+}
+
+
+
+
+double T3DScalarTree::GetValue (double const X1, double const X2, TVector3D* Position) const
+{
+  // Bilinear interpolation in the leaf containing (X1, X2).  Position is set to the point in 3D
+
+  if (!fIsRectangle) {
+    throw std::invalid_argument("interpolation is only for a rectangle");
+  }
+
+  // Starting cell, the last one for a point on the far edge
+  double const F1 = (X1 - fX1Start) / fX1Step;
+  double const F2 = (X2 - fX2Start) / fX2Step;
+  if (F1 < -1e-9 || F1 > fNX1 - 1 + 1e-9 || F2 < -1e-9 || F2 > fNX2 - 1 + 1e-9) {
+    throw std::out_of_range("point is not on the rectangle");
+  }
+  int const i1 = std::min(std::max((int) F1, 0), fNX1 - 2);
+  int const i2 = std::min(std::max((int) F2, 0), fNX2 - 2);
+
+  int ic = i1 * (fNX2 - 1) + i2;
+  double T1;
+  double T2;
+  while (true) {
+    TCell const& C = fCells[ic];
+    TVector2D const& Lo = fNodes[C.Corner[0]].U;
+    TVector2D const& Hi = fNodes[C.Corner[2]].U;
+    T1 = (X1 - Lo.GetX()) / (Hi.GetX() - Lo.GetX());
+    T2 = (X2 - Lo.GetY()) / (Hi.GetY() - Lo.GetY());
+
+    if (C.Child == -1) {
+      break;
+    }
+    ic = C.Child + (T1 >= 0.5 ? 1 : 0) + (T2 >= 0.5 ? 2 : 0);
+  }
+
+  TCell const& C = fCells[ic];
+  double const W[4] = { (1 - T1) * (1 - T2), T1 * (1 - T2), T1 * T2, (1 - T1) * T2 };
+
+  double V = 0;
+  TVector3D X(0, 0, 0);
+  for (int i = 0; i != 4; ++i) {
+    V += W[i] * fNodes[C.Corner[i]].V;
+    X += W[i] * fNodes[C.Corner[i]].X;
+  }
+
+  if (Position != 0x0) {
+    *Position = X;
+  }
+
+  return V;
+}
+
+
+
+
+void T3DScalarTree::Resample (int const NX1, int const NX2, T3DScalarContainer& Container, int const Dimension) const
+{
+  // Interpolate on a regular NX1 x NX2 grid over the rectangle, X1 changing slowest as for
+  // the points of a rectangle.  Points are (X1, X2, 0) for Dimension 2, otherwise in 3D
+
+  if (NX1 < 2 || NX2 < 2) {
+    throw std::invalid_argument("need at least 2 points in X1 and in X2 to resample");
+  }
+  if (Dimension != 2 && Dimension != 3) {
+    throw std::invalid_argument("dimension must be 2 or 3");
+  }
+
+  double const X1Step = fX1Step * (fNX1 - 1) / (NX1 - 1);
+  double const X2Step = fX2Step * (fNX2 - 1) / (NX2 - 1);
+
+  TVector3D Position;
+  for (int i1 = 0; i1 != NX1; ++i1) {
+    double const X1 = fX1Start + i1 * X1Step;
+    for (int i2 = 0; i2 != NX2; ++i2) {
+      double const X2 = fX2Start + i2 * X2Step;
+      double const V = this->GetValue(X1, X2, &Position);
+
+      if (Dimension == 2) {
+        Container.AddPoint(TVector3D(X1, X2, 0), V);
+      } else {
+        Container.AddPoint(Position, V);
+      }
+    }
+  }
+
+  return;
+}
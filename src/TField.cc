@@ -0,0 +1,47 @@
+#include "TField.h"
+
+#include <algorithm>
+
+
+
+
+void TField::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Default batch evaluation.  Fill F with the field at each of the N points in X
+
+  for (size_t i = 0; i != N; ++i) {
+    F[i] = this->GetF(X[i]);
+  }
+
+  return;
+}
+
+
+
+
+void TField::GetFBatch (double const* X, double const* Y, double const* Z, double* FX, double* FY, double* FZ, size_t const N) const
+{
+  // Batch evaluation for points and fields as separate coordinate arrays.  Blocks are
+  // gathered into vectors for the batch above and scattered back.
+
+  size_t const NBlock = 256;
+  TVector3D XBlock[NBlock];
+  TVector3D FBlock[NBlock];
+
+  for (size_t i0 = 0; i0 < N; i0 += NBlock) {
+    size_t const NThis = std::min(NBlock, N - i0);
+    for (size_t i = 0; i != NThis; ++i) {
+      XBlock[i].SetXYZ(X[i0 + i], Y[i0 + i], Z[i0 + i]);
+    }
+
+    this->GetFBatch(XBlock, FBlock, NThis);
+
+    for (size_t i = 0; i != NThis; ++i) {
+      FX[i0 + i] = FBlock[i].GetX();
+      FY[i0 + i] = FBlock[i].GetY();
+      FZ[i0 + i] = FBlock[i].GetZ();
+    }
+  }
+
+  return;
+}
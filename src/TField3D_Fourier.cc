@@ -0,0 +1,477 @@
+#include "TField3D_Fourier.h"
+#include "TSRS.h"
+
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+
+
+TField3D_Fourier::TField3D_Fourier (std::string const& InFileName,
+                                    std::string const& FileFormat,
+                                    double const Period,
+                                    int const NHarmonics,
+                                    double const EndLength,
+                                    TVector3D const& Rotations,
+                                    TVector3D const& Translation,
+                                    std::vector<double> const& Scaling)
+{
+  // Read the map in its own frame and fit it.  The map is only needed while fitting.
+
+  // Period - Length of the period along z [m]
+  // NHarmonics - Number of harmonics of the period in the series
+  // EndLength - Length at each end of the map not used in the fit [m], negative for 2 periods
+
+  TField3D_Grid const Grid(InFileName, FileFormat, TVector3D(0, 0, 0), TVector3D(0, 0, 0), Scaling);
+
+  this->Fit(Grid, Period, NHarmonics, EndLength < 0 ? 2 * Period : EndLength);
+
+  fRotationMatrix.SetRotationXYZ(Rotations);
+  fHasRotation = !fRotationMatrix.IsIdentity();
+  fTranslation = Translation;
+}
+
+
+
+
+TField3D_Fourier::~TField3D_Fourier ()
+{
+  // Destruction
+}
+
+
+
+
+void TField3D_Fourier::Fit (TField3D_Grid const& Grid, double const Period, int const NHarmonics, double const EndLength)
+{
+  // Least squares fit of the series along z at every transverse grid point.  The functions
+  // are the same for every point, so the normal equations are inverted once.
+
+  if (Grid.fDataPointer == 0x0) {
+    std::cerr << "ERROR: map has no node data to fit" << std::endl;
+    throw std::invalid_argument("map has no node data to fit");
+  }
+  if (Grid.fNZ < 2) {
+    std::cerr << "ERROR: map must vary along z for a Fourier series" << std::endl;
+    throw std::invalid_argument("map must vary along z for a Fourier series");
+  }
+  if (Period <= 0 || NHarmonics < 1 || NHarmonics > kMaxHarmonics || EndLength < 0) {
+    std::cerr << "ERROR: period and ends must be positive and harmonics between 1 and " << kMaxHarmonics << std::endl;
+    throw std::invalid_argument("period and ends must be positive and harmonics between 1 and 64");
+  }
+  if (2 * NHarmonics * Grid.fZStep >= Period) {
+    std::cerr << "ERROR: too many harmonics for the z step of the map" << std::endl;
+    throw std::invalid_argument("too many harmonics for the z step of the map");
+  }
+
+  fNX     = Grid.fNX;
+  fNY     = Grid.fNY;
+  fXStart = Grid.fXStart;
+  fYStart = Grid.fYStart;
+  fXStep  = Grid.fXStep;
+  fYStep  = Grid.fYStep;
+  fXStop  = Grid.fXStop;
+  fYStop  = Grid.fYStop;
+  fZStart = Grid.fZStart;
+  fZStop  = Grid.fZStop;
+  fZStep  = Grid.fZStep;
+  fZCenter = (fZStart + fZStop) / 2.;
+
+  fK          = TSRS::TwoPi() / Period;
+  fNHarmonics = NHarmonics;
+  fNBasis     = 2 * NHarmonics + 1;
+
+  int const NZ = Grid.fNZ;
+
+  // Fit over a whole number of periods in the middle, leaving the ends
+  int const NPeriods = (int) std::floor((fZStop - fZStart - 2 * EndLength) / Period);
+  if (NPeriods < 1) {
+    std::cerr << "ERROR: map is too short for one period between the ends" << std::endl;
+    throw std::invalid_argument("map is too short for one period between the ends");
+  }
+  double const ZFitStart = fZCenter - NPeriods * Period / 2.;
+  double const ZFitStop  = fZCenter + NPeriods * Period / 2.;
+
+  // First and last grid point of the fit
+  int const K1 = std::max(0,      (int) std::ceil ((ZFitStart - fZStart) / fZStep - 1e-9));
+  int const K2 = std::min(NZ - 1, (int) std::floor((ZFitStop  - fZStart) / fZStep + 1e-9));
+  if (K2 - K1 + 1 < fNBasis) {
+    std::cerr << "ERROR: not enough points in the map for the number of harmonics" << std::endl;
+    throw std::invalid_argument("not enough points in the map for the number of harmonics");
+  }
+
+  // Values of the functions at each grid point in the fit
+  int const NFit = K2 - K1 + 1;
+  std::vector<double> Basis(NFit * fNBasis);
+  for (int k = 0; k != NFit; ++k) {
+    double const Phase = fK * (fZStart + (K1 + k) * fZStep - fZCenter);
+    Basis[k * fNBasis] = 1;
+    for (int n = 1; n <= fNHarmonics; ++n) {
+      Basis[k * fNBasis + 2 * n - 1] = cos(n * Phase);
+      Basis[k * fNBasis + 2 * n]     = sin(n * Phase);
+    }
+  }
+
+  // Normal matrix and its inverse by Gauss-Jordan elimination
+  int const NB = fNBasis;
+  std::vector<double> A(NB * NB, 0);
+  std::vector<double> AInverse(NB * NB, 0);
+  for (int i = 0; i != NB; ++i) {
+    AInverse[i * NB + i] = 1;
+    for (int j = 0; j != NB; ++j) {
+      for (int k = 0; k != NFit; ++k) {
+        A[i * NB + j] += Basis[k * NB + i] * Basis[k * NB + j];
+      }
+    }
+  }
+  for (int c = 0; c != NB; ++c) {
+    int Pivot = c;
+    for (int r = c + 1; r != NB; ++r) {
+      if (std::fabs(A[r * NB + c]) > std::fabs(A[Pivot * NB + c])) {
+        Pivot = r;
+      }
+    }
+    if (A[Pivot * NB + c] == 0) {
+      std::cerr << "ERROR: Fourier fit is singular" << std::endl;
+      throw std::invalid_argument("Fourier fit is singular");
+    }
+    for (int j = 0; j != NB; ++j) {
+      std::swap(A[c * NB + j], A[Pivot * NB + j]);
+      std::swap(AInverse[c * NB + j], AInverse[Pivot * NB + j]);
+    }
+    double const D = A[c * NB + c];
+    for (int j = 0; j != NB; ++j) {
+      A[c * NB + j] /= D;
+      AInverse[c * NB + j] /= D;
+    }
+    for (int r = 0; r != NB; ++r) {
+      if (r == c) {
+        continue;
+      }
+      double const M = A[r * NB + c];
+      for (int j = 0; j != NB; ++j) {
+        A[r * NB + j] -= M * A[c * NB + j];
+        AInverse[r * NB + j] -= M * AInverse[c * NB + j];
+      }
+    }
+  }
+
+  // Field at a grid point of the map
+  double const* Data = Grid.fDataPointer;
+  size_t const NYZ = (size_t) fNY * NZ;
+
+  // Coefficients at each transverse point
+  fCoefficients.assign((size_t) fNX * fNY * NB, TVector3D(0, 0, 0));
+  std::vector<TVector3D> RHS(NB);
+  for (int ix = 0; ix != fNX; ++ix) {
+    for (int iy = 0; iy != fNY; ++iy) {
+      std::fill(RHS.begin(), RHS.end(), TVector3D(0, 0, 0));
+      for (int k = 0; k != NFit; ++k) {
+        double const* F = Data + 3 * (ix * NYZ + iy * NZ + K1 + k);
+        TVector3D const V(F[0], F[1], F[2]);
+        for (int i = 0; i != NB; ++i) {
+          RHS[i] += Basis[k * NB + i] * V;
+        }
+      }
+      TVector3D* C = &fCoefficients[((size_t) ix * fNY + iy) * NB];
+      for (int i = 0; i != NB; ++i) {
+        for (int j = 0; j != NB; ++j) {
+          C[i] += AInverse[i * NB + j] * RHS[j];
+        }
+      }
+    }
+  }
+
+  // What the series misses at each end, on the grid points from the end of the map up to
+  // and including the first point of the fit.  Kept in local vectors so the series is
+  // evaluated without any correction.
+  fNZLowEnd  = K1 + 1;
+  fNZHighEnd = NZ - K2;
+  fZLowEnd   = fZStart + K1 * fZStep;
+  fZHighEnd  = fZStart + K2 * fZStep;
+  fZBlend    = std::min(Period, (fZHighEnd - fZLowEnd) / 2.);
+  fLowEnd.clear();
+  fHighEnd.clear();
+  std::vector<TVector3D> LowEnd((size_t) fNX * fNY * fNZLowEnd, TVector3D(0, 0, 0));
+  std::vector<TVector3D> HighEnd((size_t) fNX * fNY * fNZHighEnd, TVector3D(0, 0, 0));
+  for (int ix = 0; ix != fNX; ++ix) {
+    for (int iy = 0; iy != fNY; ++iy) {
+      double const X = fXStart + ix * fXStep;
+      double const Y = fYStart + iy * fYStep;
+      for (int k = 0; k != NZ; ++k) {
+        if (k > K1 && k < K2) {
+          continue;
+        }
+        double const Z = k == K1 ? fZLowEnd : (k == K2 ? fZHighEnd : fZStart + k * fZStep);
+
+        TVector3D const S = this->Evaluate(X, Y, Z);
+        double const* F = Data + 3 * (ix * NYZ + iy * NZ + k);
+        TVector3D const Correction = TVector3D(F[0], F[1], F[2]) - S;
+        if (k <= K1) {
+          LowEnd[((size_t) ix * fNY + iy) * fNZLowEnd + k] = Correction;
+        }
+        if (k >= K2) {
+          HighEnd[((size_t) ix * fNY + iy) * fNZHighEnd + (k - K2)] = Correction;
+        }
+      }
+    }
+  }
+  fLowEnd.swap(LowEnd);
+  fHighEnd.swap(HighEnd);
+
+  // Accuracy against the map at all of its grid points
+  fMaxError = 0;
+  fMaxField = 0;
+  double SumSquares = 0;
+  for (int ix = 0; ix != fNX; ++ix) {
+    for (int iy = 0; iy != fNY; ++iy) {
+      for (int k = 0; k != NZ; ++k) {
+        double const* F = Data + 3 * (ix * NYZ + iy * NZ + k);
+        TVector3D const V(F[0], F[1], F[2]);
+        TVector3D const D = this->Evaluate(fXStart + ix * fXStep, fYStart + iy * fYStep, k == NZ - 1 ? fZStop : fZStart + k * fZStep) - V;
+        fMaxError = std::max(fMaxError, std::max(std::fabs(D.GetX()), std::max(std::fabs(D.GetY()), std::fabs(D.GetZ()))));
+        fMaxField = std::max(fMaxField, std::max(std::fabs(V.GetX()), std::max(std::fabs(V.GetY()), std::fabs(V.GetZ()))));
+        SumSquares += D.Dot(D);
+      }
+    }
+  }
+  fRMSError = std::sqrt(SumSquares / (3. * fNX * fNY * NZ));
+  fMapSize  = 3 * sizeof(double) * (size_t) fNX * fNY * NZ;
+
+  return;
+}
+
+
+
+
+TVector3D TField3D_Fourier::Evaluate (double const X, double const Y, double const Z) const
+{
+  // Field at a point in the frame of the map
+
+  // Zero outside of the map like TField3D_Grid
+  if (Z < fZStart || Z > fZStop) {
+    return TVector3D(0, 0, 0);
+  }
+
+  // Transverse cell and weights
+  size_t ix = 0;
+  size_t iy = 0;
+  double wx = 0;
+  double wy = 0;
+  if (fNX > 1) {
+    if (X < fXStart || X > fXStop) {
+      return TVector3D(0, 0, 0);
+    }
+    double const u = (X - fXStart) / fXStep;
+    ix = std::min((size_t) u, (size_t) fNX - 2);
+    wx = u - ix;
+  }
+  if (fNY > 1) {
+    if (Y < fYStart || Y > fYStop) {
+      return TVector3D(0, 0, 0);
+    }
+    double const u = (Y - fYStart) / fYStep;
+    iy = std::min((size_t) u, (size_t) fNY - 2);
+    wy = u - iy;
+  }
+
+  // Functions of the series at Z.  Harmonics by the angle addition recurrence so there is
+  // only one sin and cos per point.
+  double Basis[2 * kMaxHarmonics + 1];
+  double const Phase = fK * (Z - fZCenter);
+  double const C1 = cos(Phase);
+  double const S1 = sin(Phase);
+  double Cn = 1;
+  double Sn = 0;
+  Basis[0] = 1;
+  for (int n = 1; n <= fNHarmonics; ++n) {
+    double const C = Cn * C1 - Sn * S1;
+    Sn = Sn * C1 + Cn * S1;
+    Cn = C;
+    Basis[2 * n - 1] = Cn;
+    Basis[2 * n]     = Sn;
+  }
+
+  // Sum the series at the corners of the transverse cell
+  double FX = 0;
+  double FY = 0;
+  double FZ = 0;
+  for (size_t a = 0; a != (fNX > 1 ? 2 : 1); ++a) {
+    for (size_t b = 0; b != (fNY > 1 ? 2 : 1); ++b) {
+      double const W = (a == 0 ? 1 - wx : wx) * (b == 0 ? 1 - wy : wy);
+      TVector3D const* C = &fCoefficients[((ix + a) * fNY + (iy + b)) * fNBasis];
+      double SX = 0;
+      double SY = 0;
+      double SZ = 0;
+      for (int i = 0; i != fNBasis; ++i) {
+        SX += C[i].GetX() * Basis[i];
+        SY += C[i].GetY() * Basis[i];
+        SZ += C[i].GetZ() * Basis[i];
+      }
+      FX += W * SX;
+      FY += W * SY;
+      FZ += W * SZ;
+    }
+  }
+
+  TVector3D F(FX, FY, FZ);
+
+  // Corrections at the ends.  The correction at the first and last point of the fit goes
+  // to zero linearly over fZBlend inside the fit so the field is continuous at the seams.
+  if (fLowEnd.size() == 0) {
+    return F;
+  }
+  if (Z <= fZLowEnd) {
+    F += this->GetEndCorrection(fLowEnd, fNZLowEnd, fZStart, ix, iy, wx, wy, Z);
+  } else if (Z >= fZHighEnd) {
+    F += this->GetEndCorrection(fHighEnd, fNZHighEnd, fZHighEnd, ix, iy, wx, wy, Z);
+  } else {
+    if (Z < fZLowEnd + fZBlend) {
+      F += (1 - (Z - fZLowEnd) / fZBlend) * this->GetEndCorrection(fLowEnd, fNZLowEnd, fZStart, ix, iy, wx, wy, fZLowEnd);
+    }
+    if (Z > fZHighEnd - fZBlend) {
+      F += (1 - (fZHighEnd - Z) / fZBlend) * this->GetEndCorrection(fHighEnd, fNZHighEnd, fZHighEnd, ix, iy, wx, wy, fZHighEnd);
+    }
+  }
+
+  return F;
+}
+
+
+
+
+TVector3D TField3D_Fourier::GetEndCorrection (std::vector<TVector3D> const& End, int const NZEnd, double const ZEndStart, size_t const ix, size_t const iy, double const wx, double const wy, double const Z) const
+{
+  // Linear interpolation of an end correction in the transverse cell (ix, iy).  An end
+  // with a single point (the fit starts at the end of the map) is constant.
+
+  double const u = (Z - ZEndStart) / fZStep;
+  size_t const iz = NZEnd > 1 ? std::min((size_t) std::max(u, 0.), (size_t) NZEnd - 2) : 0;
+  double const wz = NZEnd > 1 ? std::min(std::max(u - iz, 0.), 1.) : 0;
+
+  TVector3D F(0, 0, 0);
+  for (size_t a = 0; a != (fNX > 1 ? 2 : 1); ++a) {
+    for (size_t b = 0; b != (fNY > 1 ? 2 : 1); ++b) {
+      double const W = (a == 0 ? 1 - wx : wx) * (b == 0 ? 1 - wy : wy);
+      TVector3D const* E = &End[((ix + a) * fNY + (iy + b)) * NZEnd + iz];
+      F += (W * (1 - wz)) * E[0];
+      if (NZEnd > 1) {
+        F += (W * wz) * E[1];
+      }
+    }
+  }
+
+  return F;
+}
+
+
+
+
+double TField3D_Fourier::GetFx (double const X, double const Y, double const Z) const
+{
+  return this->GetF(X, Y, Z).GetX();
+}
+
+
+
+
+double TField3D_Fourier::GetFy (double const X, double const Y, double const Z) const
+{
+  return this->GetF(X, Y, Z).GetY();
+}
+
+
+
+
+double TField3D_Fourier::GetFz (double const X, double const Y, double const Z) const
+{
+  return this->GetF(X, Y, Z).GetZ();
+}
+
+
+
+
+TVector3D TField3D_Fourier::GetF (double const X, double const Y, double const Z) const
+{
+  return this->GetF(TVector3D(X, Y, Z));
+}
+
+
+
+
+TVector3D TField3D_Fourier::GetF (TVector3D const& XIN) const
+{
+  // Get the field at a point in space.  Rotate and translate into the frame of the map
+  // the same way TField3D_Grid does, and rotate the field back.
+
+  if (!fHasRotation) {
+    return this->Evaluate(XIN.GetX() - fTranslation.GetX(), XIN.GetY() - fTranslation.GetY(), XIN.GetZ() - fTranslation.GetZ());
+  }
+
+  double X;
+  double Y;
+  double Z;
+  fRotationMatrix.Multiply(XIN.GetX(), XIN.GetY(), XIN.GetZ(), X, Y, Z);
+
+  return fRotationMatrix * this->Evaluate(X - fTranslation.GetX(), Y - fTranslation.GetY(), Z - fTranslation.GetZ());
+}
+
+
+
+
+void TField3D_Fourier::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Get the field at N points without going through the virtual table
+
+  for (size_t i = 0; i != N; ++i) {
+    F[i] = this->TField3D_Fourier::GetF(X[i]);
+  }
+
+  return;
+}
+
+
+
+
+double TField3D_Fourier::GetMaxError () const
+{
+  // Largest difference from the map at any of its grid points
+  return fMaxError;
+}
+
+
+
+
+double TField3D_Fourier::GetRMSError () const
+{
+  // RMS difference from the map over all of its grid points and components
+  return fRMSError;
+}
+
+
+
+
+double TField3D_Fourier::GetMaxField () const
+{
+  // Largest field component in the map, to compare the errors to
+  return fMaxField;
+}
+
+
+
+
+size_t TField3D_Fourier::GetSize () const
+{
+  // Bytes of coefficients and end corrections
+  return sizeof(TVector3D) * (fCoefficients.size() + fLowEnd.size() + fHighEnd.size());
+}
+
+
+
+
+size_t TField3D_Fourier::GetMapSize () const
+{
+  // Bytes of the map this was fit to
+  return fMapSize;
+}
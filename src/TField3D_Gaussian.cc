@@ -111,3 +111,37 @@ TVector3D TField3D_Gaussian::GetF (TVector3D const& X) const
 
   return Fraction * fField;
 }
+
+
+
+
+void TField3D_Gaussian::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Get the field at N points.  Same as GetF, but the rotation check and
+  // inverse widths are computed once for the whole batch
+
+  bool const HasRotation = fRotated.GetX() != 0 || fRotated.GetY() != 0 || fRotated.GetZ() != 0;
+
+  double const InvSigmaX = fSigma.GetX() > 0 ? 1. / fSigma.GetX() : 0;
+  double const InvSigmaY = fSigma.GetY() > 0 ? 1. / fSigma.GetY() : 0;
+  double const InvSigmaZ = fSigma.GetZ() > 0 ? 1. / fSigma.GetZ() : 0;
+
+  for (size_t i = 0; i != N; ++i) {
+
+    // Translate back into box frame
+    TVector3D XInBoxCoordinates = X[i];
+    if (HasRotation) {
+      XInBoxCoordinates.RotateSelfXYZ(fRotated);
+    }
+
+    // Position in the box frame with respect to the center, scaled by sigma
+    double const RX = (XInBoxCoordinates.GetX() - fCenter.GetX()) * InvSigmaX;
+    double const RY = (XInBoxCoordinates.GetY() - fCenter.GetY()) * InvSigmaY;
+    double const RZ = (XInBoxCoordinates.GetZ() - fCenter.GetZ()) * InvSigmaZ;
+
+    // Ignored axes have zero inverse width and contribute exp(0) = 1
+    F[i] = exp(-(RX * RX + RY * RY + RZ * RZ) / 2.) * fField;
+  }
+
+  return;
+}
@@ -12,18 +12,112 @@
 #include <sstream>
 #include <algorithm>
 #include <array>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cctype>
+#include <thread>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <cstdio>
+#include <climits>
+#include <limits>
+#include <type_traits>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+
+
+
+// Grids already read by this process, by everything that went into reading them.  The
+// entry does not keep the data alive, only grids using it do.
+struct TField3D_GridCacheEntry {
+  TField3D_Grid Grid;
+  std::weak_ptr<void const> Owner;
+};
+static std::map<std::string, TField3D_GridCacheEntry> gField3D_GridCache;
+static std::mutex gField3D_GridCacheMutex;
+
+// Directory where maps shared between processes are written
+static std::string gField3D_GridSharedDirectory = "/dev/shm";
 
 TField3D_Grid::TField3D_Grid ()
 {
   fRotated.SetXYZ(0, 0, 0);
   fTranslation.SetXYZ(0, 0, 0);
+  fHasRotation = false;
+  fKernel = 0x0;
+  fInterpolation = kInterpolation_Linear;
+  fDataPointer = 0x0;
+  fCoefficientPointer = 0x0;
+  fStorage = kStorage_Double;
+  fStoragePointer = 0x0;
+  fStorageScale.SetXYZ(1, 1, 1);
+  fStorageError = 0;
+  fHasMirror = false;
+  fMirror[0] = fMirror[1] = fMirror[2] = false;
+  fExtractMin.SetXYZ(0, 0, 0);
+  fExtractMax.SetXYZ(0, 0, 0);
 }
 
 
 
 
-TField3D_Grid::TField3D_Grid (std::string const& InFileName, std::string const& FileFormat, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling, char const CommentChar)
+TField3D_Grid::TField3D_Grid (std::string const& InFileName, std::string const& FileFormat, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling, char const CommentChar, TField3D_Grid_Interpolation const Interpolation, bool const Shared, TVector3D const& ExtractMin, TVector3D const& ExtractMax)
 {
+  // Interpolation and extraction must be known before reading since they change what is stored
+  fInterpolation = Interpolation;
+  fDataPointer = 0x0;
+  fCoefficientPointer = 0x0;
+  fStorage = kStorage_Double;
+  fStoragePointer = 0x0;
+  fStorageScale.SetXYZ(1, 1, 1);
+  fStorageError = 0;
+  fHasMirror = false;
+  fMirror[0] = fMirror[1] = fMirror[2] = false;
+  this->SetExtractionBox(ExtractMin, ExtractMax);
+
+  // The same map already read by this process is shared, not read again
+  std::string const Key = this->GetCacheKey(InFileName, FileFormat, Rotations, Translation, Scaling, CommentChar);
+  if (this->CopyFromCache(Key)) {
+    return;
+  }
+
+  // Binary files are already mapped shared, and cubic grids store coefficients which
+  // are not written out, so only text files read for linear interpolation go through
+  // the shared directory
+  std::string format = FileFormat;
+  std::transform(format.begin(), format.end(), format.begin(), ::toupper);
+  bool const UseShared = Shared && fInterpolation == kInterpolation_Linear && format != "OSCARSBIN";
+
+  std::ostringstream SharedFileName;
+  SharedFileName << GetSharedDirectory() << "/OSCARS_" << std::hex << std::hash<std::string>()(Key) << ".bin";
+
+  if (UseShared && this->ReadShared(SharedFileName.str(), Key, Rotations, Translation)) {
+    this->AddToCache(Key);
+    return;
+  }
+
+  this->ReadAnyFormat(InFileName, FileFormat, Rotations, Translation, Scaling, CommentChar);
+
+  // Publish for other processes and switch to the shared copy
+  if (UseShared) {
+    this->WriteShared(SharedFileName.str(), Key);
+    this->ReadShared(SharedFileName.str(), Key, Rotations, Translation);
+  }
+
+  this->AddToCache(Key);
+}
+
+
+
+
+void TField3D_Grid::ReadAnyFormat (std::string const& InFileName, std::string const& FileFormat, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling, char const CommentChar)
+{
+  // Read a file in any of the known formats
+
   // I will accept lower-case
   std::string format = FileFormat;
   std::transform(format.begin(), format.end(), format.begin(), ::toupper);
@@ -31,16 +125,20 @@ TField3D_Grid::TField3D_Grid (std::string const& InFileName, std::string const&
   // Which file format are you looking at?
   if (format == "OSCARS") {
     this->ReadFile(InFileName, Rotations, Translation, Scaling);
-  } else if (std::string(format.begin(), format.begin() + 8) == "OSCARS1D") {
+  } else if (format.size() >= 8 && std::string(format.begin(), format.begin() + 8) == "OSCARS1D") {
     this->ReadFile_OSCARS1D(InFileName, FileFormat, Rotations, Translation, Scaling, CommentChar);
   } else if (format == "SPECTRA") {
     this->ReadFile_SPECTRA(InFileName, Rotations, Translation, CommentChar);
   } else if (format == "SRW") {
     this->ReadFile_SRW(InFileName, Rotations, Translation, CommentChar);
+  } else if (format == "OSCARSBIN") {
+    this->ReadFile_Binary(InFileName, Rotations, Translation, Scaling);
   } else {
     std::cerr << "TField3D_Grid::TField3D_Grid format error format: " << FileFormat << std::endl;
     throw std::invalid_argument("incorrect format given");
   }
+
+  return;
 }
 
 
@@ -52,6 +150,18 @@ TField3D_Grid::TField3D_Grid (std::vector<std::pair<double, std::string> > Mappi
   // It is meant for interpolating between different undulator gaps, but it is generalized
   // to interpolate any fields
 
+  fInterpolation = kInterpolation_Linear;
+  fDataPointer = 0x0;
+  fCoefficientPointer = 0x0;
+  fStorage = kStorage_Double;
+  fStoragePointer = 0x0;
+  fStorageScale.SetXYZ(1, 1, 1);
+  fStorageError = 0;
+  fHasMirror = false;
+  fMirror[0] = fMirror[1] = fMirror[2] = false;
+  fExtractMin.SetXYZ(0, 0, 0);
+  fExtractMax.SetXYZ(0, 0, 0);
+
   // I will accept lower-case
   std::string format = FileFormat;
   std::transform(format.begin(), format.end(), format.begin(), ::toupper);
@@ -74,6 +184,90 @@ TField3D_Grid::TField3D_Grid (std::vector<std::pair<double, std::string> > Mappi
 
 
 
+TField3D_Grid::TField3D_Grid (TField const& Field, TVector3D const& Start, TVector3D const& Step, int const NX, int const NY, int const NZ, TField3D_Grid_Interpolation const Interpolation)
+{
+  // Tabulate any field on a regular grid.  A direction with one point is not a dimension
+  // of the grid.  The points are given to GetFBatch() in large blocks, so a field which
+  // does many points at once, like a vectorized python function, is called only a few times.
+
+  fInterpolation = Interpolation;
+  fDataPointer = 0x0;
+  fCoefficientPointer = 0x0;
+  fStorage = kStorage_Double;
+  fStoragePointer = 0x0;
+  fStorageScale.SetXYZ(1, 1, 1);
+  fStorageError = 0;
+  fHasMirror = false;
+  fMirror[0] = fMirror[1] = fMirror[2] = false;
+  fExtractMin.SetXYZ(0, 0, 0);
+  fExtractMax.SetXYZ(0, 0, 0);
+  fRotated.SetXYZ(0, 0, 0);
+  fTranslation.SetXYZ(0, 0, 0);
+
+  // Check Number of points is > 0 for all and that there is at least one dimension
+  if (NX < 1 || NY < 1 || NZ < 1 || (NX == 1 && NY == 1 && NZ == 1)) {
+    std::cerr << "ERROR: invalid npoints" << std::endl;
+    throw std::out_of_range("invalid number of points in at least one dimension");
+  }
+
+  fNX = NX;
+  fNY = NY;
+  fNZ = NZ;
+  fXStart = Start.GetX();
+  fYStart = Start.GetY();
+  fZStart = Start.GetZ();
+  fXStep  = NX > 1 ? Step.GetX() : 0;
+  fYStep  = NY > 1 ? Step.GetY() : 0;
+  fZStep  = NZ > 1 ? Step.GetZ() : 0;
+  fXStop  = fXStart + (fNX - 1) * fXStep;
+  fYStop  = fYStart + (fNY - 1) * fYStep;
+  fZStop  = fZStart + (fNZ - 1) * fZStep;
+
+  fHasX = NX > 1 ? true : false;
+  fHasY = NY > 1 ? true : false;
+  fHasZ = NZ > 1 ? true : false;
+
+  if (fHasX && fHasY && fHasZ) {
+    fDIMX = kDIMX_XYZ;
+  } else if (fHasX && fHasY) {
+    fDIMX = kDIMX_XY;
+  } else if (fHasX && fHasZ) {
+    fDIMX = kDIMX_XZ;
+  } else if (fHasY && fHasZ) {
+    fDIMX = kDIMX_YZ;
+  } else if (fHasX) {
+    fDIMX = kDIMX_X;
+  } else if (fHasY) {
+    fDIMX = kDIMX_Y;
+  } else {
+    fDIMX = kDIMX_Z;
+  }
+
+  fXDIM = (fHasX ? 1 : 0) + (fHasY ? 1 : 0) + (fHasZ ? 1 : 0);
+
+  // Evaluate the field in blocks of points, in the same order as the OSCARS format
+  size_t const NPoints = (size_t) NX * (size_t) NY * (size_t) NZ;
+  size_t const NBlock  = 1 << 20;
+  fData.resize(NPoints);
+  std::vector<TVector3D> X(std::min(NPoints, NBlock));
+  for (size_t i0 = 0; i0 < NPoints; i0 += NBlock) {
+    size_t const N = std::min(NBlock, NPoints - i0);
+    for (size_t i = 0; i != N; ++i) {
+      size_t const ix = (i0 + i) / ((size_t) NY * NZ);
+      size_t const iy = ((i0 + i) / NZ) % NY;
+      size_t const iz = (i0 + i) % NZ;
+      X[i].SetXYZ(fXStart + ix * fXStep, fYStart + iy * fYStep, fZStart + iz * fZStep);
+    }
+    Field.GetFBatch(X.data(), fData.data() + i0, N);
+  }
+
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+}
+
+
+
+
 TField3D_Grid::~TField3D_Grid ()
 {
   // Destruction is my goal
@@ -121,125 +315,1062 @@ size_t TField3D_Grid::GetIndex (size_t const ix, size_t const iy, size_t const i
 
 
 
+
+
+void TField3D_Grid::SetExtractionBox (TVector3D const& Min, TVector3D const& Max)
+{
+  // Set the box in the lab frame to keep when reading a file.  Min == Max to read everything.
+
+  if (Min != Max && (Min.GetX() > Max.GetX() || Min.GetY() > Max.GetY() || Min.GetZ() > Max.GetZ())) {
+    std::cerr << "ERROR: extraction box minimum is above its maximum" << std::endl;
+    throw std::invalid_argument("extraction box minimum is above its maximum");
+  }
+
+  fExtractMin = Min;
+  fExtractMax = Max;
+
+  return;
+}
+
+
+
+
+bool TField3D_Grid::HasExtractionBox () const
+{
+  return fExtractMin != fExtractMax;
+}
+
+
+
+
+void TField3D_Grid::SetStorage (TField3D_Grid_Storage const Storage, TVector3D const& MirrorX, TVector3D const& MirrorY, TVector3D const& MirrorZ)
+{
+  // Replace the field data with a compact copy: fewer bytes per value, and only half of the
+  // map in each mirrored direction.  Cubic grids keep their spline coefficients, which have
+  // the same symmetry as the data, so the spline is the one of the full map.
+
+  if (fKernel == 0x0) {
+    std::cerr << "ERROR: TField3D_Grid has no data" << std::endl;
+    throw std::out_of_range("grid has no data");
+  }
+  if (fStorage != kStorage_Double || fHasMirror) {
+    std::cerr << "ERROR: TField3D_Grid storage was already set" << std::endl;
+    throw std::logic_error("grid storage was already set");
+  }
+
+  TVector3D const Mirror[3] = {MirrorX, MirrorY, MirrorZ};
+  bool const Cubic = fInterpolation == kInterpolation_Cubic;
+
+  // Nothing to do
+  if (Storage == kStorage_Double && Mirror[0] == TVector3D(0, 0, 0) && Mirror[1] == TVector3D(0, 0, 0) && Mirror[2] == TVector3D(0, 0, 0)) {
+    return;
+  }
+
+  TVector3D const* Source = Cubic ? fCoefficientPointer : (TVector3D const*) fDataPointer;
+
+  // Values stored along each axis: the points, or the coefficients padded by one at each end
+  int    const N[3]     = {fNX, fNY, fNZ};
+  double const Start[3] = {fXStart, fYStart, fZStart};
+  double const Stop[3]  = {fXStop,  fYStop,  fZStop};
+  double const Step[3]  = {fXStep,  fYStep,  fZStep};
+
+  int       S[3];
+  int       First[3];
+  bool      Mirrored[3];
+  TVector3D Parity[3];
+  for (int a = 0; a != 3; ++a) {
+    S[a]        = Cubic && N[a] > 1 ? N[a] + 2 : N[a];
+    First[a]    = 0;
+    Mirrored[a] = Mirror[a] != TVector3D(0, 0, 0);
+    Parity[a]   = Mirrored[a] ? Mirror[a] : TVector3D(1, 1, 1);
+
+    if (!Mirrored[a]) {
+      continue;
+    }
+
+    for (int c = 0; c != 3; ++c) {
+      if (std::fabs(Mirror[a][c]) != 1) {
+        std::cerr << "ERROR: mirror parity must be +1 or -1 for each component" << std::endl;
+        throw std::invalid_argument("mirror parity must be +1 or -1 for each component");
+      }
+    }
+    if (N[a] < 4) {
+      std::cerr << "ERROR: need at least 4 points in a mirrored direction" << std::endl;
+      throw std::invalid_argument("need at least 4 points in a mirrored direction");
+    }
+    if (std::fabs(Start[a] + Stop[a]) > 1e-6 * Step[a]) {
+      std::cerr << "ERROR: grid is not symmetric about 0 in a mirrored direction" << std::endl;
+      throw std::invalid_argument("grid is not symmetric about 0 in a mirrored direction");
+    }
+
+    // Keep from one point below the middle so 0 is inside the stored grid.  In the padded
+    // coefficients the same index is the ghost point of the first kept point.
+    First[a] = (N[a] - 1) / 2 - 1;
+  }
+
+  // Grid axes in the frame the field is stored in
+  for (int a = 0; a != 3; ++a) {
+    fFieldAxes[a].SetXYZ(a == 0 ? 1 : 0, a == 1 ? 1 : 0, a == 2 ? 1 : 0);
+    fFieldAxes[a].RotateSelfXYZ(fRotated);
+  }
+
+  // How far the data is from the symmetry
+  double Asymmetry = 0;
+  double MaxAbs = 0;
+  size_t const NSource = (size_t) S[0] * S[1] * S[2];
+  for (int a = 0; a != 3; ++a) {
+    if (!Mirrored[a]) {
+      continue;
+    }
+    for (size_t i = 0; i != NSource; ++i) {
+      int Index[3] = {(int) (i / ((size_t) S[1] * S[2])), (int) ((i / S[2]) % S[1]), (int) (i % S[2])};
+      Index[a] = S[a] - 1 - Index[a];
+      TVector3D const D = this->MirrorField(Source[((size_t) Index[0] * S[1] + Index[1]) * S[2] + Index[2]], Parity[a]) - Source[i];
+      Asymmetry = std::max(Asymmetry, std::max(std::fabs(D.GetX()), std::max(std::fabs(D.GetY()), std::fabs(D.GetZ()))));
+      MaxAbs = std::max(MaxAbs, std::max(std::fabs(Source[i].GetX()), std::max(std::fabs(Source[i].GetY()), std::fabs(Source[i].GetZ()))));
+    }
+  }
+  if (Asymmetry > 1e-3 * MaxAbs) {
+    std::cerr << "WARNING: field map differs from its mirror image by up to " << Asymmetry << std::endl;
+  }
+
+  // Copy what is kept
+  int const M[3] = {S[0] - First[0], S[1] - First[1], S[2] - First[2]};
+  double Error = 0;
+  switch (Storage) {
+    case kStorage_Double:
+      Error = this->SetStorageData<double>(Source, S, First, M);
+      break;
+    case kStorage_Float32:
+      Error = this->SetStorageData<float>(Source, S, First, M);
+      break;
+    case kStorage_Fixed16:
+      Error = this->SetStorageData<int16_t>(Source, S, First, M);
+      break;
+    default:
+      throw std::out_of_range("unknown storage");
+  }
+
+  fStorage      = Storage;
+  fStorageError = std::max(Error, Asymmetry);
+  fHasMirror    = Mirrored[0] || Mirrored[1] || Mirrored[2];
+  for (int a = 0; a != 3; ++a) {
+    fMirror[a]       = Mirrored[a];
+    fMirrorParity[a] = Parity[a];
+  }
+
+  // Only the compact copy is looked up now
+  fDataPointer = 0x0;
+  fCoefficientPointer = 0x0;
+
+  int const Range[6] = {First[0], N[0] - 1, First[1], N[1] - 1, First[2], N[2] - 1};
+  this->SetExtractedGeometry(Range);
+
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+
+  return;
+}
+
+
+
+
+template <typename T>
+double TField3D_Grid::SetStorageData (TVector3D const* Source, int const* S, int const* First, int const* M)
+{
+  // Copy the M[0] x M[1] x M[2] values from index First of Source into storage of type T
+  // and return the largest difference between a stored and an original value
+
+  size_t const NKept = (size_t) M[0] * M[1] * M[2];
+  bool const Fixed = std::is_integral<T>::value;
+
+  // Fixed point uses the full range for the largest value of each component
+  double Scale[3] = {1, 1, 1};
+  if (Fixed) {
+    double MaxAbs[3] = {0, 0, 0};
+    for (size_t i = 0; i != NKept; ++i) {
+      size_t const ix = First[0] + i / ((size_t) M[1] * M[2]);
+      size_t const iy = First[1] + (i / M[2]) % M[1];
+      size_t const iz = First[2] + i % M[2];
+      TVector3D const& F = Source[(ix * S[1] + iy) * S[2] + iz];
+      for (int c = 0; c != 3; ++c) {
+        MaxAbs[c] = std::max(MaxAbs[c], std::fabs(F[c]));
+      }
+    }
+    for (int c = 0; c != 3; ++c) {
+      Scale[c] = MaxAbs[c] > 0 ? MaxAbs[c] / std::numeric_limits<T>::max() : 1;
+    }
+  }
+
+  std::shared_ptr<std::vector<T> > Data = std::make_shared<std::vector<T> >(3 * NKept);
+
+  double Error = 0;
+  for (size_t i = 0; i != NKept; ++i) {
+    size_t const ix = First[0] + i / ((size_t) M[1] * M[2]);
+    size_t const iy = First[1] + (i / M[2]) % M[1];
+    size_t const iz = First[2] + i % M[2];
+    TVector3D const& F = Source[(ix * S[1] + iy) * S[2] + iz];
+    for (int c = 0; c != 3; ++c) {
+      T const V = Fixed ? (T) std::lround(F[c] / Scale[c]) : (T) F[c];
+      (*Data)[3 * i + c] = V;
+      Error = std::max(Error, std::fabs(V * Scale[c] - F[c]));
+    }
+  }
+
+  // Source may belong to the old owner, so it is replaced only now
+  fStoragePointer = Data->data();
+  fDataOwner = Data;
+  fStorageScale.SetXYZ(Scale[0], Scale[1], Scale[2]);
+
+  return Error;
+}
+
+
+
+
+TField3D_Grid::TField3D_Grid_Storage TField3D_Grid::GetStorage () const
+{
+  return fStorage;
+}
+
+
+
+
+size_t TField3D_Grid::GetStorageSize () const
+{
+  // Bytes of field data looked up by this grid
+
+  bool const Cubic = fInterpolation == kInterpolation_Cubic;
+  size_t const NValues = (size_t) (Cubic && fNX > 1 ? fNX + 2 : fNX) * (size_t) (Cubic && fNY > 1 ? fNY + 2 : fNY) * (size_t) (Cubic && fNZ > 1 ? fNZ + 2 : fNZ);
+
+  switch (fStorage) {
+    case kStorage_Float32:
+      return 3 * NValues * sizeof(float);
+    case kStorage_Fixed16:
+      return 3 * NValues * sizeof(int16_t);
+    default:
+      return 3 * NValues * sizeof(double);
+  }
+}
+
+
+
+
+double TField3D_Grid::GetStorageError () const
+{
+  // Largest difference between a stored and an original value, including any asymmetry of
+  // the original map in mirrored directions
+  return fStorageError;
+}
+
+
+
+
+bool TField3D_Grid::GetExtractionRange (TVector3D const& Rotations, TVector3D const& Translation, int* Range) const
+{
+  // Index range {ix0, ix1, iy0, iy1, iz0, iz1} of the points to keep for the current grid
+  // geometry.  The box corners are taken into the grid frame the same way GetF() takes a
+  // point, and the range is padded by what the interpolation needs around a cell.  Returns
+  // false, with the full range, if there is no extraction box.
+
+  int const N[3] = {fNX, fNY, fNZ};
+  for (int d = 0; d != 3; ++d) {
+    Range[2*d]     = 0;
+    Range[2*d + 1] = N[d] - 1;
+  }
+
+  if (!this->HasExtractionBox()) {
+    return false;
+  }
+
+  // Bounding box of the extraction box in the grid frame
+  TMatrix3D const Rotation(Rotations);
+  double Min[3];
+  double Max[3];
+  for (int ic = 0; ic != 8; ++ic) {
+    double X;
+    double Y;
+    double Z;
+    Rotation.Multiply(ic & 1 ? fExtractMax.GetX() : fExtractMin.GetX(),
+                      ic & 2 ? fExtractMax.GetY() : fExtractMin.GetY(),
+                      ic & 4 ? fExtractMax.GetZ() : fExtractMin.GetZ(),
+                      X, Y, Z);
+    double const G[3] = {X - Translation.GetX(), Y - Translation.GetY(), Z - Translation.GetZ()};
+    for (int d = 0; d != 3; ++d) {
+      Min[d] = ic == 0 ? G[d] : std::min(Min[d], G[d]);
+      Max[d] = ic == 0 ? G[d] : std::max(Max[d], G[d]);
+    }
+  }
+
+  // Cubic splines reach further than the neighbouring points
+  int const Pad = fInterpolation == kInterpolation_Cubic ? 4 : 1;
+
+  double const Start[3] = {fXStart, fYStart, fZStart};
+  double const Step[3]  = {fXStep,  fYStep,  fZStep};
+  for (int d = 0; d != 3; ++d) {
+    if (N[d] < 2) {
+      continue;
+    }
+
+    double Lo = (Min[d] - Start[d]) / Step[d];
+    double Hi = (Max[d] - Start[d]) / Step[d];
+    if (Lo > Hi) {
+      std::swap(Lo, Hi);
+    }
+
+    if (Hi < 0 || Lo > N[d] - 1) {
+      std::cerr << "ERROR: extraction box does not overlap the field map" << std::endl;
+      throw std::out_of_range("extraction box does not overlap the field map");
+    }
+
+    Lo = std::max(Lo, -1.);
+    Hi = std::min(Hi, (double) N[d]);
+
+    Range[2*d]     = std::max(0,        (int) std::floor(Lo) - Pad);
+    Range[2*d + 1] = std::min(N[d] - 1, (int) std::ceil(Hi)  + Pad);
+
+    // Keep at least one cell so the dimension is not lost
+    if (Range[2*d] == Range[2*d + 1]) {
+      if (Range[2*d + 1] < N[d] - 1) {
+        ++Range[2*d + 1];
+      } else {
+        --Range[2*d];
+      }
+    }
+  }
+
+  return true;
+}
+
+
+
+
+void TField3D_Grid::SetExtractedGeometry (int const* Range)
+{
+  // Cut the grid geometry down to the index range kept by the extraction box
+
+  fXStart += Range[0] * fXStep;
+  fYStart += Range[2] * fYStep;
+  fZStart += Range[4] * fZStep;
+  fNX = Range[1] - Range[0] + 1;
+  fNY = Range[3] - Range[2] + 1;
+  fNZ = Range[5] - Range[4] + 1;
+  fXStop  = fXStart + (fNX - 1) * fXStep;
+  fYStop  = fYStart + (fNY - 1) * fYStep;
+  fZStop  = fZStart + (fNZ - 1) * fZStep;
+
+  // The number of points in a dimension is never cut to one, so the dimensions stay the same
+
+  return;
+}
+
+
+
 TVector3D TField3D_Grid::GetF (TVector3D const& XIN) const
 {
   // Get the field at a point in space.  Must rotate point into coordinate system, then translate it.
 
+  if (fKernel == 0x0) {
+    std::cerr << "ERROR: TField3D_Grid has no data" << std::endl;
+    throw std::out_of_range("grid has no data");
+  }
+
   // Rotate and Translate
-  TVector3D X(XIN);
-  X.RotateSelfXYZ(fRotated);
-  X -= fTranslation;
+  double X = XIN.GetX();
+  double Y = XIN.GetY();
+  double Z = XIN.GetZ();
+  if (fHasRotation) {
+    fRotationMatrix.Multiply(XIN.GetX(), XIN.GetY(), XIN.GetZ(), X, Y, Z);
+  }
+
+  if (!fHasMirror) {
+    return (this->*fKernel)(X - fTranslation.GetX(), Y - fTranslation.GetY(), Z - fTranslation.GetZ());
+  }
+
+  // Only the positive half of a mirrored axis is stored.  Look up the mirror point and
+  // flip the components with odd parity.
+  double G[3] = {X - fTranslation.GetX(), Y - fTranslation.GetY(), Z - fTranslation.GetZ()};
+  TVector3D Parity(1, 1, 1);
+  bool Mirrored = false;
+  for (int a = 0; a != 3; ++a) {
+    if (fMirror[a] && G[a] < 0) {
+      G[a] = -G[a];
+      Parity.SetXYZ(Parity.GetX() * fMirrorParity[a].GetX(), Parity.GetY() * fMirrorParity[a].GetY(), Parity.GetZ() * fMirrorParity[a].GetZ());
+      Mirrored = true;
+    }
+  }
+
+  TVector3D const F = (this->*fKernel)(G[0], G[1], G[2]);
+
+  return Mirrored ? this->MirrorField(F, Parity) : F;
+}
+
+
+
+
+TVector3D TField3D_Grid::MirrorField (TVector3D const& F, TVector3D const& Parity) const
+{
+  // Apply the parity of the grid frame to a stored field.  The stored field is rotated, so
+  // the parity is applied along the rotated grid axes.
+
+  if (!fHasRotation) {
+    return TVector3D(F.GetX() * Parity.GetX(), F.GetY() * Parity.GetY(), F.GetZ() * Parity.GetZ());
+  }
+
+  TVector3D Result(0, 0, 0);
+  for (int a = 0; a != 3; ++a) {
+    Result += (Parity[a] * fFieldAxes[a].Dot(F)) * fFieldAxes[a];
+  }
+
+  return Result;
+}
+
+
+
+
+void TField3D_Grid::SelectKernel ()
+{
+  // Precompute the rotation matrix and reciprocal steps and pick the interpolation
+  // kernel for the dimensions of this grid.  Called once the data has been read.
+
+  if (fInterpolation == kInterpolation_Cubic) {
+    this->ComputeCubicCoefficients();
+  }
+
+  // Data read into memory is moved to immutable storage which copies of this grid share.
+  // It is looked up through the same pointer as mapped data.
+  static_assert(sizeof(TVector3D) == 3 * sizeof(double), "TVector3D must be three packed doubles");
+  if (fData.size() != 0) {
+    std::shared_ptr<std::vector<TVector3D> > Data = std::make_shared<std::vector<TVector3D> >();
+    Data->swap(fData);
+    fDataPointer = (double const*) Data->data();
+    fCoefficientPointer = 0x0;
+    fDataOwner = Data;
+  } else if (fCoefficients.size() != 0) {
+    std::shared_ptr<std::vector<TVector3D> > Coefficients = std::make_shared<std::vector<TVector3D> >();
+    Coefficients->swap(fCoefficients);
+    fDataPointer = 0x0;
+    fCoefficientPointer = Coefficients->data();
+    fDataOwner = Coefficients;
+  }
+
+  // Double storage is read in place, compact storage was set by SetStorage()
+  if (fDataPointer != 0x0) {
+    fStoragePointer = fDataPointer;
+  } else if (fCoefficientPointer != 0x0) {
+    fStoragePointer = fCoefficientPointer;
+  }
+
+  fRotationMatrix.SetRotationXYZ(fRotated);
+  fHasRotation = !fRotationMatrix.IsIdentity();
+
+  fXStepInverse = fNX > 1 ? 1. / fXStep : 0;
+  fYStepInverse = fNY > 1 ? 1. / fYStep : 0;
+  fZStepInverse = fNZ > 1 ? 1. / fZStep : 0;
+
+  switch (fStorage) {
+    case kStorage_Double:
+      this->SelectKernelStorage<double>();
+      break;
+    case kStorage_Float32:
+      this->SelectKernelStorage<float>();
+      break;
+    case kStorage_Fixed16:
+      this->SelectKernelStorage<int16_t>();
+      break;
+    default:
+      throw std::out_of_range("unknown storage");
+  }
+
+  return;
+}
+
+
+
+
+template <typename T>
+void TField3D_Grid::SelectKernelStorage ()
+{
+  // Pick the kernel for the dimensions of this grid reading values of type T
+
+  if (fInterpolation == kInterpolation_Cubic) {
+    switch (fDIMX) {
+      case kDIMX_X:
+        fKernel = &TField3D_Grid::GetFKernelCubic<kDIMX_X, T>;
+        break;
+      case kDIMX_Y:
+        fKernel = &TField3D_Grid::GetFKernelCubic<kDIMX_Y, T>;
+        break;
+      case kDIMX_Z:
+        fKernel = &TField3D_Grid::GetFKernelCubic<kDIMX_Z, T>;
+        break;
+      case kDIMX_XY:
+        fKernel = &TField3D_Grid::GetFKernelCubic<kDIMX_XY, T>;
+        break;
+      case kDIMX_XZ:
+        fKernel = &TField3D_Grid::GetFKernelCubic<kDIMX_XZ, T>;
+        break;
+      case kDIMX_YZ:
+        fKernel = &TField3D_Grid::GetFKernelCubic<kDIMX_YZ, T>;
+        break;
+      case kDIMX_XYZ:
+        fKernel = &TField3D_Grid::GetFKernelCubic<kDIMX_XYZ, T>;
+        break;
+      default:
+        throw std::out_of_range("unknown dimension");
+    }
+
+    return;
+  }
+
+  switch (fDIMX) {
+    case kDIMX_X:
+      fKernel = &TField3D_Grid::GetFKernel<kDIMX_X, T>;
+      break;
+    case kDIMX_Y:
+      fKernel = &TField3D_Grid::GetFKernel<kDIMX_Y, T>;
+      break;
+    case kDIMX_Z:
+      fKernel = &TField3D_Grid::GetFKernel<kDIMX_Z, T>;
+      break;
+    case kDIMX_XY:
+      fKernel = &TField3D_Grid::GetFKernel<kDIMX_XY, T>;
+      break;
+    case kDIMX_XZ:
+      fKernel = &TField3D_Grid::GetFKernel<kDIMX_XZ, T>;
+      break;
+    case kDIMX_YZ:
+      fKernel = &TField3D_Grid::GetFKernel<kDIMX_YZ, T>;
+      break;
+    case kDIMX_XYZ:
+      fKernel = &TField3D_Grid::GetFKernel<kDIMX_XYZ, T>;
+      break;
+    default:
+      throw std::out_of_range("unknown dimension");
+  }
+
+  return;
+}
+
+
+
+
+template <TField3D_Grid::TField3D_Grid_DIMX D, typename T>
+TVector3D TField3D_Grid::GetFKernel (double const X, double const Y, double const Z) const
+{
+  // Linear interpolation for a point already in the grid frame.  Which axes exist is
+  // known at compile time so the unused ones cost nothing.
+
+  bool const HasX = D == kDIMX_X || D == kDIMX_XY || D == kDIMX_XZ || D == kDIMX_XYZ;
+  bool const HasY = D == kDIMX_Y || D == kDIMX_XY || D == kDIMX_YZ || D == kDIMX_XYZ;
+  bool const HasZ = D == kDIMX_Z || D == kDIMX_XZ || D == kDIMX_YZ || D == kDIMX_XYZ;
 
   // If outside the range, return a zero
-  if (fNX > 1 && (X.GetX() <= fXStart || X.GetX() >= fXStop)) {
+  if (HasX && (X <= fXStart || X >= fXStop)) {
     return TVector3D(0, 0, 0);
   }
-  if (fNY > 1 && (X.GetY() <= fYStart || X.GetY() >= fYStop)) {
+  if (HasY && (Y <= fYStart || Y >= fYStop)) {
     return TVector3D(0, 0, 0);
   }
-  if (fNZ > 1 && (X.GetZ() <= fZStart || X.GetZ() >= fZStop)) {
+  if (HasZ && (Z <= fZStart || Z >= fZStop)) {
     return TVector3D(0, 0, 0);
   }
-      
-  // Get index in each dimension relative to start and stop
-  size_t const nx = fNX > 1 ? (X.GetX() - fXStart) / fXStep      : 0;
-  double const dx = fNX > 1 ? (X.GetX() - fXStart) - nx * fXStep : 0;
 
-  size_t const ny = fNY > 1 ? (X.GetY() - fYStart) / fYStep      : 0;
-  double const dy = fNY > 1 ? (X.GetY() - fYStart) - ny * fYStep : 0;
+  // Index of the lower grid point and fractional distance to the next in each dimension
+  double const ux = HasX ? (X - fXStart) * fXStepInverse : 0;
+  double const uy = HasY ? (Y - fYStart) * fYStepInverse : 0;
+  double const uz = HasZ ? (Z - fZStart) * fZStepInverse : 0;
+
+  size_t const nx = HasX ? std::min((size_t) ux, (size_t) fNX - 2) : 0;
+  size_t const ny = HasY ? std::min((size_t) uy, (size_t) fNY - 2) : 0;
+  size_t const nz = HasZ ? std::min((size_t) uz, (size_t) fNZ - 2) : 0;
+
+  double const Wx[2] = { 1. - (ux - nx), ux - nx };
+  double const Wy[2] = { 1. - (uy - ny), uy - ny };
+  double const Wz[2] = { 1. - (uz - nz), uz - nz };
+
+  // Sum over the corners of the cell
+  double FX = 0;
+  double FY = 0;
+  double FZ = 0;
+  for (size_t i = 0; i != (HasX ? 2 : 1); ++i) {
+    for (size_t j = 0; j != (HasY ? 2 : 1); ++j) {
+      for (size_t k = 0; k != (HasZ ? 2 : 1); ++k) {
+        double const W = (HasX ? Wx[i] : 1) * (HasY ? Wy[j] : 1) * (HasZ ? Wz[k] : 1);
+        T const* F = (T const*) fStoragePointer + 3 * ((nx + i) * fNY * fNZ + (ny + j) * fNZ + (nz + k));
+        FX += W * F[0];
+        FY += W * F[1];
+        FZ += W * F[2];
+      }
+    }
+  }
+
+  // Fixed point values are scaled once at the end since the interpolation is linear in them
+  if (std::is_integral<T>::value) {
+    return TVector3D(FX * fStorageScale.GetX(), FY * fStorageScale.GetY(), FZ * fStorageScale.GetZ());
+  }
 
-  size_t const nz = fNZ > 1 ? (X.GetZ() - fZStart) / fZStep      : 0;
-  double const dz = fNZ > 1 ? (X.GetZ() - fZStart) - nz * fZStep : 0;
+  return TVector3D(FX, FY, FZ);
+}
 
 
-  switch (fDIMX) {
-    case kDIMX_XYZ:
-      {
-        // First move in X to find the 4 points of square
-        size_t const i000 = GetIndex(nx + 0, ny + 0, nz + 0);
-        size_t const i100 = GetIndex(nx + 1, ny + 0, nz + 0);
-        TVector3D const v00 = fData[i000] + dx * (fData[i100] - fData[i000]) / fXStep;
-
-        size_t const i010 = GetIndex(nx + 0, ny + 1, nz + 0);
-        size_t const i110 = GetIndex(nx + 1, ny + 1, nz + 0);
-        TVector3D const v10 = fData[i010] + dx * (fData[i110] - fData[i010]) / fXStep;
-
-        size_t const i001 = GetIndex(nx + 0, ny + 0, nz + 1);
-        size_t const i101 = GetIndex(nx + 1, ny + 0, nz + 1);
-        TVector3D const v01 = fData[i001] + dx * (fData[i101] - fData[i001]) / fXStep;
-
-        size_t const i011 = GetIndex(nx + 0, ny + 1, nz + 1);
-        size_t const i111 = GetIndex(nx + 1, ny + 1, nz + 1);
-        TVector3D const v11 = fData[i011] + dx * (fData[i111] - fData[i011]) / fXStep;
-
-        // Step in Y to find 2 points
-        TVector3D const v0 = v00 + dy * (v10 - v00) / fYStep;
-        TVector3D const v1 = v01 + dy * (v11 - v01) / fYStep;
-
-        // Step in Z to find point
-        return v0 + dz * (v1 - v0) / fZStep;
-      }
-      break;
-    case kDIMX_X:
-      {
-        size_t const i0 = nx + 0;
-        size_t const i1 = nx + 1;
-        return fData[i0] + dx * (fData[i1] - fData[i0]) / fXStep;
+
+
+void TField3D_Grid::ComputeCubicCoefficients ()
+{
+  // Replace the field data with natural cubic B-spline coefficients.  The coefficients
+  // are padded by one ghost point at each end of every grid axis so the kernel never
+  // has to check the boundaries.  The ghost points are the linear extrapolation
+  // c[-1] = 2c[0] - c[1], which gives zero second derivative at the ends (natural
+  // spline) and makes the end coefficients equal to the end data.
+
+  // Already done, or the coefficients were given directly
+  if (fData.size() == 0) {
+    return;
+  }
+
+  // Padded dimensions
+  int const PX = fNX > 1 ? fNX + 2 : 1;
+  int const PY = fNY > 1 ? fNY + 2 : 1;
+  int const PZ = fNZ > 1 ? fNZ + 2 : 1;
+  int const OX = fNX > 1 ? 1 : 0;
+  int const OY = fNY > 1 ? 1 : 0;
+  int const OZ = fNZ > 1 ? 1 : 0;
+
+  // Copy the data into the interior
+  fCoefficients.assign(PX * PY * PZ, TVector3D(0, 0, 0));
+  for (int ix = 0; ix != fNX; ++ix) {
+    for (int iy = 0; iy != fNY; ++iy) {
+      for (int iz = 0; iz != fNZ; ++iz) {
+        fCoefficients[((ix + OX) * PY + (iy + OY)) * PZ + (iz + OZ)] = fData[GetIndex(ix, iy, iz)];
       }
-    case kDIMX_Y:
-      {
-        size_t const i0 = ny + 0;
-        size_t const i1 = ny + 1;
-        return fData[i0] + dy * (fData[i1] - fData[i0]) / fYStep;
+    }
+  }
+
+  // Solve along each axis in turn.  Every line along the axis is done, including the
+  // ghost lines from the axes already done, which keeps the tensor product consistent.
+  for (int Axis = 0; Axis != 3; ++Axis) {
+    int const N = Axis == 0 ? fNX : (Axis == 1 ? fNY : fNZ);
+    if (N < 2) {
+      continue;
+    }
+
+    // Stride along this axis and the ranges of the other two
+    int const Stride = Axis == 0 ? PY * PZ : (Axis == 1 ? PZ : 1);
+    int const NA = Axis == 0 ? PY : PX;
+    int const NB = Axis == 2 ? PY : PZ;
+
+    // Scratch for the tridiagonal solve
+    std::vector<double>    Gamma(N);
+    std::vector<TVector3D> Line(N);
+
+    for (int a = 0; a != NA; ++a) {
+      for (int b = 0; b != NB; ++b) {
+
+        // Index of the first interior point of this line
+        int First = 0;
+        if (Axis == 0) {
+          First = (1 * PY + a) * PZ + b;
+        } else if (Axis == 1) {
+          First = (a * PY + 1) * PZ + b;
+        } else {
+          First = (a * PY + b) * PZ + 1;
+        }
+
+        for (int i = 0; i != N; ++i) {
+          Line[i] = fCoefficients[First + i * Stride];
+        }
+
+        // Interior equations c[i-1] + 4c[i] + c[i+1] = 6f[i] with c[0] = f[0] and
+        // c[N-1] = f[N-1], solved with the Thomas algorithm
+        if (N > 2) {
+          for (int i = 1; i < N - 1; ++i) {
+            TVector3D RHS = 6 * Line[i];
+            if (i == 1) {
+              RHS -= Line[0];
+            }
+            if (i == N - 2) {
+              RHS -= Line[N - 1];
+            }
+
+            double const Denominator = i == 1 ? 4 : 4 - Gamma[i - 1];
+            Gamma[i] = 1. / Denominator;
+            Line[i] = i == 1 ? RHS / Denominator : (RHS - Line[i - 1]) / Denominator;
+          }
+          for (int i = N - 3; i >= 1; --i) {
+            Line[i] -= Gamma[i] * Line[i + 1];
+          }
+        }
+
+        for (int i = 0; i != N; ++i) {
+          fCoefficients[First + i * Stride] = Line[i];
+        }
+
+        // Ghost points
+        fCoefficients[First - Stride]     = 2 * Line[0]     - Line[1];
+        fCoefficients[First + N * Stride] = 2 * Line[N - 1] - Line[N - 2];
       }
-    case kDIMX_Z:
-      {
-        size_t const i0 = nz + 0;
-        size_t const i1 = nz + 1;
-        return fData[i0] + dz * (fData[i1] - fData[i0]) / fZStep;
+    }
+  }
+
+  // The node values are no longer needed
+  fData.clear();
+  fData.shrink_to_fit();
+  fDataPointer = 0x0;
+
+  return;
+}
+
+
+
+
+template <TField3D_Grid::TField3D_Grid_DIMX D, typename T>
+TVector3D TField3D_Grid::GetFKernelCubic (double const X, double const Y, double const Z) const
+{
+  // Cubic B-spline interpolation for a point already in the grid frame
+
+  bool const HasX = D == kDIMX_X || D == kDIMX_XY || D == kDIMX_XZ || D == kDIMX_XYZ;
+  bool const HasY = D == kDIMX_Y || D == kDIMX_XY || D == kDIMX_YZ || D == kDIMX_XYZ;
+  bool const HasZ = D == kDIMX_Z || D == kDIMX_XZ || D == kDIMX_YZ || D == kDIMX_XYZ;
+
+  // If outside the range, return a zero
+  if (HasX && (X <= fXStart || X >= fXStop)) {
+    return TVector3D(0, 0, 0);
+  }
+  if (HasY && (Y <= fYStart || Y >= fYStop)) {
+    return TVector3D(0, 0, 0);
+  }
+  if (HasZ && (Z <= fZStart || Z >= fZStop)) {
+    return TVector3D(0, 0, 0);
+  }
+
+  // Index of the lower grid point and fractional distance to the next in each dimension
+  double const ux = HasX ? (X - fXStart) * fXStepInverse : 0;
+  double const uy = HasY ? (Y - fYStart) * fYStepInverse : 0;
+  double const uz = HasZ ? (Z - fZStart) * fZStepInverse : 0;
+
+  size_t const nx = HasX ? std::min((size_t) ux, (size_t) fNX - 2) : 0;
+  size_t const ny = HasY ? std::min((size_t) uy, (size_t) fNY - 2) : 0;
+  size_t const nz = HasZ ? std::min((size_t) uz, (size_t) fNZ - 2) : 0;
+
+  // Cubic B-spline weights for the four surrounding coefficients
+  double Wx[4];
+  double Wy[4];
+  double Wz[4];
+  double const* U[3] = { &ux, &uy, &uz };
+  size_t const  I[3] = { nx, ny, nz };
+  double*       W[3] = { Wx, Wy, Wz };
+  for (int a = 0; a != 3; ++a) {
+    double const t  = *U[a] - I[a];
+    double const t2 = t * t;
+    double const t3 = t2 * t;
+    W[a][0] = (1 - t) * (1 - t) * (1 - t) / 6.;
+    W[a][1] = (3 * t3 - 6 * t2 + 4) / 6.;
+    W[a][2] = (-3 * t3 + 3 * t2 + 3 * t + 1) / 6.;
+    W[a][3] = t3 / 6.;
+  }
+
+  // Padded dimensions.  Coefficient nx - 1 is at padded index nx.
+  size_t const PY = HasY ? fNY + 2 : 1;
+  size_t const PZ = HasZ ? fNZ + 2 : 1;
+
+  // Sum over the 4^dim surrounding coefficients
+  double FX = 0;
+  double FY = 0;
+  double FZ = 0;
+  for (size_t i = 0; i != (HasX ? 4 : 1); ++i) {
+    for (size_t j = 0; j != (HasY ? 4 : 1); ++j) {
+      double const Wij = (HasX ? Wx[i] : 1) * (HasY ? Wy[j] : 1);
+      size_t const Iij = ((nx + i) * PY + (ny + j)) * PZ + nz;
+      for (size_t k = 0; k != (HasZ ? 4 : 1); ++k) {
+        double const W = Wij * (HasZ ? Wz[k] : 1);
+        T const* C = (T const*) fStoragePointer + 3 * (Iij + k);
+        FX += W * C[0];
+        FY += W * C[1];
+        FZ += W * C[2];
       }
-    case kDIMX_XY:
-      {
-        size_t const i00 = GetIndex(nx + 0, ny + 0, 0);
-        size_t const i10 = GetIndex(nx + 1, ny + 0, 0);
-        TVector3D const v0 = fData[i00] + dx * (fData[i10] - fData[i00]) / fXStep;
+    }
+  }
+
+  if (std::is_integral<T>::value) {
+    return TVector3D(FX * fStorageScale.GetX(), FY * fStorageScale.GetY(), FZ * fStorageScale.GetZ());
+  }
+
+  return TVector3D(FX, FY, FZ);
+}
+
+
+
+
+void TField3D_Grid::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Get the field at N points.  The call to GetF is qualified so the whole
+  // batch is done without going through the virtual table
+
+  for (size_t i = 0; i != N; ++i) {
+    F[i] = this->TField3D_Grid::GetF(X[i]);
+  }
+
+  return;
+}
+
+
+
+
+
+
+
+
+
+
+double TField3D_Grid::GetHeaderValue (std::string const& L) const
+{
+  // Get the value after comment character
+
+  // Easy reading
+  std::istringstream S;
+  S.str(L);
+
+  // For the two values of interest
+  double Value;
+
+  S >> Value;
+
+  // Check read state of input
+  if (S.bad()) {
+    std::cerr << "ERROR: S is bad" << std::endl;
+    throw std::ifstream::failure("cannot read header value");
+  }
+
+  return Value;
+}
+
+
+
+
+
+
+
+double TField3D_Grid::GetHeaderValueSRW (std::string const& L, const char CommentChar) const
+{
+  // Get the value after comment character
+
+  // Easy reading
+  std::istringstream S;
+  S.str(L);
+
+  // For the two values of interest
+  char CC;
+  double Value;
+
+  S.get(CC);
+
+  if (CC != CommentChar) {
+    std::cerr << "ERROR: bad format in header" << std::endl;
+    throw std::ifstream::failure("something is wrong with the comment character, it was not seen");
+  }
+
+  S >> Value;
+
+  // Check read state of input
+  if (S.bad()) {
+    std::cerr << "ERROR: S is bad" << std::endl;
+    throw std::ifstream::failure("cannot read header value SRW format");
+  }
+
+  return Value;
+}
+
+
+
+
+
+
+
+char const* TField3D_Grid::GetLine (char const* Position, char const* End, std::string& L)
+{
+  // Copy the line starting at Position into L, like std::getline.  Returns the
+  // start of the next line
+
+  if (Position == End) {
+    L.clear();
+    return End;
+  }
+
+  char const* NewLine = (char const*) std::memchr(Position, '\n', End - Position);
+  if (NewLine == 0x0) {
+    L.assign(Position, End);
+    return End;
+  }
+
+  L.assign(Position, NewLine);
+  return NewLine + 1;
+}
+
+
+
+
+
+
+
+std::vector<char const*> TField3D_Grid::GetLineChunks (char const* Begin, char const* End)
+{
+  // Split [Begin, End) into one chunk per hardware thread.  Every boundary is moved
+  // forward to the start of a line.  Small files are not split very finely.
+
+  size_t const Size = End - Begin;
+  size_t const MinChunkSize = 1 << 18;
+
+  size_t NChunks = std::thread::hardware_concurrency();
+  if (NChunks > Size / MinChunkSize + 1) {
+    NChunks = Size / MinChunkSize + 1;
+  }
+  if (NChunks < 1) {
+    NChunks = 1;
+  }
+
+  std::vector<char const*> Chunks(1, Begin);
+  for (size_t ic = 1; ic < NChunks; ++ic) {
+    char const* Position = std::max(Begin + Size * ic / NChunks, Chunks.back());
+    char const* NewLine = (char const*) std::memchr(Position, '\n', End - Position);
+    Chunks.push_back(NewLine == 0x0 ? End : NewLine + 1);
+  }
+  Chunks.push_back(End);
+
+  return Chunks;
+}
+
+
+
+
+
+
+
+bool TField3D_Grid::ParseValues (char const*& Position, char const* End, double* Values, int const N)
+{
+  // Read N numbers from the line starting at Position, as operator>> would.  Never reads past
+  // the end of the line.  Returns false if the line does not hold N numbers.
+
+  for (int i = 0; i != N; ++i) {
+
+    // Skip blanks but do not go onto the next line
+    while (Position != End && *Position != '\n' && std::isspace((unsigned char) *Position)) {
+      ++Position;
+    }
+    if (Position == End || *Position == '\n') {
+      return false;
+    }
+
+    // The mapped file is not null terminated, so give strtod a copy of the token
+    char Token[64];
+    size_t Length = 0;
+    while (Position + Length != End && !std::isspace((unsigned char) Position[Length]) && Length != sizeof(Token) - 1) {
+      Token[Length] = Position[Length];
+      ++Length;
+    }
+    Token[Length] = '\0';
+
+    char* TokenEnd;
+    Values[i] = std::strtod(Token, &TokenEnd);
+    if (TokenEnd == Token) {
+      return false;
+    }
+    Position += TokenEnd - Token;
+  }
+
+  return true;
+}
+
+
+
+
+
+
+
+void TField3D_Grid::CountLines (char const* Begin, char const* End, size_t* N)
+{
+  // Number of lines in [Begin, End), including a last line without newline
+
+  size_t Count = std::count(Begin, End, '\n');
+  if (Begin != End && *(End - 1) != '\n') {
+    ++Count;
+  }
+
+  *N = Count;
+
+  return;
+}
+
+
+
+
+
+
+
+void TField3D_Grid::ParseGridData (char const* Begin, char const* End, TVector3D const& Rotations, TVector3D const& Translation, TVector3D const& FieldScaling)
+{
+  // Parse fNX*fNY*fNZ lines of "Fx Fy Fz" into fData.  Lines are counted per chunk first so
+  // each thread knows which point index its chunk starts at.  With an extraction box only
+  // the lines of points inside it are parsed and stored.
+
+  size_t const NPoints = (size_t) fNX * (size_t) fNY * (size_t) fNZ;
 
-        size_t const i01 = GetIndex(nx + 0, ny + 1, 0);
-        size_t const i11 = GetIndex(nx + 1, ny + 1, 0);
-        TVector3D const v1 = fData[i01] + dx * (fData[i11] - fData[i01]) / fXStep;
+  int Range[6];
+  bool const Extract = this->GetExtractionRange(Rotations, Translation, Range);
+  size_t const NKept = (size_t) (Range[1] - Range[0] + 1) * (size_t) (Range[3] - Range[2] + 1) * (size_t) (Range[5] - Range[4] + 1);
 
-        return v0 + dy * (v1 - v0) / fYStep;
-      }
-    case kDIMX_XZ:
-      {
-        size_t const i00 = GetIndex(nx + 0, 0, nz + 0);
-        size_t const i10 = GetIndex(nx + 1, 0, nz + 0);
-        TVector3D const v0 = fData[i00] + dx * (fData[i10] - fData[i00]) / fXStep;
+  std::vector<char const*> const Chunks = GetLineChunks(Begin, End);
+  size_t const NChunks = Chunks.size() - 1;
+
+  // Count lines in each chunk
+  std::vector<size_t> NLines(NChunks, 0);
+  std::vector<std::thread> Threads;
+  for (size_t ic = 0; ic != NChunks; ++ic) {
+    Threads.push_back(std::thread(&TField3D_Grid::CountLines, Chunks[ic], Chunks[ic + 1], &NLines[ic]));
+  }
+  for (size_t it = 0; it != Threads.size(); ++it) {
+    Threads[it].join();
+  }
 
-        size_t const i01 = GetIndex(nx + 0, 0, nz + 1);
-        size_t const i11 = GetIndex(nx + 1, 0, nz + 1);
-        TVector3D const v1 = fData[i01] + dx * (fData[i11] - fData[i01]) / fXStep;
+  // Index of the first point in each chunk
+  std::vector<size_t> FirstLine(NChunks, 0);
+  size_t NTotal = 0;
+  for (size_t ic = 0; ic != NChunks; ++ic) {
+    FirstLine[ic] = NTotal;
+    NTotal += NLines[ic];
+  }
 
-        return v0 + dz * (v1 - v0) / fZStep;
-      }
-    case kDIMX_YZ:
-      {
-        size_t const i00 = GetIndex(0, ny + 0, nz + 0);
-        size_t const i10 = GetIndex(0, ny + 1, nz + 0);
-        TVector3D const v0 = fData[i00] + dy * (fData[i10] - fData[i00]) / fYStep;
+  if (NTotal < NPoints) {
+    std::cerr << "ERROR: bad input file" << std::endl;
+    throw std::ifstream::failure("error reading file.  Check format");
+  }
 
-        size_t const i01 = GetIndex(0, ny + 0, nz + 1);
-        size_t const i11 = GetIndex(0, ny + 1, nz + 1);
-        TVector3D const v1 = fData[i01] + dy * (fData[i11] - fData[i01]) / fYStep;
+  // Each thread writes straight into its own part of fData.  Lines past the last point are ignored.
+  fData.clear();
+  fData.resize(NKept);
 
-        return v0 + dz * (v1 - v0) / fZStep;
-      }
-      break;
-    default:
-      throw std::out_of_range("unknown dimension");
+  std::vector<char> Failed(NChunks, 0);
+  Threads.clear();
+  for (size_t ic = 0; ic != NChunks; ++ic) {
+    if (FirstLine[ic] < NPoints) {
+      Threads.push_back(std::thread(&TField3D_Grid::ParseGridDataChunk, this, Chunks[ic], Chunks[ic + 1], FirstLine[ic], Range, std::cref(Rotations), std::cref(FieldScaling), &Failed[ic]));
+    }
+  }
+  for (size_t it = 0; it != Threads.size(); ++it) {
+    Threads[it].join();
   }
 
-  throw std::out_of_range("unknown dimension");
+  if (std::find(Failed.begin(), Failed.end(), 1) != Failed.end()) {
+    fData.clear();
+    std::cerr << "ERROR: input stream bad" << std::endl;
+    throw std::ifstream::failure("error reading file.  Check format");
+  }
+
+  if (Extract) {
+    this->SetExtractedGeometry(Range);
+  }
+
+  return;
 }
 
 
@@ -248,29 +1379,41 @@ TVector3D TField3D_Grid::GetF (TVector3D const& XIN) const
 
 
 
+void TField3D_Grid::ParseGridDataChunk (char const* Begin, char const* End, size_t const FirstIndex, int const* Range, TVector3D const& Rotations, TVector3D const& FieldScaling, char* Failed)
+{
+  // Parse one chunk of data lines, FirstIndex is the point index of the first line.  Points
+  // outside of Range are skipped without being parsed.
 
+  size_t const NPoints = (size_t) fNX * (size_t) fNY * (size_t) fNZ;
+  size_t const NYKept  = Range[3] - Range[2] + 1;
+  size_t const NZKept  = Range[5] - Range[4] + 1;
 
+  double Values[3];
 
-double TField3D_Grid::GetHeaderValue (std::string const& L) const
-{
-  // Get the value after comment character
+  for (size_t i = FirstIndex; Begin != End && i < NPoints; ++i) {
+    char const* Position = Begin;
 
-  // Easy reading
-  std::istringstream S;
-  S.str(L);
+    int const ix = (int) (i / ((size_t) fNY * (size_t) fNZ));
+    int const iy = (int) ((i / fNZ) % fNY);
+    int const iz = (int) (i % fNZ);
 
-  // For the two values of interest
-  double Value;
+    if (ix >= Range[0] && ix <= Range[1] && iy >= Range[2] && iy <= Range[3] && iz >= Range[4] && iz <= Range[5]) {
+      if (!ParseValues(Position, End, Values, 3)) {
+        *Failed = 1;
+        return;
+      }
 
-  S >> Value;
+      TVector3D F(Values[0] * FieldScaling.GetX(), Values[1] * FieldScaling.GetY(), Values[2] * FieldScaling.GetZ());
+      F.RotateSelfXYZ(Rotations);
+      fData[((ix - Range[0]) * NYKept + (iy - Range[2])) * NZKept + (iz - Range[4])] = F;
+    }
 
-  // Check read state of input
-  if (S.bad()) {
-    std::cerr << "ERROR: S is bad" << std::endl;
-    throw std::ifstream::failure("cannot read header value");
+    // Anything else on the line is ignored
+    char const* NewLine = (char const*) std::memchr(Position, '\n', End - Position);
+    Begin = NewLine == 0x0 ? End : NewLine + 1;
   }
 
-  return Value;
+  return;
 }
 
 
@@ -279,34 +1422,49 @@ double TField3D_Grid::GetHeaderValue (std::string const& L) const
 
 
 
-double TField3D_Grid::GetHeaderValueSRW (std::string const& L, const char CommentChar) const
+void TField3D_Grid::ParseData1DChunk (char const* Begin, char const* End, std::vector<int> const& Order, int const InputCount, std::vector<double> const& Scaling, char const CommentChar, std::vector<std::array<double, 4> >* Data, char* Failed)
 {
-  // Get the value after comment character
+  // Parse one chunk of an OSCARS1D file, skipping blank and comment lines
 
-  // Easy reading
-  std::istringstream S;
-  S.str(L);
+  double Values[4];
 
-  // For the two values of interest
-  char CC;
-  double Value;
+  while (Begin != End) {
+    char const* NewLine = (char const*) std::memchr(Begin, '\n', End - Begin);
+    char const* LineEnd = NewLine == 0x0 ? End : NewLine;
+    char const* Next    = NewLine == 0x0 ? End : NewLine + 1;
 
-  S.get(CC);
+    // Look for a blank line or comment line and skip if found.  You should never use tab btw.
+    char const* FirstChar = Begin;
+    while (FirstChar != LineEnd && (*FirstChar == ' ' || *FirstChar == '\t')) {
+      ++FirstChar;
+    }
+    if (FirstChar == LineEnd || *FirstChar == CommentChar) {
+      Begin = Next;
+      continue;
+    }
 
-  if (CC != CommentChar) {
-    std::cerr << "ERROR: bad format in header" << std::endl;
-    throw std::ifstream::failure("something is wrong with the comment character, it was not seen");
-  }
+    // Read this line of data
+    char const* Position = Begin;
+    if (!ParseValues(Position, LineEnd, Values, InputCount)) {
+      *Failed = 1;
+      return;
+    }
 
-  S >> Value;
+    std::array<double, 4> Value = { {0, 0, 0, 0} };
+    for (int i = 0; i < InputCount; ++i) {
+      Value[Order[i]] = Values[i];
+    }
 
-  // Check read state of input
-  if (S.bad()) {
-    std::cerr << "ERROR: S is bad" << std::endl;
-    throw std::ifstream::failure("cannot read header value SRW format");
+    // Scale the input as requested
+    for (size_t iscale = 0; iscale != Scaling.size() && iscale < (size_t) InputCount; ++iscale) {
+      Value[Order[iscale]] *= Scaling[iscale];
+    }
+
+    Data->push_back(Value);
+    Begin = Next;
   }
 
-  return Value;
+  return;
 }
 
 
@@ -319,57 +1477,54 @@ void TField3D_Grid::ReadFile (std::string const& InFileName, TVector3D const& Ro
 {
   // Read file with the best format in the entire world, OSCARSv1.0
 
-  // Open the input file and throw exception if not open
-  std::ifstream fi(InFileName);
-  if (!fi) {
-    std::cerr << "ERROR: cannot open file" << std::endl;
-    throw std::ifstream::failure("cannot open file for reading");
-  }
+  // Map the input file, throws exception if it cannot be opened
+  TMappedFile const InFile(InFileName);
+  char const* P = InFile.GetData();
+  char const* const End = P + InFile.GetSize();
 
-  // For reading lines of file
-  std::istringstream S;
+  // For reading header lines of file
   std::string L;
 
   // Initial line for comment
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
 
 
   // Initial X
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const XStartIN = GetHeaderValue(L);
 
   // Step X
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const XStepIN = GetHeaderValue(L);
 
   // Number of points X
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   int const NX = (int) GetHeaderValue(L);
 
 
   // Initial Y
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const YStartIN = GetHeaderValue(L);
 
   // Step Y
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const YStepIN = GetHeaderValue(L);
 
   // Number of points Y
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   int const NY = (int) GetHeaderValue(L);
 
 
   // Initial Z
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const ZStartIN = GetHeaderValue(L);
 
   // Step Z
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const ZStepIN = GetHeaderValue(L);
 
   // Number of points Z
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   int const NZ = (int) GetHeaderValue(L);
 
   // If we're doing any scaling, scale spatial dimensions and fields.  Start with stepsize change
@@ -445,66 +1600,16 @@ void TField3D_Grid::ReadFile (std::string const& InFileName, TVector3D const& Ro
     ++fXDIM;
   }
 
-  // Reserve correct number of points in vector (slightly faster)
-  fData.reserve(fNX * fNY * fNZ);
-
-  // Temp variables for field
-  double fx;
-  double fy;
-  double fz;
-
-
-  // Loop over all points
-  for (int ix = 0; ix != NX; ++ix) {
-    for (int iy = 0; iy != NY; ++iy) {
-      for (int iz = 0; iz != NZ; ++iz) {
-
-        // Grab a line from input file
-        std::getline(fi, L);
-
-        // Check we did not hit an EOF
-        if (fi.eof()) {
-          std::cerr << "ERROR: bad input file" << std::endl;
-          throw std::ifstream::failure("error reading file.  Check format");
-        }
-
-        // Read data
-        S.clear();
-        S.str(L);
-        S >> fx >> fy >> fz;
-
-        // Scale values?
-        if (FxScaling != 1) {
-          fx *= FxScaling;
-        }
-        if (FyScaling != 1) {
-          fy *= FyScaling;
-        }
-        if (FzScaling != 1) {
-          fz *= FzScaling;
-        }
-
-        // Check the stream did not hit an EOF
-        if (S.fail()) {
-          std::cerr << "ERRROR: input stream bad" << std::endl;
-          throw std::ifstream::failure("error reading file.  Check format");
-        }
-
-        // Push data to storage
-        TVector3D F(fx, fy, fz);
-        F.RotateSelfXYZ(Rotations);
-        fData.push_back(F);
-      }
-    }
-  }
-
-  // Close file
-  fi.close();
+  // Read all points, scaled and rotated
+  this->ParseGridData(P, End, Rotations, Translation, TVector3D(FxScaling, FyScaling, FzScaling));
 
   // Store Rotations and Translation
   fRotated = Rotations;
   fTranslation = Translation;
 
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+
   return;
 }
 
@@ -534,12 +1639,10 @@ void TField3D_Grid::ReadFile_OSCARS1D (std::string const& InFileName, std::strin
 {
   // Read file with OSCARS1D format
 
-  // Open the input file and throw exception if not open
-  std::ifstream fi(InFileName);
-  if (!fi) {
-    std::cerr << "ERROR: cannot open file" << std::endl;
-    throw std::ifstream::failure("cannot open file for reading");
-  }
+  // Map the input file, throws exception if it cannot be opened
+  TMappedFile const InFile(InFileName);
+  char const* P = InFile.GetData();
+  char const* const End = P + InFile.GetSize();
 
   // And this is for which order they come in
   std::vector<int> Order(4, -1);
@@ -611,51 +1714,34 @@ void TField3D_Grid::ReadFile_OSCARS1D (std::string const& InFileName, std::strin
 
 
   // For reading lines of file
-  std::istringstream S;
   std::string L;
 
   // Initial line for comment
-  std::getline(fi, L);
-
-  // Vector for the data inputs
-  std::vector<std::array<double, 4> > InputData;
-
-  // Loop over all lines in file
-  for ( ; std::getline(fi, L); ) {
-
-    // Look for a blank line or comment line and skip if found.  You should never use tab btw.
-    size_t FirstChar = L.find_first_not_of(" \t");
-    if (FirstChar == std::string::npos || L[FirstChar] == CommentChar) {
-      continue;
-    }
+  P = GetLine(P, End, L);
 
-    // Clear and set the istringstream for this line
-    S.clear();
-    S.str(L);
+  // Parse each chunk of lines on its own thread
+  std::vector<char const*> const Chunks = GetLineChunks(P, End);
+  size_t const NChunks = Chunks.size() - 1;
+  std::vector<std::vector<std::array<double, 4> > > ChunkData(NChunks);
+  std::vector<char> Failed(NChunks, 0);
 
-    // Vector for this line of input
-    std::vector<double> Value(4);
-
-    // Read this line of data
-    for (int i = 0; i < InputCount; ++i) {
-      S >> Value[Order[i]];
-      if (S.fail()) {
-        throw std::length_error("something is incorrect with data format or iformat string");
-      }
-    }
-
-    // Scale the input as requested
-    for (size_t iscale = 0; iscale != Scaling.size() && iscale < 4; ++iscale) {
-      Value[Order[iscale]] *= Scaling[iscale];
-    }
+  std::vector<std::thread> Threads;
+  for (size_t ic = 0; ic != NChunks; ++ic) {
+    Threads.push_back(std::thread(&TField3D_Grid::ParseData1DChunk, Chunks[ic], Chunks[ic + 1], std::cref(Order), InputCount, std::cref(Scaling), CommentChar, &ChunkData[ic], &Failed[ic]));
+  }
+  for (size_t it = 0; it != Threads.size(); ++it) {
+    Threads[it].join();
+  }
 
-    // Add to data array.
-    std::array<double, 4> a = { {Value[0], Value[1], Value[2], Value[3]} };
-    InputData.push_back(a);
+  if (std::find(Failed.begin(), Failed.end(), 1) != Failed.end()) {
+    throw std::length_error("something is incorrect with data format or iformat string");
   }
 
-  // Close file
-  fi.close();
+  // Vector for the data inputs, in file order
+  std::vector<std::array<double, 4> > InputData;
+  for (size_t ic = 0; ic != NChunks; ++ic) {
+    InputData.insert(InputData.end(), ChunkData[ic].begin(), ChunkData[ic].end());
+  }
 
   // Sort the field
   std::sort(InputData.begin(), InputData.end(), this->CompareField1D);
@@ -677,10 +1763,39 @@ void TField3D_Grid::ReadFile_OSCARS1D (std::string const& InFileName, std::strin
   // UPDATE: VAR
   int const NPointsPerMeter = 10000;
 
+  // For cubic interpolation the input is regularized with a natural cubic spline, so the
+  // regular grid only needs the same mean spacing as the input rather than the fine
+  // grid linear interpolation needs.  The spline needs distinct positions.
+  if (fInterpolation == kInterpolation_Cubic) {
+    InputData.erase(std::unique(InputData.begin(), InputData.end(), TField3D_Grid::SamePosition1D), InputData.end());
+  }
+
   // Get the number of points and the step size
-  size_t const NPoints  = (Last - First) * NPointsPerMeter;
+  size_t const NPoints  = fInterpolation == kInterpolation_Cubic ? std::max((size_t) 2, InputData.size()) : (Last - First) * NPointsPerMeter;
   double const StepSize = (Last - First) / (double) (NPoints - 1);
 
+  // Second derivatives of the natural cubic spline through the input for each component
+  std::vector<std::array<double, 4> > SplineM(InputData.size(), std::array<double, 4>{ {0, 0, 0, 0} });
+  if (fInterpolation == kInterpolation_Cubic && InputData.size() > 2) {
+    size_t const N = InputData.size();
+    std::vector<double> Gamma(N, 0);
+    for (size_t i = 1; i < N - 1; ++i) {
+      double const h0 = InputData[i][0] - InputData[i - 1][0];
+      double const h1 = InputData[i + 1][0] - InputData[i][0];
+      double const Denominator = 2 * (h0 + h1) - (i == 1 ? 0 : h0 * Gamma[i - 1]);
+      Gamma[i] = h1 / Denominator;
+      for (int c = 1; c != 4; ++c) {
+        double const RHS = 6 * ((InputData[i + 1][c] - InputData[i][c]) / h1 - (InputData[i][c] - InputData[i - 1][c]) / h0);
+        SplineM[i][c] = (RHS - (i == 1 ? 0 : h0 * SplineM[i - 1][c])) / Denominator;
+      }
+    }
+    for (size_t i = N - 2; i >= 2; --i) {
+      for (int c = 1; c != 4; ++c) {
+        SplineM[i - 1][c] -= Gamma[i - 1] * SplineM[i][c];
+      }
+    }
+  }
+
   // Set all to default values
   fNX = 1;
   fNY = 1;
@@ -751,9 +1866,15 @@ void TField3D_Grid::ReadFile_OSCARS1D (std::string const& InFileName, std::strin
 
 
 
+  // Only the part inside the extraction box is regularized and kept
+  int Range[6];
+  bool const Extract = this->GetExtractionRange(Rotations, Translation, Range);
+  size_t const IFirst = Axis == "X" ? Range[0] : Axis == "Y" ? Range[2] : Range[4];
+  size_t const ILast  = Axis == "X" ? Range[1] : Axis == "Y" ? Range[3] : Range[5];
+
   // Clear the internal data and reserve the number of points
   fData.clear();
-  fData.reserve(NPoints);
+  fData.reserve(ILast - IFirst + 1);
 
 
   // Variables to hold the slope between two real points and new By (linear interpolated)
@@ -774,7 +1895,7 @@ void TField3D_Grid::ReadFile_OSCARS1D (std::string const& InFileName, std::strin
   double ThisZ;
 
   // For each desired point find the bin before and after the desired Z position
-  for (size_t i = 0; i != NPoints; ++i) {
+  for (size_t i = IFirst; i <= ILast; ++i) {
     ThisZ = i * StepSize + First;
     for (size_t j = MinBin + 1; j != InputData.size(); ++j) {
       if (InputData[j][0] > ThisZ) {
@@ -794,6 +1915,18 @@ void TField3D_Grid::ReadFile_OSCARS1D (std::string const& InFileName, std::strin
     NewBy = !HasFy ? 0 : InputData[BeforeBin][2] + (ThisZ - InputData[BeforeBin][0]) * SlopeY;
     NewBz = !HasFz ? 0 : InputData[BeforeBin][3] + (ThisZ - InputData[BeforeBin][0]) * SlopeZ;
 
+    // Cubic spline correction to the linear interpolation
+    if (fInterpolation == kInterpolation_Cubic) {
+      double const h = InputData[AfterBin][0] - InputData[BeforeBin][0];
+      double const A = (InputData[AfterBin][0] - ThisZ) / h;
+      double const B = 1 - A;
+      double const CA = (A * A * A - A) * h * h / 6.;
+      double const CB = (B * B * B - B) * h * h / 6.;
+      NewBx += !HasFx ? 0 : CA * SplineM[BeforeBin][1] + CB * SplineM[AfterBin][1];
+      NewBy += !HasFy ? 0 : CA * SplineM[BeforeBin][2] + CB * SplineM[AfterBin][2];
+      NewBz += !HasFz ? 0 : CA * SplineM[BeforeBin][3] + CB * SplineM[AfterBin][3];
+    }
+
 
     // Append the new BxByBz to the output vector
     TVector3D F(NewBx, NewBy, NewBz);
@@ -804,10 +1937,17 @@ void TField3D_Grid::ReadFile_OSCARS1D (std::string const& InFileName, std::strin
   // Clear array data
   InputData.clear();
 
+  if (Extract) {
+    this->SetExtractedGeometry(Range);
+  }
+
   // Store Rotations and Translation
   fRotated = Rotations;
   fTranslation = Translation;
 
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+
   return;
 }
 
@@ -837,57 +1977,54 @@ void TField3D_Grid::ReadFile_SRW (std::string const& InFileName, TVector3D const
 {
   // Read file with SRW field input format
 
-  // Open the input file and throw exception if not open
-  std::ifstream fi(InFileName);
-  if (!fi) {
-    std::cerr << "ERROR: cannot open file" << std::endl;
-    throw std::ifstream::failure("cannot open file for reading SRW format");
-  }
+  // Map the input file, throws exception if it cannot be opened
+  TMappedFile const InFile(InFileName);
+  char const* P = InFile.GetData();
+  char const* const End = P + InFile.GetSize();
 
-  // For reading lines of file
-  std::istringstream S;
+  // For reading header lines of file
   std::string L;
 
   // Initial line for comment
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
 
 
   // Initial X
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const XStart = GetHeaderValueSRW(L, CommentChar);
 
   // Step X
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const XStep = GetHeaderValueSRW(L, CommentChar);
 
   // Number of points X
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   int const NX = (int) GetHeaderValueSRW(L, CommentChar);
 
 
   // Initial Y
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const YStart = GetHeaderValueSRW(L, CommentChar);
 
   // Step Y
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const YStep = GetHeaderValueSRW(L, CommentChar);
 
   // Number of points Y
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   int const NY = (int) GetHeaderValueSRW(L, CommentChar);
 
 
   // Initial Z
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const ZStart = GetHeaderValueSRW(L, CommentChar);
 
   // Step Z
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   double const ZStep = GetHeaderValueSRW(L, CommentChar);
 
   // Number of points Z
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   int const NZ = (int) GetHeaderValueSRW(L, CommentChar);
 
 
@@ -945,50 +2082,16 @@ void TField3D_Grid::ReadFile_SRW (std::string const& InFileName, TVector3D const
     ++fXDIM;
   }
 
-  // Reserve correct number of points in vector (slightly faster)
-  fData.reserve(fNX * fNY * fNZ);
-
-  // Temp variables for field
-  double fx;
-  double fy;
-  double fz;
-
-
-  // Loop over all points
-  for (int ix = 0; ix != NX; ++ix) {
-    for (int iy = 0; iy != NY; ++iy) {
-      for (int iz = 0; iz != NZ; ++iz) {
-
-        // Grab a line from input file
-        std::getline(fi, L);
-
-        // Read data
-        S.clear();
-        S.str(L);
-        S >> fx >> fy >> fz;
-
-
-        // Check the stream did not hit an EOF
-        if (S.fail() || fi.fail()) {
-          std::cerr << "ERRROR: input stream bad" << std::endl;
-          throw std::ifstream::failure("input file stream failure");
-        }
-
-        // Push data to storage
-        TVector3D F(fx, fy, fz);
-        F.RotateSelfXYZ(Rotations);
-        fData.push_back(F);
-      }
-    }
-  }
-
-  // Close file
-  fi.close();
+  // Read all points and rotate them
+  this->ParseGridData(P, End, Rotations, Translation, TVector3D(1, 1, 1));
 
   // Store Rotations and Translation
   fRotated = Rotations;
   fTranslation = Translation;
 
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+
   return;
 }
 
@@ -1003,22 +2106,20 @@ void TField3D_Grid::ReadFile_SPECTRA (std::string const& InFileName, TVector3D c
 {
   // Read file with SPECTRA field input format
 
-  // Open the input file and throw exception if not open
-  std::ifstream fi(InFileName);
-  if (!fi) {
-    std::cerr << "ERROR: cannot open file" << std::endl;
-    throw std::ifstream::failure("cannot open file");
-  }
+  // Map the input file, throws exception if it cannot be opened
+  TMappedFile const InFile(InFileName);
+  char const* P = InFile.GetData();
+  char const* const End = P + InFile.GetSize();
 
-  // For reading lines of file
+  // For reading header lines of file
   std::istringstream S;
   std::string L;
 
   // Initial line for comment
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
 
   // Now header information
-  std::getline(fi, L);
+  P = GetLine(P, End, L);
   S.str(L);
 
   // Grab parameters and correct for [mm] -> [m] conversion.
@@ -1038,17 +2139,152 @@ void TField3D_Grid::ReadFile_SPECTRA (std::string const& InFileName, TVector3D c
     throw std::out_of_range("invalid number of points in at least one dimension");
   }
 
-  // Save position data to object variables
-  fXStart = -(fXStep * (fNX - 1)) / 2;
-  fYStart = -(fYStep * (fNY - 1)) / 2;
-  fZStart = -(fZStep * (fNZ - 1)) / 2;
+  // Save position data to object variables
+  fXStart = -(fXStep * (fNX - 1)) / 2;
+  fYStart = -(fYStep * (fNY - 1)) / 2;
+  fZStart = -(fZStep * (fNZ - 1)) / 2;
+  fXStop  = fXStart + (fNX - 1) * fXStep;
+  fYStop  = fYStart + (fNY - 1) * fYStep;
+  fZStop  = fZStart + (fNZ - 1) * fZStep;
+
+  fHasX = fNX > 1 ? true : false;
+  fHasY = fNY > 1 ? true : false;
+  fHasZ = fNZ > 1 ? true : false;
+
+  if (fHasX && fHasY && fHasZ) {
+    fDIMX = kDIMX_XYZ;
+  } else if (fHasX && fHasY) {
+    fDIMX = kDIMX_XY;
+  } else if (fHasX && fHasZ) {
+    fDIMX = kDIMX_XZ;
+  } else if (fHasY && fHasZ) {
+    fDIMX = kDIMX_YZ;
+  } else if (fHasX) {
+    fDIMX = kDIMX_X;
+  } else if (fHasY) {
+    fDIMX = kDIMX_Y;
+  } else if (fHasZ) {
+    fDIMX = kDIMX_Z;
+  } else {
+    std::cerr << "ERROR: error in file header format" << std::endl;
+    throw std::out_of_range("invalid dimensions");
+  }
+
+  fXDIM = 0;
+  if (fHasX) {
+    ++fXDIM;
+  }
+  if (fHasY) {
+    ++fXDIM;
+  }
+  if (fHasZ) {
+    ++fXDIM;
+  }
+
+  // Read all points and rotate them
+  this->ParseGridData(P, End, Rotations, Translation, TVector3D(1, 1, 1));
+
+  // Store Rotations and Translation
+  fRotated = Rotations;
+  fTranslation = Translation;
+
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+
+  return;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+void TField3D_Grid::ReadFile_Binary (std::string const& InFileName, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling)
+{
+  // Read the OSCARSBIN binary format by memory mapping the file.  If the payload is
+  // float64 and needs no rotation, scaling, or spline coefficients the field is looked
+  // up directly in the mapped file with no copy at all.  Otherwise it is converted once.
+
+  std::shared_ptr<TMappedFile> Mapped(new TMappedFile(InFileName));
+
+  // Check the header
+  TBinaryHeader H;
+  if (Mapped->GetSize() < sizeof(TBinaryHeader)) {
+    std::cerr << "ERROR: file too small for OSCARSBIN header" << std::endl;
+    throw std::ifstream::failure("error reading file.  Check format");
+  }
+  std::memcpy(&H, Mapped->GetData(), sizeof(TBinaryHeader));
+
+  if (std::strncmp(H.Magic, "OSCARSBF", 8) != 0) {
+    std::cerr << "ERROR: not an OSCARSBIN file" << std::endl;
+    throw std::ifstream::failure("error reading file.  Check format");
+  }
+  if (H.Version != 1) {
+    std::cerr << "ERROR: unsupported OSCARSBIN version " << H.Version << std::endl;
+    throw std::ifstream::failure("unsupported binary format version");
+  }
+  if (H.ByteOrder != 0x01020304) {
+    std::cerr << "ERROR: OSCARSBIN file was written with a different byte order" << std::endl;
+    throw std::ifstream::failure("binary format byte order does not match");
+  }
+  if (H.ValueSize != sizeof(double) && H.ValueSize != sizeof(float)) {
+    std::cerr << "ERROR: OSCARSBIN value size must be 4 or 8" << std::endl;
+    throw std::ifstream::failure("error reading file.  Check format");
+  }
+
+  int const NX = (int) H.N[0];
+  int const NY = (int) H.N[1];
+  int const NZ = (int) H.N[2];
+
+  // Check Number of points is > 0 for all
+  if (NX < 1 || NY < 1 || NZ < 1) {
+    std::cerr << "ERROR: invalid npoints" << std::endl;
+    throw std::out_of_range("invalid number of points in at least one dimension");
+  }
+
+  size_t const NPoints = (size_t) NX * (size_t) NY * (size_t) NZ;
+  if (H.PayloadOffset + 3 * NPoints * H.ValueSize > Mapped->GetSize()) {
+    std::cerr << "ERROR: OSCARSBIN file is truncated" << std::endl;
+    throw std::ifstream::failure("error reading file.  Check format");
+  }
+
+  // If we're doing any scaling, scale spatial dimensions and fields.  Start with stepsize change
+  double const XStep = Scaling.size() > 0 ? H.Step[0] * Scaling[0] : H.Step[0];
+  double const YStep = Scaling.size() > 1 ? H.Step[1] * Scaling[1] : H.Step[1];
+  double const ZStep = Scaling.size() > 2 ? H.Step[2] * Scaling[2] : H.Step[2];
+
+  // Get field scaling if it exists
+  double const FxScaling = Scaling.size() > 3 ? Scaling[3] : 1;
+  double const FyScaling = Scaling.size() > 4 ? Scaling[4] : 1;
+  double const FzScaling = Scaling.size() > 5 ? Scaling[5] : 1;
+
+  // Save position data to object variables, scaled about the middle point
+  fNX = NX;
+  fNY = NY;
+  fNZ = NZ;
+  fXStart = H.Start[0] + H.Step[0] * (NX - 1) / 2. - XStep * (NX - 1) / 2.;
+  fYStart = H.Start[1] + H.Step[1] * (NY - 1) / 2. - YStep * (NY - 1) / 2.;
+  fZStart = H.Start[2] + H.Step[2] * (NZ - 1) / 2. - ZStep * (NZ - 1) / 2.;
+  fXStep  = XStep;
+  fYStep  = YStep;
+  fZStep  = ZStep;
   fXStop  = fXStart + (fNX - 1) * fXStep;
   fYStop  = fYStart + (fNY - 1) * fYStep;
   fZStop  = fZStart + (fNZ - 1) * fZStep;
 
-  fHasX = fNX > 1 ? true : false;
-  fHasY = fNY > 1 ? true : false;
-  fHasZ = fNZ > 1 ? true : false;
+  fHasX = NX > 1 ? true : false;
+  fHasY = NY > 1 ? true : false;
+  fHasZ = NZ > 1 ? true : false;
 
   if (fHasX && fHasY && fHasZ) {
     fDIMX = kDIMX_XYZ;
@@ -1069,80 +2305,169 @@ void TField3D_Grid::ReadFile_SPECTRA (std::string const& InFileName, TVector3D c
     throw std::out_of_range("invalid dimensions");
   }
 
-  fXDIM = 0;
-  if (fHasX) {
-    ++fXDIM;
-  }
-  if (fHasY) {
-    ++fXDIM;
-  }
-  if (fHasZ) {
-    ++fXDIM;
-  }
+  fXDIM = (fHasX ? 1 : 0) + (fHasY ? 1 : 0) + (fHasZ ? 1 : 0);
 
-  // Reserve correct number of points in vector (slightly faster)
-  fData.reserve(fNX * fNY * fNZ);
+  char const* Payload = Mapped->GetData() + H.PayloadOffset;
 
-  // Temp variables for field
-  double fx;
-  double fy;
-  double fz;
+  bool const Transformed = FxScaling != 1 || FyScaling != 1 || FzScaling != 1 || Rotations.GetX() != 0 || Rotations.GetY() != 0 || Rotations.GetZ() != 0;
 
-  // Loop over all points
-  for (int ix = 0; ix != fNX; ++ix) {
-    for (int iy = 0; iy != fNY; ++iy) {
-      for (int iz = 0; iz != fNZ; ++iz) {
+  // Points to keep
+  int Range[6];
+  bool const Extract = this->GetExtractionRange(Rotations, Translation, Range);
 
-        // Grab a line from input file
-        std::getline(fi, L);
+  fData.clear();
+  if (H.ValueSize == sizeof(double) && !Transformed && !Extract && fInterpolation == kInterpolation_Linear && ((size_t) Payload) % sizeof(double) == 0) {
 
-        // Check we did not hit an EOF
-        if (fi.eof()) {
-          std::cerr << "ERROR: bad input file" << std::endl;
-          throw std::ifstream::failure("file stream failure");
-        }
+    // Use the mapped payload directly
+    fDataPointer = (double const*) Payload;
+    fDataOwner = Mapped;
 
-        // Read data
-        S.clear();
-        S.str("");
-        S.str(L);
-        S >> fx >> fy >> fz;
+  } else {
 
-        // Check the stream did not hit an EOF
-        if (S.fail()) {
-          std::cerr << "ERRROR: input stream bad" << std::endl;
-          throw std::ifstream::failure("file stream failure");
+    // Convert, scale, and rotate into memory the points which are kept
+    size_t const NYKept = Range[3] - Range[2] + 1;
+    size_t const NZKept = Range[5] - Range[4] + 1;
+    size_t const NKept  = (Range[1] - Range[0] + 1) * NYKept * NZKept;
+
+    fData.resize(NKept);
+    for (size_t i = 0; i != NKept; ++i) {
+      size_t const ix = Range[0] + i / (NYKept * NZKept);
+      size_t const iy = Range[2] + (i / NZKept) % NYKept;
+      size_t const iz = Range[4] + i % NZKept;
+      size_t const iFile = (ix * NY + iy) * NZ + iz;
+
+      double V[3];
+      for (int j = 0; j != 3; ++j) {
+        if (H.ValueSize == sizeof(double)) {
+          double v;
+          std::memcpy(&v, Payload + (3 * iFile + j) * sizeof(double), sizeof(double));
+          V[j] = v;
+        } else {
+          float v;
+          std::memcpy(&v, Payload + (3 * iFile + j) * sizeof(float), sizeof(float));
+          V[j] = v;
         }
-
-        // Push data to storage
-        TVector3D F(fx, fy, fz);
-        F.RotateSelfXYZ(Rotations);
-        fData.push_back(F);
       }
+
+      TVector3D F(V[0] * FxScaling, V[1] * FyScaling, V[2] * FzScaling);
+      F.RotateSelfXYZ(Rotations);
+      fData[i] = F;
     }
-  }
 
-  // Close file
-  fi.close();
+    if (Extract) {
+      this->SetExtractedGeometry(Range);
+    }
+  }
 
   // Store Rotations and Translation
   fRotated = Rotations;
   fTranslation = Translation;
 
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+
+  return;
+}
+
+
+
+
+void TField3D_Grid::WriteFile_Binary (std::string const& OutFileName, bool const Float32, std::string const& Comment) const
+{
+  // Write this grid in the OSCARSBIN binary format.  This is the converter from any of
+  // the text formats: read them into a grid, then write it out here.  The field is
+  // written as stored, so read it with no rotations or scaling if you want the original.
+
+  if (fDataPointer == 0x0) {
+    std::cerr << "ERROR: grid has no node data to write.  Cubic grids store spline coefficients, and compact storage is not written" << std::endl;
+    throw std::out_of_range("grid has no node data to write");
+  }
+
+  std::ofstream of(OutFileName.c_str(), std::ios::binary);
+  if (!of.is_open()) {
+    std::cerr << "ERROR: cannot open file for writing: " << OutFileName << std::endl;
+    throw std::ofstream::failure("cannot open file for writing");
+  }
+
+  WriteBinaryHeader(of, fNX, fNY, fNZ, TVector3D(fXStart, fYStart, fZStart), TVector3D(fXStep, fYStep, fZStep), Float32, Comment);
+
+  // Write in chunks so float32 conversion does not need a second copy of the grid
+  size_t const NPoints = (size_t) fNX * (size_t) fNY * (size_t) fNZ;
+  size_t const NChunk  = 65536;
+  std::vector<TVector3D> Chunk;
+  for (size_t i = 0; i < NPoints; i += NChunk) {
+    size_t const N = std::min(NChunk, NPoints - i);
+    Chunk.resize(N);
+    for (size_t j = 0; j != N; ++j) {
+      double const* F = fDataPointer + 3 * (i + j);
+      Chunk[j].SetXYZ(F[0], F[1], F[2]);
+    }
+    WriteBinaryPoints(of, Chunk.data(), N, Float32);
+  }
+
+  of.close();
+
   return;
 }
 
 
 
 
+void TField3D_Grid::WriteBinaryHeader (std::ostream& of, int const NX, int const NY, int const NZ, TVector3D const& Start, TVector3D const& Step, bool const Float32, std::string const& Comment)
+{
+  // Write the OSCARSBIN header and pad up to the payload offset
+
+  TBinaryHeader H;
+  std::memset(&H, 0, sizeof(TBinaryHeader));
+
+  std::memcpy(H.Magic, "OSCARSBF", 8);
+  H.Version   = 1;
+  H.ByteOrder = 0x01020304;
+  H.ValueSize = Float32 ? sizeof(float) : sizeof(double);
+
+  // A long comment is written in full after the header
+  H.CommentSize = Comment.size() >= sizeof(H.Comment) ? Comment.size() : 0;
+
+  // Payload is aligned to 64 bytes
+  H.PayloadOffset = ((sizeof(TBinaryHeader) + H.CommentSize + 63) / 64) * 64;
+
+  H.N[0] = NX;
+  H.N[1] = NY;
+  H.N[2] = NZ;
+  for (int i = 0; i != 3; ++i) {
+    H.Start[i] = Start[i];
+    H.Step[i]  = Step[i];
+  }
+  std::strncpy(H.Comment, Comment.c_str(), sizeof(H.Comment) - 1);
+
+  of.write((char const*) &H, sizeof(TBinaryHeader));
+  of.write(Comment.data(), H.CommentSize);
 
+  std::vector<char> Padding(H.PayloadOffset - sizeof(TBinaryHeader) - H.CommentSize, 0);
+  of.write(Padding.data(), Padding.size());
 
+  return;
+}
 
 
 
 
+void TField3D_Grid::WriteBinaryPoints (std::ostream& of, TVector3D const* F, size_t const N, bool const Float32)
+{
+  // Append N field points to the OSCARSBIN payload
 
+  for (size_t i = 0; i != N; ++i) {
+    if (Float32) {
+      float const V[3] = { (float) F[i].GetX(), (float) F[i].GetY(), (float) F[i].GetZ() };
+      of.write((char const*) V, sizeof(V));
+    } else {
+      double const V[3] = { F[i].GetX(), F[i].GetY(), F[i].GetZ() };
+      of.write((char const*) V, sizeof(V));
+    }
+  }
 
+  return;
+}
 
 
 
@@ -1367,6 +2692,9 @@ void TField3D_Grid::InterpolateFromFiles (std::vector<std::pair<double, std::str
   fRotated = Rotations;
   fTranslation = Translation;
 
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+
   return;
 }
 
@@ -1445,12 +2773,391 @@ TVector3D TField3D_Grid::InterpolateFields (std::vector<double> const& Parameter
 
 
 
+bool TField3D_Grid::HasSameGrid (TField3D_Grid const& G) const
+{
+  // Same points, frame and interpolation as G
+
+  return fNX == G.fNX && fNY == G.fNY && fNZ == G.fNZ &&
+         fXStart == G.fXStart && fYStart == G.fYStart && fZStart == G.fZStart &&
+         fXStep  == G.fXStep  && fYStep  == G.fYStep  && fZStep  == G.fZStep &&
+         fRotated == G.fRotated && fTranslation == G.fTranslation &&
+         fInterpolation == G.fInterpolation;
+}
+
+
+
+
+
+
+
+void TField3D_Grid::SetCombination (TField3D_Grid const& A, double const WA, TField3D_Grid const& B, double const WB)
+{
+  // Set this grid to WA * A + WB * B.  A and B must be on the same grid.  Both the stored
+  // field and the cubic coefficients are linear in the data, so either can be combined
+  // directly without recomputing anything.
+
+  if (!A.HasSameGrid(B)) {
+    std::cerr << "ERROR: grids are not the same" << std::endl;
+    throw std::invalid_argument("grids are not the same");
+  }
+  if (A.fStorage != kStorage_Double || B.fStorage != kStorage_Double || A.fHasMirror || B.fHasMirror) {
+    std::cerr << "ERROR: only grids with full double storage can be combined" << std::endl;
+    throw std::invalid_argument("only grids with full double storage can be combined");
+  }
+
+  // Position data
+  fNX     = A.fNX;
+  fNY     = A.fNY;
+  fNZ     = A.fNZ;
+  fXStart = A.fXStart;
+  fYStart = A.fYStart;
+  fZStart = A.fZStart;
+  fXStep  = A.fXStep;
+  fYStep  = A.fYStep;
+  fZStep  = A.fZStep;
+  fXStop  = A.fXStop;
+  fYStop  = A.fYStop;
+  fZStop  = A.fZStop;
+  fHasX   = A.fHasX;
+  fHasY   = A.fHasY;
+  fHasZ   = A.fHasZ;
+  fXDIM   = A.fXDIM;
+  fDIMX   = A.fDIMX;
+
+  fRotated       = A.fRotated;
+  fTranslation   = A.fTranslation;
+  fInterpolation = A.fInterpolation;
+
+  if (fInterpolation == kInterpolation_Cubic) {
+    size_t const NCoefficients = (size_t) (fNX > 1 ? fNX + 2 : 1) * (size_t) (fNY > 1 ? fNY + 2 : 1) * (size_t) (fNZ > 1 ? fNZ + 2 : 1);
+    TVector3D const* CA = A.fCoefficientPointer;
+    TVector3D const* CB = B.fCoefficientPointer;
+
+    fData.clear();
+    fCoefficients.resize(NCoefficients);
+    for (size_t i = 0; i != NCoefficients; ++i) {
+      fCoefficients[i] = CA[i] * WA + CB[i] * WB;
+    }
+  } else {
+    size_t const NPoints = (size_t) fNX * (size_t) fNY * (size_t) fNZ;
+    double const* DA = A.fDataPointer;
+    double const* DB = B.fDataPointer;
+
+    fData.resize(NPoints);
+    for (size_t i = 0; i != NPoints; ++i) {
+      fData[i].SetXYZ(DA[3*i + 0] * WA + DB[3*i + 0] * WB,
+                      DA[3*i + 1] * WA + DB[3*i + 1] * WB,
+                      DA[3*i + 2] * WA + DB[3*i + 2] * WB);
+    }
+  }
+
+  // Precompute what is needed for lookups
+  this->SelectKernel();
+
+  return;
+}
+
+
+
+
+
+
+
+std::string TField3D_Grid::GetCacheKey (std::string const& InFileName, std::string const& FileFormat, TVector3D const& Rotations, TVector3D const& Translation, std::vector<double> const& Scaling, char const CommentChar) const
+{
+  // Everything that changes what is read from a file.  The file is identified by its full
+  // path, size, and modification time so an edited file is read again.
+
+  std::ostringstream Key;
+  Key.precision(17);
+
+  char FullPath[PATH_MAX];
+  if (realpath(InFileName.c_str(), FullPath) != 0x0) {
+    Key << FullPath;
+  } else {
+    Key << InFileName;
+  }
+
+  struct stat FileStat;
+  if (stat(InFileName.c_str(), &FileStat) == 0) {
+    Key << " " << FileStat.st_size << " " << FileStat.st_mtime;
+  }
+
+  Key << " " << FileFormat
+      << " " << Rotations.GetX() << " " << Rotations.GetY() << " " << Rotations.GetZ()
+      << " " << Translation.GetX() << " " << Translation.GetY() << " " << Translation.GetZ()
+      << " " << Scaling.size();
+  for (size_t i = 0; i != Scaling.size(); ++i) {
+    Key << " " << Scaling[i];
+  }
+  Key << " " << (int) CommentChar << " " << (int) fInterpolation;
+  if (this->HasExtractionBox()) {
+    Key << " " << fExtractMin.GetX() << " " << fExtractMin.GetY() << " " << fExtractMin.GetZ()
+        << " " << fExtractMax.GetX() << " " << fExtractMax.GetY() << " " << fExtractMax.GetZ();
+  }
+
+  return Key.str();
+}
+
+
+
+
+
+
+
+bool TField3D_Grid::CopyFromCache (std::string const& Key)
+{
+  // Become a copy of a grid with this key if one is still alive.  The copy shares its data.
+
+  std::lock_guard<std::mutex> Lock(gField3D_GridCacheMutex);
+
+  std::map<std::string, TField3D_GridCacheEntry>::iterator it = gField3D_GridCache.find(Key);
+  if (it == gField3D_GridCache.end()) {
+    return false;
+  }
+
+  std::shared_ptr<void const> Owner = it->second.Owner.lock();
+  if (!Owner) {
+    gField3D_GridCache.erase(it);
+    return false;
+  }
+
+  *this = it->second.Grid;
+  fDataOwner = Owner;
+
+  return true;
+}
+
+
+
+
+
+
+
+void TField3D_Grid::AddToCache (std::string const& Key) const
+{
+  // Remember this grid so later reads of the same file share its data
+
+  if (!fDataOwner) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> Lock(gField3D_GridCacheMutex);
+
+  TField3D_GridCacheEntry& Entry = gField3D_GridCache[Key];
+  Entry.Grid = *this;
+  Entry.Grid.fDataOwner.reset();
+  Entry.Owner = fDataOwner;
+
+  return;
+}
+
+
+
+
+
+
+
+bool TField3D_Grid::ReadShared (std::string const& SharedFileName, std::string const& Key, TVector3D const& Rotations, TVector3D const& Translation)
+{
+  // Map the shared OSCARSBIN copy of this map if another process has written it.  The
+  // copy holds the field already scaled and rotated, so it is read as it is and only the
+  // rotation of the grid frame is restored.  The whole key is the comment, and files with
+  // the same name (hash) but another key are not used.
+
+  if (access(SharedFileName.c_str(), R_OK) != 0) {
+    return false;
+  }
+
+  try {
+    {
+      TMappedFile const Mapped(SharedFileName);
+      TBinaryHeader H;
+      if (Mapped.GetSize() < sizeof(TBinaryHeader)) {
+        return false;
+      }
+      std::memcpy(&H, Mapped.GetData(), sizeof(TBinaryHeader));
+      if (H.CommentSize != (Key.size() >= sizeof(H.Comment) ? Key.size() : 0)) {
+        return false;
+      }
+      if (H.CommentSize == 0) {
+        if (std::strncmp(H.Comment, Key.c_str(), sizeof(H.Comment)) != 0) {
+          return false;
+        }
+      } else if (Mapped.GetSize() < sizeof(TBinaryHeader) + H.CommentSize || Key.compare(0, Key.size(), Mapped.GetData() + sizeof(TBinaryHeader), H.CommentSize) != 0) {
+        return false;
+      }
+    }
+
+    // The shared copy is already cut to the extraction box
+    TVector3D const ExtractMin = fExtractMin;
+    TVector3D const ExtractMax = fExtractMax;
+    fExtractMin.SetXYZ(0, 0, 0);
+    fExtractMax.SetXYZ(0, 0, 0);
+    try {
+      this->ReadFile_Binary(SharedFileName, TVector3D(0, 0, 0), Translation);
+    } catch (...) {
+      this->SetExtractionBox(ExtractMin, ExtractMax);
+      throw;
+    }
+    this->SetExtractionBox(ExtractMin, ExtractMax);
+  } catch (...) {
+    return false;
+  }
+
+  fRotated = Rotations;
+  this->SelectKernel();
+
+  return true;
+}
+
+
+
+
+
+
+
+void TField3D_Grid::WriteShared (std::string const& SharedFileName, std::string const& Key) const
+{
+  // Write this grid to the shared directory for other processes.  It is written under a
+  // temporary name and renamed so nobody maps a partial file.  Files stay there until
+  // ClearShared, or a reboot for /dev/shm.
+
+  std::ostringstream TempFileName;
+  TempFileName << SharedFileName << "." << getpid() << ".tmp";
+
+  try {
+    this->WriteFile_Binary(TempFileName.str(), false, Key);
+  } catch (...) {
+    std::remove(TempFileName.str().c_str());
+    std::cerr << "WARNING: cannot share field map through " << GetSharedDirectory() << std::endl;
+    return;
+  }
+
+  if (std::rename(TempFileName.str().c_str(), SharedFileName.c_str()) != 0) {
+    std::remove(TempFileName.str().c_str());
+  }
+
+  return;
+}
+
+
+
+
+
+
+
+void TField3D_Grid::SetSharedDirectory (std::string const& Directory)
+{
+  // Directory for maps shared between processes.  Should be on a memory backed file system.
+  std::lock_guard<std::mutex> Lock(gField3D_GridCacheMutex);
+  gField3D_GridSharedDirectory = Directory;
+  return;
+}
+
+
+
+
+
+
+
+std::string TField3D_Grid::GetSharedDirectory ()
+{
+  // Directory for maps shared between processes
+  std::lock_guard<std::mutex> Lock(gField3D_GridCacheMutex);
+  return gField3D_GridSharedDirectory;
+}
+
+
+
+
+
+size_t TField3D_Grid::ClearShared ()
+{
+  // Remove the maps written to the shared directory, by any process.  Grids mapping them
+  // keep their data until they are gone, and later reads write them again.
+
+  std::string const Directory = GetSharedDirectory();
+
+  DIR* D = opendir(Directory.c_str());
+  if (D == 0x0) {
+    return 0;
+  }
+
+  size_t NRemoved = 0;
+  for (struct dirent* Entry = readdir(D); Entry != 0x0; Entry = readdir(D)) {
+    std::string const Name = Entry->d_name;
+    if (Name.size() > 11 && Name.compare(0, 7, "OSCARS_") == 0 && Name.compare(Name.size() - 4, 4, ".bin") == 0) {
+      if (unlink((Directory + "/" + Name).c_str()) == 0) {
+        ++NRemoved;
+      }
+    }
+  }
+  closedir(D);
+
+  return NRemoved;
+}
+
+
+
+
+
+
+
+TField3D_Grid::TField3D_Grid_Interpolation TField3D_Grid::GetInterpolation (std::string const& Name)
+{
+  // Interpolation mode from its name, any case
+
+  std::string name = Name;
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+  if (name == "" || name == "linear") {
+    return kInterpolation_Linear;
+  } else if (name == "cubic" || name == "spline" || name == "tricubic") {
+    return kInterpolation_Cubic;
+  }
+
+  std::cerr << "ERROR: unknown interpolation: " << Name << std::endl;
+  throw std::invalid_argument("interpolation must be 'linear' or 'cubic'");
+}
+
+
+
+
+TField3D_Grid::TField3D_Grid_Storage TField3D_Grid::GetStorage (std::string const& Name)
+{
+  // Storage from its name, any case
+
+  std::string name = Name;
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+  if (name == "" || name == "double" || name == "float64") {
+    return kStorage_Double;
+  } else if (name == "float" || name == "float32") {
+    return kStorage_Float32;
+  } else if (name == "fixed16" || name == "int16") {
+    return kStorage_Fixed16;
+  }
+
+  std::cerr << "ERROR: unknown storage: " << Name << std::endl;
+  throw std::invalid_argument("storage must be 'double', 'float32' or 'fixed16'");
+}
+
+
+
+
 bool TField3D_Grid::CompareField1D (std::array<double, 4> const& A, std::array<double, 4> const& B)
 {
   // This function is used for sorting the field in 'position' cood.  It is a comparison function
   return A[0] < B[0];
 }
 
+bool TField3D_Grid::SamePosition1D (std::array<double, 4> const& A, std::array<double, 4> const& B)
+{
+  // Are these two 1D field points at the same position
+  return A[0] == B[0];
+}
+
 bool TField3D_Grid::CompareMappingElements (std::pair<double, std::string> const& A, std::pair<double, std::string> const& B)
 {
   // This function is used for sorting the field in 'position' cood.  It is a comparison function
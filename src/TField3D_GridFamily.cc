@@ -0,0 +1,204 @@
+#include "TField3D_GridFamily.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+
+
+TField3D_GridFamily::TField3D_GridFamily (std::vector<std::pair<double, std::string> > const& Mapping,
+                                          std::string const& FileFormat,
+                                          double const Parameter,
+                                          TVector3D const& Rotations,
+                                          TVector3D const& Translation,
+                                          std::vector<double> const& Scaling,
+                                          char const CommentChar,
+                                          TField3D_Grid::TField3D_Grid_Interpolation const Interpolation,
+                                          bool const Lazy)
+{
+  // Read every map in the mapping once.  Any format TField3D_Grid can read is allowed,
+  // but all maps must be on the same grid.
+
+  fLazy = Lazy;
+
+  // Need two maps to interpolate between
+  if (Mapping.size() < 2) {
+    std::cerr << "ERROR: need at least two maps in mapping" << std::endl;
+    throw std::length_error("need at least two maps in mapping");
+  }
+
+  // Sort the input mapping by parameter
+  std::vector<std::pair<double, std::string> > MyMapping = Mapping;
+  std::sort(MyMapping.begin(), MyMapping.end(), TField3D_Grid::CompareMappingElements);
+
+  try {
+    for (size_t i = 0; i != MyMapping.size(); ++i) {
+      if (i > 0 && MyMapping[i].first == MyMapping[i - 1].first) {
+        std::cerr << "ERROR: same parameter value given for two maps" << std::endl;
+        throw std::invalid_argument("same parameter value given for two maps");
+      }
+
+      fParameters.push_back(MyMapping[i].first);
+      fGrids.push_back(new TField3D_Grid(MyMapping[i].second, FileFormat, Rotations, Translation, Scaling, CommentChar, Interpolation));
+
+      if (!fGrids.back()->HasSameGrid(*fGrids.front())) {
+        std::cerr << "ERROR: map is not on the same grid as the first: " << MyMapping[i].second << std::endl;
+        throw std::invalid_argument("all maps must be on the same grid");
+      }
+    }
+  } catch (...) {
+    for (size_t i = 0; i != fGrids.size(); ++i) {
+      delete fGrids[i];
+    }
+    throw;
+  }
+
+  // Invalid so the first SetParameter() always builds the map
+  fBefore = fGrids.size();
+  fAfter  = fGrids.size();
+
+  this->SetParameter(Parameter);
+}
+
+
+
+
+TField3D_GridFamily::~TField3D_GridFamily ()
+{
+  // Delete the maps
+  for (size_t i = 0; i != fGrids.size(); ++i) {
+    delete fGrids[i];
+  }
+}
+
+
+
+
+double TField3D_GridFamily::GetFx (double const X, double const Y, double const Z) const
+{
+  return this->GetF(X, Y, Z).GetX();
+}
+
+
+
+
+double TField3D_GridFamily::GetFy (double const X, double const Y, double const Z) const
+{
+  return this->GetF(X, Y, Z).GetY();
+}
+
+
+
+
+double TField3D_GridFamily::GetFz (double const X, double const Y, double const Z) const
+{
+  return this->GetF(X, Y, Z).GetZ();
+}
+
+
+
+
+TVector3D TField3D_GridFamily::GetF (double const X, double const Y, double const Z) const
+{
+  return this->GetF(TVector3D(X, Y, Z));
+}
+
+
+
+
+TVector3D TField3D_GridFamily::GetF (TVector3D const& X) const
+{
+  // Field at the current parameter value
+
+  if (!fLazy) {
+    return fCurrent.GetF(X);
+  }
+
+  return fGrids[fBefore]->GetF(X) * fWeightBefore + fGrids[fAfter]->GetF(X) * fWeightAfter;
+}
+
+
+
+
+void TField3D_GridFamily::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Field at N points at the current parameter value
+
+  if (!fLazy) {
+    fCurrent.GetFBatch(X, F, N);
+    return;
+  }
+
+  std::vector<TVector3D> FAfter(N);
+  fGrids[fBefore]->GetFBatch(X, F, N);
+  fGrids[fAfter]->GetFBatch(X, FAfter.data(), N);
+
+  for (size_t i = 0; i != N; ++i) {
+    F[i] = F[i] * fWeightBefore + FAfter[i] * fWeightAfter;
+  }
+
+  return;
+}
+
+
+
+
+void TField3D_GridFamily::SetParameter (double const Parameter)
+{
+  // Move the family to a new parameter value.  Only the weights change, and in the
+  // non-lazy mode the interpolated map is rebuilt from the maps in memory.
+
+  if (Parameter < fParameters.front() || Parameter > fParameters.back()) {
+    std::cerr << "ERROR: parameter outside of the range of the mapping" << std::endl;
+    throw std::out_of_range("parameter outside of the range of the mapping");
+  }
+
+  // First map at or above the parameter
+  size_t After = std::lower_bound(fParameters.begin(), fParameters.end(), Parameter) - fParameters.begin();
+  if (After == 0) {
+    After = 1;
+  }
+  size_t const Before = After - 1;
+
+  double const WeightAfter  = (Parameter - fParameters[Before]) / (fParameters[After] - fParameters[Before]);
+  double const WeightBefore = 1. - WeightAfter;
+
+  // Nothing to rebuild if the map would not change
+  bool const Same = Before == fBefore && After == fAfter && WeightBefore == fWeightBefore && WeightAfter == fWeightAfter;
+
+  fParameter    = Parameter;
+  fBefore       = Before;
+  fAfter        = After;
+  fWeightBefore = WeightBefore;
+  fWeightAfter  = WeightAfter;
+
+  if (!fLazy && !Same) {
+    fCurrent.SetCombination(*fGrids[fBefore], fWeightBefore, *fGrids[fAfter], fWeightAfter);
+  }
+
+  return;
+}
+
+
+
+
+double TField3D_GridFamily::GetParameter () const
+{
+  return fParameter;
+}
+
+
+
+
+size_t TField3D_GridFamily::GetNMaps () const
+{
+  return fGrids.size();
+}
+
+
+
+
+bool TField3D_GridFamily::IsLazy () const
+{
+  return fLazy;
+}
@@ -147,3 +147,46 @@ TVector3D TField3D_IdealUndulator::GetF (double const X, double const Y, double
 }
 
 
+
+
+void TField3D_IdealUndulator::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Get the field at N points.  Same as GetF, but the phase shift, the
+  // termination boundaries, and the wave number are computed once for the whole batch
+
+  // Phase shift in length
+  double const PhaseShift = fPhase * fPeriodLength / TSRS::TwoPi ();
+
+  // Wave number along the period axis
+  double const K = TSRS::TwoPi() / fPeriodLength;
+
+  // Boundaries of the field, the termination periods, and the termination half periods
+  double const DMin       = -fUndulatorLength / 2. + PhaseShift;
+  double const DMax       =  fUndulatorLength / 2. + PhaseShift;
+  double const DMinPeriod = DMin + fPeriodLength;
+  double const DMaxPeriod = DMax - fPeriodLength;
+  double const DMinHalf   = DMin + fPeriodLength / 2.;
+  double const DMaxHalf   = DMax - fPeriodLength / 2.;
+
+  for (size_t i = 0; i != N; ++i) {
+
+    // How far are you from the "center" in the correct direction
+    double const D = (X[i] - fCenter).Dot( fPeriodUnitVector );
+
+    // Check if we are outside of the NPeriod + termination range
+    if (D > DMax || D < DMin) {
+      F[i].SetXYZ(0, 0, 0);
+      continue;
+    }
+
+    // Amplitude including the taper correction and the termination periods
+    double Amplitude = 1 + D * fTaper;
+    if (D < DMinPeriod || D > DMaxPeriod) {
+      Amplitude *= (D < DMinHalf || D > DMaxHalf) ? 0.25 : 0.75;
+    }
+
+    F[i] = fField * (sin(K * (D - PhaseShift)) * Amplitude);
+  }
+
+  return;
+}
@@ -113,5 +113,34 @@ TVector3D TField3D_UniformBox::GetF (TVector3D const& X) const
 
 
 
+void TField3D_UniformBox::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Get the field at N points.  Same as GetF, but the rotation check and
+  // half widths are computed once for the whole batch
+
+  bool const HasRotation = fRotated.GetX() != 0 || fRotated.GetY() != 0 || fRotated.GetZ() != 0;
+
+  double const HalfWidthX = fabs(fWidth.GetX() / 2.);
+  double const HalfWidthY = fabs(fWidth.GetY() / 2.);
+  double const HalfWidthZ = fabs(fWidth.GetZ() / 2.);
+
+  for (size_t i = 0; i != N; ++i) {
 
+    // Translate back into box frame
+    TVector3D XInBoxCoordinates = X[i];
+    if (HasRotation) {
+      XInBoxCoordinates.RotateSelfXYZ(fRotated);
+    }
 
+    // Position in the box frame with respect to the center
+    TVector3D const RX = XInBoxCoordinates - fCenter;
+
+    if ((!fIgnoreAxisX && fabs(RX.GetX()) > HalfWidthX) || (!fIgnoreAxisY && fabs(RX.GetY()) > HalfWidthY) || (!fIgnoreAxisZ && fabs(RX.GetZ()) > HalfWidthZ)) {
+      F[i].SetXYZ(0, 0, 0);
+    } else {
+      F[i] = fField;
+    }
+  }
+
+  return;
+}
@@ -8,17 +8,27 @@
 
 #include "TFieldContainer.h"
 
+#include "TField3D_Gaussian.h"
+#include "TField3D_Grid.h"
+#include "TField3D_IdealUndulator.h"
+#include "TField3D_UniformBox.h"
+#include "TSRS.h"
+
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <typeinfo>
+#include <limits>
+#include <cmath>
 
 
 
 TFieldContainer::TFieldContainer ()
 {
   // Default constructor
+  fIsCompiled = false;
 }
 
 
@@ -26,6 +36,7 @@ TFieldContainer::TFieldContainer ()
 TFieldContainer::TFieldContainer (TField* F)
 {
   // Construct me with a field
+  fIsCompiled = false;
   this->AddField(F);
 }
 
@@ -43,12 +54,21 @@ void TFieldContainer::AddField (TField* F)
 {
   // Construct me with a field
   fFields.push_back(F);
+
+  // Any compiled form is now out of date
+  fIsCompiled = false;
+  fCompiled.clear();
 }
 
 
 
 double TFieldContainer::GetFx (double const X, double const Y, double const Z) const
 {
+  // Use the compiled form if there is one
+  if (fIsCompiled) {
+    return this->GetFCompiled(TVector3D(X, Y, Z)).GetX();
+  }
+
   double Sum = 0;
 
   // Loop over Fields for summing fields
@@ -63,6 +83,11 @@ double TFieldContainer::GetFx (double const X, double const Y, double const Z) c
 
 double TFieldContainer::GetFy (double const X, double const Y, double const Z) const
 {
+  // Use the compiled form if there is one
+  if (fIsCompiled) {
+    return this->GetFCompiled(TVector3D(X, Y, Z)).GetY();
+  }
+
   double Sum = 0;
 
   // Loop over Fields for summing fields
@@ -77,6 +102,11 @@ double TFieldContainer::GetFy (double const X, double const Y, double const Z) c
 
 double TFieldContainer::GetFz (double const X, double const Y, double const Z) const
 {
+  // Use the compiled form if there is one
+  if (fIsCompiled) {
+    return this->GetFCompiled(TVector3D(X, Y, Z)).GetZ();
+  }
+
   double Sum = 0;
 
   // Loop over Fields for summing fields
@@ -91,6 +121,11 @@ double TFieldContainer::GetFz (double const X, double const Y, double const Z) c
 
 TVector3D TFieldContainer::GetF (double const X, double const Y, double const Z) const
 {
+  // Use the compiled form if there is one
+  if (fIsCompiled) {
+    return this->GetFCompiled(TVector3D(X, Y, Z));
+  }
+
   TVector3D Sum(0, 0, 0);
 
   // Loop over Fields for summing fields
@@ -106,6 +141,11 @@ TVector3D TFieldContainer::GetF (double const X, double const Y, double const Z)
 
 TVector3D TFieldContainer::GetF (TVector3D const& X) const
 {
+  // Use the compiled form if there is one
+  if (fIsCompiled) {
+    return this->GetFCompiled(X);
+  }
+
   TVector3D Sum(0, 0, 0);
 
   // Loop over Fields for summing fields
@@ -119,6 +159,55 @@ TVector3D TFieldContainer::GetF (TVector3D const& X) const
 
 
 
+void TFieldContainer::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Fill F with the summed field at each of the N points in X
+
+  for (size_t i = 0; i != N; ++i) {
+    F[i].SetXYZ(0, 0, 0);
+  }
+
+  // Nothing to sum
+  if (fFields.size() == 0) {
+    return;
+  }
+
+  // A single field can write directly to the output
+  if (fFields.size() == 1) {
+    fFields[0]->GetFBatch(X, F, N);
+    return;
+  }
+
+  // Buffer for each field's contribution
+  std::vector<TVector3D> FieldF(N);
+
+  // Loop over Fields for summing fields
+  for (std::vector<TField*>::const_iterator it = fFields.begin(); it != fFields.end(); ++it) {
+    (*it)->GetFBatch(X, FieldF.data(), N);
+    for (size_t i = 0; i != N; ++i) {
+      F[i] += FieldF[i];
+    }
+  }
+
+  return;
+}
+
+
+
+
+void TFieldContainer::GetFBatch (std::vector<TVector3D> const& X, std::vector<TVector3D>& F) const
+{
+  // Fill F with the summed field at each point in X
+
+  F.resize(X.size());
+  this->GetFBatch(X.data(), F.data(), X.size());
+
+  return;
+}
+
+
+
+
 size_t TFieldContainer::GetNFields () const
 {
   // Return the number of fields input
@@ -128,6 +217,218 @@ size_t TFieldContainer::GetNFields () const
 
 
 
+
+TField* TFieldContainer::GetField (size_t const i) const
+{
+  // Return field i, the container keeps ownership
+  if (i >= fFields.size()) {
+    throw std::out_of_range("field index out of range");
+  }
+
+  return fFields[i];
+}
+
+
+
+
+void TFieldContainer::Compile ()
+{
+  // Freeze the current set of fields into a closed representation.  Known field
+  // types have their rotation matrices and constants precomputed and are summed
+  // inline in GetFCompiled.  Python functions and any other (or derived) field
+  // types fall back to the virtual GetF.  Adding or clearing fields undoes this.
+
+  fCompiled.clear();
+
+  for (std::vector<TField*>::const_iterator it = fFields.begin(); it != fFields.end(); ++it) {
+    TField const* Field = *it;
+
+    TCompiledField C;
+    C.Type        = kType_Virtual;
+    C.Field       = Field;
+    C.HasRotation = false;
+    for (int i = 0; i != 10; ++i) {
+      C.P[i] = 0;
+    }
+
+    if (typeid(*Field) == typeid(TField3D_Gaussian)) {
+      TField3D_Gaussian const* G = static_cast<TField3D_Gaussian const*>(Field);
+
+      C.Type = kType_Gaussian;
+      C.Rotation.SetRotationXYZ(G->fRotated);
+      C.HasRotation = !C.Rotation.IsIdentity();
+      C.F      = G->fField;
+      C.Center = G->fCenter;
+
+      // Inverse widths, zero for an ignored axis
+      C.P[0] = G->fSigma.GetX() > 0 ? 1. / G->fSigma.GetX() : 0;
+      C.P[1] = G->fSigma.GetY() > 0 ? 1. / G->fSigma.GetY() : 0;
+      C.P[2] = G->fSigma.GetZ() > 0 ? 1. / G->fSigma.GetZ() : 0;
+
+    } else if (typeid(*Field) == typeid(TField3D_UniformBox)) {
+      TField3D_UniformBox const* U = static_cast<TField3D_UniformBox const*>(Field);
+
+      C.Type = kType_UniformBox;
+      C.Rotation.SetRotationXYZ(U->fRotated);
+      C.HasRotation = !C.Rotation.IsIdentity();
+      C.F      = U->fField;
+      C.Center = U->fCenter;
+
+      // Half widths, infinite for an ignored axis
+      double const Inf = std::numeric_limits<double>::infinity();
+      C.P[0] = U->fIgnoreAxisX ? Inf : fabs(U->fWidth.GetX() / 2.);
+      C.P[1] = U->fIgnoreAxisY ? Inf : fabs(U->fWidth.GetY() / 2.);
+      C.P[2] = U->fIgnoreAxisZ ? Inf : fabs(U->fWidth.GetZ() / 2.);
+
+    } else if (typeid(*Field) == typeid(TField3D_IdealUndulator)) {
+      TField3D_IdealUndulator const* I = static_cast<TField3D_IdealUndulator const*>(Field);
+
+      C.Type = kType_IdealUndulator;
+      C.F      = I->fField;
+      C.Center = I->fCenter;
+      C.Axis   = I->fPeriodUnitVector;
+
+      // Phase shift in length, wave number, and taper
+      double const PhaseShift = I->fPhase * I->fPeriodLength / TSRS::TwoPi();
+      C.P[0] = PhaseShift;
+      C.P[1] = TSRS::TwoPi() / I->fPeriodLength;
+      C.P[2] = I->fTaper;
+
+      // Boundaries of the field, the termination periods, and the termination half periods
+      C.P[3] = -I->fUndulatorLength / 2. + PhaseShift;
+      C.P[4] =  I->fUndulatorLength / 2. + PhaseShift;
+      C.P[5] = C.P[3] + I->fPeriodLength;
+      C.P[6] = C.P[4] - I->fPeriodLength;
+      C.P[7] = C.P[3] + I->fPeriodLength / 2.;
+      C.P[8] = C.P[4] - I->fPeriodLength / 2.;
+
+    } else if (typeid(*Field) == typeid(TField3D_Grid)) {
+      C.Type = kType_Grid;
+    }
+
+    fCompiled.push_back(C);
+  }
+
+  fIsCompiled = true;
+
+  return;
+}
+
+
+
+
+bool TFieldContainer::IsCompiled () const
+{
+  // Is the compiled form in use
+  return fIsCompiled;
+}
+
+
+
+
+TVector3D TFieldContainer::GetFCompiled (TVector3D const& X) const
+{
+  // Sum of all fields using the compiled representation
+
+  double SumX = 0;
+  double SumY = 0;
+  double SumZ = 0;
+
+  for (std::vector<TCompiledField>::const_iterator it = fCompiled.begin(); it != fCompiled.end(); ++it) {
+    TCompiledField const& C = *it;
+
+    switch (C.Type) {
+      case kType_Gaussian:
+        {
+          // Position in the field frame
+          double RX = X.GetX();
+          double RY = X.GetY();
+          double RZ = X.GetZ();
+          if (C.HasRotation) {
+            C.Rotation.Multiply(X.GetX(), X.GetY(), X.GetZ(), RX, RY, RZ);
+          }
+
+          // With respect to the center and scaled by the width
+          RX = (RX - C.Center.GetX()) * C.P[0];
+          RY = (RY - C.Center.GetY()) * C.P[1];
+          RZ = (RZ - C.Center.GetZ()) * C.P[2];
+
+          double const Fraction = exp(-(RX * RX + RY * RY + RZ * RZ) / 2.);
+
+          SumX += Fraction * C.F.GetX();
+          SumY += Fraction * C.F.GetY();
+          SumZ += Fraction * C.F.GetZ();
+        }
+        break;
+      case kType_UniformBox:
+        {
+          // Position in the field frame
+          double RX = X.GetX();
+          double RY = X.GetY();
+          double RZ = X.GetZ();
+          if (C.HasRotation) {
+            C.Rotation.Multiply(X.GetX(), X.GetY(), X.GetZ(), RX, RY, RZ);
+          }
+
+          if (fabs(RX - C.Center.GetX()) > C.P[0] || fabs(RY - C.Center.GetY()) > C.P[1] || fabs(RZ - C.Center.GetZ()) > C.P[2]) {
+            break;
+          }
+
+          SumX += C.F.GetX();
+          SumY += C.F.GetY();
+          SumZ += C.F.GetZ();
+        }
+        break;
+      case kType_IdealUndulator:
+        {
+          // Distance from the center along the period axis
+          double const D = (X.GetX() - C.Center.GetX()) * C.Axis.GetX()
+                         + (X.GetY() - C.Center.GetY()) * C.Axis.GetY()
+                         + (X.GetZ() - C.Center.GetZ()) * C.Axis.GetZ();
+
+          // Outside of the NPeriod + termination range
+          if (D > C.P[4] || D < C.P[3]) {
+            break;
+          }
+
+          // Amplitude including the taper correction and the termination periods
+          double Amplitude = 1 + D * C.P[2];
+          if (D < C.P[5] || D > C.P[6]) {
+            Amplitude *= (D < C.P[7] || D > C.P[8]) ? 0.25 : 0.75;
+          }
+          Amplitude *= sin(C.P[1] * (D - C.P[0]));
+
+          SumX += Amplitude * C.F.GetX();
+          SumY += Amplitude * C.F.GetY();
+          SumZ += Amplitude * C.F.GetZ();
+        }
+        break;
+      case kType_Grid:
+        {
+          // Qualified call so it does not go through the virtual table
+          TVector3D const F = static_cast<TField3D_Grid const*>(C.Field)->TField3D_Grid::GetF(X);
+          SumX += F.GetX();
+          SumY += F.GetY();
+          SumZ += F.GetZ();
+        }
+        break;
+      default:
+        {
+          TVector3D const F = C.Field->GetF(X);
+          SumX += F.GetX();
+          SumY += F.GetY();
+          SumZ += F.GetZ();
+        }
+        break;
+    }
+  }
+
+  return TVector3D(SumX, SumY, SumZ);
+}
+
+
+
+
 void TFieldContainer::Clear ()
 {
   for (std::vector<TField*>::iterator it = fFields.begin(); it != fFields.end(); ++it) {
@@ -138,6 +439,10 @@ void TFieldContainer::Clear ()
 
   fFields.clear();
 
+  // Nothing left to compile
+  fIsCompiled = false;
+  fCompiled.clear();
+
   return;
 }
 
@@ -158,7 +463,8 @@ void TFieldContainer::WriteToFile (std::string const& OutFileName, std::string c
   // Open file for output
   std::ofstream of(OutFileName.c_str());
   if (!of.is_open()) {
-    throw;
+    std::cerr << "ERROR: cannot open file for writing: " << OutFileName << std::endl;
+    throw std::ofstream::failure("cannot open file: " + OutFileName);
   }
 
   std::string CommentNoCRLF = Comment;
@@ -197,20 +503,66 @@ void TFieldContainer::WriteToFile (std::string const& OutFileName, std::string c
     // Set output format
     of << std::scientific;
 
+    // Positions and fields along Z, evaluated one line at a time
+    std::vector<TVector3D> XLine(MyNZ);
+    std::vector<TVector3D> BLine(MyNZ);
+
     // Loop over all points and output
     for (int i = 0; i < MyNX; ++i) {
       for (int j = 0; j < MyNY; ++j) {
         for (int k = 0; k < MyNZ; ++k) {
 
           // Set current position
-          X.SetXYZ(XLim[0] + XStep * i, YLim[0] + YStep * j, ZLim[0] + ZStep * k);
+          XLine[k].SetXYZ(XLim[0] + XStep * i, YLim[0] + YStep * j, ZLim[0] + ZStep * k);
+        }
 
-          // Get B Field
-          B = this->GetF(X);
+        // Get B Field
+        this->GetFBatch(XLine, BLine);
 
-          // Print field to file
-          of << B.GetX() << " " << B.GetY() << " " << B.GetZ() << std::endl;
+        // Print field to file
+        for (int k = 0; k < MyNZ; ++k) {
+          of << BLine[k].GetX() << " " << BLine[k].GetY() << " " << BLine[k].GetZ() << std::endl;
+        }
+      }
+    }
+  } else if (OutFormat == "OSCARSBIN" || OutFormat == "OSCARSBIN32") {
+
+    // Binary grid format, float64 or float32.  Same grid as the OSCARS text format.
+    of.close();
+    of.open(OutFileName.c_str(), std::ios::binary);
+    if (!of.is_open()) {
+      std::cerr << "ERROR: cannot open file for writing: " << OutFileName << std::endl;
+      throw std::ofstream::failure("cannot open file: " + OutFileName);
+    }
+
+    bool const Float32 = OutFormat == "OSCARSBIN32";
+
+    int const MyNX = NX == 0 ? 1 : NX;
+    int const MyNY = NY == 0 ? 1 : NY;
+    int const MyNZ = NZ == 0 ? 1 : NZ;
+
+    double const XStep = MyNX == 1 ? 0 : (XLim[1] - XLim[0]) / (NX - 1);
+    double const YStep = MyNY == 1 ? 0 : (YLim[1] - YLim[0]) / (NY - 1);
+    double const ZStep = MyNZ == 1 ? 0 : (ZLim[1] - ZLim[0]) / (NZ - 1);
+
+    TField3D_Grid::WriteBinaryHeader(of, MyNX, MyNY, MyNZ, TVector3D(XLim[0], YLim[0], ZLim[0]), TVector3D(XStep, YStep, ZStep), Float32, CommentNoCRLF == "" ? "OSCARSBIN" : CommentNoCRLF);
+
+    // Positions and fields along Z, evaluated one line at a time
+    std::vector<TVector3D> XLine(MyNZ);
+    std::vector<TVector3D> BLine(MyNZ);
+
+    // Loop over all points and output
+    for (int i = 0; i < MyNX; ++i) {
+      for (int j = 0; j < MyNY; ++j) {
+        for (int k = 0; k < MyNZ; ++k) {
+
+          // Set current position
+          XLine[k].SetXYZ(XLim[0] + XStep * i, YLim[0] + YStep * j, ZLim[0] + ZStep * k);
         }
+
+        // Get B Field and write it
+        this->GetFBatch(XLine, BLine);
+        TField3D_Grid::WriteBinaryPoints(of, BLine.data(), MyNZ, Float32);
       }
     }
   } else if (std::string(OutFormat.begin(), OutFormat.begin() + 8) == "OSCARS1D") {
@@ -318,14 +670,20 @@ void TFieldContainer::WriteToFile (std::string const& OutFileName, std::string c
     // Set output format
     of << std::scientific;
 
-    // Loop over all points and output
+    // All positions along the line and their fields
+    std::vector<TVector3D> XLine(N);
+    std::vector<TVector3D> BLine(N);
     for (int i = 0; i < N; ++i) {
+      XLine[i] = StartPoint + Step * (double) i;
+    }
+    this->GetFBatch(XLine, BLine);
 
-      // Set current position
-      X = StartPoint + Step * (double) i;
+    // Loop over all points and output
+    for (int i = 0; i < N; ++i) {
 
-      // Get B Field
-      B = this->GetF(X);
+      // Current position and field
+      X = XLine[i];
+      B = BLine[i];
 
       Outputs[0] = X.GetX();
       Outputs[1] = X.GetY();
@@ -371,19 +729,25 @@ void TFieldContainer::WriteToFile (std::string const& OutFileName, std::string c
     // Set output format
     of << std::scientific;
 
+    // Positions and fields along Z, evaluated one line at a time
+    std::vector<TVector3D> XLine(NZ);
+    std::vector<TVector3D> BLine(NZ);
+
     // Loop over all points and output
     for (int i = 0; i < NX; ++i) {
       for (int j = 0; j < NY; ++j) {
         for (int k = 0; k < NZ; ++k) {
 
           // Set current position
-          X.SetXYZ(XLim[0] + XStep * i, YLim[0] + YStep * j, ZLim[0] + ZStep * k);
+          XLine[k].SetXYZ(XLim[0] + XStep * i, YLim[0] + YStep * j, ZLim[0] + ZStep * k);
+        }
 
-          // Get B Field
-          B = this->GetF(X);
+        // Get B Field
+        this->GetFBatch(XLine, BLine);
 
-          // Print field to file
-          of << B.GetX() << "\t" << B.GetY() << "\t" << B.GetZ() << std::endl;
+        // Print field to file
+        for (int k = 0; k < NZ; ++k) {
+          of << BLine[k].GetX() << "\t" << BLine[k].GetY() << "\t" << BLine[k].GetZ() << std::endl;
         }
       }
     }
@@ -405,19 +769,25 @@ void TFieldContainer::WriteToFile (std::string const& OutFileName, std::string c
     // Set output format
     of << std::scientific;
 
+    // Positions and fields along Z, evaluated one line at a time
+    std::vector<TVector3D> XLine(NZ);
+    std::vector<TVector3D> BLine(NZ);
+
     // Loop over all points and output
     for (int i = 0; i < NX; ++i) {
       for (int j = 0; j < NY; ++j) {
         for (int k = 0; k < NZ; ++k) {
 
           // Set current position
-          X.SetXYZ(XLim[0] + XStep * i, YLim[0] + YStep * j, ZLim[0] + ZStep * k);
+          XLine[k].SetXYZ(XLim[0] + XStep * i, YLim[0] + YStep * j, ZLim[0] + ZStep * k);
+        }
 
-          // Get B Field
-          B = this->GetF(X);
+        // Get B Field
+        this->GetFBatch(XLine, BLine);
 
-          // Print field to file
-          of << B.GetX() << " " << B.GetY() << " " << B.GetZ() << std::endl;
+        // Print field to file
+        for (int k = 0; k < NZ; ++k) {
+          of << BLine[k].GetX() << " " << BLine[k].GetY() << " " << BLine[k].GetZ() << std::endl;
         }
       }
     }
@@ -1,16 +1,19 @@
 #include "TFieldPythonFunction.h"
 
 #include <stdexcept>
+#include <cstring>
+#include <iostream>
 
 // UPDATE: exceptions
 
-TFieldPythonFunction::TFieldPythonFunction (PyObject* Function)
+TFieldPythonFunction::TFieldPythonFunction (PyObject* Function, bool const Vectorized)
 {
   // Constructor takes a python object, which should be a function
   // Increment reference because we're going to keep it..
 
   Py_INCREF(Function);
   fPythonFunction = Function;
+  fVectorized = Vectorized;
 
   // Check to see the function is callable
   if (!PyCallable_Check(fPythonFunction)) {
@@ -24,6 +27,7 @@ TFieldPythonFunction::TFieldPythonFunction (PyObject* Function)
 TFieldPythonFunction::~TFieldPythonFunction ()
 {
   // When exit, decrement reference since we're done with it
+  TLockGIL LockGIL;
   Py_DECREF(fPythonFunction);
 }
 
@@ -34,13 +38,21 @@ TVector3D TFieldPythonFunction::GetF (TVector3D const& X) const
 {
   // Get the magnetic field from a python function.
 
+  if (fVectorized) {
+    TVector3D F;
+    this->GetFBatch(&X, &F, 1);
+    return F;
+  }
+
   // For the future
   double T = 0;
 
+  TLockGIL LockGIL;
+
   // Check to see the function is callable
   if (!PyCallable_Check(fPythonFunction)) {
-    std::cout << "PyCallable_Check fail" << std::endl;
-    throw;
+    PyErr_SetString(PyExc_TypeError, "python field function is not callable");
+    throw std::invalid_argument("python field function is not callable");
   }
 
   // Build the input object for the python function
@@ -53,17 +65,16 @@ TVector3D TFieldPythonFunction::GetF (TVector3D const& X) const
   // We're done with the input object
   Py_DECREF(InputTuple);
 
-  // If the output is null we didn't get anything
+  // If the output is null the function raised, and the python error is left set
   if (OutputTuple == NULL) {
-    std::cout << "No object" << std::endl;
-    throw;
+    throw std::runtime_error("python field function failed");
   }
 
   // Get a python list from output tuple
   PyObject* OutputList;
   if (!PyArg_Parse(OutputTuple, "O!", &PyList_Type, &OutputList)) {
-    std::cout << "Didnt make it" << std::endl;
-    throw;
+    Py_DECREF(OutputTuple);
+    throw std::invalid_argument("python field function must return a list of 3");
   }
 
 
@@ -84,6 +95,102 @@ TVector3D TFieldPythonFunction::GetF (TVector3D const& X) const
 
 
 
+void TFieldPythonFunction::GetFBatch (TVector3D const* X, TVector3D* F, size_t const N) const
+{
+  // Get the field at N points.  A vectorized function is called once for all of them.
+
+  TLockGIL LockGIL;
+
+  if (!fVectorized) {
+    for (size_t i = 0; i != N; ++i) {
+      F[i] = this->GetF(X[i]);
+    }
+    return;
+  }
+
+  static_assert(sizeof(TVector3D) == 3 * sizeof(double), "TVector3D must be three packed doubles");
+
+  // Points as an (N, 3) memoryview of doubles.  They are copied into a bytearray so the
+  // function can keep them.
+#if PY_MAJOR_VERSION >= 3
+  PyObject* Bytes = PyByteArray_FromStringAndSize((char const*) X, (Py_ssize_t) (3 * N * sizeof(double)));
+  PyObject* View  = Bytes == NULL ? NULL : PyMemoryView_FromObject(Bytes);
+  PyObject* Points = View == NULL ? NULL : PyObject_CallMethod(View, (char*) "cast", (char*) "s(nn)", "d", (Py_ssize_t) N, (Py_ssize_t) 3);
+  Py_XDECREF(View);
+  Py_XDECREF(Bytes);
+#else
+  PyObject* Points = PyList_New(N);
+  for (size_t i = 0; i != N; ++i) {
+    PyList_SET_ITEM(Points, i, Py_BuildValue("[ddd]", X[i].GetX(), X[i].GetY(), X[i].GetZ()));
+  }
+#endif
+  // Errors from python are left set for the caller to raise
+  if (Points == NULL) {
+    throw std::runtime_error("cannot make the points for the python function");
+  }
+
+  // Call python function
+  PyObject* Result = PyObject_CallFunctionObjArgs(fPythonFunction, Points, NULL);
+  Py_DECREF(Points);
+
+  if (Result == NULL) {
+    throw std::runtime_error("python field function failed");
+  }
+
+  // An array of doubles is copied directly
+  if (PyObject_CheckBuffer(Result)) {
+    Py_buffer Buffer;
+    if (PyObject_GetBuffer(Result, &Buffer, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0) {
+      bool const IsDouble = Buffer.format != NULL && Buffer.itemsize == sizeof(double) && Buffer.format[std::strlen(Buffer.format) - 1] == 'd';
+      bool const Good = IsDouble && Buffer.len == (Py_ssize_t) (3 * N * sizeof(double));
+      if (Good) {
+        std::memcpy((void*) F, Buffer.buf, Buffer.len);
+      }
+      PyBuffer_Release(&Buffer);
+      if (Good) {
+        Py_DECREF(Result);
+        return;
+      }
+    }
+    PyErr_Clear();
+  }
+
+  // Otherwise a sequence of N sequences of 3
+  PyObject* Sequence = PySequence_Fast(Result, "python field function must return a sequence");
+  bool Good = Sequence != NULL && PySequence_Fast_GET_SIZE(Sequence) == (Py_ssize_t) N;
+  for (size_t i = 0; Good && i != N; ++i) {
+    PyObject* Item = PySequence_Fast(PySequence_Fast_GET_ITEM(Sequence, i), "python field function must return N sequences of 3");
+    Good = Item != NULL && PySequence_Fast_GET_SIZE(Item) == 3;
+    if (Good) {
+      F[i].SetXYZ(PyFloat_AsDouble(PySequence_Fast_GET_ITEM(Item, 0)),
+                  PyFloat_AsDouble(PySequence_Fast_GET_ITEM(Item, 1)),
+                  PyFloat_AsDouble(PySequence_Fast_GET_ITEM(Item, 2)));
+      Good = PyErr_Occurred() == NULL;
+    }
+    Py_XDECREF(Item);
+  }
+  Py_XDECREF(Sequence);
+  Py_DECREF(Result);
+
+  if (!Good) {
+    PyErr_SetString(PyExc_ValueError, "python field function must return N fields of 3 doubles");
+    throw std::invalid_argument("python field function must return N fields of 3 doubles");
+  }
+
+  return;
+}
+
+
+
+
+bool TFieldPythonFunction::IsVectorized () const
+{
+  return fVectorized;
+}
+
+
+
+
 TVector3D TFieldPythonFunction::GetF (double const X, double const Y, double const Z) const
 {
   return this->GetF(TVector3D(X, Y, Z));
@@ -0,0 +1,92 @@
+#include "TMappedFile.h"
+
+#include <iostream>
+#include <fstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+
+TMappedFile::TMappedFile (std::string const& FileName)
+{
+  // Map the entire file read-only.  Pages are shared with any other process
+  // mapping the same file.
+
+  fFileName = FileName;
+  fData     = 0x0;
+  fSize     = 0;
+
+  int const fd = open(FileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "ERROR: cannot open file: " << FileName << std::endl;
+    throw std::ifstream::failure("cannot open file for reading");
+  }
+
+  struct stat FileStat;
+  if (fstat(fd, &FileStat) != 0) {
+    close(fd);
+    std::cerr << "ERROR: cannot stat file: " << FileName << std::endl;
+    throw std::ifstream::failure("cannot stat file");
+  }
+
+  fSize = (size_t) FileStat.st_size;
+
+  // Nothing to map for an empty file
+  if (fSize == 0) {
+    close(fd);
+    return;
+  }
+
+  fData = mmap(0x0, fSize, PROT_READ, MAP_SHARED, fd, 0);
+
+  // The mapping holds its own reference to the file
+  close(fd);
+
+  if (fData == MAP_FAILED) {
+    fData = 0x0;
+    fSize = 0;
+    std::cerr << "ERROR: cannot map file: " << FileName << std::endl;
+    throw std::ifstream::failure("cannot map file");
+  }
+}
+
+
+
+
+TMappedFile::~TMappedFile ()
+{
+  // Unmap the file
+  if (fData != 0x0) {
+    munmap(fData, fSize);
+  }
+}
+
+
+
+
+char const* TMappedFile::GetData () const
+{
+  // Start of the mapped file
+  return (char const*) fData;
+}
+
+
+
+
+size_t TMappedFile::GetSize () const
+{
+  // Size of the mapped file in bytes
+  return fSize;
+}
+
+
+
+
+std::string const& TMappedFile::GetFileName () const
+{
+  // Name of the mapped file
+  return fFileName;
+}
@@ -0,0 +1,109 @@
+#include "TMatrix3D.h"
+
+#include <stdexcept>
+
+
+
+TMatrix3D::TMatrix3D ()
+{
+  // Default constructor is the identity
+  this->SetIdentity();
+}
+
+
+
+
+TMatrix3D::TMatrix3D (TVector3D const& Angles)
+{
+  // Constructor for the rotation matrix equivalent to TVector3D::RotateSelfXYZ(Angles)
+  this->SetRotationXYZ(Angles);
+}
+
+
+
+
+TMatrix3D::~TMatrix3D ()
+{
+  // Destroy me
+}
+
+
+
+
+void TMatrix3D::SetIdentity ()
+{
+  // Set this to the identity matrix
+  for (int i = 0; i != 3; ++i) {
+    for (int j = 0; j != 3; ++j) {
+      fM[i][j] = i == j ? 1 : 0;
+    }
+  }
+
+  return;
+}
+
+
+
+
+void TMatrix3D::SetRotationXYZ (TVector3D const& Angles)
+{
+  // Set this to the matrix which rotates about X, then Y, then Z, exactly as
+  // TVector3D::RotateSelfXYZ does.  The columns are the rotated unit vectors.
+
+  for (int j = 0; j != 3; ++j) {
+    TVector3D Column(j == 0 ? 1 : 0, j == 1 ? 1 : 0, j == 2 ? 1 : 0);
+    Column.RotateSelfXYZ(Angles);
+
+    fM[0][j] = Column.GetX();
+    fM[1][j] = Column.GetY();
+    fM[2][j] = Column.GetZ();
+  }
+
+  return;
+}
+
+
+
+
+bool TMatrix3D::IsIdentity () const
+{
+  // Is this exactly the identity matrix
+  for (int i = 0; i != 3; ++i) {
+    for (int j = 0; j != 3; ++j) {
+      if (fM[i][j] != (i == j ? 1 : 0)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+
+
+TMatrix3D TMatrix3D::Transpose () const
+{
+  // Return the transpose, which for a rotation is the inverse
+  TMatrix3D T;
+  for (int i = 0; i != 3; ++i) {
+    for (int j = 0; j != 3; ++j) {
+      T.fM[i][j] = fM[j][i];
+    }
+  }
+
+  return T;
+}
+
+
+
+
+double TMatrix3D::operator () (int const i, int const j) const
+{
+  // Get an element of the matrix
+  if (i < 0 || i > 2 || j < 0 || j > 2) {
+    throw std::out_of_range("index out of range");
+  }
+
+  return fM[i][j];
+}
@@ -0,0 +1,238 @@
+#include "TNUFFT.h"
+
+#include "TOSCARSSR.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+TNUFFT::TNUFFT (int const M1, int const M2, int const NSets)
+{
+  // Constructor
+  //
+  // M1, M2 - Number of frequencies in each dimension
+  // NSets  - Number of sets of coefficients
+
+  if (M1 < 1 || M2 < 1) {
+    throw std::invalid_argument("number of frequencies must be at least 1");
+  }
+  if (NSets < 1) {
+    throw std::invalid_argument("number of sets must be at least 1");
+  }
+
+  fM1 = M1;
+  fM2 = M2;
+  fNSets = NSets;
+
+  fMr1 = 2;
+  while (fMr1 < 2 * fM1) {
+    fMr1 *= 2;
+  }
+  fMr2 = 2;
+  while (fMr2 < 2 * fM2) {
+    fMr2 *= 2;
+  }
+
+  // Gaussian as wide as it can be for the oversampling, see Greengard and Lee
+  double const R1 = (double) fMr1 / (double) fM1;
+  double const R2 = (double) fMr2 / (double) fM2;
+  fTau1 = TOSCARSSR::Pi() * kSpread / ((double) fM1 * fM1 * R1 * (R1 - 0.5));
+  fTau2 = TOSCARSSR::Pi() * kSpread / ((double) fM2 * fM2 * R2 * (R2 - 0.5));
+
+  for (int i = 0; i != fMr1 / 2; ++i) {
+    fTwiddle1.push_back(std::polar(1., -TOSCARSSR::TwoPi() * i / fMr1));
+  }
+  for (int i = 0; i != fMr2 / 2; ++i) {
+    fTwiddle2.push_back(std::polar(1., -TOSCARSSR::TwoPi() * i / fMr2));
+  }
+
+  fGrid.assign((size_t) fNSets * fMr1 * fMr2, 0);
+  fValues.assign((size_t) fNSets * fM1 * fM2, 0);
+}
+
+
+
+
+TNUFFT::~TNUFFT ()
+{
+  // Destructor
+}
+
+
+
+
+void TNUFFT::Clear ()
+{
+  // Remove all sources
+  std::fill(fGrid.begin(), fGrid.end(), std::complex<double>(0, 0));
+
+  return;
+}
+
+
+
+
+void TNUFFT::Add (double const X1, double const X2, std::complex<double> const* C)
+{
+  // Spread a source onto the grid points within kSpread of it in each dimension
+
+  double const H1 = TOSCARSSR::TwoPi() / fMr1;
+  double const H2 = TOSCARSSR::TwoPi() / fMr2;
+
+  double const Y1 = X1 - TOSCARSSR::TwoPi() * floor(X1 / TOSCARSSR::TwoPi());
+  double const Y2 = X2 - TOSCARSSR::TwoPi() * floor(X2 / TOSCARSSR::TwoPi());
+
+  int const First1 = (int) floor(Y1 / H1) - kSpread + 1;
+  int const First2 = (int) floor(Y2 / H2) - kSpread + 1;
+
+  double W1[2 * kSpread];
+  double W2[2 * kSpread];
+  int    I1[2 * kSpread];
+  int    I2[2 * kSpread];
+  for (int l = 0; l != 2 * kSpread; ++l) {
+    double const D1 = (First1 + l) * H1 - Y1;
+    double const D2 = (First2 + l) * H2 - Y2;
+    W1[l] = exp(-D1 * D1 / (4. * fTau1));
+    W2[l] = exp(-D2 * D2 / (4. * fTau2));
+    I1[l] = ((First1 + l) % fMr1 + fMr1) % fMr1;
+    I2[l] = ((First2 + l) % fMr2 + fMr2) % fMr2;
+  }
+
+  for (int iSet = 0; iSet != fNSets; ++iSet) {
+    std::complex<double>* G = fGrid.data() + (size_t) iSet * fMr1 * fMr2;
+    for (int l1 = 0; l1 != 2 * kSpread; ++l1) {
+      std::complex<double> const CW = C[iSet] * W1[l1];
+      std::complex<double>* Row = G + (size_t) I1[l1] * fMr2;
+      for (int l2 = 0; l2 != 2 * kSpread; ++l2) {
+        Row[I2[l2]] += CW * W2[l2];
+      }
+    }
+  }
+
+  return;
+}
+
+
+
+
+void TNUFFT::Transform ()
+{
+  // FFT of the grid, then divide out the Gaussian for the frequencies wanted
+
+  std::vector<std::complex<double> > Column(fMr1);
+
+  // Fourier transform of the Gaussian, and the normalization of the FFT
+  double const Norm = TOSCARSSR::Pi() / sqrt(fTau1 * fTau2) / ((double) fMr1 * fMr2);
+
+  for (int iSet = 0; iSet != fNSets; ++iSet) {
+    std::complex<double>* G = fGrid.data() + (size_t) iSet * fMr1 * fMr2;
+
+    for (int i1 = 0; i1 != fMr1; ++i1) {
+      FFT(G + (size_t) i1 * fMr2, fTwiddle2);
+    }
+
+    // Only the columns of frequencies wanted
+    for (int i2 = 0; i2 != fM2; ++i2) {
+      int const m2 = i2 - fM2 / 2;
+      int const k2 = (m2 + fMr2) % fMr2;
+
+      for (int i1 = 0; i1 != fMr1; ++i1) {
+        Column[i1] = G[(size_t) i1 * fMr2 + k2];
+      }
+      FFT(Column.data(), fTwiddle1);
+
+      for (int i1 = 0; i1 != fM1; ++i1) {
+        int const m1 = i1 - fM1 / 2;
+        int const k1 = (m1 + fMr1) % fMr1;
+        fValues[((size_t) iSet * fM1 + i1) * fM2 + i2] = Column[k1] * (Norm * exp(m1 * m1 * fTau1 + m2 * m2 * fTau2));
+      }
+    }
+  }
+
+  return;
+}
+
+
+
+
+std::complex<double> const& TNUFFT::GetValue (int const iSet, int const i1, int const i2) const
+{
+  // Value for frequency m1 = i1 - M1/2, m2 = i2 - M2/2 after Transform()
+  return fValues[((size_t) iSet * fM1 + i1) * fM2 + i2];
+}
+
+
+
+
+double TNUFFT::GetNOperations (size_t const NSources) const
+{
+  // Spreading, then the FFT of every row and of the columns wanted, each a butterfly of 2
+  double const Spread = (double) NSources * 4 * kSpread * kSpread;
+  double const FFT = (double) fMr1 * fMr2 * log2((double) fMr2) + (double) fM2 * fMr1 * log2((double) fMr1);
+
+  return fNSets * (Spread + FFT + (double) fM1 * fM2);
+}
+
+
+
+
+int TNUFFT::GetM1 () const
+{
+  // Number of frequencies in the first dimension
+  return fM1;
+}
+
+
+
+
+int TNUFFT::GetM2 () const
+{
+  // Number of frequencies in the second dimension
+  return fM2;
+}
+
+
+
+
+int TNUFFT::GetNSets () const
+{
+  // Number of sets of coefficients
+  return fNSets;
+}
+
+
+
+
+void TNUFFT::FFT (std::complex<double>* X, std::vector<std::complex<double> > const& Twiddle)
+{
+  // In place radix 2 FFT, Sum x exp(-2 pi i k l / N), N twice the number of twiddle factors
+
+  size_t const N = 2 * Twiddle.size();
+
+  // Bit reversed order
+  for (size_t i = 1, j = 0; i < N; ++i) {
+    size_t Bit = N >> 1;
+    for ( ; j & Bit; Bit >>= 1) {
+      j ^= Bit;
+    }
+    j ^= Bit;
+    if (i < j) {
+      std::swap(X[i], X[j]);
+    }
+  }
+
+  for (size_t Length = 2; Length <= N; Length <<= 1) {
+    size_t const Half = Length / 2;
+    size_t const Step = N / Length;
+    for (size_t i = 0; i < N; i += Length) {
+      for (size_t k = 0; k != Half; ++k) {
+        std::complex<double> const U = X[i + k];
+        std::complex<double> const V = X[i + k + Half] * Twiddle[k * Step];
+        X[i + k]        = U + V;
+        X[i + k + Half] = U - V;
+      }
+    }
+  }
+
+  return;
+}
@@ -41,6 +41,7 @@ TRandomA::~TRandomA ()
 
 void TRandomA::SetSeed (int const Seed)
 {
+  std::lock_guard<std::mutex> Guard(fMutex);
   delete fMT;
   fMT = new std::mt19937(Seed);
 
@@ -52,6 +53,7 @@ void TRandomA::SetSeed (int const Seed)
 
 double TRandomA::Normal ()
 {
+  std::lock_guard<std::mutex> Guard(fMutex);
   return fNormalDist(*fMT);
 }
 
@@ -60,5 +62,6 @@ double TRandomA::Normal ()
 
 double TRandomA::Uniform ()
 {
+  std::lock_guard<std::mutex> Guard(fMutex);
   return fUniformDist(*fMT);
 }
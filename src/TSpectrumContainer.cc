@@ -12,6 +12,7 @@
 #include "TSRS.h"
 
 #include <fstream>
+#include <stdexcept>
 
 
 
@@ -177,6 +178,26 @@ void TSpectrumContainer::AddToFlux (size_t const i, double const Flux)
 
 
 
+void TSpectrumContainer::AddToFlux (std::vector<double> const& Flux)
+{
+  // Add Flux[i] to point i for every point, in order.  Values calculated on several
+  // threads are collected first and added here from one, so the sum does not depend on
+  // the number of threads.
+
+  if (Flux.size() != fSpectrumPoints.size()) {
+    throw std::length_error("TSpectrumContainer::AddToFlux wrong number of values");
+  }
+
+  for (size_t i = 0; i != Flux.size(); ++i) {
+    this->AddToFlux(i, Flux[i]);
+  }
+
+  return;
+}
+
+
+
+
 
 
 double TSpectrumContainer::GetFlux (size_t const i) const
@@ -221,6 +242,19 @@ size_t TSpectrumContainer::GetNPoints () const
 
 
 
+
+double const* TSpectrumContainer::GetData () const
+{
+  // All points as contiguous doubles: energy, flux for each point
+
+  static_assert(sizeof(std::pair<double, double>) == 2 * sizeof(double), "spectrum points must be two packed doubles");
+
+  return fSpectrumPoints.empty() ? 0x0 : (double const*) fSpectrumPoints.data();
+}
+
+
+
+
 void TSpectrumContainer::WriteToFileText (std::string const FileName, std::string const Header) const
 {
   // Write this spectrum to a file in text format.
@@ -0,0 +1,103 @@
+#include "TSurfacePoints.h"
+
+TSurfacePoints::TSurfacePoints ()
+  : fHasBuffers(false)
+{
+  // Default constructor
+}
+
+
+
+
+TSurfacePoints::TSurfacePoints (TSurfacePoints const& Other)
+  : fHasBuffers(false)
+{
+  // Copy constructor.  The buffers are not copied, a copy kept for its geometry alone
+  // should not keep them alive.
+}
+
+
+
+
+TSurfacePoints& TSurfacePoints::operator= (TSurfacePoints const& Other)
+{
+  // Assignment, the buffers are forgotten as the points change
+  this->ClearBuffers();
+
+  return *this;
+}
+
+
+
+
+double TSurfacePoints::GetArea (size_t const i) const
+{
+  // Unknown unless the derived surface knows it
+  return 0;
+}
+
+
+
+
+TSurfacePoints::TBuffers const& TSurfacePoints::GetBuffers () const
+{
+  // Get the buffers, filling them the first time.  If threads race to fill them the first
+  // one stored is kept and used by all, so a reference handed out is never replaced.
+
+  std::shared_ptr<TBuffers const> Buffers = std::atomic_load(&fBuffers);
+  if (Buffers) {
+    return *Buffers;
+  }
+
+  size_t const NPoints = this->GetNPoints();
+
+  std::shared_ptr<TBuffers> New = std::make_shared<TBuffers>();
+  New->NPoints = NPoints;
+  New->X.resize(NPoints);
+  New->Y.resize(NPoints);
+  New->Z.resize(NPoints);
+  New->NX.resize(NPoints);
+  New->NY.resize(NPoints);
+  New->NZ.resize(NPoints);
+  New->X1.resize(NPoints);
+  New->X2.resize(NPoints);
+  New->Area.resize(NPoints);
+
+  for (size_t i = 0; i != NPoints; ++i) {
+    TSurfacePoint const P = this->GetPoint(i);
+    New->X[i]  = P.GetX();
+    New->Y[i]  = P.GetY();
+    New->Z[i]  = P.GetZ();
+    New->NX[i] = P.GetNormalX();
+    New->NY[i] = P.GetNormalY();
+    New->NZ[i] = P.GetNormalZ();
+    New->X1[i] = this->GetX1(i);
+    New->X2[i] = this->GetX2(i);
+    New->Area[i] = this->GetArea(i);
+  }
+
+  std::shared_ptr<TBuffers const> Expected;
+  std::shared_ptr<TBuffers const> Filled = New;
+  bool const Stored = std::atomic_compare_exchange_strong(&fBuffers, &Expected, Filled);
+  fHasBuffers.store(true);
+
+  return Stored ? *Filled : *Expected;
+}
+
+
+
+
+void TSurfacePoints::ClearBuffers ()
+{
+  // Forget the buffers, they are filled again when next asked for.  Points are not changed
+  // while buffers are being filled, so the flag alone tells if there is anything to forget.
+
+  if (!fHasBuffers.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  fHasBuffers.store(false, std::memory_order_relaxed);
+  std::atomic_store(&fBuffers, std::shared_ptr<TBuffers const>());
+
+  return;
+}
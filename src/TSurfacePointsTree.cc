@@ -0,0 +1,263 @@
+#include "TSurfacePointsTree.h"
+
+#include "TOSCARSSR.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+TSurfacePointsTree::TSurfacePointsTree (TSurfacePoints const& Surface, size_t const LeafSize, int const Order)
+{
+  // Build the tree for a surface
+  //
+  // Surface  - Points and normals
+  // LeafSize - Patches with more points than this are split
+  // Order    - Number of Chebyshev points along each side of a box
+
+  if (LeafSize < 1) {
+    throw std::invalid_argument("leaf size must be at least 1");
+  }
+  if (Order < 1) {
+    throw std::invalid_argument("interpolation order must be at least 1");
+  }
+
+  fOrder = Order;
+
+  TSurfacePoints::TBuffers const& S = Surface.GetBuffers();
+
+  fIndex.resize(S.NPoints);
+  for (size_t i = 0; i != S.NPoints; ++i) {
+    fIndex[i] = i;
+  }
+
+  if (S.NPoints == 0) {
+    return;
+  }
+
+  TNode Root;
+  Root.First = 0;
+  Root.Last = S.NPoints;
+  fNodes.push_back(Root);
+
+  this->Build(S, 0, LeafSize);
+}
+
+
+
+
+TSurfacePointsTree::~TSurfacePointsTree ()
+{
+  // Destructor
+}
+
+
+
+
+void TSurfacePointsTree::Build (TSurfacePoints::TBuffers const& S, size_t const iNode, size_t const LeafSize)
+{
+  // Bounds and normal cone of a node, then split it in two if it has too many points
+
+  size_t const First = fNodes[iNode].First;
+  size_t const Last  = fNodes[iNode].Last;
+
+  TVector3D Lo(S.X[fIndex[First]], S.Y[fIndex[First]], S.Z[fIndex[First]]);
+  TVector3D Hi = Lo;
+  TVector3D Axis(0, 0, 0);
+  for (size_t k = First; k != Last; ++k) {
+    size_t const i = fIndex[k];
+    Lo.SetXYZ(std::min(Lo.GetX(), S.X[i]), std::min(Lo.GetY(), S.Y[i]), std::min(Lo.GetZ(), S.Z[i]));
+    Hi.SetXYZ(std::max(Hi.GetX(), S.X[i]), std::max(Hi.GetY(), S.Y[i]), std::max(Hi.GetZ(), S.Z[i]));
+
+    TVector3D const N(S.NX[i], S.NY[i], S.NZ[i]);
+    if (N.Mag2() > 0) {
+      Axis += N.UnitVector();
+    }
+  }
+
+  TVector3D const Center = (Lo + Hi) / 2.;
+  double Radius = 0;
+  double Cone = 0;
+  if (Axis.Mag2() > 0) {
+    Axis = Axis.UnitVector();
+  }
+  for (size_t k = First; k != Last; ++k) {
+    size_t const i = fIndex[k];
+    Radius = std::max(Radius, (TVector3D(S.X[i], S.Y[i], S.Z[i]) - Center).Mag());
+
+    // Points without a normal do not count toward the cone
+    TVector3D const N(S.NX[i], S.NY[i], S.NZ[i]);
+    if (N.Mag2() > 0) {
+      Cone = std::max(Cone, acos(std::max(-1., std::min(1., N.UnitVector().Dot(Axis)))));
+    }
+  }
+  if (Axis.Mag2() == 0) {
+    Cone = TOSCARSSR::Pi();
+  }
+
+  fNodes[iNode].Lo = Lo;
+  fNodes[iNode].Hi = Hi;
+  fNodes[iNode].Center = Center;
+  fNodes[iNode].Radius = Radius;
+  fNodes[iNode].Axis = Axis;
+  fNodes[iNode].Cone = Cone;
+  fNodes[iNode].Child = -1;
+
+  if (Last - First <= LeafSize || Radius == 0) {
+    return;
+  }
+
+  // Split at the median of the longest side
+  TVector3D const Width = Hi - Lo;
+  int const Dim = Width.GetX() >= Width.GetY() && Width.GetX() >= Width.GetZ() ? 0 : (Width.GetY() >= Width.GetZ() ? 1 : 2);
+  double const* Coordinate = Dim == 0 ? S.X.data() : (Dim == 1 ? S.Y.data() : S.Z.data());
+
+  size_t const Middle = First + (Last - First) / 2;
+  std::nth_element(fIndex.begin() + First, fIndex.begin() + Middle, fIndex.begin() + Last, [Coordinate] (size_t const a, size_t const b) {
+    return Coordinate[a] < Coordinate[b];
+  });
+
+  size_t const Child = fNodes.size();
+  fNodes[iNode].Child = (int) Child;
+
+  TNode Node;
+  Node.First = First;
+  Node.Last = Middle;
+  fNodes.push_back(Node);
+  Node.First = Middle;
+  Node.Last = Last;
+  fNodes.push_back(Node);
+
+  this->Build(S, Child, LeafSize);
+  this->Build(S, Child + 1, LeafSize);
+
+  return;
+}
+
+
+
+
+size_t TSurfacePointsTree::GetNNodes () const
+{
+  // Number of patches
+  return fNodes.size();
+}
+
+
+
+
+TSurfacePointsTree::TNode const& TSurfacePointsTree::GetNode (size_t const i) const
+{
+  // The ith patch, the root is 0
+  if (i >= fNodes.size()) {
+    throw std::out_of_range("tree node index out of range");
+  }
+
+  return fNodes[i];
+}
+
+
+
+
+size_t TSurfacePointsTree::GetIndex (size_t const i) const
+{
+  // Surface index of the ith point of the tree
+  return fIndex[i];
+}
+
+
+
+
+int TSurfacePointsTree::GetNPoints (size_t const iNode, int const Dim) const
+{
+  // Number of Chebyshev points along one side of the box, 1 if it has no width compared
+  // to the longest side
+
+  TVector3D const Width = fNodes[iNode].Hi - fNodes[iNode].Lo;
+  double const Max = std::max(Width.GetX(), std::max(Width.GetY(), Width.GetZ()));
+
+  return Width[Dim] > 1e-9 * Max ? fOrder : 1;
+}
+
+
+
+
+size_t TSurfacePointsTree::GetNInterpolationPoints (size_t const iNode) const
+{
+  // Number of Chebyshev points of a patch
+  return (size_t) this->GetNPoints(iNode, 0) * this->GetNPoints(iNode, 1) * this->GetNPoints(iNode, 2);
+}
+
+
+
+
+void TSurfacePointsTree::GetInterpolationPoints (size_t const iNode, std::vector<TVector3D>& Points) const
+{
+  // Tensor product of the Chebyshev points of each side, Z changing fastest
+
+  TNode const& Node = fNodes[iNode];
+
+  std::vector<double> C[3];
+  for (int d = 0; d != 3; ++d) {
+    int const N = this->GetNPoints(iNode, d);
+    double const Mid  = (Node.Hi[d] + Node.Lo[d]) / 2.;
+    double const Half = (Node.Hi[d] - Node.Lo[d]) / 2.;
+    for (int k = 0; k != N; ++k) {
+      C[d].push_back(N == 1 ? Mid : Mid + Half * cos((2 * k + 1) * TOSCARSSR::Pi() / (2 * N)));
+    }
+  }
+
+  Points.clear();
+  for (size_t ix = 0; ix != C[0].size(); ++ix) {
+    for (size_t iy = 0; iy != C[1].size(); ++iy) {
+      for (size_t iz = 0; iz != C[2].size(); ++iz) {
+        Points.push_back(TVector3D(C[0][ix], C[1][iy], C[2][iz]));
+      }
+    }
+  }
+
+  return;
+}
+
+
+
+
+TVector3D TSurfacePointsTree::Interpolate (size_t const iNode, std::vector<TVector3D> const& Values, TVector3D const& X) const
+{
+  // Lagrange interpolation through the points of GetInterpolationPoints
+
+  TNode const& Node = fNodes[iNode];
+
+  std::vector<double> L[3];
+  for (int d = 0; d != 3; ++d) {
+    int const N = this->GetNPoints(iNode, d);
+    double const Mid  = (Node.Hi[d] + Node.Lo[d]) / 2.;
+    double const Half = (Node.Hi[d] - Node.Lo[d]) / 2.;
+
+    std::vector<double> C(N);
+    for (int k = 0; k != N; ++k) {
+      C[k] = N == 1 ? Mid : Mid + Half * cos((2 * k + 1) * TOSCARSSR::Pi() / (2 * N));
+    }
+
+    L[d].assign(N, 1);
+    for (int k = 0; k != N; ++k) {
+      for (int j = 0; j != N; ++j) {
+        if (j != k) {
+          L[d][k] *= (X[d] - C[j]) / (C[k] - C[j]);
+        }
+      }
+    }
+  }
+
+  TVector3D Sum(0, 0, 0);
+  size_t i = 0;
+  for (size_t ix = 0; ix != L[0].size(); ++ix) {
+    for (size_t iy = 0; iy != L[1].size(); ++iy) {
+      double const Lxy = L[0][ix] * L[1][iy];
+      for (size_t iz = 0; iz != L[2].size(); ++iz) {
+        Sum += (Lxy * L[2][iz]) * Values[i++];
+      }
+    }
+  }
+
+  return Sum;
+}
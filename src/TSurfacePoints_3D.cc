@@ -51,6 +51,7 @@ double TSurfacePoints_3D::GetX2 (size_t const i) const
 void TSurfacePoints_3D::AddPoint(TSurfacePoint const& P)
 {
   fPoints.push_back(P);
+  this->ClearBuffers();
   return;
 }
 
@@ -60,6 +61,7 @@ void TSurfacePoints_3D::AddPoint(TSurfacePoint const& P)
 void TSurfacePoints_3D::AddPoint(TVector3D const& X, TVector3D const& N)
 {
   fPoints.push_back(TSurfacePoint(X, N));
+  this->ClearBuffers();
   return;
 }
 
@@ -69,5 +71,6 @@ void TSurfacePoints_3D::AddPoint(TVector3D const& X, TVector3D const& N)
 void TSurfacePoints_3D::AddPoint(double const& X, double const& Y, double const& Z, double const& NX, double const& NY, double const& NZ)
 {
   fPoints.push_back(TSurfacePoint(X, Y, Z, NX, NY, NZ));
+  this->ClearBuffers();
   return;
 }
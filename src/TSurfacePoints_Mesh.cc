@@ -0,0 +1,356 @@
+#include "TSurfacePoints_Mesh.h"
+
+#include "TMappedFile.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cstdint>
+
+TSurfacePoints_Mesh::TSurfacePoints_Mesh ()
+{
+  // Default constructor, no triangles
+  fNormal = 1;
+}
+
+
+
+
+TSurfacePoints_Mesh::TSurfacePoints_Mesh (std::string const& InFileName, std::string const& Format, double const Scale, TVector3D const& Rotations, TVector3D const& Translation, int const Normal)
+{
+  // Constructor reading a file, see ReadFile()
+  fNormal = 1;
+  this->ReadFile(InFileName, Format, Scale, Rotations, Translation, Normal);
+}
+
+
+
+
+TSurfacePoints_Mesh::~TSurfacePoints_Mesh ()
+{
+  // Destructor
+}
+
+
+
+
+void TSurfacePoints_Mesh::ReadFile (std::string const& InFileName, std::string const& Format, double const Scale, TVector3D const& Rotations, TVector3D const& Translation, int const Normal)
+{
+  // Read the triangles of a file, replacing any there were
+
+  if (Normal != -1 && Normal != 0 && Normal != 1) {
+    throw std::invalid_argument("normal must be -1, 0, or 1");
+  }
+
+  // Format from the extension if not given.  I will accept upper-case
+  std::string F = Format;
+  if (F == "") {
+    size_t const Dot = InFileName.rfind('.');
+    F = Dot == std::string::npos ? "" : InFileName.substr(Dot + 1);
+  }
+  std::transform(F.begin(), F.end(), F.begin(), ::tolower);
+  if (F != "stl" && F != "obj") {
+    throw std::invalid_argument("unknown mesh format, must be stl or obj");
+  }
+
+  TMappedFile const File(InFileName);
+
+  this->ClearBuffers();
+  fPoints.clear();
+  fArea.clear();
+  fVertices.clear();
+  fNormal = Normal;
+
+  if (F == "stl") {
+    this->ReadFile_STL(File, Scale, Rotations, Translation);
+  } else {
+    this->ReadFile_OBJ(File, Scale, Rotations, Translation);
+  }
+
+  return;
+}
+
+
+
+
+void TSurfacePoints_Mesh::ReadFile_STL (TMappedFile const& File, double const Scale, TVector3D const& Rotations, TVector3D const& Translation)
+{
+  // STL, binary or text.  A binary file is 80 bytes of header, the number of triangles, and
+  // 50 bytes for each: 12 float32 (normal, then the three vertices) and 2 unused bytes.
+  // Text files can begin with "solid" as well, so the size is what tells them apart.
+
+  char const* Begin = File.GetData();
+  char const* End   = Begin + File.GetSize();
+
+  uint32_t NTriangles = 0;
+  if (File.GetSize() >= 84) {
+    std::memcpy(&NTriangles, Begin + 80, sizeof(uint32_t));
+  }
+
+  std::vector<TVector3D> Polygon;
+
+  if (File.GetSize() >= 84 && File.GetSize() == 84 + 50 * (size_t) NTriangles) {
+    fPoints.reserve(NTriangles);
+    fArea.reserve(NTriangles);
+    fVertices.reserve(3 * (size_t) NTriangles);
+
+    for (size_t i = 0; i != NTriangles; ++i) {
+      float Values[12];
+      std::memcpy(Values, Begin + 84 + 50 * i, sizeof(Values));
+
+      Polygon.clear();
+      for (int iv = 1; iv != 4; ++iv) {
+        TVector3D V(Values[3 * iv], Values[3 * iv + 1], Values[3 * iv + 2]);
+        V *= Scale;
+        V.RotateSelfXYZ(Rotations);
+        V += Translation;
+        Polygon.push_back(V);
+      }
+      this->AddPolygon(Polygon);
+    }
+
+    return;
+  }
+
+  // Text: only the vertex lines matter, and endloop ends a facet
+  std::string Word;
+  double Values[3];
+  for (char const* Line = Begin; Line < End; ) {
+    char const* NewLine = (char const*) std::memchr(Line, '\n', End - Line);
+    char const* LineEnd = NewLine == 0x0 ? End : NewLine;
+    char const* Position = Line;
+
+    if (GetWord(Position, LineEnd, Word)) {
+      if (Word == "vertex") {
+        if (!GetNumbers(Position, LineEnd, Values, 3)) {
+          throw std::ifstream::failure("error reading STL vertex.  Check format");
+        }
+        TVector3D V(Values[0], Values[1], Values[2]);
+        V *= Scale;
+        V.RotateSelfXYZ(Rotations);
+        V += Translation;
+        Polygon.push_back(V);
+      } else if (Word == "endloop") {
+        this->AddPolygon(Polygon);
+        Polygon.clear();
+      }
+    }
+
+    Line = LineEnd + 1;
+  }
+
+  return;
+}
+
+
+
+
+void TSurfacePoints_Mesh::ReadFile_OBJ (TMappedFile const& File, double const Scale, TVector3D const& Rotations, TVector3D const& Translation)
+{
+  // Wavefront OBJ.  Only vertices (v) and faces (f) are used.  Face entries may be v, v/vt,
+  // v//vn or v/vt/vn, numbered from 1, or negative to count back from the last vertex.
+
+  char const* Begin = File.GetData();
+  char const* End   = Begin + File.GetSize();
+
+  std::vector<TVector3D> Vertices;
+  std::vector<TVector3D> Polygon;
+  std::string Word;
+  double Values[3];
+
+  for (char const* Line = Begin; Line < End; ) {
+    char const* NewLine = (char const*) std::memchr(Line, '\n', End - Line);
+    char const* LineEnd = NewLine == 0x0 ? End : NewLine;
+    char const* Position = Line;
+
+    if (GetWord(Position, LineEnd, Word)) {
+      if (Word == "v") {
+        if (!GetNumbers(Position, LineEnd, Values, 3)) {
+          throw std::ifstream::failure("error reading OBJ vertex.  Check format");
+        }
+        TVector3D V(Values[0], Values[1], Values[2]);
+        V *= Scale;
+        V.RotateSelfXYZ(Rotations);
+        V += Translation;
+        Vertices.push_back(V);
+      } else if (Word == "f") {
+        Polygon.clear();
+        while (GetWord(Position, LineEnd, Word)) {
+          char* IndexEnd;
+          long const Index = std::strtol(Word.c_str(), &IndexEnd, 10);
+          long const i = Index < 0 ? (long) Vertices.size() + Index : Index - 1;
+          if (IndexEnd == Word.c_str() || Index == 0 || i < 0 || i >= (long) Vertices.size()) {
+            throw std::out_of_range("OBJ face refers to a vertex not defined before it");
+          }
+          Polygon.push_back(Vertices[i]);
+        }
+        this->AddPolygon(Polygon);
+      }
+    }
+
+    Line = LineEnd + 1;
+  }
+
+  return;
+}
+
+
+
+
+void TSurfacePoints_Mesh::AddTriangle (TVector3D const& A, TVector3D const& B, TVector3D const& C)
+{
+  // Add a triangle, counter-clockwise seen from the side the normal points to
+
+  TVector3D N = (B - A).Cross(C - A);
+  double const Area = N.Mag() / 2.;
+  if (Area == 0) {
+    return;
+  }
+
+  if (fNormal == -1) {
+    N *= -1;
+  }
+
+  fPoints.push_back(TSurfacePoint((A + B + C) / 3., N));
+  fArea.push_back(Area);
+  fVertices.push_back(A);
+  fVertices.push_back(B);
+  fVertices.push_back(C);
+  this->ClearBuffers();
+
+  return;
+}
+
+
+
+
+void TSurfacePoints_Mesh::AddPolygon (std::vector<TVector3D> const& Vertices)
+{
+  // Add a flat convex polygon as a fan of triangles from the first vertex
+  for (size_t i = 2; i < Vertices.size(); ++i) {
+    this->AddTriangle(Vertices[0], Vertices[i - 1], Vertices[i]);
+  }
+
+  return;
+}
+
+
+
+
+void TSurfacePoints_Mesh::GetTriangle (size_t const i, TVector3D& A, TVector3D& B, TVector3D& C) const
+{
+  // Vertices of the ith triangle
+  A = fVertices[3 * i];
+  B = fVertices[3 * i + 1];
+  C = fVertices[3 * i + 2];
+
+  return;
+}
+
+
+
+
+TSurfacePoint const TSurfacePoints_Mesh::GetPoint (size_t const i) const
+{
+  // Get the ith surface point
+  return fPoints[i];
+}
+
+
+
+
+size_t TSurfacePoints_Mesh::GetNPoints () const
+{
+  // Get the number of points
+  return fPoints.size();
+}
+
+
+
+
+double TSurfacePoints_Mesh::GetX1 (size_t const i) const
+{
+  // A mesh has no surface coordinates, only 3D points are written for it
+  return 0;
+}
+
+
+
+
+double TSurfacePoints_Mesh::GetX2 (size_t const i) const
+{
+  // A mesh has no surface coordinates, only 3D points are written for it
+  return 0;
+}
+
+
+
+
+double TSurfacePoints_Mesh::GetArea (size_t const i) const
+{
+  // Area of the ith triangle [m^2]
+  return fArea[i];
+}
+
+
+
+
+double TSurfacePoints_Mesh::GetTotalArea () const
+{
+  // Sum of the areas of all triangles [m^2]
+  double Sum = 0;
+  for (std::vector<double>::const_iterator it = fArea.begin(); it != fArea.end(); ++it) {
+    Sum += *it;
+  }
+
+  return Sum;
+}
+
+
+
+
+bool TSurfacePoints_Mesh::GetWord (char const*& Position, char const* End, std::string& Word)
+{
+  // Next blank separated word before End, false if there is none
+
+  while (Position != End && std::isspace((unsigned char) *Position)) {
+    ++Position;
+  }
+  if (Position == End) {
+    return false;
+  }
+
+  char const* Start = Position;
+  while (Position != End && !std::isspace((unsigned char) *Position)) {
+    ++Position;
+  }
+  Word.assign(Start, Position);
+
+  return true;
+}
+
+
+
+
+bool TSurfacePoints_Mesh::GetNumbers (char const*& Position, char const* End, double* Values, int const N)
+{
+  // Next N words as numbers, false if there are not N numbers
+
+  std::string Word;
+  for (int i = 0; i != N; ++i) {
+    if (!GetWord(Position, End, Word)) {
+      return false;
+    }
+
+    char* WordEnd;
+    Values[i] = std::strtod(Word.c_str(), &WordEnd);
+    if (WordEnd == Word.c_str()) {
+      return false;
+    }
+  }
+
+  return true;
+}
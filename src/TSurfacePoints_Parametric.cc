@@ -0,0 +1,261 @@
+#include "TSurfacePoints_Parametric.h"
+
+#include "TOSCARSSR.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+TSurfacePoints_Parametric::TSurfacePoints_Parametric ()
+{
+  // Default constructor, no points
+  fNU = 0;
+  fNV = 0;
+  fUStart = 0;
+  fVStart = 0;
+  fUStep = 0;
+  fVStep = 0;
+}
+
+
+
+
+TSurfacePoints_Parametric::TSurfacePoints_Parametric (TFunction const& Position, TFunction const& NormalFunction, double const UStart, double const UStop, int const NU, double const VStart, double const VStop, int const NV, TVector3D const& Rotations, TVector3D const& Translation, int const Normal)
+{
+  // Constructor for any function, see Init()
+  this->Init(Position, NormalFunction, UStart, UStop, NU, VStart, VStop, NV, Rotations, Translation, Normal);
+}
+
+
+
+
+TSurfacePoints_Parametric::TSurfacePoints_Parametric (std::string const& Shape, std::vector<double> const& Parameters, int const NU, int const NV, std::vector<double> const& URange, std::vector<double> const& VRange, TVector3D const& Rotations, TVector3D const& Translation, int const Normal)
+{
+  // Constructor for a built in shape, see Init()
+  this->Init(Shape, Parameters, NU, NV, URange, VRange, Rotations, Translation, Normal);
+}
+
+
+
+
+TSurfacePoints_Parametric::~TSurfacePoints_Parametric ()
+{
+  // Destructor
+}
+
+
+
+
+void TSurfacePoints_Parametric::Init (TFunction const& Position, TFunction const& NormalFunction, double const UStart, double const UStop, int const NU, double const VStart, double const VStop, int const NV, TVector3D const& Rotations, TVector3D const& Translation, int const Normal)
+{
+  // Sample the surface.  Rotations are done before the translation, as for the other surfaces
+  //
+  // Position       - Position at (u, v) [m]
+  // NormalFunction - Normal at (u, v), need not be a unit vector.  If empty, dP/du x dP/dv
+  // UStart, UStop  - Range of u, both ends included
+  // NU             - Number of points in u, at least 2
+  // VStart, VStop  - Range of v, both ends included
+  // NV             - Number of points in v, at least 2
+  // Rotations      - Rotation angles about the X, Y, and Z axis
+  // Translation    - Translation done after the rotations
+  // Normal         - If -1 reverse the direction of the normal vector
+
+  if (NU < 2 || NV < 2) {
+    throw std::invalid_argument("need at least 2 points in u and in v");
+  }
+  if (Normal != -1 && Normal != 0 && Normal != 1) {
+    throw std::invalid_argument("normal must be -1, 0, or 1");
+  }
+
+  // Any points already materialized are for the old surface
+  this->ClearBuffers();
+
+  fNU = NU;
+  fNV = NV;
+  fUStart = UStart;
+  fVStart = VStart;
+  fUStep = GetStep(UStart, UStop, NU);
+  fVStep = GetStep(VStart, VStop, NV);
+
+  // Derivatives are central differences with these steps
+  double const HU = 1e-6 * (UStop != UStart ? fabs(UStop - UStart) : 1);
+  double const HV = 1e-6 * (VStop != VStart ? fabs(VStop - VStart) : 1);
+
+  fPoints.clear();
+  fArea.clear();
+  fPoints.reserve((size_t) NU * (size_t) NV);
+  fArea.reserve((size_t) NU * (size_t) NV);
+
+  for (int iu = 0; iu != NU; ++iu) {
+    double const U = UStart + iu * fUStep;
+    for (int iv = 0; iv != NV; ++iv) {
+      double const V = VStart + iv * fVStep;
+
+      TVector3D X = Position(U, V);
+      TVector3D const DPDU = (Position(U + HU, V) - Position(U - HU, V)) / (2 * HU);
+      TVector3D const DPDV = (Position(U, V + HV) - Position(U, V - HV)) / (2 * HV);
+      TVector3D N = NormalFunction ? NormalFunction(U, V) : DPDU.Cross(DPDV);
+
+      // Trapezoid weights on the edges of the range
+      double const WU = (iu == 0 || iu == NU - 1) ? 0.5 : 1;
+      double const WV = (iv == 0 || iv == NV - 1) ? 0.5 : 1;
+      fArea.push_back(DPDU.Cross(DPDV).Mag() * fabs(fUStep * fVStep) * WU * WV);
+
+      X.RotateSelfXYZ(Rotations);
+      N.RotateSelfXYZ(Rotations);
+      if (Normal == -1) {
+        N *= -1;
+      }
+      X += Translation;
+
+      // A point where the normal is not defined (0) keeps a 0 normal
+      TSurfacePoint P;
+      P.SetXYZ(X);
+      P.SetNormalXYZ(N.Mag2() > 0 ? N.UnitVector() : N);
+      fPoints.push_back(P);
+    }
+  }
+
+  return;
+}
+
+
+
+
+void TSurfacePoints_Parametric::Init (std::string const& Shape, std::vector<double> const& Parameters, int const NU, int const NV, std::vector<double> const& URange, std::vector<double> const& VRange, TVector3D const& Rotations, TVector3D const& Translation, int const Normal)
+{
+  // Sample a built in shape.  The normals point inward as for the shapes in python.
+  //
+  // cylinder [R, L] - P = (R cos v, R sin v, u),  u in [-L/2, L/2], v in [0, 2pi]
+  // sphere   [R]    - P = R (cos u cos v, sin u cos v, sin v),  u in [0, 2pi], v in [-pi/2, pi/2]
+  // torus    [R, r] - P = ((R + r cos u) cos v, (R + r cos u) sin v, r sin u),  u and v in [0, 2pi]
+
+  // I will accept upper-case
+  std::string S = Shape;
+  std::transform(S.begin(), S.end(), S.begin(), ::tolower);
+
+  TFunction Position;
+  TFunction NormalFunction;
+  double URangeDefault[2];
+  double VRangeDefault[2];
+
+  if (S == "cylinder") {
+    if (Parameters.size() != 2) {
+      throw std::invalid_argument("cylinder needs parameters [R, L]");
+    }
+    double const R = Parameters[0];
+    double const L = Parameters[1];
+    Position       = [R] (double const U, double const V) { return TVector3D(R * cos(V), R * sin(V), U); };
+    NormalFunction = [] (double const U, double const V) { return TVector3D(-cos(V), -sin(V), 0); };
+    URangeDefault[0] = -L / 2.;
+    URangeDefault[1] =  L / 2.;
+    VRangeDefault[0] = 0;
+    VRangeDefault[1] = TOSCARSSR::TwoPi();
+  } else if (S == "sphere") {
+    if (Parameters.size() != 1) {
+      throw std::invalid_argument("sphere needs parameters [R]");
+    }
+    double const R = Parameters[0];
+    Position       = [R] (double const U, double const V) { return TVector3D(R * cos(U) * cos(V), R * sin(U) * cos(V), R * sin(V)); };
+    NormalFunction = [] (double const U, double const V) { return TVector3D(-cos(U) * cos(V), -sin(U) * cos(V), -sin(V)); };
+    URangeDefault[0] = 0;
+    URangeDefault[1] = TOSCARSSR::TwoPi();
+    VRangeDefault[0] = -TOSCARSSR::PiOver2();
+    VRangeDefault[1] =  TOSCARSSR::PiOver2();
+  } else if (S == "torus") {
+    if (Parameters.size() != 2) {
+      throw std::invalid_argument("torus needs parameters [R, r]");
+    }
+    double const R = Parameters[0];
+    double const r = Parameters[1];
+    Position       = [R, r] (double const U, double const V) { return TVector3D((R + r * cos(U)) * cos(V), (R + r * cos(U)) * sin(V), r * sin(U)); };
+    NormalFunction = [] (double const U, double const V) { return TVector3D(-cos(U) * cos(V), -cos(U) * sin(V), -sin(U)); };
+    URangeDefault[0] = 0;
+    URangeDefault[1] = TOSCARSSR::TwoPi();
+    VRangeDefault[0] = 0;
+    VRangeDefault[1] = TOSCARSSR::TwoPi();
+  } else {
+    throw std::invalid_argument("not a valid shape: cylinder sphere torus");
+  }
+
+  if ((URange.size() != 0 && URange.size() != 2) || (VRange.size() != 0 && VRange.size() != 2)) {
+    throw std::invalid_argument("a range must be [start, stop]");
+  }
+
+  double const UStart = URange.size() == 2 ? URange[0] : URangeDefault[0];
+  double const UStop  = URange.size() == 2 ? URange[1] : URangeDefault[1];
+  double const VStart = VRange.size() == 2 ? VRange[0] : VRangeDefault[0];
+  double const VStop  = VRange.size() == 2 ? VRange[1] : VRangeDefault[1];
+
+  this->Init(Position, NormalFunction, UStart, UStop, NU, VStart, VStop, NV, Rotations, Translation, Normal);
+
+  return;
+}
+
+
+
+
+TSurfacePoint const TSurfacePoints_Parametric::GetPoint (size_t const i) const
+{
+  // Get the ith surface point
+  return fPoints[i];
+}
+
+
+
+
+size_t TSurfacePoints_Parametric::GetNPoints () const
+{
+  // Get the number of points
+  return fPoints.size();
+}
+
+
+
+
+double TSurfacePoints_Parametric::GetX1 (size_t const i) const
+{
+  // u of the ith point
+  return fUStart + (int) (i / fNV) * fUStep;
+}
+
+
+
+
+double TSurfacePoints_Parametric::GetX2 (size_t const i) const
+{
+  // v of the ith point
+  return fVStart + (int) (i % fNV) * fVStep;
+}
+
+
+
+
+double TSurfacePoints_Parametric::GetArea (size_t const i) const
+{
+  // Area the ith point stands for [m^2]
+  return fArea[i];
+}
+
+
+
+
+double TSurfacePoints_Parametric::GetTotalArea () const
+{
+  // Sum of the areas of all points [m^2]
+  double Sum = 0;
+  for (std::vector<double>::const_iterator it = fArea.begin(); it != fArea.end(); ++it) {
+    Sum += *it;
+  }
+
+  return Sum;
+}
+
+
+
+
+double TSurfacePoints_Parametric::GetStep (double const Start, double const Stop, int const N)
+{
+  // Step between N points from start to stop inclusive
+  return (Stop - Start) / (N - 1);
+}
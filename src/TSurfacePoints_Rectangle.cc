@@ -85,6 +85,9 @@ void TSurfacePoints_Rectangle::Init (int const NX1, int const NX2, TVector3D con
   // X2     - Point that defines X2 axis (from X0)
   // Normal - If -1 reverse the direction of the calculated normal vector
 
+  // Any points already materialized are for the old rectangle
+  this->ClearBuffers();
+
   // X0 is the first point and starting point for stepping
   fStartVector = X0;
 
@@ -145,6 +148,9 @@ void TSurfacePoints_Rectangle::Init (std::string const& Plane, int const NX1, in
   // Normal      - If -1 reverse the direction of the calculated normal vector
 
 
+  // Any points already materialized are for the old rectangle
+  this->ClearBuffers();
+
   // I will accept lower-case
   std::string P = Plane;
   std::transform(P.begin(), P.end(), P.begin(), ::toupper);
@@ -232,6 +238,43 @@ TVector3D TSurfacePoints_Rectangle::GetXYZ (size_t const i) const
 
 
 
+TVector3D TSurfacePoints_Rectangle::GetXYZ (double const I1, double const I2) const
+{
+  // XYZ coordinate at fractional point indices I1, I2
+  return (fStartVector + I1 * fX1Vector + I2 * fX2Vector);
+}
+
+
+
+
+TVector2D TSurfacePoints_Rectangle::GetX1X2 (double const I1, double const I2) const
+{
+  // X1 and X2 coordinates in this frame at fractional point indices I1, I2
+  return TVector2D(fX1StepSize * I1 - fX1Vector.Mag() * (fNX1 - 1)/ 2.,
+                   fX2StepSize * I2 - fX2Vector.Mag() * (fNX2 - 1)/ 2.);
+}
+
+
+
+
+int TSurfacePoints_Rectangle::GetNX1 () const
+{
+  // Number of points along X1
+  return fNX1;
+}
+
+
+
+
+int TSurfacePoints_Rectangle::GetNX2 () const
+{
+  // Number of points along X2
+  return fNX2;
+}
+
+
+
+
 size_t TSurfacePoints_Rectangle::GetNPoints () const
 {
   // Get the number of points
@@ -267,3 +310,12 @@ double TSurfacePoints_Rectangle::GetElementArea () const
   // UPDATE: calculate area from vectors for skew
   return fX1StepSize * fX2StepSize;
 }
+
+
+
+
+double TSurfacePoints_Rectangle::GetArea (size_t const i) const
+{
+  // Every point has the same area
+  return this->GetElementArea();
+}
@@ -0,0 +1,95 @@
+#include "TSurfacePoints_View.h"
+
+#include <cstring>
+
+TSurfacePoints_View::TSurfacePoints_View (size_t const N,
+                                          char const* Points,
+                                          std::ptrdiff_t const* PointStrides,
+                                          char const* Normals,
+                                          std::ptrdiff_t const* NormalStrides,
+                                          TVector3D const& Rotations,
+                                          TVector3D const& Translation,
+                                          bool const InvertNormals)
+{
+  // Constructor.  Keeps the pointers, the memory is not copied.
+
+  fNPoints = N;
+
+  fPoints           = Points;
+  fPointStrides[0]  = PointStrides[0];
+  fPointStrides[1]  = PointStrides[1];
+  fNormals          = Normals;
+  fNormalStrides[0] = NormalStrides[0];
+  fNormalStrides[1] = NormalStrides[1];
+
+  fRotations   = Rotations;
+  fHasRotation = Rotations.Mag2() != 0;
+  fTranslation = Translation;
+  fNormalSign  = InvertNormals ? -1 : 1;
+}
+
+
+
+
+TSurfacePoints_View::~TSurfacePoints_View ()
+{
+  // Nothing is owned
+}
+
+
+
+
+TVector3D TSurfacePoints_View::GetVector (char const* Data, std::ptrdiff_t const* Strides, size_t const i) const
+{
+  // Three doubles of element i.  memcpy since a view may not be aligned.
+
+  double V[3];
+  char const* P = Data + (std::ptrdiff_t) i * Strides[0];
+  std::memcpy(V + 0, P,                  sizeof(double));
+  std::memcpy(V + 1, P +     Strides[1], sizeof(double));
+  std::memcpy(V + 2, P + 2 * Strides[1], sizeof(double));
+
+  return TVector3D(V[0], V[1], V[2]);
+}
+
+
+
+
+TSurfacePoint const TSurfacePoints_View::GetPoint (size_t const i) const
+{
+  // Point and normal i, rotated, translated and the normal inverted if requested
+
+  TVector3D X = this->GetVector(fPoints,  fPointStrides,  i);
+  TVector3D N = this->GetVector(fNormals, fNormalStrides, i);
+
+  if (fHasRotation) {
+    X.RotateSelfXYZ(fRotations);
+    N.RotateSelfXYZ(fRotations);
+  }
+
+  return TSurfacePoint(X + fTranslation, fNormalSign * N);
+}
+
+
+
+
+size_t TSurfacePoints_View::GetNPoints () const
+{
+  return fNPoints;
+}
+
+
+
+
+double TSurfacePoints_View::GetX1 (size_t const i) const
+{
+  return 0;
+}
+
+
+
+
+double TSurfacePoints_View::GetX2 (size_t const i) const
+{
+  return 0;
+}
@@ -0,0 +1,262 @@
+#include "TTriangleBVH.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+TTriangleBVH::TTriangleBVH ()
+{
+  // Constructor
+  fBuilt = false;
+}
+
+
+
+
+TTriangleBVH::~TTriangleBVH ()
+{
+  // Destructor
+}
+
+
+
+
+void TTriangleBVH::AddTriangle (TVector3D const& A, TVector3D const& B, TVector3D const& C)
+{
+  // Add a triangle, the tree must be built again
+
+  TTriangle T;
+  T.A = A;
+  T.E1 = B - A;
+  T.E2 = C - A;
+
+  // Triangles without area never block
+  if (T.E1.Cross(T.E2).Mag2() == 0) {
+    return;
+  }
+
+  fTriangles.push_back(T);
+  fBuilt = false;
+
+  return;
+}
+
+
+
+
+void TTriangleBVH::AddMesh (TSurfacePoints_Mesh const& Mesh)
+{
+  // Add all triangles of a mesh
+
+  TVector3D A;
+  TVector3D B;
+  TVector3D C;
+  for (size_t i = 0; i != Mesh.GetNPoints(); ++i) {
+    Mesh.GetTriangle(i, A, B, C);
+    this->AddTriangle(A, B, C);
+  }
+
+  return;
+}
+
+
+
+
+void TTriangleBVH::Build (size_t const LeafSize)
+{
+  // Build the tree of boxes from the root down
+
+  if (LeafSize < 1) {
+    throw std::invalid_argument("leaf size must be at least 1");
+  }
+
+  fNodes.clear();
+  fBuilt = true;
+
+  if (fTriangles.size() == 0) {
+    return;
+  }
+
+  TNode Root;
+  Root.First = 0;
+  Root.Last = fTriangles.size();
+  fNodes.push_back(Root);
+
+  this->Build(0, LeafSize);
+
+  return;
+}
+
+
+
+
+void TTriangleBVH::Build (size_t const iNode, size_t const LeafSize)
+{
+  // Box of a node, then split it in two if it has too many triangles
+
+  size_t const First = fNodes[iNode].First;
+  size_t const Last  = fNodes[iNode].Last;
+
+  TVector3D Lo = fTriangles[First].A;
+  TVector3D Hi = Lo;
+  TVector3D CLo = fTriangles[First].A + (fTriangles[First].E1 + fTriangles[First].E2) / 3.;
+  TVector3D CHi = CLo;
+  for (size_t i = First; i != Last; ++i) {
+    TTriangle const& T = fTriangles[i];
+    TVector3D const Vertices[3] = { T.A, T.A + T.E1, T.A + T.E2 };
+    for (int k = 0; k != 3; ++k) {
+      TVector3D const& V = Vertices[k];
+      Lo.SetXYZ(std::min(Lo.GetX(), V.GetX()), std::min(Lo.GetY(), V.GetY()), std::min(Lo.GetZ(), V.GetZ()));
+      Hi.SetXYZ(std::max(Hi.GetX(), V.GetX()), std::max(Hi.GetY(), V.GetY()), std::max(Hi.GetZ(), V.GetZ()));
+    }
+
+    TVector3D const Centroid = T.A + (T.E1 + T.E2) / 3.;
+    CLo.SetXYZ(std::min(CLo.GetX(), Centroid.GetX()), std::min(CLo.GetY(), Centroid.GetY()), std::min(CLo.GetZ(), Centroid.GetZ()));
+    CHi.SetXYZ(std::max(CHi.GetX(), Centroid.GetX()), std::max(CHi.GetY(), Centroid.GetY()), std::max(CHi.GetZ(), Centroid.GetZ()));
+  }
+
+  fNodes[iNode].Lo = Lo;
+  fNodes[iNode].Hi = Hi;
+  fNodes[iNode].Child = -1;
+
+  if (Last - First <= LeafSize) {
+    return;
+  }
+
+  // Split at the median centroid along the longest side of the box of centroids
+  TVector3D const Width = CHi - CLo;
+  int const Dim = Width.GetX() >= Width.GetY() && Width.GetX() >= Width.GetZ() ? 0 : (Width.GetY() >= Width.GetZ() ? 1 : 2);
+  if (Width[Dim] == 0) {
+    return;
+  }
+
+  size_t const Middle = First + (Last - First) / 2;
+  std::nth_element(fTriangles.begin() + First, fTriangles.begin() + Middle, fTriangles.begin() + Last, [Dim] (TTriangle const& a, TTriangle const& b) {
+    return 3. * a.A[Dim] + a.E1[Dim] + a.E2[Dim] < 3. * b.A[Dim] + b.E1[Dim] + b.E2[Dim];
+  });
+
+  size_t const Child = fNodes.size();
+  fNodes[iNode].Child = (int) Child;
+
+  TNode Node;
+  Node.First = First;
+  Node.Last = Middle;
+  fNodes.push_back(Node);
+  Node.First = Middle;
+  Node.Last = Last;
+  fNodes.push_back(Node);
+
+  this->Build(Child, LeafSize);
+  this->Build(Child + 1, LeafSize);
+
+  return;
+}
+
+
+
+
+bool TTriangleBVH::IsBlocked (TVector3D const& From, TVector3D const& To, size_t& Last) const
+{
+  // Walk down the boxes the line crosses, testing the triangles of the leaves
+
+  if (!fBuilt) {
+    throw std::out_of_range("triangle tree is not built");
+  }
+
+  if (fNodes.size() == 0) {
+    return false;
+  }
+
+  TVector3D const D = To - From;
+
+  // Neighboring lines are usually blocked by the same triangle
+  if (Last < fTriangles.size() && this->Intersects(fTriangles[Last], From, D)) {
+    return true;
+  }
+
+  double const InvD[3] = { 1. / D.GetX(), 1. / D.GetY(), 1. / D.GetZ() };
+  double const O[3] = { From.GetX(), From.GetY(), From.GetZ() };
+
+  // The tree is split at the median so it is never deeper than this
+  int Stack[128];
+  int NStack = 0;
+  Stack[NStack++] = 0;
+
+  while (NStack > 0) {
+    TNode const& Node = fNodes[Stack[--NStack]];
+
+    // Part of the line, 0 to 1, inside each slab of the box
+    double TMin = 0;
+    double TMax = 1;
+    for (int d = 0; d != 3; ++d) {
+      double T1 = (Node.Lo[d] - O[d]) * InvD[d];
+      double T2 = (Node.Hi[d] - O[d]) * InvD[d];
+      if (T1 > T2) {
+        std::swap(T1, T2);
+      }
+      // NaN when the line is in the plane of a side, which does not cut the interval
+      TMin = T1 > TMin ? T1 : TMin;
+      TMax = T2 < TMax ? T2 : TMax;
+    }
+    if (TMin > TMax) {
+      continue;
+    }
+
+    if (Node.Child < 0) {
+      for (size_t i = Node.First; i != Node.Last; ++i) {
+        if (this->Intersects(fTriangles[i], From, D)) {
+          Last = i;
+          return true;
+        }
+      }
+    } else {
+      Stack[NStack++] = Node.Child;
+      Stack[NStack++] = Node.Child + 1;
+    }
+  }
+
+  return false;
+}
+
+
+
+
+bool TTriangleBVH::Intersects (TTriangle const& T, TVector3D const& From, TVector3D const& D) const
+{
+  // Moller and Trumbore, J. Graphics Tools 2, 21 (1997).  The line is From + t D with
+  // 0 < t < 1, the end at To excluded to within 1e-9.
+
+  TVector3D const P = D.Cross(T.E2);
+  double const Det = T.E1.Dot(P);
+
+  // Line in the plane of the triangle
+  if (fabs(Det) <= 1e-14 * T.E1.Mag() * P.Mag()) {
+    return false;
+  }
+
+  double const InvDet = 1. / Det;
+  TVector3D const S = From - T.A;
+  double const U = S.Dot(P) * InvDet;
+  if (U < 0 || U > 1) {
+    return false;
+  }
+
+  TVector3D const Q = S.Cross(T.E1);
+  double const V = D.Dot(Q) * InvDet;
+  if (V < 0 || U + V > 1) {
+    return false;
+  }
+
+  double const t = T.E2.Dot(Q) * InvDet;
+
+  return t > 0 && t < 1. - 1e-9;
+}
+
+
+
+
+size_t TTriangleBVH::GetNTriangles () const
+{
+  // Number of triangles with area
+  return fTriangles.size();
+}